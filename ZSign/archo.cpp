@@ -24,7 +24,7 @@ ZArchO::ZArchO()
 	m_uLoadCommandsFreeSpace = 0;
 }
 
-bool ZArchO::Init(uint8_t* pBase, uint32_t uLength)
+bool ZArchO::Init(uint8_t* pBase, uint64_t uLength)
 {
 	if (NULL == pBase || uLength <= 0) {
 		return false;
@@ -79,7 +79,7 @@ bool ZArchO::Init(uint8_t* pBase, uint32_t uLength)
 							m_uLoadCommandsFreeSpace = BO(sect->offset) - BO(m_pHeader->sizeofcmds) - m_uHeaderSize;
 						}
 					} else if (0 == strcmp("__info_plist", sect->sectname)) {
-						m_strInfoPlist.append((const char*)m_pBase + BO(sect->offset), BO((uint32_t)sect->size));
+						m_strInfoPlist.append((const char*)m_pBase + BO(sect->offset), (size_t)BO64(sect->size));
 					}
 				}
 			} else if (0 == strcmp("__LINKEDIT", seglc->segname)) {
@@ -223,6 +223,11 @@ uint32_t ZArchO::BO(uint32_t uValue)
 	return m_bBigEndian ? LE(uValue) : uValue;
 }
 
+uint64_t ZArchO::BO64(uint64_t uValue)
+{
+	return m_bBigEndian ? LE(uValue) : uValue;
+}
+
 bool ZArchO::IsExecute()
 {
 	if (NULL != m_pHeader) {
@@ -231,6 +236,14 @@ bool ZArchO::IsExecute()
 	return false;
 }
 
+const char* ZArchO::GetArchName()
+{
+	if (NULL != m_pHeader) {
+		return GetArch(BO(m_pHeader->cputype), BO(m_pHeader->cpusubtype) & 0x00ffffff); // strip capability bits (ptrauth abi)
+	}
+	return "unknown";
+}
+
 void ZArchO::PrintInfo()
 {
 	if (NULL == m_pHeader) {
@@ -240,7 +253,7 @@ void ZArchO::PrintInfo()
 	ZLog::Print("------------------------------------------------------------------\n");
 	ZLog::Print(">>> MachO Info: \n");
 	ZLog::PrintV("\tFileType: \t%s\n", GetFileType(BO(m_pHeader->filetype)));
-	ZLog::PrintV("\tTotalSize: \t%u (%s)\n", m_uLength, ZUtil::FormatSize(m_uLength).c_str());
+	ZLog::PrintV("\tTotalSize: \t%llu (%s)\n", (unsigned long long)m_uLength, ZUtil::FormatSize(m_uLength).c_str());
 	ZLog::PrintV("\tPlatform: \t%u\n", m_b64Bit ? 64 : 32);
 	ZLog::PrintV("\tCPUArch: \t%s\n", GetArch(BO(m_pHeader->cputype), BO(m_pHeader->cpusubtype)));
 	ZLog::PrintV("\tCPUType: \t0x%x\n", BO(m_pHeader->cputype));
@@ -248,9 +261,9 @@ void ZArchO::PrintInfo()
 	ZLog::PrintV("\tBigEndian: \t%d\n", m_bBigEndian);
 	ZLog::PrintV("\tEncrypted: \t%d\n", m_bEncrypted);
 	ZLog::PrintV("\tCommandCount: \t%d\n", BO(m_pHeader->ncmds));
-	ZLog::PrintV("\tCodeLength: \t%d (%s)\n", m_uCodeLength, ZUtil::FormatSize(m_uCodeLength).c_str());
-	ZLog::PrintV("\tSignLength: \t%d (%s)\n", m_uSignLength, ZUtil::FormatSize(m_uSignLength).c_str());
-	ZLog::PrintV("\tSpareLength: \t%d (%s)\n", m_uLength - m_uCodeLength - m_uSignLength, ZUtil::FormatSize(m_uLength - m_uCodeLength - m_uSignLength).c_str());
+	ZLog::PrintV("\tCodeLength: \t%llu (%s)\n", (unsigned long long)m_uCodeLength, ZUtil::FormatSize(m_uCodeLength).c_str());
+	ZLog::PrintV("\tSignLength: \t%llu (%s)\n", (unsigned long long)m_uSignLength, ZUtil::FormatSize(m_uSignLength).c_str());
+	ZLog::PrintV("\tSpareLength: \t%lld (%s)\n", (long long)(m_uLength - m_uCodeLength - m_uSignLength), ZUtil::FormatSize(m_uLength - m_uCodeLength - m_uSignLength).c_str());
 
 	uint8_t* pLoadCommand = m_pBase + m_uHeaderSize;
 	for (uint32_t i = 0; i < BO(m_pHeader->ncmds); i++) {
@@ -322,6 +335,7 @@ bool ZArchO::BuildCodeSignature(ZSignAsset* pSignAsset,
 	const string& strCodeResourcesSHA256, 
 	string& strOutput)
 {
+	ZTRACE_SPAN_BYTES("ZArchO::BuildCodeSignature", m_uCodeLength);
 	string strRequirementsSlot;
 	string strEntitlementsSlot;
 	string strDerEntitlementsSlot;
@@ -362,7 +376,26 @@ bool ZArchO::BuildCodeSignature(ZSignAsset* pSignAsset,
 	uint8_t* pCodeSlots256Data = NULL;
 	uint32_t uCodeSlots1DataLength = 0;
 	uint32_t uCodeSlots256DataLength = 0;
-	if (!bForce) {
+	string strCodeSlots1;
+	string strCodeSlots256;
+	if (!m_arrDirtyRanges.empty()) {
+		// edited in place since the existing signature: its page hashes still hold except under the dirty ranges,
+		// which is true even when forced, so only those pages are hashed again
+		ZSign::GetCodeSignatureExistsCodeSlotsData(m_pSignBase, pCodeSlots1Data, uCodeSlots1DataLength, pCodeSlots256Data, uCodeSlots256DataLength);
+		if (NULL == pCodeSlots256Data) { // a SHA256-only signature keeps its page hashes in the primary code directory
+			pCodeSlots256Data = pCodeSlots1Data;
+			uCodeSlots256DataLength = uCodeSlots1DataLength;
+		}
+		bool bSlots1 = ZSign::SlotRehashDirtyPages(false, m_pBase, m_uCodeLength, pCodeSlots1Data, uCodeSlots1DataLength, m_arrDirtyRanges, strCodeSlots1);
+		bool bSlots256 = ZSign::SlotRehashDirtyPages(true, m_pBase, m_uCodeLength, pCodeSlots256Data, uCodeSlots256DataLength, m_arrDirtyRanges, strCodeSlots256);
+		pCodeSlots1Data = bSlots1 ? (uint8_t*)strCodeSlots1.data() : NULL;
+		uCodeSlots1DataLength = (uint32_t)strCodeSlots1.size();
+		pCodeSlots256Data = bSlots256 ? (uint8_t*)strCodeSlots256.data() : NULL;
+		uCodeSlots256DataLength = (uint32_t)strCodeSlots256.size();
+		if (!bSlots256) {
+			ZLog::Warn(">>> Existing code slots don't match, hashing every page.\n");
+		}
+	} else if (!bForce) {
 		ZSign::GetCodeSignatureExistsCodeSlotsData(m_pSignBase, pCodeSlots1Data, uCodeSlots1DataLength, pCodeSlots256Data, uCodeSlots256DataLength);
 	}
 
@@ -423,6 +456,15 @@ bool ZArchO::BuildCodeSignature(ZSignAsset* pSignAsset,
 		strAltnateCodeDirectorySlot.swap(strCodeDirectorySlot);
 	}
 
+	m_arrCDHashes.clear();
+	string strCDHash;
+	if (ZSign::GetCDHash(strCodeDirectorySlot, pSignAsset->m_bSHA256Only, strCDHash)) {
+		m_arrCDHashes.push_back(strCDHash);
+	}
+	if (ZSign::GetCDHash(strAltnateCodeDirectorySlot, true, strCDHash)) {
+		m_arrCDHashes.push_back(strCDHash);
+	}
+
 	string strCMSSignatureSlot;
 	if (!pSignAsset->m_bAdhoc) { //adhoc remove cms signature slot
 		ZSign::SlotBuildCMSSignature(pSignAsset, strCodeDirectorySlot, strAltnateCodeDirectorySlot, strCMSSignatureSlot);
@@ -536,12 +578,6 @@ bool ZArchO::Sign(ZSignAsset* pSignAsset,
 					const string& strInfoSHA256, 
 					const string& strCodeResourcesData)
 {
-	if (NULL == m_pSignBase) {
-		m_bEnoughSpace = false;
-		ZLog::Warn(">>> Can't find CodeSignature segment!\n");
-		return false;
-	}
-
 	string strCodeResourcesSHA1;
 	string strCodeResourcesSHA256;
 	if (strCodeResourcesData.empty()) {
@@ -551,6 +587,23 @@ bool ZArchO::Sign(ZSignAsset* pSignAsset,
 		ZSHA::SHA(strCodeResourcesData, strCodeResourcesSHA1, strCodeResourcesSHA256);
 	}
 
+	return Sign(pSignAsset, bForce, strBundleId, strInfoSHA1, strInfoSHA256, strCodeResourcesSHA1, strCodeResourcesSHA256);
+}
+
+bool ZArchO::Sign(ZSignAsset* pSignAsset, 
+					bool bForce, 
+					const string& strBundleId, 
+					const string& strInfoSHA1, 
+					const string& strInfoSHA256, 
+					const string& strCodeResourcesSHA1, 
+					const string& strCodeResourcesSHA256)
+{
+	if (NULL == m_pSignBase) {
+		m_bEnoughSpace = false;
+		ZLog::Warn(">>> Can't find CodeSignature segment!\n");
+		return false;
+	}
+
 	string strCodeSignBlob;
 	BuildCodeSignature(pSignAsset, bForce, strBundleId, strInfoSHA1, strInfoSHA256, strCodeResourcesSHA1, strCodeResourcesSHA256, strCodeSignBlob);
 	if (strCodeSignBlob.empty()) {
@@ -558,10 +611,10 @@ bool ZArchO::Sign(ZSignAsset* pSignAsset,
 		return false;
 	}
 
-	int nSpaceLength = (int)m_uLength - (int)m_uCodeLength - (int)strCodeSignBlob.size();
+	int64_t nSpaceLength = (int64_t)m_uLength - (int64_t)m_uCodeLength - (int64_t)strCodeSignBlob.size();
 	if (nSpaceLength < 0) {
 		m_bEnoughSpace = false;
-		ZLog::WarnV(">>> No enough CodeSignature space (now: %d, need: %d).\n", (int)m_uLength - (int)m_uCodeLength, (int)strCodeSignBlob.size());
+		ZLog::WarnV(">>> No enough CodeSignature space (now: %lld, need: %d).\n", (long long)(m_uLength - m_uCodeLength), (int)strCodeSignBlob.size());
 		return false;
 	}
 
@@ -570,11 +623,17 @@ bool ZArchO::Sign(ZSignAsset* pSignAsset,
 	return true;
 }
 
-uint32_t ZArchO::ReallocCodeSignSpace(const string& strNewFile)
+uint64_t ZArchO::ReallocCodeSignSpace(const string& strNewFile)
 {
 	ZFile::RemoveFile(strNewFile.c_str());
 
-	uint32_t uNewLength = m_uCodeLength + ZUtil::ByteAlign(((m_uCodeLength / 4096) + 1) * (20 + 32), 4096) + 16384; //16K May Be Enough
+	if (m_uCodeLength > UINT32_MAX) { // LC_CODE_SIGNATURE dataoff is 32-bit
+		ZLog::Error(">>> CodeSignature offset exceeds 4GB!\n");
+		return 0;
+	}
+
+	uint64_t uSlotsLength = ((m_uCodeLength / 4096) + 1) * (20 + 32);
+	uint64_t uNewLength = m_uCodeLength + (uSlotsLength + 4096 - uSlotsLength % 4096) + 16384; //16K May Be Enough
 	if (NULL == m_pLinkEditSegment || uNewLength <= m_uLength) {
 		return 0;
 	}
@@ -584,19 +643,18 @@ uint32_t ZArchO::ReallocCodeSignSpace(const string& strNewFile)
 	case LC_SEGMENT:
 	{
 		segment_command* seglc = (segment_command*)m_pLinkEditSegment;
-		seglc->vmsize = ZUtil::ByteAlign(BO(seglc->vmsize) + (uNewLength - m_uLength), 4096);
+		seglc->vmsize = ZUtil::ByteAlign(BO(seglc->vmsize) + (uint32_t)(uNewLength - m_uLength), 4096);
 		seglc->vmsize = BO(seglc->vmsize);
-		seglc->filesize = uNewLength - BO(seglc->fileoff);
+		seglc->filesize = (uint32_t)(uNewLength - BO(seglc->fileoff));
 		seglc->filesize = BO(seglc->filesize);
 	}
 	break;
 	case LC_SEGMENT_64:
 	{
 		segment_command_64* seglc = (segment_command_64*)m_pLinkEditSegment;
-		seglc->vmsize = ZUtil::ByteAlign(BO((uint32_t)seglc->vmsize) + (uNewLength - m_uLength), 4096);
-		seglc->vmsize = BO((uint32_t)seglc->vmsize);
-		seglc->filesize = uNewLength - BO((uint32_t)seglc->fileoff);
-		seglc->filesize = BO((uint32_t)seglc->filesize);
+		uint64_t uVMSize = BO64(seglc->vmsize) + (uNewLength - m_uLength);
+		seglc->vmsize = BO64(uVMSize + 4096 - uVMSize % 4096);
+		seglc->filesize = BO64(uNewLength - BO64(seglc->fileoff));
 	}
 	break;
 	}
@@ -611,11 +669,11 @@ uint32_t ZArchO::ReallocCodeSignSpace(const string& strNewFile)
 		pcslc = (codesignature_command*)(m_pBase + m_uHeaderSize + BO(m_pHeader->sizeofcmds));
 		pcslc->cmd = BO(LC_CODE_SIGNATURE);
 		pcslc->cmdsize = BO((uint32_t)sizeof(codesignature_command));
-		pcslc->dataoff = BO(m_uCodeLength);
+		pcslc->dataoff = BO((uint32_t)m_uCodeLength);
 		m_pHeader->ncmds = BO(BO(m_pHeader->ncmds) + 1);
 		m_pHeader->sizeofcmds = BO(BO(m_pHeader->sizeofcmds) + sizeof(codesignature_command));
 	}
-	pcslc->datasize = BO(uNewLength - m_uCodeLength);
+	pcslc->datasize = BO((uint32_t)(uNewLength - m_uCodeLength));
 
 	if (!ZFile::AppendFile(strNewFile.c_str(), (const char*)m_pBase, m_uLength)) {
 		return 0;
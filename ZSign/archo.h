@@ -7,7 +7,7 @@ public:
 	ZArchO();
 
 public:
-	bool Init(uint8_t* pBase, uint32_t uLength);
+	bool Init(uint8_t* pBase, uint64_t uLength);
 
 public:
 	bool Sign(ZSignAsset* pSignAsset, 
@@ -16,15 +16,24 @@ public:
 				const string& strInfoSHA1, 
 				const string& strInfoSHA256, 
 				const string& strCodeResourcesData);
+	bool Sign(ZSignAsset* pSignAsset, 
+				bool bForce, 
+				const string& strBundleId, 
+				const string& strInfoSHA1, 
+				const string& strInfoSHA256, 
+				const string& strCodeResourcesSHA1, 
+				const string& strCodeResourcesSHA256);
 
 	void PrintInfo();
 	bool IsExecute();
+	const char* GetArchName();
 	bool InjectDylib(bool bWeakInject, const char* szDylibFile);
 	void RemoveDylibs(set<string> setDylibs);
-	uint32_t ReallocCodeSignSpace(const string& strNewFile);
+	uint64_t ReallocCodeSignSpace(const string& strNewFile);
 
 private:
 	uint32_t	BO(uint32_t uVal);
+	uint64_t	BO64(uint64_t uVal);
 	const char* GetFileType(uint32_t uFileType);
 	const char* GetArch(int cpuType, int cpuSubType);
 	bool		BuildCodeSignature(ZSignAsset* pSignAsset, 
@@ -38,10 +47,10 @@ private:
 
 public:
 	uint8_t*		m_pBase;
-	uint32_t		m_uLength;
-	uint32_t		m_uCodeLength;
+	uint64_t		m_uLength;
+	uint64_t		m_uCodeLength;
 	uint8_t*		m_pSignBase;
-	uint32_t		m_uSignLength;
+	uint64_t		m_uSignLength;
 	string			m_strInfoPlist;
 	bool			m_bEncrypted;
 	bool			m_b64Bit;
@@ -53,6 +62,8 @@ public:
 	uint32_t		m_uFileType;
 	mach_header*	m_pHeader;
 	uint32_t		m_uHeaderSize;
+	vector<string>	m_arrCDHashes;
+	vector<pair<uint64_t, uint64_t>> m_arrDirtyRanges; // offset, length of bytes edited since the existing signature
 
 private:
 	static uint64_t s_uExecSegLimit;
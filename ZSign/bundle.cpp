@@ -45,11 +45,18 @@ bool ZBundle::GetSignFolderInfo(const string& strFolder, jvalue& jvNode, bool bG
 	string strInfoPlistPath = strFolder + "/Info.plist";
 	ZFile::ReadFile(strInfoPlistPath.c_str(), strInfoPlistData);
 
-	jvalue jvInfo;
-	jvInfo.read_plist(strInfoPlistData);
-	string strBundleId = jvInfo["CFBundleIdentifier"];
-	string strBundleExe = jvInfo["CFBundleExecutable"];
-	string strBundleVersion = jvInfo["CFBundleVersion"];
+	vector<string> arrKeys;
+	arrKeys.push_back("CFBundleIdentifier");
+	arrKeys.push_back("CFBundleExecutable");
+	arrKeys.push_back("CFBundleVersion");
+	arrKeys.push_back("CFBundleDisplayName");
+	arrKeys.push_back("CFBundleName");
+
+	vector<string> arrValues;
+	jpview(strInfoPlistData).get_strings(arrKeys, arrValues);
+	string strBundleId = arrValues[0];
+	string strBundleExe = arrValues[1];
+	string strBundleVersion = arrValues[2];
 	if (strBundleId.empty() || strBundleExe.empty()) {
 		return false;
 	}
@@ -68,9 +75,9 @@ bool ZBundle::GetSignFolderInfo(const string& strFolder, jvalue& jvNode, bool bG
 	}
 
 	if (bGetName) {
-		string strBundleName = jvInfo["CFBundleDisplayName"];
+		string strBundleName = arrValues[3];
 		if (strBundleName.empty()) {
-			strBundleName = jvInfo["CFBundleName"].as_cstr();
+			strBundleName = arrValues[4];
 		}
 		jvNode["name"] = strBundleName;
 	}
@@ -88,7 +95,7 @@ bool ZBundle::GetObjectsToSign(const string& strFolder, jvalue& jvInfo)
 				ZFile::IsPathSuffix(strPath, ".xctest")) {
 				jvalue jvNode;
 				if (GetSignFolderInfo(strPath, jvNode)) {
-					jvInfo["folders"].push_back(jvNode);
+					jvInfo["folders"].push_back(std::move(jvNode));
 				}
 			}
 		} else {
@@ -104,6 +111,7 @@ bool ZBundle::GetObjectsToSign(const string& strFolder, jvalue& jvInfo)
 
 bool ZBundle::GenerateCodeResources(const string& strFolder, jvalue& jvCodeRes)
 {
+	ZTRACE_SPAN("ZBundle::GenerateCodeResources");
 	set<string> setFiles;
 	ZFile::EnumFolder(strFolder.c_str(), true, NULL, [&](bool bFolder, const string& strPath) {
 		if (!bFolder) {
@@ -114,9 +122,9 @@ bool ZBundle::GenerateCodeResources(const string& strFolder, jvalue& jvCodeRes)
 		return false;
 	});
 
-	jvalue jvInfo;
-	jvInfo.read_plist_from_file("%s/Info.plist", strFolder.c_str());
-	string strBundleExe = jvInfo["CFBundleExecutable"];
+	string strInfoPlistData;
+	ZFile::ReadFileV(strInfoPlistData, "%s/Info.plist", strFolder.c_str());
+	string strBundleExe = jpview(strInfoPlistData).get_string("CFBundleExecutable");
 
 #ifdef _WIN32
 	iconv ic;
@@ -127,14 +135,22 @@ bool ZBundle::GenerateCodeResources(const string& strFolder, jvalue& jvCodeRes)
 	setFiles.erase(strBundleExe);
 	
 	jvCodeRes.clear();
-	jvCodeRes["files"] = jvalue(jvalue::E_OBJECT);
-	jvCodeRes["files2"] = jvalue(jvalue::E_OBJECT);
+	jvalue& jvFiles = jvCodeRes["files"];
+	jvalue& jvFiles2 = jvCodeRes["files2"];
+	jvFiles = jvalue(jvalue::E_OBJECT);
+	jvFiles2 = jvalue(jvalue::E_OBJECT);
 
 	for (string strKey : setFiles) {
+		if (ZFile::IsPathSuffix(strKey, ".zsign_dirty")) { // handed to the binary's own signature, which removes it
+			continue;
+		}
 		string strFile = strFolder + "/" + strKey;
 		string strSHA1Base64;
 		string strSHA256Base64;
-		ZSHA::SHABase64File(strFile.c_str(), strSHA1Base64, strSHA256Base64);
+		if (!ZSHA::SHABase64File(strFile.c_str(), strSHA1Base64, strSHA256Base64)) {
+			ZLog::ErrorV(">>> Can't hash file for CodeResources! %s\n", strFile.c_str());
+			return false;
+		}
 
 #ifdef _WIN32
 		strKey = ic.A2U8(strKey);
@@ -153,19 +169,21 @@ bool ZBundle::GenerateCodeResources(const string& strFolder, jvalue& jvCodeRes)
 		}
 
 		if (!bomit1) {
+			jvalue& jvFile = jvFiles[strKey];
 			if (string::npos != strKey.rfind(".lproj/")) {
-				jvCodeRes["files"][strKey]["hash"] = "data:" + strSHA1Base64;
-				jvCodeRes["files"][strKey]["optional"] = true;
+				jvFile["hash"] = "data:" + strSHA1Base64;
+				jvFile["optional"] = true;
 			} else {
-				jvCodeRes["files"][strKey] = "data:" + strSHA1Base64;
+				jvFile = "data:" + strSHA1Base64;
 			}
 		}
 
 		if (!bomit2) {
-			jvCodeRes["files2"][strKey]["hash"] = "data:" + strSHA1Base64;
-			jvCodeRes["files2"][strKey]["hash2"] = "data:" + strSHA256Base64;
+			jvalue& jvFile2 = jvFiles2[strKey];
+			jvFile2["hash"] = "data:" + strSHA1Base64;
+			jvFile2["hash2"] = "data:" + strSHA256Base64;
 			if (string::npos != strKey.rfind(".lproj/")) {
-				jvCodeRes["files2"][strKey]["optional"] = true;
+				jvFile2["optional"] = true;
 			}
 		}
 	}
@@ -237,6 +255,7 @@ void ZBundle::GetNodeChangedFiles(jvalue& jvNode)
 
 bool ZBundle::SignNode(jvalue& jvNode)
 {
+	ZTRACE_SPAN("ZBundle::SignNode");
 	if (jvNode.has("folders")) {
 		for (size_t i = 0; i < jvNode["folders"].size(); i++) {
 			if (!SignNode(jvNode["folders"][i])) {
@@ -251,9 +270,17 @@ bool ZBundle::SignNode(jvalue& jvNode)
 			ZLog::PrintV(">>> SignFile: \t%s\n", strFile.c_str());
 			ZMachO macho;
 			if (macho.InitV("%s/%s", m_strAppFolder.c_str(), strFile.c_str())) {
-				if (!macho.Sign(m_pSignAsset, m_bForceSign, config["bundle_id"], "", "", "")) {
+				if (!m_setThinArches.empty() && !macho.Thin(m_setThinArches)) {
+					ZLog::ErrorV(">>> Can't thin file! %s\n", strFile.c_str());
+					signFailedFiles += strFile;
+					signFailedFiles += "\n";
+				} else if (!macho.Sign(m_pSignAsset, m_bForceSign, config["bundle_id"], "", "", "")) {
                     signFailedFiles += strFile;
                     signFailedFiles += "\n";
+                } else {
+                    vector<string> arrCDHashes;
+                    macho.GetCDHashes(arrCDHashes);
+                    m_manifest.AddFile(m_strAppFolder, strFile, arrCDHashes);
                 }
                 if(progressHandler) {
                     progressHandler();
@@ -266,14 +293,13 @@ bool ZBundle::SignNode(jvalue& jvNode)
 		}
 	}
 
-	jbase64 b64;
 	string strInfoSHA1;
 	string strInfoSHA256;
 	string strFolder = jvNode["path"];
 	string strBundleId = jvNode["bundle_id"];
 	string strBundleExe = jvNode["bundle_executable"];
-	b64.decode(jvNode["sha1"].as_cstr(), strInfoSHA1);
-	b64.decode(jvNode["sha256"].as_cstr(), strInfoSHA256);
+	jbase64::decode_to(jvNode["sha1"].as_cstr(), strInfoSHA1);
+	jbase64::decode_to(jvNode["sha256"].as_cstr(), strInfoSHA256);
 	if (strBundleId.empty() || strBundleExe.empty() || strInfoSHA1.empty() ||
 		strInfoSHA256.empty()) {
 		ZLog::ErrorV(">>> Can't get BundleID or BundleExecute or Info.plist SHASum in Info.plist! %s\n", strFolder.c_str());
@@ -303,6 +329,13 @@ bool ZBundle::SignNode(jvalue& jvNode)
         return true;
 	}
 
+	if (!m_setThinArches.empty() && !macho.Thin(m_setThinArches)) {
+		ZLog::ErrorV(">>> Can't thin BundleExecute file! %s\n", strExePath.c_str());
+        signFailedFiles += strExePath;
+        signFailedFiles += "\n";
+        return true;
+	}
+
 	ZFile::CreateFolderV("%s/_CodeSignature", strBaseFolder.c_str());
 	string strCodeResFile = strBaseFolder + "/_CodeSignature/CodeResources";
 
@@ -318,8 +351,14 @@ bool ZBundle::SignNode(jvalue& jvNode)
 //			return false;
 //		}
 	} else if (jvNode.has("changed")) { // use existsed
-		for (size_t i = 0; i < jvNode["changed"].size(); i++) {
-			string strFile = jvNode["changed"][i].as_cstr();
+		jvalue& jvChanged = jvNode["changed"];
+		jvalue& jvFiles = jvCodeRes["files"];
+		jvalue& jvFiles2 = jvCodeRes["files2"];
+		if (jvFiles2.size() > jvChanged.size()) { // everything not rehashed below keeps its cached hash
+			ZMetrics::Add(ZMetrics::E_FILES_CACHED, jvFiles2.size() - jvChanged.size());
+		}
+		for (size_t i = 0; i < jvChanged.size(); i++) {
+			string strFile = jvChanged[i].as_cstr();
 			string strRealFile = m_strAppFolder + "/" + strFile;
 
 			string strFileSHA1;
@@ -334,17 +373,21 @@ bool ZBundle::SignNode(jvalue& jvNode)
 				strKey = strFile.substr(strFolder.size() + 1);
 			}
 
-			jvCodeRes["files"][strKey] = "data:" + strFileSHA1;
-			jvCodeRes["files2"][strKey]["hash"] = "data:" + strFileSHA1;
-			jvCodeRes["files2"][strKey]["hash2"] = "data:" + strFileSHA256;
+			jvFiles[strKey] = "data:" + strFileSHA1;
+			jvalue& jvFile2 = jvFiles2[strKey];
+			jvFile2["hash"] = "data:" + strFileSHA1;
+			jvFile2["hash2"] = "data:" + strFileSHA256;
 
 			ZLog::DebugV("\t\tChanged file: %s, %s\n", strFileSHA1.c_str(), strKey.c_str());
 		}
 	}
 
-	string strCodeResData;
-	jvCodeRes.style_write_plist(strCodeResData);
-	if (!ZFile::WriteFile(strCodeResFile.c_str(), strCodeResData)) {
+	// stream the plist to disk and hash it in the same pass
+	ZTraceSpan spanCodeRes("ZBundle::WriteCodeResources");
+	string strCodeResSHA1;
+	string strCodeResSHA256;
+	ZSHAFileWriter writer;
+	if (!writer.Open(strCodeResFile.c_str()) || !jvCodeRes.style_write_plist(writer) || !writer.Close(strCodeResSHA1, strCodeResSHA256)) {
 		ZLog::ErrorV("\tWriting CodeResources failed! %s\n", strCodeResFile.c_str());
 		return false;
 	}
@@ -358,10 +401,13 @@ bool ZBundle::SignNode(jvalue& jvNode)
 		}
 	}
 
-	if (!macho.Sign(m_pSignAsset, bForceSign, strBundleId, strInfoSHA1, strInfoSHA256, strCodeResData)) {
+	if (!macho.Sign(m_pSignAsset, bForceSign, strBundleId, strInfoSHA1, strInfoSHA256, strCodeResSHA1, strCodeResSHA256)) {
 		return false;
 	}
 
+	vector<string> arrCDHashes;
+	macho.GetCDHashes(arrCDHashes);
+	m_manifest.AddFile(m_strAppFolder, ("/" == strFolder) ? strBundleExe : (strFolder + "/" + strBundleExe), arrCDHashes);
 	return true;
 }
 
@@ -588,6 +634,7 @@ bool ZBundle::ConfigureFolderSign(ZSignAsset *pSignAsset,
                             bool dontGenerateEmbeddedMobileProvision
                             )
 {
+    ZTRACE_SPAN("ZBundle::ConfigureFolderSign");
     m_bForceSign = bForce;
     m_pSignAsset = pSignAsset;
     m_bWeakInject = bWeakInject;
@@ -662,7 +709,7 @@ bool ZBundle::ConfigureFolderSign(ZSignAsset *pSignAsset,
     ZLog::PrintV(">>> SubjectCN: \t%s\n", m_pSignAsset->m_strSubjectCN.c_str());
     ZLog::PrintV(">>> ReadCache: \t%s\n", m_bForceSign ? "NO" : "YES");
     
-    config = jvRoot;
+    config = std::move(jvRoot);
     
     return true;
 }
@@ -688,13 +735,25 @@ int ZBundle::GetSignCount() {
     return GetSignCount(config);
 }
 
+void ZBundle::SetThinArches(const set<string>& setArches) {
+    m_setThinArches = setArches;
+}
+
 bool ZBundle::StartSign(bool enableCache) {
+    ZTRACE_SPAN("ZBundle::StartSign");
+    // a stale manifest must not outlive a sign that fails halfway
+    ZManifest::Remove(m_strAppFolder);
+    m_manifest.Begin(m_pSignAsset);
     if (SignNode(config))
     {
         if (enableCache)
         {
             config.style_write_to_file("%s/zsign_cache.json", m_strAppFolder.c_str());
         }
+        if (signFailedFiles.empty())
+        {
+            m_manifest.Save(m_strAppFolder);
+        }
         return true;
     }
     return false;
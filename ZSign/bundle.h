@@ -2,6 +2,7 @@
 #include "common/common.h"
 #include "common/json.h"
 #include "openssl.h"
+#include "manifest.h"
 #include <vector>
 
 class ZBundle
@@ -11,6 +12,7 @@ public:
     bool ConfigureFolderSign(ZSignAsset *pSignAsset, const string &strFolder, const string &strBundleID, const string &strBundleVersion, const string &strDisplayName, const string &strDyLibFile, bool bForce, bool bWeakInject, bool bEnableCache, bool dontGenerateEmbeddedMobileProvision);
     bool StartSign(bool enableCache);
     int GetSignCount();
+    void SetThinArches(const set<string>& setArches);
 
 public:
 	bool SignFolder(ZSignAsset* pSignAsset,
@@ -45,6 +47,8 @@ private:
 	bool			m_bWeakInject;
 	ZSignAsset*		m_pSignAsset;
 	vector<string>	m_arrInjectDylibs;
+	ZManifest		m_manifest;
+	set<string>		m_setThinArches;
     jvalue config;
 
 public:
@@ -1,10 +1,37 @@
 #include "base64.h"
 #include <string.h>
 
-#define B0(a) (a & 0xFF)
-#define B1(a) (a >> 8 & 0xFF)
-#define B2(a) (a >> 16 & 0xFF)
-#define B3(a) (a >> 24 & 0xFF)
+// the neon path stays off unless JBASE64_ENABLE_NEON is defined,
+// tests/base64_test checks it against the scalar loops when built that way on arm64
+#if defined(__aarch64__) && defined(JBASE64_ENABLE_NEON)
+#include <arm_neon.h>
+#define JBASE64_NEON
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#define JBASE64_SSSE3
+#endif
+
+static const char s_b64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// 0x00-0x3f: index, 0xfd: '=', 0xfe: whitespace, 0xff: invalid
+static const uint8_t s_b64_index[256] = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe, 0xfe, 0xff, 0xff, 0xfe, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xfe, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+	0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0xfd, 0xff, 0xff,
+	0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+	0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
 
 jbase64::jbase64()
 {
@@ -27,32 +54,6 @@ jbase64::~jbase64()
 	}
 }
 
-char jbase64::get_b64_char(int index)
-{
-	static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-	if (index >= 0 && index < 64) {
-		return table[index];
-	}
-	return '=';
-}
-
-int jbase64::get_b64_index(char ch)
-{
-	int index = -1;
-	if (ch >= 'A' && ch <= 'Z') {
-		index = ch - 'A';
-	} else if (ch >= 'a' && ch <= 'z') {
-		index = ch - 'a' + 26;
-	} else if (ch >= '0' && ch <= '9') {
-		index = ch - '0' + 52;
-	} else if (ch == '+') {
-		index = 62;
-	} else if (ch == '/') {
-		index = 63;
-	}
-	return index;
-}
-
 const char* jbase64::encode(const char* src, int src_len)
 {
 	if (0 == src_len) {
@@ -63,36 +64,9 @@ const char* jbase64::encode(const char* src, int src_len)
 		return "";
 	}
 
-	char* enc = new char[src_len * 3 + 128];
+	char* enc = new char[encoded_size(src_len) + 1];
 	m_array_encodes.push_back(enc);
-
-	int i = 0;
-	char* p64 = enc;
-	unsigned char* pcursor = (unsigned char*)src;
-	for (i = 0; i < src_len - 3; i += 3) {
-		unsigned long temp = *(unsigned long*)pcursor;
-		int b0 = get_b64_char((B0(temp) >> 2) & 0x3F);
-		int b1 = get_b64_char((B0(temp) << 6 >> 2 | B1(temp) >> 4) & 0x3F);
-		int b2 = get_b64_char((B1(temp) << 4 >> 2 | B2(temp) >> 6) & 0x3F);
-		int b3 = get_b64_char((B2(temp) << 2 >> 2) & 0x3F);
-		*((unsigned long*)p64) = b0 | b1 << 8 | b2 << 16 | b3 << 24;
-		p64 += 4;
-		pcursor += 3;
-	}
-
-	if (i < src_len) {
-		int rest = src_len - i;
-		unsigned long temp = 0;
-		for (int j = 0; j < rest; ++j) {
-			*(((unsigned char*)&temp) + j) = *pcursor++;
-		}
-		p64[0] = get_b64_char((B0(temp) >> 2) & 0x3F);
-		p64[1] = get_b64_char((B0(temp) << 6 >> 2 | B1(temp) >> 4) & 0x3F);
-		p64[2] = rest > 1 ? get_b64_char((B1(temp) << 4 >> 2 | B2(temp) >> 6) & 0x3F) : '=';
-		p64[3] = rest > 2 ? get_b64_char((B2(temp) << 2 >> 2) & 0x3F) : '=';
-		p64 += 4;
-	}
-	*p64 = '\0';
+	enc[encode_to(src, src_len, enc)] = '\0';
 	return enc;
 }
 
@@ -111,56 +85,226 @@ const char* jbase64::decode(const char* src, int src_len, int* pdecode_len)
 		return "";
 	}
 
-	char* dec = new char[src_len];
+	char* dec = new char[decoded_size(src_len) + 1];
 	m_array_decodes.push_back(dec);
 
-	int i = 0;
-	char* pbuf = dec;
-	unsigned char* psrc = (unsigned char*)src;
-	for (i = 0; i < src_len - 4; i += 4) {
-		unsigned long temp = *(unsigned long*)psrc;
-		int b0 = (get_b64_index((char)B0(temp)) << 2 | get_b64_index((char)B1(temp)) << 2 >> 6) & 0xFF;
-		int b1 = (get_b64_index((char)B1(temp)) << 4 | get_b64_index((char)B2(temp)) << 2 >> 4) & 0xFF;
-		int b2 = (get_b64_index((char)B2(temp)) << 6 | get_b64_index((char)B3(temp)) << 2 >> 2) & 0xFF;
-		*((unsigned long*)pbuf) = b0 | b1 << 8 | b2 << 16;
-		psrc += 4;
-		pbuf += 3;
+	size_t dec_len = 0;
+	if (!decode_to(src, src_len, (uint8_t*)dec, dec_len)) {
+		dec_len = 0;
+	}
+	dec[dec_len] = '\0';
+
+	if (NULL != pdecode_len) {
+		*pdecode_len = (int)dec_len;
+	}
+
+	return dec;
+}
+
+const char* jbase64::decode(const char* src, string& output)
+{
+	decode_to(src, output);
+	return output.data();
+}
+
+size_t jbase64::encoded_size(size_t src_len)
+{
+	return (src_len + 2) / 3 * 4;
+}
+
+size_t jbase64::decoded_size(size_t src_len)
+{
+	return (src_len + 3) / 4 * 3;
+}
+
+size_t jbase64::encode_to(const void* src, size_t src_len, char* dst)
+{
+	const uint8_t* psrc = (const uint8_t*)src;
+	char* pdst = dst;
+	size_t i = 0;
+
+#if defined(JBASE64_NEON)
+	// 48 bytes -> 64 chars, de-interleaved loads give each sextet its own register
+	uint8x16x4_t table;
+	table.val[0] = vld1q_u8((const uint8_t*)s_b64_chars);
+	table.val[1] = vld1q_u8((const uint8_t*)s_b64_chars + 16);
+	table.val[2] = vld1q_u8((const uint8_t*)s_b64_chars + 32);
+	table.val[3] = vld1q_u8((const uint8_t*)s_b64_chars + 48);
+	for (; i + 48 <= src_len; i += 48) {
+		uint8x16x3_t in = vld3q_u8(psrc + i);
+		uint8x16x4_t out;
+		out.val[0] = vshrq_n_u8(in.val[0], 2);
+		out.val[1] = vorrq_u8(vshlq_n_u8(vandq_u8(in.val[0], vdupq_n_u8(0x03)), 4), vshrq_n_u8(in.val[1], 4));
+		out.val[2] = vorrq_u8(vshlq_n_u8(vandq_u8(in.val[1], vdupq_n_u8(0x0f)), 2), vshrq_n_u8(in.val[2], 6));
+		out.val[3] = vandq_u8(in.val[2], vdupq_n_u8(0x3f));
+		out.val[0] = vqtbl4q_u8(table, out.val[0]);
+		out.val[1] = vqtbl4q_u8(table, out.val[1]);
+		out.val[2] = vqtbl4q_u8(table, out.val[2]);
+		out.val[3] = vqtbl4q_u8(table, out.val[3]);
+		vst4q_u8((uint8_t*)pdst, out);
+		pdst += 64;
+	}
+#elif defined(JBASE64_SSSE3)
+	// 12 bytes -> 16 chars, the load reads 16 so keep 4 bytes of slack
+	const __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+											'0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+	for (; i + 16 <= src_len; i += 12) {
+		__m128i in = _mm_loadu_si128((const __m128i*)(psrc + i));
+		in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+		__m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+		__m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+		__m128i indices = _mm_or_si128(t0, t1);
+		__m128i lut_index = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+		__m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+		lut_index = _mm_or_si128(lut_index, _mm_and_si128(less, _mm_set1_epi8(13)));
+		__m128i out = _mm_add_epi8(_mm_shuffle_epi8(shift_lut, lut_index), indices);
+		_mm_storeu_si128((__m128i*)pdst, out);
+		pdst += 16;
+	}
+#endif
+
+	for (; i + 3 <= src_len; i += 3) {
+		uint32_t v = (uint32_t)psrc[i] << 16 | (uint32_t)psrc[i + 1] << 8 | psrc[i + 2];
+		pdst[0] = s_b64_chars[(v >> 18) & 0x3f];
+		pdst[1] = s_b64_chars[(v >> 12) & 0x3f];
+		pdst[2] = s_b64_chars[(v >> 6) & 0x3f];
+		pdst[3] = s_b64_chars[v & 0x3f];
+		pdst += 4;
 	}
 
 	if (i < src_len) {
-		int rest = src_len - i;
-		unsigned long temp = 0;
-		for (int j = 0; j < rest; ++j) {
-			*(((unsigned char*)&temp) + j) = *psrc++;
+		uint32_t v = (uint32_t)psrc[i] << 16;
+		if (i + 1 < src_len) {
+			v |= (uint32_t)psrc[i + 1] << 8;
 		}
+		pdst[0] = s_b64_chars[(v >> 18) & 0x3f];
+		pdst[1] = s_b64_chars[(v >> 12) & 0x3f];
+		pdst[2] = (i + 1 < src_len) ? s_b64_chars[(v >> 6) & 0x3f] : '=';
+		pdst[3] = '=';
+		pdst += 4;
+	}
 
-		int b0 = (get_b64_index((char)B0(temp)) << 2 | get_b64_index((char)B1(temp)) << 2 >> 6) & 0xFF;
-		*pbuf++ = b0;
+	return (size_t)(pdst - dst);
+}
+
+bool jbase64::decode_to(const char* src, size_t src_len, uint8_t* dst, size_t& dst_len)
+{
+	const uint8_t* psrc = (const uint8_t*)src;
+	uint8_t* pdst = dst;
+	size_t i = 0;
 
-		if ('=' != B1(temp) && '=' != B2(temp)) {
-			int b1 = (get_b64_index((char)B1(temp)) << 4 | get_b64_index((char)B2(temp)) << 2 >> 4) & 0xFF;
-			*pbuf++ = b1;
+	// the vector loops only take blocks made of alphabet chars,
+	// whitespace and padding are left to the scalar loop
+#if defined(JBASE64_NEON)
+	uint8x16x4_t table_lo;
+	uint8x16x4_t table_hi;
+	for (int k = 0; k < 4; k++) {
+		table_lo.val[k] = vld1q_u8(s_b64_index + k * 16);
+		table_hi.val[k] = vld1q_u8(s_b64_index + 64 + k * 16);
+	}
+	for (; i + 64 <= src_len; i += 64) {
+		uint8x16x4_t in = vld4q_u8(psrc + i);
+		uint8x16x4_t idx;
+		uint8x16_t error = vdupq_n_u8(0);
+		for (int k = 0; k < 4; k++) {
+			// bytes >= 0x80 miss both tables and are caught by their own high bit
+			idx.val[k] = vorrq_u8(vqtbl4q_u8(table_lo, in.val[k]), vqtbl4q_u8(table_hi, vsubq_u8(in.val[k], vdupq_n_u8(64))));
+			error = vorrq_u8(error, vorrq_u8(idx.val[k], in.val[k]));
+		}
+		if (vmaxvq_u8(error) >= 0x80) {
+			break;
 		}
 
-		if ('=' != B2(temp) && '=' != B3(temp)) {
-			int b2 = (get_b64_index((char)B2(temp)) << 6 | get_b64_index((char)B3(temp)) << 2 >> 2) & 0xFF;
-			*pbuf++ = b2;
+		uint8x16x3_t out;
+		out.val[0] = vorrq_u8(vshlq_n_u8(idx.val[0], 2), vshrq_n_u8(idx.val[1], 4));
+		out.val[1] = vorrq_u8(vshlq_n_u8(idx.val[1], 4), vshrq_n_u8(idx.val[2], 2));
+		out.val[2] = vorrq_u8(vshlq_n_u8(idx.val[2], 6), idx.val[3]);
+		vst3q_u8(pdst, out);
+		pdst += 48;
+	}
+#elif defined(JBASE64_SSSE3)
+	for (; i + 16 <= src_len; i += 16) {
+		__m128i in = _mm_loadu_si128((const __m128i*)(psrc + i));
+		__m128i upper = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('Z' + 1)));
+		__m128i lower = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('z' + 1)));
+		__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('9' + 1)));
+		__m128i plus = _mm_cmpeq_epi8(in, _mm_set1_epi8('+'));
+		__m128i slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+		__m128i valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(_mm_or_si128(digit, plus), slash));
+		if (0xFFFF != _mm_movemask_epi8(valid)) {
+			break;
 		}
+
+		__m128i shift = _mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-65)), _mm_and_si128(lower, _mm_set1_epi8(-71)));
+		shift = _mm_or_si128(shift, _mm_and_si128(digit, _mm_set1_epi8(4)));
+		shift = _mm_or_si128(shift, _mm_and_si128(plus, _mm_set1_epi8(19)));
+		shift = _mm_or_si128(shift, _mm_and_si128(slash, _mm_set1_epi8(16)));
+		__m128i values = _mm_add_epi8(in, shift);
+
+		// pack 4 x 6 bits into 3 bytes per lane, then drop the empty 4th byte
+		__m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+		merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+		merged = _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+		_mm_storel_epi64((__m128i*)pdst, merged);
+		uint32_t tail = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(merged, 8));
+		memcpy(pdst + 8, &tail, 4);
+		pdst += 12;
 	}
-	*pbuf = '\0';
+#endif
 
-	if (NULL != pdecode_len) {
-		*pdecode_len = (int)(pbuf - dec);
+	uint32_t v = 0;
+	int count = 0;
+	for (; i < src_len; i++) {
+		uint8_t index = s_b64_index[(uint8_t)psrc[i]];
+		if (index < 64) {
+			v = v << 6 | index;
+			if (4 == ++count) {
+				pdst[0] = (uint8_t)(v >> 16);
+				pdst[1] = (uint8_t)(v >> 8);
+				pdst[2] = (uint8_t)v;
+				pdst += 3;
+				v = 0;
+				count = 0;
+			}
+		} else if (0xFD == index) { // padding ends the data
+			break;
+		} else if (0xFF == index) {
+			dst_len = (size_t)(pdst - dst);
+			return false;
+		}
 	}
 
-	return dec;
+	if (count >= 2) {
+		v <<= (4 - count) * 6;
+		*pdst++ = (uint8_t)(v >> 16);
+		if (count >= 3) {
+			*pdst++ = (uint8_t)(v >> 8);
+		}
+	}
+
+	dst_len = (size_t)(pdst - dst);
+	return (1 != count);
 }
 
-const char* jbase64::decode(const char* src, string& output)
+void jbase64::encode_append(const void* src, size_t src_len, string& output)
 {
-	output.clear();
-	int dec_len = 0;
-	const char* p = decode(src, 0, &dec_len);
-	output.append(p, dec_len);
-	return output.data();
+	size_t offset = output.size();
+	output.resize(offset + encoded_size(src_len));
+	if (src_len > 0) {
+		encode_to(src, src_len, &output[offset]);
+	}
+}
+
+bool jbase64::decode_to(const char* src, size_t src_len, string& output)
+{
+	output.resize(decoded_size(src_len));
+	size_t dst_len = 0;
+	bool ret = (src_len > 0) ? decode_to(src, src_len, (uint8_t*)&output[0], dst_len) : true;
+	output.resize(dst_len);
+	return ret;
+}
+
+bool jbase64::decode_to(const char* src, string& output)
+{
+	return decode_to(src, (NULL != src) ? strlen(src) : 0, output);
 }
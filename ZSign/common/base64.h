@@ -1,6 +1,8 @@
 #ifndef BASE64_INCLUDED
 #define BASE64_INCLUDED
 
+#include <stddef.h>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -13,14 +15,23 @@ public:
 	~jbase64();
 
 public:
+	// legacy api, the returned buffers live until this object is destroyed
 	const char* encode(const char* src, int src_len = 0);
 	const char* encode(const string& input);
 	const char* decode(const char* src, int src_len = 0, int* pdecode_len = NULL);
 	const char* decode(const char* src, string& output);
 
-private:
-	inline int get_b64_index(char ch);
-	inline char get_b64_char(int index);
+public:
+	// allocation free api, callers own the buffers.
+	// encode_to writes exactly encoded_size(src_len) chars without a terminator,
+	// decode_to needs decoded_size(src_len) bytes, skips whitespace and stops at padding.
+	static size_t	encoded_size(size_t src_len);
+	static size_t	decoded_size(size_t src_len);
+	static size_t	encode_to(const void* src, size_t src_len, char* dst);
+	static bool		decode_to(const char* src, size_t src_len, uint8_t* dst, size_t& dst_len);
+	static void		encode_append(const void* src, size_t src_len, string& output);
+	static bool		decode_to(const char* src, size_t src_len, string& output);
+	static bool		decode_to(const char* src, string& output);
 
 private:
 	vector<char*> m_array_decodes;
@@ -54,3 +54,5 @@ using namespace std;
 #include "sha.h"
 #include "log.h"
 #include "util.h"
+#include "trace.h"
+#include "metrics.h"
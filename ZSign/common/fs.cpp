@@ -1,5 +1,15 @@
 #include "fs.h"
 #include "../Utils.hpp"
+#include <thread>
+#ifdef __APPLE__
+#include <copyfile.h>
+#include <sys/clonefile.h>
+#elif defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#endif
 #if !defined(S_ISREG) && defined(S_IFMT) && defined(S_IFREG)
 #define S_ISREG(m) (((m)&S_IFMT) == S_IFREG)
 #endif
@@ -42,7 +52,16 @@ void* ZFile::MapFile(const char* path, size_t offset, size_t size, size_t* psize
 	}
 
 #else
-    refreshFile(path);
+    {
+        ZTRACE_SPAN("refreshFile");
+        ZMetricsTimer timer(ZMetrics::E_REFRESH_US);
+        struct stat st;
+        if (0 == stat(path, &st)) {
+            ZMetrics::Add(ZMetrics::E_REFRESH_FILES, 1);
+            ZMetrics::Add(ZMetrics::E_REFRESH_BYTES, (uint64_t)st.st_size);
+        }
+        refreshFile(path);
+    }
     int fd = open(path, ro ? O_RDONLY : O_RDWR);
     if (fd <= 0)
     {
@@ -96,8 +115,55 @@ bool ZFile::UnmapFile(void* base, size_t size)
 #endif
 }
 
+void ZFile::AdviseFileSequential(int fd)
+{
+#if defined(__APPLE__)
+	fcntl(fd, F_RDAHEAD, 1);
+#elif defined(POSIX_FADV_SEQUENTIAL)
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+void ZFile::AdviseFileDone(int fd, int64_t offset, int64_t size)
+{
+	// drop pages behind the read cursor so hashing a huge file doesn't pin it in the cache
+#if defined(__APPLE__)
+	if (0 == offset) {
+		fcntl(fd, F_NOCACHE, 1);
+	}
+#elif defined(POSIX_FADV_DONTNEED)
+	posix_fadvise(fd, (off_t)offset, (off_t)size, POSIX_FADV_DONTNEED);
+#endif
+}
+
+void ZFile::AdviseMapSequential(void* base, size_t size)
+{
+#ifndef _WIN32
+	uintptr_t uPageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+	uintptr_t uBegin = (uintptr_t)base & ~(uPageSize - 1);
+	uintptr_t uEnd = (uintptr_t)base + size;
+	if (uEnd > uBegin) {
+		madvise((void*)uBegin, uEnd - uBegin, MADV_SEQUENTIAL);
+	}
+#endif
+}
+
+void ZFile::AdviseMapDone(void* base, size_t size)
+{
+#ifndef _WIN32
+	// only whole pages inside the range, neighbours may still be in use
+	uintptr_t uPageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+	uintptr_t uBegin = ((uintptr_t)base + uPageSize - 1) & ~(uPageSize - 1);
+	uintptr_t uEnd = ((uintptr_t)base + size) & ~(uPageSize - 1);
+	if (uEnd > uBegin) {
+		madvise((void*)uBegin, uEnd - uBegin, MADV_DONTNEED);
+	}
+#endif
+}
+
 bool ZFile::WriteFile(const char* szFile, const char* szData, size_t sLen)
 {
+	ZTRACE_SPAN_BYTES("ZFile::WriteFile", sLen);
 	if (NULL == szFile) {
 		return false;
 	}
@@ -143,6 +209,7 @@ bool ZFile::WriteFileV(const char* szData, size_t sLen, const char* szPath, ...)
 
 bool ZFile::ReadFile(const char* szFile, string& strData)
 {
+	ZTraceSpan span("ZFile::ReadFile");
 	strData.clear();
 	FILE* fp = NULL;
 	_fopen64(fp, szFile, "rb");
@@ -151,6 +218,7 @@ bool ZFile::ReadFile(const char* szFile, string& strData)
 		int64_t to_read = _ftelli64(fp);
 		_fseeki64(fp, 0, SEEK_SET);
 		to_read = (to_read > 0 ? to_read : 0);
+		span.SetBytes((uint64_t)to_read);
 		strData.resize((size_t)to_read);
 		if (strData.capacity() >= (size_t)to_read) {
 			int64_t readed = 0;
@@ -163,7 +231,7 @@ bool ZFile::ReadFile(const char* szFile, string& strData)
 			}
 		}
 		fclose(fp);
-		return (strData.size() == to_read);
+		return (strData.size() == (size_t)to_read);
 	}
 	return false;
 }
@@ -258,14 +326,145 @@ bool ZFile::CreateFolderV(const char* szPath, ...)
 	return CreateFolder(szFolder);
 }
 
-int ZFile::RemoveFolderCallBack(const char* fpath, const struct stat* sb, int typeflag, struct FTW* ftwbuf)
+#ifndef _WIN32
+
+// One directory still being emptied. Files are unlinked relative to the directory's fd while it's scanned,
+// the directory itself goes once its scan and every subdirectory scan have finished.
+struct ZRemoveDir
 {
-	int ret = remove(fpath);
-	if (ret) {
-		perror(fpath);
+	string			strPath;
+	ZRemoveDir*		pParent;
+	atomic<int>		nPending;
+};
+
+class ZFolderRemover
+{
+public:
+	ZFolderRemover()
+	{
+		m_nActive = 0;
+		m_bFailed = false;
 	}
-	return ret;
-}
+
+	bool Run(const char* szFolder)
+	{
+		Push(szFolder, NULL);
+
+		unsigned int uWorkers = max(1u, min(8u, thread::hardware_concurrency()));
+		vector<thread> arrWorkers;
+		for (unsigned int i = 1; i < uWorkers; i++) {
+			arrWorkers.push_back(thread([this] { Work(); }));
+		}
+		Work();
+		for (size_t i = 0; i < arrWorkers.size(); i++) {
+			arrWorkers[i].join();
+		}
+		return !m_bFailed;
+	}
+
+private:
+	void Push(const string& strPath, ZRemoveDir* pParent)
+	{
+		ZRemoveDir* pDir = new ZRemoveDir();
+		pDir->strPath = strPath;
+		pDir->pParent = pParent;
+		pDir->nPending.store(1); // its own scan
+		if (NULL != pParent) {
+			pParent->nPending.fetch_add(1);
+		}
+
+		lock_guard<mutex> lock(m_mutex);
+		m_arrQueue.push_back(pDir);
+		m_cond.notify_one();
+	}
+
+	void Work()
+	{
+		while (true) {
+			ZRemoveDir* pDir = NULL;
+			{
+				unique_lock<mutex> lock(m_mutex);
+				m_cond.wait(lock, [this] { return !m_arrQueue.empty() || 0 == m_nActive; });
+				if (m_arrQueue.empty()) {
+					m_cond.notify_all();
+					return;
+				}
+				pDir = m_arrQueue.back(); // depth first keeps the number of half-emptied directories low
+				m_arrQueue.pop_back();
+				m_nActive++;
+			}
+
+			Scan(pDir);
+			Finish(pDir);
+
+			lock_guard<mutex> lock(m_mutex);
+			m_nActive--;
+			if (0 == m_nActive && m_arrQueue.empty()) {
+				m_cond.notify_all();
+			}
+		}
+	}
+
+	void Scan(ZRemoveDir* pDir)
+	{
+		int fd = open(pDir->strPath.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+		DIR* dir = (fd >= 0) ? fdopendir(fd) : NULL;
+		if (NULL == dir) {
+			if (fd >= 0) {
+				close(fd);
+			}
+			Fail(pDir->strPath.c_str());
+			return;
+		}
+
+		dirent* ptr = NULL;
+		while (NULL != (ptr = readdir(dir))) {
+			if (0 == strcmp(ptr->d_name, ".") || 0 == strcmp(ptr->d_name, "..")) {
+				continue;
+			}
+
+			bool bFolder = (DT_DIR == ptr->d_type);
+			if (DT_UNKNOWN == ptr->d_type) {
+				struct stat st;
+				bFolder = (0 == fstatat(fd, ptr->d_name, &st, AT_SYMLINK_NOFOLLOW) && S_ISDIR(st.st_mode));
+			}
+
+			if (bFolder) {
+				Push(pDir->strPath + "/" + ptr->d_name, pDir);
+			} else if (0 != unlinkat(fd, ptr->d_name, 0) && ENOENT != errno) {
+				Fail((pDir->strPath + "/" + ptr->d_name).c_str());
+			}
+		}
+		closedir(dir);
+	}
+
+	void Finish(ZRemoveDir* pDir)
+	{
+		while (NULL != pDir && 1 == pDir->nPending.fetch_sub(1)) {
+			if (0 != rmdir(pDir->strPath.c_str()) && ENOENT != errno) {
+				Fail(pDir->strPath.c_str());
+			}
+			ZRemoveDir* pParent = pDir->pParent;
+			delete pDir;
+			pDir = pParent;
+		}
+	}
+
+	void Fail(const char* szPath)
+	{
+		ZLog::WarnV(">>> Remove failed! %s, %s\n", szPath, strerror(errno));
+		m_bFailed = true;
+	}
+
+private:
+	mutex					m_mutex;
+	condition_variable		m_cond;
+	vector<ZRemoveDir*>		m_arrQueue;
+	int						m_nActive;
+	atomic<bool>			m_bFailed;
+};
+
+#endif
 
 bool ZFile::RemoveFolder(const char* szFolder)
 {
@@ -285,7 +484,67 @@ bool ZFile::RemoveFolder(const char* szFolder)
 	shfs.fFlags |= (FOF_SILENT | FOF_NOERRORUI);
 	return (0 == ::SHFileOperationA(&shfs));
 #else
-	return nftw(szFolder, RemoveFolderCallBack, 64, FTW_DEPTH | FTW_PHYS);
+	ZTRACE_SPAN("ZFile::RemoveFolder");
+	ZFolderRemover remover;
+	return remover.Run(szFolder);
+#endif
+}
+
+#ifndef _WIN32
+
+// trash left in strParent by processes that exited (the launch path ends with exit()) before their delete thread finished
+static void _SweepTrash(const string& strParent)
+{
+	DIR* dir = opendir(strParent.c_str());
+	if (NULL == dir) {
+		return;
+	}
+
+	vector<string> arrTrash;
+	dirent* ptr = NULL;
+	while (NULL != (ptr = readdir(dir))) {
+		const char* szTag = strstr(ptr->d_name, ".zsign_trash.");
+		if (NULL != szTag && atoi(szTag + 13) != (int)getpid()) { // ours are still being removed
+			arrTrash.push_back(strParent + "/" + ptr->d_name);
+		}
+	}
+	closedir(dir);
+
+	for (size_t i = 0; i < arrTrash.size(); i++) {
+		ZFile::RemoveFolder(arrTrash[i].c_str());
+	}
+}
+
+#endif
+
+bool ZFile::RemoveFolderAsync(const char* szFolder)
+{
+#ifdef _WIN32
+	return RemoveFolder(szFolder);
+#else
+	if (!IsFolder(szFolder)) {
+		return RemoveFile(szFolder);
+	}
+
+	// a sibling name stays on the same volume, so the rename is instant and the path is free right away
+	static atomic<uint32_t> s_uTrashId(0);
+	string strFolder = szFolder;
+	while (strFolder.size() > 1 && '/' == strFolder[strFolder.size() - 1]) {
+		strFolder.erase(strFolder.size() - 1);
+	}
+	string strTrash;
+	ZUtil::StringFormatV(strTrash, "%s.zsign_trash.%d.%u", strFolder.c_str(), (int)getpid(), s_uTrashId.fetch_add(1));
+	if (0 != rename(strFolder.c_str(), strTrash.c_str())) {
+		return RemoveFolder(szFolder);
+	}
+
+	size_t pos = strTrash.rfind('/');
+	string strParent = (string::npos == pos) ? "." : ((0 == pos) ? "/" : strTrash.substr(0, pos));
+	thread([strTrash, strParent] {
+		RemoveFolder(strTrash.c_str());
+		_SweepTrash(strParent);
+	}).detach();
+	return true;
 #endif
 }
 
@@ -340,41 +599,154 @@ bool ZFile::IsZipFile(const char* szFile)
 	return false;
 }
 
+#ifndef _WIN32
+
+// kernel-side copy without bouncing the data through user space, false if nothing could be copied this way
+static bool _CopyFileKernel(int src_fd, int dest_fd, off_t size)
+{
+#if defined(__APPLE__)
+	return (0 == fcopyfile(src_fd, dest_fd, NULL, COPYFILE_DATA));
+#elif defined(__linux__)
+	off_t copied = 0;
+#ifdef __NR_copy_file_range
+	while (copied < size) {
+		ssize_t ret = syscall(__NR_copy_file_range, src_fd, NULL, dest_fd, NULL, (size_t)(size - copied), 0);
+		if (ret < 0 && EINTR == errno) {
+			continue;
+		}
+		if (ret <= 0) {
+			break;
+		}
+		copied += ret;
+	}
+	if (copied >= size) {
+		return true;
+	}
+	if (copied > 0) { // failed midway, the remaining bytes go through the other paths from the same offsets
+		lseek(src_fd, copied, SEEK_SET);
+		lseek(dest_fd, copied, SEEK_SET);
+	}
+#endif
+	while (copied < size) {
+		ssize_t ret = sendfile(dest_fd, src_fd, NULL, (size_t)(size - copied));
+		if (ret < 0 && EINTR == errno) {
+			continue;
+		}
+		if (ret <= 0) {
+			break;
+		}
+		copied += ret;
+	}
+	return (copied >= size);
+#else
+	return false;
+#endif
+}
+
+static bool _CopyFileBuffered(int src_fd, int dest_fd)
+{
+	const size_t sBufferSize = 1024 * 1024;
+	char* buffer = new char[sBufferSize];
+	bool bRet = true;
+	while (bRet) {
+		ssize_t bytes_read = read(src_fd, buffer, sBufferSize);
+		if (bytes_read < 0 && EINTR == errno) {
+			continue;
+		}
+		if (bytes_read <= 0) {
+			bRet = (0 == bytes_read);
+			break;
+		}
+
+		ssize_t sum_written = 0;
+		while (sum_written < bytes_read) {
+			ssize_t bytes_written = write(dest_fd, buffer + sum_written, bytes_read - sum_written);
+			if (bytes_written < 0 && EINTR == errno) {
+				continue;
+			}
+			if (bytes_written <= 0) {
+				bRet = false;
+				break;
+			}
+			sum_written += bytes_written;
+		}
+	}
+	delete[] buffer;
+	return bRet;
+}
+
+#endif
+
 bool ZFile::CopyFile(const char* szSrcFile, const char* szDestFile)
 {
+	ZTRACE_SPAN("ZFile::CopyFile");
 #ifdef _WIN32
 	return ::CopyFileA(szSrcFile, szDestFile, FALSE) ? true : false;
 #else 
 
-	int src_id = -1;
-	int dest_fd = -1;
-	ssize_t sum_readed = 0;
-	ssize_t sum_written = 0;
-	src_id = open(szSrcFile, O_RDONLY);
-	if (-1 != src_id) {
-		dest_fd = open(szDestFile, O_CREAT | O_WRONLY | O_TRUNC, 0644);
-		if (-1 != dest_fd) {
-			char buffer[4096];
-			ssize_t bytes_read = read(src_id, buffer, sizeof(buffer));
-			while (bytes_read > 0) {
-				sum_readed += bytes_read;
-				ssize_t bytes_written = write(dest_fd, buffer, bytes_read);
-				if (bytes_written != bytes_read) {
-					break;
-				}
-				sum_written += bytes_written;
-				bytes_read = read(src_id, buffer, sizeof(buffer));
-			}
-			close(dest_fd);
+	// reflink clone -> kernel copy -> 1M buffered read/write, the destination keeps the source's mode
+	int src_fd = open(szSrcFile, O_RDONLY);
+	if (-1 == src_fd) {
+		return false;
+	}
+
+	struct stat st;
+	if (0 != fstat(src_fd, &st)) {
+		close(src_fd);
+		return false;
+	}
+	mode_t mode = st.st_mode & 07777;
+
+	struct stat st_dest;
+	if (0 == stat(szDestFile, &st_dest) && st_dest.st_dev == st.st_dev && st_dest.st_ino == st.st_ino) {
+		close(src_fd); // same file, nothing to copy
+		return false;
+	}
+
+	// everything is written to a sibling and renamed over the destination at the end, so a copy that fails
+	// halfway leaves the destination as it was
+	static atomic<uint32_t> s_uCopyId(0);
+	string strTemp;
+	ZUtil::StringFormatV(strTemp, "%s.zsign_copy.%d.%u", szDestFile, (int)getpid(), s_uCopyId.fetch_add(1));
+
+#ifdef __APPLE__
+	// clonefile() won't replace an existing file either
+	if (0 == clonefile(szSrcFile, strTemp.c_str(), 0)) {
+		if (0 == rename(strTemp.c_str(), szDestFile)) {
+			close(src_fd);
+			return true;
 		}
-		close(src_id);
+		unlink(strTemp.c_str());
 	}
+#endif
 
-	if (-1 == src_id || -1 == dest_fd || sum_readed != sum_written) {
+	int dest_fd = open(strTemp.c_str(), O_CREAT | O_EXCL | O_WRONLY, mode);
+	if (-1 == dest_fd) {
+		close(src_fd);
 		return false;
 	}
 
-	return true;
+	bool bRet = false;
+#if defined(__linux__) && defined(FICLONE)
+	bRet = (0 == ioctl(dest_fd, FICLONE, src_fd));
+#endif
+	if (!bRet) {
+		bRet = _CopyFileKernel(src_fd, dest_fd, st.st_size);
+	}
+	if (!bRet) {
+		bRet = (0 == ftruncate(dest_fd, 0) && 0 == lseek(src_fd, 0, SEEK_SET) && 0 == lseek(dest_fd, 0, SEEK_SET) && _CopyFileBuffered(src_fd, dest_fd));
+	}
+	fchmod(dest_fd, mode); // the umask applies to O_CREAT's mode
+
+	close(dest_fd);
+	close(src_fd);
+	if (bRet) {
+		bRet = (0 == rename(strTemp.c_str(), szDestFile));
+	}
+	if (!bRet) {
+		unlink(strTemp.c_str());
+	}
+	return bRet;
 
 #endif
 }
@@ -581,3 +953,94 @@ bool ZFile::PathRemoveFileSpec(string& path)
 	}
 	return false;
 }
+
+ZBufferPool::ZBufferPool(size_t sBufferSize, size_t sMemoryCap)
+{
+	m_sBufferSize = sBufferSize;
+	m_sMemoryCap = sMemoryCap;
+	m_sAllocated = 0;
+	m_sGeneration = 0;
+}
+
+ZBufferPool::~ZBufferPool()
+{
+	FreeBuffers();
+}
+
+void ZBufferPool::FreeBuffers()
+{
+	for (size_t i = 0; i < m_arrFree.size(); i++) {
+		m_mapOwned.erase(m_arrFree[i]);
+		delete[] m_arrFree[i];
+		m_sAllocated--;
+	}
+	m_arrFree.clear();
+}
+
+uint8_t* ZBufferPool::Acquire(size_t& sSize)
+{
+	unique_lock<mutex> lock(m_mutex);
+	sSize = m_sBufferSize;
+	while (m_arrFree.empty()) {
+		// at least one buffer is always allowed, even if the cap is smaller than a buffer
+		if (0 == m_sAllocated || (m_sAllocated + 1) * m_sBufferSize <= m_sMemoryCap) {
+			uint8_t* pBuffer = new uint8_t[m_sBufferSize];
+			m_mapOwned[pBuffer] = m_sGeneration;
+			m_sAllocated++;
+			return pBuffer;
+		}
+		m_cond.wait(lock);
+		sSize = m_sBufferSize;
+	}
+	uint8_t* pBuffer = m_arrFree.back();
+	m_arrFree.pop_back();
+	return pBuffer;
+}
+
+void ZBufferPool::Release(uint8_t* pBuffer)
+{
+	if (NULL == pBuffer) {
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(m_mutex);
+		map<uint8_t*, size_t>::iterator it = m_mapOwned.find(pBuffer);
+		if (it != m_mapOwned.end() && it->second == m_sGeneration) {
+			m_arrFree.push_back(pBuffer);
+		} else { // allocated before the last Configure()
+			if (it != m_mapOwned.end()) {
+				m_mapOwned.erase(it);
+			}
+			delete[] pBuffer;
+			m_sAllocated--;
+		}
+	}
+	m_cond.notify_one();
+}
+
+void ZBufferPool::Configure(size_t sBufferSize, size_t sMemoryCap)
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		if (sBufferSize != m_sBufferSize) {
+			FreeBuffers();
+			m_sGeneration++;
+		}
+		m_sBufferSize = sBufferSize;
+		m_sMemoryCap = sMemoryCap;
+	}
+	m_cond.notify_all();
+}
+
+size_t ZBufferPool::GetBufferSize()
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_sBufferSize;
+}
+
+size_t ZBufferPool::GetMemoryCap()
+{
+	lock_guard<mutex> lock(m_mutex);
+	return m_sMemoryCap;
+}
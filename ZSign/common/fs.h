@@ -1,5 +1,6 @@
 #pragma once
 #include "common.h"
+#include <condition_variable>
 
 typedef function<bool (bool bFolder, const string& strPath)> enum_folder_callback;
 
@@ -23,6 +24,7 @@ public:
 	static bool		RemoveFileV(const char* szPath, ...);
 	static bool		RemoveFolder(const char* szFolder);
 	static bool		RemoveFolderV(const char* szPath, ...);
+	static bool		RemoveFolderAsync(const char* szFolder);
 	static bool		IsFileExists(const char* szFile);
 	static bool		IsFileExistsV(const char* szPath, ...);
 	static int64_t	GetFileSize(FILE* fp);
@@ -36,6 +38,10 @@ public:
 	static string	GetRealPathV(const char* szPath, ...);
 	static void*	MapFile(const char* path, size_t offset, size_t size, size_t* psize, bool ro);
 	static bool		UnmapFile(void* base, size_t size);
+	static void		AdviseFileSequential(int fd);
+	static void		AdviseFileDone(int fd, int64_t offset, int64_t size);
+	static void		AdviseMapSequential(void* base, size_t size);
+	static void		AdviseMapDone(void* base, size_t size);
 	static bool		IsPathSuffix(const string& strPath, const char* suffix);
 	static const char* GetTempFolder();
 	static bool		EnumFolder(const char* szFolder, bool bRecursive, enum_folder_callback filter, enum_folder_callback callback);
@@ -43,8 +49,33 @@ public:
 	static bool		PathRemoveFileSpec(string& path);
 
 private:
-	static int RemoveFolderCallBack(const char* fpath, const struct stat* sb, int typeflag, struct FTW* ftwbuf);
+	static map<void*, void*> s_mapFiles;
+};
+
+// Fixed-size reusable buffers for windowed reads, Acquire() blocks once the memory cap is reached.
+class ZBufferPool
+{
+public:
+	ZBufferPool(size_t sBufferSize, size_t sMemoryCap);
+	~ZBufferPool();
+
+public:
+	uint8_t*	Acquire(size_t& sSize);
+	void		Release(uint8_t* pBuffer);
+	void		Configure(size_t sBufferSize, size_t sMemoryCap);
+	size_t		GetBufferSize();
+	size_t		GetMemoryCap();
 
 private:
-	static map<void*, void*> s_mapFiles;
+	void		FreeBuffers();
+
+private:
+	mutex				m_mutex;
+	condition_variable	m_cond;
+	vector<uint8_t*>	m_arrFree;
+	size_t				m_sBufferSize;
+	size_t				m_sMemoryCap;
+	size_t				m_sAllocated;
+	size_t				m_sGeneration;
+	map<uint8_t*, size_t> m_mapOwned;
 };
@@ -79,6 +79,15 @@ jvalue::jvalue(const jvalue& other)
 	_copy_value(other);
 }
 
+jvalue::jvalue(jvalue&& other) noexcept
+{
+	// steal the heap parts, vector<jvalue> growth and temporaries no longer deep copy
+	m_type = other.m_type;
+	m_value = other.m_value;
+	other.m_type = E_NULL;
+	other.m_value.v_double = 0;
+}
+
 jvalue::jvalue(const char* val, size_t len)
 {
 	m_type = E_DATA;
@@ -213,13 +222,8 @@ void jvalue::_copy_value(const jvalue& src)
 		m_value.p_array = (NULL == src.m_value.p_array) ? NULL : new array(*(src.m_value.p_array));
 		break;
 	case E_OBJECT:
-	{
-		m_value.p_object = (NULL == src.m_value.p_object) ? NULL : new object();
-		if (NULL != m_value.p_object) {
-			*m_value.p_object = *src.m_value.p_object;
-		}
-	}
-	break;
+		m_value.p_object = (NULL == src.m_value.p_object) ? NULL : new object(*(src.m_value.p_object));
+		break;
 	case E_STRING:
 		m_value.p_string = (NULL == src.m_value.p_string) ? NULL : _new_string(src.m_value.p_string);
 		break;
@@ -470,6 +474,21 @@ jvalue& jvalue::operator=(const jvalue& other)
 	return (*this);
 }
 
+jvalue& jvalue::operator=(jvalue&& other) noexcept
+{
+	if (this != &other) {
+		jvalue tmp(std::move(other)); // other may live inside this tree
+		swap(tmp);
+	}
+	return (*this);
+}
+
+void jvalue::swap(jvalue& other) noexcept
+{
+	std::swap(m_type, other.m_type);
+	std::swap(m_value, other.m_value);
+}
+
 jvalue& jvalue::operator[](int index)
 {
 	return (*this)[(size_t)(index < 0 ? 0 : index)];
@@ -500,10 +519,7 @@ jvalue& jvalue::operator[](size_t index)
 
 	size_t sum = m_value.p_array->size();
 	if (sum <= index) {
-		size_t fill = index - sum;
-		for (size_t i = 0; i <= fill; i++) {
-			m_value.p_array->push_back(null);
-		}
+		m_value.p_array->resize(index + 1);
 	}
 
 	return m_value.p_array->at(index);
@@ -535,14 +551,13 @@ jvalue& jvalue::operator[](const char* key)
 		_free();
 		m_type = E_OBJECT;
 		m_value.p_object = new object();
-	} else {
-		auto it = m_value.p_object->find(key);
-		if (it != m_value.p_object->end()) {
-			return it->second;
-		}
 	}
-	auto it = m_value.p_object->insert(m_value.p_object->end(), make_pair(key, null));
-	return it->second;
+	// one lookup, the hint places new keys without a second search
+	auto it = m_value.p_object->lower_bound(key);
+	if (it != m_value.p_object->end() && it->first == key) {
+		return it->second;
+	}
+	return m_value.p_object->emplace_hint(it, key, jvalue())->second;
 }
 
 const jvalue& jvalue::operator[](const char* key) const
@@ -642,6 +657,11 @@ bool jvalue::get_keys(vector<string>& keys) const
 	return false;
 }
 
+const map<string, jvalue>* jvalue::get_members() const
+{
+	return (E_OBJECT == m_type) ? m_value.p_object : NULL;
+}
+
 bool jvalue::_map_keys(vector<string>& keys) const
 {
 	if (E_OBJECT == m_type && NULL != m_value.p_object) {
@@ -779,11 +799,21 @@ bool jvalue::push_back(const string& val)
 
 bool jvalue::push_back(const jvalue& jval)
 {
-	if (E_ARRAY == m_type || E_NULL == m_type) {
-		(*this)[size()] = jval;
-		return true;
+	return push_back(jvalue(jval));
+}
+
+bool jvalue::push_back(jvalue&& jval)
+{
+	if (E_ARRAY != m_type && E_NULL != m_type) {
+		return false;
 	}
-	return false;
+
+	if (NULL == m_value.p_array || E_NULL == m_type) { // jvalue(E_ARRAY) has no storage yet
+		m_type = E_ARRAY;
+		m_value.p_array = new array();
+	}
+	m_value.p_array->push_back(std::move(jval));
+	return true;
 }
 
 bool jvalue::push_back(const char* val, size_t len)
@@ -822,9 +852,8 @@ void jvalue::assign_data(const uint8_t* data, size_t size)
 
 void jvalue::assign_data(const char* base64)
 {
-	jbase64 b64;
 	string output;
-	b64.decode(base64, output);
+	jbase64::decode_to(base64, output);
 	assign_data(output);
 }
 
@@ -911,10 +940,9 @@ bool jvalue::as_data(string& data) const
 	case E_STRING:
 	{
 		if (is_data_string()) {
-			jbase64 b64;
-			int data_len = 0;
-			const char* pdata = b64.decode(m_value.p_string + 5, 0, &data_len);
-			data.append(pdata, data_len);
+			string output;
+			jbase64::decode_to(m_value.p_string + 5, output);
+			data.append(output);
 			return true;
 		}
 	}
@@ -1170,6 +1198,12 @@ const char* jvalue::style_write_plist(string& strdoc) const
 	return strdoc.c_str();
 }
 
+bool jvalue::style_write_plist(jpsink& sink) const
+{
+	jpwriter pw;
+	return pw.style_write(*this, sink);
+}
+
 bool jvalue::write_bplist(string& strdoc) const
 {
 	strdoc.clear();
@@ -1699,8 +1733,7 @@ void jwriter::_write_value(const jvalue& jval, string& strdoc)
 	{
 		strdoc += "\"data:";
 		const string& data = jval.as_data();
-		jbase64 b64;
-		strdoc += b64.encode(data.data(), (int)data.size());
+		jbase64::encode_append(data.data(), data.size(), strdoc);
 		strdoc += "\"";
 	}
 	break;
@@ -1773,8 +1806,7 @@ void jwriter::_style_write_value(const jvalue& jval)
 		string strdoc;
 		strdoc += "\"data:";
 		const string& data = jval.as_data();
-		jbase64 b64;
-		strdoc += b64.encode(data.data(), (int)data.size());
+		jbase64::encode_append(data.data(), data.size(), strdoc);
 		strdoc += "\"";
 		_push_value(strdoc);
 	}
@@ -2013,8 +2045,7 @@ void jwriter::_write_value_to_html(const jvalue& jval, string& strdoc)
 	{
 		strdoc += "\\\"data:";
 		const string& data = jval.as_data();
-		jbase64 b64;
-		strdoc += b64.encode(data.data(), (int)data.size());
+		jbase64::encode_append(data.data(), data.size(), strdoc);
 		strdoc += "\\\"";
 	}
 	break;
@@ -2109,6 +2140,162 @@ bool jpreader::parse(const char* pdoc, size_t len, jvalue& root, bool* is_binary
 	}
 }
 
+bool jpreader::find(const char* pdoc, size_t len, const vector<string>& keypath, jvalue& val)
+{
+	val.clear();
+	if (NULL == pdoc || len < 30) {
+		return false;
+	}
+
+	if (0 == ::memcmp(pdoc, "bplist00", 8)) {
+		const char* ptop = _init_binary(pdoc, len);
+		if (NULL == ptop) {
+			return false;
+		}
+		return _find_binary_value(ptop, keypath, val);
+	} else {
+		m_pbegin = pdoc;
+		m_pend = m_pbegin + len;
+		m_pcursor = m_pbegin;
+		m_perror = m_pbegin;
+		m_strerr = "null";
+		return _find_value(keypath, val);
+	}
+}
+
+bool jpreader::find(const char* pdoc, size_t len, const vector<string>& keys, vector<jvalue>& vals)
+{
+	vals.clear();
+	vals.resize(keys.size());
+	if (NULL == pdoc || len < 30) {
+		return false;
+	}
+
+	if (0 == ::memcmp(pdoc, "bplist00", 8)) {
+		const char* ptop = _init_binary(pdoc, len);
+		if (NULL == ptop) {
+			return false;
+		}
+		return _find_binary_values(ptop, keys, vals);
+	} else {
+		m_pbegin = pdoc;
+		m_pend = m_pbegin + len;
+		m_pcursor = m_pbegin;
+		m_perror = m_pbegin;
+		m_strerr = "null";
+		return _find_values(keys, vals);
+	}
+}
+
+bool jpreader::_find_values(const vector<string>& keys, vector<jvalue>& vals)
+{
+	ptoken token;
+	_read_token(token);
+	if (ptoken::E_PTOKEN_DICTIONARY_BEGIN != token.type) {
+		return false;
+	}
+
+	size_t left = keys.size();
+	ptoken key;
+	string strkey;
+	while (left > 0 && _read_token(key)) {
+		if (ptoken::E_PTOKEN_KEY != key.type) {
+			return (ptoken::E_PTOKEN_DICTIONARY_END == key.type);
+		}
+
+		strkey = "";
+		if (!_decode_string(key, strkey)) {
+			return false;
+		}
+
+		_read_token(token);
+		size_t i = 0;
+		while (i < keys.size() && (strkey != keys[i] || !vals[i].is_null())) {
+			i++;
+		}
+
+		if (i < keys.size()) {
+			if (!_read_value(vals[i], token)) {
+				return false;
+			}
+			left--;
+		} else if (!_skip_value(token)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool jpreader::_find_value(const vector<string>& keypath, jvalue& val)
+{
+	ptoken token;
+	_read_token(token);
+	for (size_t depth = 0; depth < keypath.size(); depth++) {
+		if (ptoken::E_PTOKEN_DICTIONARY_BEGIN != token.type) {
+			return false;
+		}
+
+		bool found = false;
+		ptoken key;
+		string strkey;
+		while (_read_token(key)) {
+			if (ptoken::E_PTOKEN_KEY != key.type) {
+				return false; // '</dict>' or broken document
+			}
+
+			strkey = "";
+			if (!_decode_string(key, strkey)) {
+				return false;
+			}
+
+			_read_token(token);
+			if (strkey == keypath[depth]) {
+				found = true;
+				break;
+			}
+
+			if (!_skip_value(token)) {
+				return false;
+			}
+		}
+
+		if (!found) {
+			return false;
+		}
+	}
+	return _read_value(val, token);
+}
+
+bool jpreader::_skip_value(ptoken& token)
+{
+	int depth = 0;
+	while (true) {
+		switch (token.type) {
+		case ptoken::E_PTOKEN_ERROR:
+		case ptoken::E_PTOKEN_END:
+			return false;
+		case ptoken::E_PTOKEN_ARRAY_BEGIN:
+		case ptoken::E_PTOKEN_DICTIONARY_BEGIN:
+			depth++;
+			break;
+		case ptoken::E_PTOKEN_ARRAY_END:
+		case ptoken::E_PTOKEN_DICTIONARY_END:
+			depth--;
+			break;
+		default:
+			break;
+		}
+
+		if (depth <= 0) {
+			return (0 == depth);
+		}
+
+		if (!_read_token(token)) {
+			return false;
+		}
+	}
+}
+
 bool jpreader::_read_value(jvalue& pval, ptoken& token)
 {
 	switch (token.type) {
@@ -2737,7 +2924,7 @@ bool jpreader::_read_binary_value(const char*& pcursor, jvalue& pv)
 			}
 
 			if (jkey.is_string() && !jval.is_null()) {
-				pv[jkey.as_cstr()] = jval;
+				pv[jkey.as_cstr()] = std::move(jval);
 			}
 		}
 	}
@@ -2775,9 +2962,10 @@ bool jpreader::_read_binary_value(const char*& pcursor, jvalue& pv)
 	return true;
 }
 
-bool jpreader::parse_binary(const char* pbdoc, size_t len, jvalue& pv)
+const char* jpreader::_init_binary(const char* pbdoc, size_t len)
 {
 	m_pbegin = pbdoc;
+	m_pend = pbdoc + len;
 
 	m_ptrailer = m_pbegin + len - 26;
 
@@ -2786,19 +2974,211 @@ bool jpreader::parse_binary(const char* pbdoc, size_t len, jvalue& pv)
 	m_num_objects = _get_uint_val(m_ptrailer + 2, 8);
 	m_top_object_offset = _get_uint_val(m_ptrailer + 10, 8);
 
-	if (0 == m_num_objects) {
+	uint64_t offset_table = _get_uint_val(m_ptrailer + 18, 8);
+	if (0 == m_num_objects || m_top_object_offset >= m_num_objects || offset_table >= len ||
+		m_num_objects * m_offset_table_offset_size > len - offset_table) {
+		return NULL;
+	}
+
+	m_poffset_table = m_pbegin + offset_table;
+	return _get_binary_object(m_top_object_offset);
+}
+
+const char* jpreader::_get_binary_object(uint64_t index)
+{
+	if (index >= m_num_objects) {
+		return NULL;
+	}
+
+	uint64_t offset = _get_uint_val(m_poffset_table + index * m_offset_table_offset_size, m_offset_table_offset_size);
+	if (offset >= (uint64_t)(m_ptrailer - m_pbegin)) {
+		return NULL;
+	}
+	return m_pbegin + offset;
+}
+
+bool jpreader::_binary_key_equal(const char* pcur, const string& key)
+{
+	uint8_t c = *pcur++;
+	uint8_t type = c & 0xF0;
+	size_t size = c & 0x0F;
+	if (NS_STRING_ASCII != type && NS_STRING_UTF8 != type && NS_STRING_UNICODE != type) {
 		return false;
 	}
 
-	m_poffset_table = m_pbegin + _get_uint_val(m_ptrailer + 18, 8);
-	const char* pval = (m_pbegin + _get_uint_val(m_poffset_table + m_offset_table_offset_size * m_top_object_offset, m_offset_table_offset_size));
+	if (0x0F == size) {
+		if (!_read_uint_size(pcur, size)) {
+			return false;
+		}
+	}
+
+	if (NS_STRING_UNICODE == type) { // rare for keys, decode it
+		if ((size_t)(m_pend - pcur) / 2 < size) {
+			return false;
+		}
+
+		jvalue jkey;
+		_read_unicode(pcur, size, jkey);
+		return (key == jkey.as_cstr());
+	}
+
+	return (size == key.size() && (size_t)(m_pend - pcur) >= size && 0 == ::memcmp(pcur, key.data(), size));
+}
+
+bool jpreader::_find_binary_value(const char* pcur, const vector<string>& keypath, jvalue& pv)
+{
+	for (size_t depth = 0; depth < keypath.size(); depth++) {
+		uint8_t c = *pcur++;
+		if (NS_DICTIONARY != (c & 0xF0)) {
+			return false;
+		}
+
+		size_t size = c & 0x0F;
+		if (0x0F == size) {
+			if (!_read_uint_size(pcur, size)) {
+				return false;
+			}
+		}
+
+		if ((size_t)(m_pend - pcur) < 2 * size * m_object_ref_size) {
+			return false;
+		}
+
+		const char* pnext = NULL;
+		for (size_t i = 0; i < size; i++) {
+			uint64_t key_index = _get_uint_val(pcur + i * m_object_ref_size, m_object_ref_size);
+			const char* pkey = _get_binary_object(key_index);
+			if (NULL != pkey && _binary_key_equal(pkey, keypath[depth])) {
+				uint64_t value_index = _get_uint_val(pcur + (i + size) * m_object_ref_size, m_object_ref_size);
+				pnext = _get_binary_object(value_index);
+				break;
+			}
+		}
+
+		if (NULL == pnext) {
+			return false;
+		}
+		pcur = pnext;
+	}
+	return _read_binary_value(pcur, pv);
+}
+
+bool jpreader::_find_binary_values(const char* pcur, const vector<string>& keys, vector<jvalue>& vals)
+{
+	uint8_t c = *pcur++;
+	if (NS_DICTIONARY != (c & 0xF0)) {
+		return false;
+	}
+
+	size_t size = c & 0x0F;
+	if (0x0F == size) {
+		if (!_read_uint_size(pcur, size)) {
+			return false;
+		}
+	}
+
+	if ((size_t)(m_pend - pcur) < 2 * size * m_object_ref_size) {
+		return false;
+	}
+
+	size_t left = keys.size();
+	for (size_t i = 0; i < size && left > 0; i++) {
+		uint64_t key_index = _get_uint_val(pcur + i * m_object_ref_size, m_object_ref_size);
+		const char* pkey = _get_binary_object(key_index);
+		if (NULL == pkey) {
+			continue;
+		}
+
+		for (size_t k = 0; k < keys.size(); k++) {
+			if (vals[k].is_null() && _binary_key_equal(pkey, keys[k])) {
+				uint64_t value_index = _get_uint_val(pcur + (i + size) * m_object_ref_size, m_object_ref_size);
+				const char* pval = _get_binary_object(value_index);
+				if (NULL != pval) {
+					_read_binary_value(pval, vals[k]);
+				}
+				left--;
+				break;
+			}
+		}
+	}
+	return true;
+}
+
+bool jpreader::parse_binary(const char* pbdoc, size_t len, jvalue& pv)
+{
+	const char* pval = _init_binary(pbdoc, len);
+	if (NULL == pval) {
+		return false;
+	}
 	return _read_binary_value(pval, pv);
 }
 
+jpview::jpview()
+{
+	m_pdoc = NULL;
+	m_len = 0;
+}
+
+jpview::jpview(const char* pdoc, size_t len)
+{
+	attach(pdoc, len);
+}
+
+jpview::jpview(const string& strdoc)
+{
+	attach(strdoc.data(), strdoc.size());
+}
+
+void jpview::attach(const char* pdoc, size_t len)
+{
+	m_pdoc = pdoc;
+	m_len = len;
+}
+
+bool jpview::get(const char* key, jvalue& val) const
+{
+	vector<string> keypath;
+	keypath.push_back(key);
+	return get(keypath, val);
+}
+
+bool jpview::get(const vector<string>& keypath, jvalue& val) const
+{
+	jpreader reader;
+	return reader.find(m_pdoc, m_len, keypath, val);
+}
+
+string jpview::get_string(const char* key) const
+{
+	jvalue val;
+	get(key, val);
+	return val.as_cstr();
+}
+
+bool jpview::get_strings(const vector<string>& keys, vector<string>& vals) const
+{
+	vector<jvalue> jvals;
+	jpreader reader;
+	bool ret = reader.find(m_pdoc, m_len, keys, jvals);
+	vals.clear();
+	for (size_t i = 0; i < jvals.size(); i++) {
+		vals.push_back(jvals[i].as_cstr());
+	}
+	return ret;
+}
+
+bool jpview::has(const char* key) const
+{
+	jvalue val;
+	return get(key, val);
+}
+
 jpwriter::jpwriter()
 {
 	m_tab = "\t";
 	m_line = "\n";
+	m_psink = NULL;
+	m_sink_ok = true;
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -3252,6 +3632,28 @@ const string& jpwriter::style_write(const jvalue& pval)
 	return _style_write(pval);
 }
 
+bool jpwriter::style_write(const jvalue& pval, jpsink& sink)
+{
+	m_tab = "\t";
+	m_line = "\n";
+	m_psink = &sink;
+	m_sink_ok = true;
+	_style_write(pval);
+	_flush_sink(0);
+	m_psink = NULL;
+	return m_sink_ok;
+}
+
+void jpwriter::_flush_sink(size_t threshold)
+{
+	if (NULL != m_psink && !m_strdoc.empty() && m_strdoc.size() >= threshold) {
+		if (m_sink_ok) {
+			m_sink_ok = m_psink->write(m_strdoc.data(), m_strdoc.size());
+		}
+		m_strdoc.clear();
+	}
+}
+
 const string& jpwriter::_style_write(const jvalue& pval)
 {
 	m_indent = "";
@@ -3266,19 +3668,21 @@ const string& jpwriter::_style_write(const jvalue& pval)
 
 void jpwriter::_style_write_value(const jvalue& pval)
 {
+	_flush_sink(64 * 1024);
+
 	if (pval.is_object()) {
-		vector<string> keys;
-		pval.get_keys(keys);
-		if (!keys.empty()) {
+		const map<string, jvalue>* members = pval.get_members();
+		if (NULL != members && !members->empty()) {
 			m_strdoc += m_indent + "<dict>" + m_line;
 			m_indent += m_tab;
-			for (size_t i = 0; i < keys.size(); i++) {
-				string strkey = keys[i];
-				_xml_escape(strkey);
-				m_strdoc += m_indent + "<key>";
-				m_strdoc += strkey;
-				m_strdoc += "</key>" + m_line;
-				_style_write_value(pval[keys[i].c_str()]);
+			// the map is already in key order, walk it instead of copying the keys and looking each one up again
+			for (map<string, jvalue>::const_iterator it = members->begin(); it != members->end(); ++it) {
+				m_strdoc += m_indent;
+				m_strdoc += "<key>";
+				_append_escaped(it->first.data(), it->first.size());
+				m_strdoc += "</key>";
+				m_strdoc += m_line;
+				_style_write_value(it->second);
 			}
 			if (!m_indent.empty()) {
 				m_indent.resize(m_indent.size() - 1);
@@ -3308,9 +3712,8 @@ void jpwriter::_style_write_value(const jvalue& pval)
 	} else if (pval.is_data()) {
 		m_strdoc += m_indent + "<data>" + m_line;
 		m_strdoc += m_indent;
-		jbase64 b64;
 		string strdata = pval.as_data();
-		m_strdoc += b64.encode(strdata.data(), (int32_t)strdata.size());
+		jbase64::encode_append(strdata.data(), strdata.size(), m_strdoc);
 		m_strdoc += m_line;
 		m_strdoc += m_indent + "</data>" + m_line;
 	} else if (pval.is_string()) {
@@ -3319,17 +3722,22 @@ void jpwriter::_style_write_value(const jvalue& pval)
 			m_strdoc += pval.as_string().c_str() + 5;
 			m_strdoc += "</date>" + m_line;
 		} else if (pval.is_data_string()) {
-			m_strdoc += m_indent + "<data>" + m_line;
 			m_strdoc += m_indent;
-			m_strdoc += pval.as_string().c_str() + 5;
+			m_strdoc += "<data>";
+			m_strdoc += m_line;
+			m_strdoc += m_indent;
+			m_strdoc += pval.as_cstr() + 5;
+			m_strdoc += m_line;
+			m_strdoc += m_indent;
+			m_strdoc += "</data>";
 			m_strdoc += m_line;
-			m_strdoc += m_indent + "</data>" + m_line;
 		} else {
-			string strval = pval.as_cstr();
-			_xml_escape(strval);
-			m_strdoc += m_indent + "<string>";
-			m_strdoc += strval;
-			m_strdoc += "</string>" + m_line;
+			const char* pstr = pval.as_cstr();
+			m_strdoc += m_indent;
+			m_strdoc += "<string>";
+			_append_escaped(pstr, strlen(pstr));
+			m_strdoc += "</string>";
+			m_strdoc += m_line;
 		}
 	} else if (pval.is_bool()) {
 		m_strdoc += m_indent + (pval.as_bool() ? "<true/>" : "<false/>") + m_line;
@@ -3359,6 +3767,24 @@ void jpwriter::_style_write_value(const jvalue& pval)
 	}
 }
 
+void jpwriter::_append_escaped(const char* str, size_t len)
+{
+	// same output as _xml_escape, without a copy for the usual string that has nothing to escape
+	const char* pend = str + len;
+	while (str < pend) {
+		const char* pspecial = str;
+		while (pspecial < pend && '&' != *pspecial && '<' != *pspecial) {
+			pspecial++;
+		}
+		m_strdoc.append(str, pspecial - str);
+		if (pspecial < pend) {
+			m_strdoc += ('&' == *pspecial) ? "&amp;" : "&lt;";
+			pspecial++;
+		}
+		str = pspecial;
+	}
+}
+
 void jpwriter::_xml_escape(string& str)
 {
 	_string_replace(str, "&", "&amp;");
@@ -26,6 +26,8 @@ typedef unsigned long		ulong;
 #include <string>
 using namespace std;
 
+class jpsink;
+
 class jvalue
 {
 public:
@@ -51,6 +53,7 @@ public:
 	jvalue(const char* val);
 	jvalue(const string& val);
 	jvalue(const jvalue& other);
+	jvalue(jvalue&& other) noexcept;
 	jvalue(const char* val, size_t len);
 	~jvalue();
 
@@ -90,6 +93,7 @@ public:
 	bool		erase(const char* key);
 	bool		append(jvalue& jv);
 	bool		get_keys(vector<string>& keys) const;
+	const map<string, jvalue>* get_members() const;
 	int			index(const char* elem) const;
 
 	jvalue& front();
@@ -102,6 +106,7 @@ public:
 	bool		push_back(const char* val);
 	bool		push_back(const string& val);
 	bool		push_back(const jvalue& jval);
+	bool		push_back(jvalue&& jval);
 	bool		push_back(const char* val, size_t len);
 
 	bool		is_int()	const;
@@ -126,6 +131,8 @@ public:
 	operator const char* ()	const;
 
 	jvalue& operator=(const jvalue& other);
+	jvalue& operator=(jvalue&& other) noexcept;
+	void	swap(jvalue& other) noexcept;
 
 	jvalue& operator[](int index);
 	const jvalue& operator[](int index) const;
@@ -230,6 +237,7 @@ public:
 
 	string			style_write_plist() const;
 	const char*		style_write_plist(string& strdoc) const;
+	bool			style_write_plist(jpsink& sink) const;
 
 	bool			write_bplist(string& strdoc) const;
 
@@ -384,6 +392,8 @@ public:
 
 public:
 	bool	parse(const char* pdoc, size_t len, jvalue& root, bool* is_binary);
+	bool	find(const char* pdoc, size_t len, const vector<string>& keypath, jvalue& val);
+	bool	find(const char* pdoc, size_t len, const vector<string>& keys, vector<jvalue>& vals);
 	void	error(string& strmsg) const;
 
 private:
@@ -445,6 +455,10 @@ private:
 	void	_skip_spaces();
 	bool	_add_error(const string& message, const char* ploc);
 
+	bool	_find_value(const vector<string>& keypath, jvalue& val);
+	bool	_find_values(const vector<string>& keys, vector<jvalue>& vals);
+	bool	_skip_value(ptoken& token);
+
 
 public:
 	bool	parse_binary(const char* pbdoc, size_t len, jvalue& pv);
@@ -455,6 +469,11 @@ private:
 	bool		_read_uint_size(const char*& pcur, size_t& size);
 	bool		_read_binary_value(const char*& pcur, jvalue& pv);
 	bool		_read_unicode(const char* pcur, size_t size, jvalue& pv);
+	const char*	_init_binary(const char* pbdoc, size_t len);
+	const char*	_get_binary_object(uint64_t index);
+	bool		_find_binary_value(const char* pcur, const vector<string>& keypath, jvalue& pv);
+	bool		_find_binary_values(const char* pcur, const vector<string>& keys, vector<jvalue>& vals);
+	bool		_binary_key_equal(const char* pcur, const string& key);
 
 private: //xml
 	const char* m_pbegin;
@@ -472,6 +491,38 @@ private: //binary
 	uint8_t		m_offset_table_offset_size;
 };
 
+// read-only view over a plist buffer (bplist00 or xml), resolves single keys or key paths
+// by walking the offset table or the tags in place, only the requested value is materialized.
+// the buffer must outlive the view.
+class jpview
+{
+public:
+	jpview();
+	jpview(const char* pdoc, size_t len);
+	jpview(const string& strdoc);
+
+public:
+	void	attach(const char* pdoc, size_t len);
+	bool	get(const char* key, jvalue& val) const;
+	bool	get(const vector<string>& keypath, jvalue& val) const;
+	string	get_string(const char* key) const;
+	// top-level keys in one pass over the dictionary, missing ones come back empty
+	bool	get_strings(const vector<string>& keys, vector<string>& vals) const;
+	bool	has(const char* key) const;
+
+private:
+	const char* m_pdoc;
+	size_t		m_len;
+};
+
+// output sink for streaming plist writes, receives the document in chunks and in order
+class jpsink
+{
+public:
+	virtual ~jpsink() {}
+	virtual bool write(const char* data, size_t len) = 0;
+};
+
 class jpwriter
 {
 public:
@@ -481,6 +532,7 @@ public:
 	void			write(const jvalue& pval, string& strdoc);
 	void			write_to_binary(const jvalue& pval, string& strdoc);
 	const string&	style_write(const jvalue& pval);
+	bool			style_write(const jvalue& pval, jpsink& sink);
 	
 private:
 	struct bplist_object
@@ -507,6 +559,8 @@ private:
 private:
 	void _style_write_value(const jvalue& pval);
 	const string& _style_write(const jvalue& pval);
+	void _flush_sink(size_t threshold);
+	void _append_escaped(const char* str, size_t len);
 
 public:
 	static inline uint16_t	_swap(uint16_t value);
@@ -525,6 +579,8 @@ private:
 	string			m_line;
 	string			m_indent;
 	string			m_strdoc;
+	jpsink*			m_psink;
+	bool			m_sink_ok;
 };
 
 #endif // JSON_INCLUDED
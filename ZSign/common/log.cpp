@@ -1,55 +1,290 @@
 #include "log.h"
 #include "../Utils.hpp"
+#include <atomic>
+#include <deque>
+#include <thread>
+#include <condition_variable>
 
 int ZLog::g_nLogLevel = ZLog::E_INFO;
+const size_t ZLog::s_uMaxRecentErrors = 64;
 
-void ZLog::_Print(const char* szLog, int nColor)
+#ifndef _WIN32
+
+// bounded multi-producer/multi-consumer queue (Vyukov), each slot carries one formatted message
+class ZLogRing
 {
-	if (g_nLogLevel <= E_NONE) {
-		return;
+public:
+	ZLogRing()
+	{
+		for (size_t i = 0; i < s_uSlots; i++) {
+			m_arrSlots[i].uSeq.store(i, memory_order_relaxed);
+		}
+		m_uEnqueuePos.store(0, memory_order_relaxed);
+		m_uDequeuePos.store(0, memory_order_relaxed);
+		m_bSleeping.store(false, memory_order_relaxed);
+	}
+
+	bool Push(const char* szLog, size_t uLen, int nColor)
+	{
+		if (uLen > sizeof(m_arrSlots[0].szText)) {
+			return false;
+		}
+
+		Slot* pSlot = NULL;
+		size_t uPos = m_uEnqueuePos.load(memory_order_relaxed);
+		while (true) {
+			pSlot = &m_arrSlots[uPos & (s_uSlots - 1)];
+			size_t uSeq = pSlot->uSeq.load(memory_order_acquire);
+			intptr_t nDiff = (intptr_t)uSeq - (intptr_t)uPos;
+			if (0 == nDiff) {
+				if (m_uEnqueuePos.compare_exchange_weak(uPos, uPos + 1, memory_order_relaxed)) {
+					break;
+				}
+			} else if (nDiff < 0) {
+				return false; // full
+			} else {
+				uPos = m_uEnqueuePos.load(memory_order_relaxed);
+			}
+		}
+
+		pSlot->nColor = nColor;
+		pSlot->uLen = uLen;
+		memcpy(pSlot->szText, szLog, pSlot->uLen);
+		pSlot->uSeq.store(uPos + 1, memory_order_release);
+
+		// pairs with the store in Run(): either the flusher sees this slot before it sleeps, or this sees it asleep.
+		// the lock makes sure it is already waiting when notified
+		atomic_thread_fence(memory_order_seq_cst);
+		if (m_bSleeping.load(memory_order_relaxed)) {
+			lock_guard<mutex> lock(m_mtxWait);
+			m_cond.notify_one();
+		}
+		return true;
+	}
+
+	// drains whatever is queued into one buffer and writes it with a single syscall.
+	// the flusher, Flush(), the atexit hook and the full ring fallback all drain, one at a time so batches stay in order
+	bool Drain()
+	{
+		lock_guard<mutex> lock(m_mtxDrain);
+		return DrainLocked();
+	}
+
+	// for a message that didn't fit in the ring: whatever is queued goes first, then the message, with no drain in between.
+	// a slot another thread claimed but hasn't filled yet stops a drain, and this thread's own earlier messages may sit
+	// behind it, so wait until everything claimed so far is out
+	void DrainAndWrite(const char* szLog, size_t uLen, int nColor)
+	{
+		lock_guard<mutex> lock(m_mtxDrain);
+		size_t uEnd = m_uEnqueuePos.load(memory_order_acquire);
+		while ((intptr_t)(uEnd - m_uDequeuePos.load(memory_order_relaxed)) > 0) {
+			if (!DrainLocked()) {
+				this_thread::yield();
+			}
+		}
+		string strOutput;
+		AppendColored(strOutput, szLog, uLen, nColor);
+		WriteOut(strOutput.data(), strOutput.size());
+	}
+
+	// sleeps without a timeout while the ring is empty
+	void Run()
+	{
+		while (true) {
+			Drain();
+			unique_lock<mutex> lock(m_mtxWait);
+			m_bSleeping.store(true, memory_order_seq_cst);
+			m_cond.wait(lock, [this] { return HasPending(); });
+			m_bSleeping.store(false, memory_order_relaxed);
+		}
+	}
+
+private:
+	bool HasPending()
+	{
+		size_t uPos = m_uDequeuePos.load(memory_order_seq_cst);
+		return m_arrSlots[uPos & (s_uSlots - 1)].uSeq.load(memory_order_seq_cst) == uPos + 1;
+	}
+
+	bool DrainLocked()
+	{
+		string strBatch;
+		while (true) {
+			Slot* pSlot = NULL;
+			size_t uPos = m_uDequeuePos.load(memory_order_relaxed);
+			while (true) {
+				pSlot = &m_arrSlots[uPos & (s_uSlots - 1)];
+				size_t uSeq = pSlot->uSeq.load(memory_order_acquire);
+				intptr_t nDiff = (intptr_t)uSeq - (intptr_t)(uPos + 1);
+				if (0 == nDiff) {
+					if (m_uDequeuePos.compare_exchange_weak(uPos, uPos + 1, memory_order_relaxed)) {
+						break;
+					}
+				} else if (nDiff < 0) {
+					pSlot = NULL; // empty
+					break;
+				} else {
+					uPos = m_uDequeuePos.load(memory_order_relaxed);
+				}
+			}
+
+			if (NULL == pSlot) {
+				break;
+			}
+
+			AppendColored(strBatch, pSlot->szText, pSlot->uLen, pSlot->nColor);
+			pSlot->uSeq.store(uPos + s_uSlots, memory_order_release);
+		}
+
+		if (strBatch.empty()) {
+			return false;
+		}
+		WriteOut(strBatch.data(), strBatch.size());
+		return true;
+	}
+
+	static void AppendColored(string& strOutput, const char* szLog, size_t uLen, int nColor)
+	{
+		const char* szColor = NULL;
+		switch (nColor) {
+			case 6:
+				szColor = "\033[33m";
+				break;
+			case 10:
+				szColor = "\033[32m";
+				break;
+			case 12:
+				szColor = "\033[31m";
+				break;
+			default:
+				break;
+		}
+
+		if (NULL != szColor) {
+			strOutput += szColor;
+		}
+		strOutput.append(szLog, uLen);
+		if (NULL != szColor) {
+			strOutput += "\033[0m";
+		}
+	}
+
+	static void WriteOut(const char* szData, size_t uLen)
+	{
+		while (uLen > 0) {
+			ssize_t nWritten = write(STDOUT_FILENO, szData, uLen);
+			if (nWritten < 0 && EINTR == errno) {
+				continue;
+			}
+			if (nWritten <= 0) {
+				break;
+			}
+			szData += nWritten;
+			uLen -= nWritten;
+		}
+	}
+
+private:
+	struct Slot
+	{
+		atomic<size_t>	uSeq;
+		int				nColor;
+		size_t			uLen;
+		char			szText[1024]; // FORMAT_V limit
+	};
+
+	static const size_t s_uSlots = 256; // power of two
+
+	Slot				m_arrSlots[s_uSlots];
+	atomic<size_t>		m_uEnqueuePos;
+	atomic<size_t>		m_uDequeuePos;
+	atomic<bool>		m_bSleeping;
+	mutex				m_mtxWait;
+	mutex				m_mtxDrain;
+	condition_variable	m_cond;
+};
+
+static ZLogRing* GetLogRing()
+{
+	// never freed, the flusher thread may still run during static destruction
+	static ZLogRing* s_pRing = NULL;
+	static once_flag s_once;
+	call_once(s_once, [] {
+		s_pRing = new ZLogRing();
+		thread([] { s_pRing->Run(); }).detach();
+		atexit([] { s_pRing->Drain(); }); // exit() doesn't wait for the flusher
+	});
+	return s_pRing;
+}
+
+#endif
+
+static mutex s_mtxRecentErrors;
+static deque<string> s_arrRecentErrors;
+
+void ZLog::_AddRecentError(const char* szLog)
+{
+	lock_guard<mutex> lock(s_mtxRecentErrors);
+	if (s_arrRecentErrors.size() >= s_uMaxRecentErrors) {
+		s_arrRecentErrors.pop_front();
 	}
+	s_arrRecentErrors.push_back(szLog);
+}
 
+void ZLog::GetRecentErrors(vector<string>& arrLines)
+{
+	lock_guard<mutex> lock(s_mtxRecentErrors);
+	arrLines.assign(s_arrRecentErrors.begin(), s_arrRecentErrors.end());
+}
+
+void ZLog::ClearRecentErrors()
+{
+	lock_guard<mutex> lock(s_mtxRecentErrors);
+	s_arrRecentErrors.clear();
+}
+
+void ZLog::Flush()
+{
+#ifndef _WIN32
+	GetLogRing()->Drain();
+#endif
+}
+
+void ZLog::_Write(const char* szLog, size_t uLen, int nColor)
+{
 #ifdef _WIN32
 
-	string strLog = szLog;
 	HANDLE hConsole = ::GetStdHandle(STD_OUTPUT_HANDLE);
 	if (nColor > 0) {
 		::SetConsoleTextAttribute(hConsole, nColor);
 	}
-	::WriteFile(hConsole, strLog.data(), (DWORD)strLog.size(), NULL, NULL);
+	::WriteFile(hConsole, szLog, (DWORD)uLen, NULL, NULL);
 	if (nColor > 0) {
 		::SetConsoleTextAttribute(hConsole, 7);
 	}
 
 #else
 
-	const char* szColor = NULL;
-	switch (nColor) {
-		case 6:
-			szColor = "\033[33m";
-			break;
-		case 10:
-			szColor = "\033[32m";
-			break;
-		case 12: 
-			szColor = "\033[31m";
-			break;
-		default:
-			break;
-	}
-
-	if (NULL != szColor) {
-		write(STDOUT_FILENO, szColor, strlen(szColor));
-	}
-	write(STDOUT_FILENO, szLog, strlen(szLog));
-	if (NULL != szColor) {
-		write(STDOUT_FILENO, "\033[0m", 4);
-	}
-    writeToLogFile(szLog);
-	
+	ZLogRing* pRing = GetLogRing();
+	if (!pRing->Push(szLog, uLen, nColor)) { // full ring or oversized message, write it directly after what's queued
+		pRing->DrainAndWrite(szLog, uLen, nColor);
+	}
+
 #endif
 }
 
+void ZLog::_Print(const char* szLog, int nColor)
+{
+	if (g_nLogLevel <= E_NONE) {
+		return;
+	}
+
+	_Write(szLog, strlen(szLog), nColor);
+	if (6 == nColor || 12 == nColor) {
+		_AddRecentError(szLog);
+	}
+}
+
 void ZLog::Print(int nLevel, const char* szLog)
 {
 	if (g_nLogLevel >= nLevel) {
@@ -73,8 +308,10 @@ bool ZLog::Error(const char* szLog)
 
 bool ZLog::ErrorV(const char* szFormat, ...)
 {
-	FORMAT_V(szFormat, szLog);
-	_Print(szLog, 12);
+	if (g_nLogLevel > E_NONE) {
+		FORMAT_V(szFormat, szLog);
+		_Print(szLog, 12);
+	}
 	return false;
 }
 
@@ -86,8 +323,10 @@ bool ZLog::Success(const char* szLog)
 
 bool ZLog::SuccessV(const char* szFormat, ...)
 {
-	FORMAT_V(szFormat, szLog);
-	_Print(szLog, 10);
+	if (g_nLogLevel > E_NONE) {
+		FORMAT_V(szFormat, szLog);
+		_Print(szLog, 10);
+	}
 	return true;
 }
 
@@ -98,6 +337,9 @@ bool ZLog::PrintResult(bool bSuccess, const char* szLog)
 
 bool ZLog::PrintResultV(bool bSuccess, const char* szFormat, ...)
 {
+	if (g_nLogLevel <= E_NONE) {
+		return bSuccess;
+	}
 	FORMAT_V(szFormat, szLog);
 	return bSuccess ? Success(szLog) : Error(szLog);
 }
@@ -110,8 +352,10 @@ bool ZLog::Warn(const char* szLog)
 
 bool ZLog::WarnV(const char* szFormat, ...)
 {
-	FORMAT_V(szFormat, szLog);
-	_Print(szLog, 6);
+	if (g_nLogLevel > E_NONE) {
+		FORMAT_V(szFormat, szLog);
+		_Print(szLog, 6);
+	}
 	return false;
 }
 
@@ -144,20 +388,3 @@ void ZLog::DebugV(const char* szFormat, ...)
 		_Print(szLog);
 	}
 }
-
-vector<string> ZLog::logs;
-
-void ZLog::writeToLogFile(const std::string& message) {
-//    const char* documentsPath = getDocumentsDirectory();
-//    std::string logFilePath = std::string(documentsPath) + "/logs.txt";
-//
-//    std::ofstream logFile(logFilePath, std::ios_base::app);
-//    if (logFile.is_open()) {
-//        logFile << message;
-//        logFile.close();
-//    } else {
-//        std::cerr << "Failed to open log file: " << logFilePath << std::endl;
-//    }
-
-    logs.push_back(message);
-}
@@ -30,10 +30,18 @@ public:
 	static void Print(int nLevel, const char* szLog);
 	static void PrintV(int nLevel, const char* szFormat, ...);
 	static void SetLogLever(int nLogLevel) { g_nLogLevel = nLogLevel; }
-    static vector<std::string> logs;
+
+public:
+	// messages go through a bounded lock-free ring and are written out by a background thread
+	static void Flush();
+	// the last s_uMaxRecentErrors error and warning lines, oldest first
+	static void GetRecentErrors(vector<string>& arrLines);
+	static void ClearRecentErrors();
 
 private:
 	static void _Print(const char* szLog, int nColor = 0);
-    static void writeToLogFile(const std::string& message);
+	static void _Write(const char* szLog, size_t uLen, int nColor);
+	static void _AddRecentError(const char* szLog);
 	static int g_nLogLevel;
+	static const size_t s_uMaxRecentErrors;
 };
@@ -7,6 +7,8 @@ typedef int	vm_prot_t;
 
 #define FAT_MAGIC 		0xcafebabe
 #define FAT_CIGAM 		0xbebafeca
+#define FAT_MAGIC_64 	0xcafebabf
+#define FAT_CIGAM_64 	0xbfbafeca
 
 #define MH_MAGIC 		0xfeedface
 #define MH_CIGAM 		0xcefaedfe
@@ -183,6 +185,16 @@ struct fat_arch
 	uint32_t align;			  /* alignment as a power of 2 */
 };
 
+struct fat_arch_64
+{
+	cpu_type_t cputype;		  /* cpu specifier (int) */
+	cpu_subtype_t cpusubtype; /* machine specifier (int) */
+	uint64_t offset;		  /* file offset to this object file */
+	uint64_t size;			  /* size of this object file */
+	uint32_t align;			  /* alignment as a power of 2 */
+	uint32_t reserved;		  /* reserved */
+};
+
 struct mach_header
 {
 	uint32_t magic;			  /* mach magic number identifier */
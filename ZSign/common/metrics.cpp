@@ -0,0 +1,74 @@
+#include "metrics.h"
+#include "json.h"
+#include <chrono>
+
+atomic<uint64_t> ZMetrics::s_arrCounters[ZMetrics::E_COUNTER_MAX];
+
+static const char* s_arrNames[ZMetrics::E_COUNTER_MAX] = {
+	"sha1_bytes",
+	"sha256_bytes",
+	"pages_hashed",
+	"pages_reused",
+	"pages_us",
+	"files_hashed",
+	"files_cached",
+	"files_us",
+	"cms_signatures",
+	"cms_us",
+	"refresh_files",
+	"refresh_bytes",
+	"refresh_us",
+	"realloc_files",
+	"realloc_bytes",
+	"realloc_us",
+};
+
+const char* ZMetrics::GetName(eCounter eName)
+{
+	return (eName >= 0 && eName < E_COUNTER_MAX) ? s_arrNames[eName] : "";
+}
+
+bool ZMetrics::Get(const char* szName, uint64_t& uValue)
+{
+	for (int i = 0; i < E_COUNTER_MAX; i++) {
+		if (0 == strcmp(szName, s_arrNames[i])) {
+			uValue = Get((eCounter)i);
+			return true;
+		}
+	}
+	return false;
+}
+
+void ZMetrics::Reset()
+{
+	for (int i = 0; i < E_COUNTER_MAX; i++) {
+		s_arrCounters[i].store(0, memory_order_relaxed);
+	}
+}
+
+uint64_t ZMetrics::Now()
+{
+	return (uint64_t)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void ZMetrics::GetJson(jvalue& jvMetrics)
+{
+	jvMetrics = jvalue(jvalue::E_OBJECT);
+	for (int i = 0; i < E_COUNTER_MAX; i++) {
+		jvMetrics[s_arrNames[i]] = (int64_t)Get((eCounter)i);
+	}
+}
+
+void ZMetrics::GetJson(string& strJson)
+{
+	jvalue jvMetrics;
+	GetJson(jvMetrics);
+	jvMetrics.write(strJson);
+}
+
+bool ZMetrics::WriteJson(const char* szFile)
+{
+	jvalue jvMetrics;
+	GetJson(jvMetrics);
+	return jvMetrics.style_write_to_file("%s", szFile);
+}
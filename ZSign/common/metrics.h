@@ -0,0 +1,72 @@
+#pragma once
+
+#include "common.h"
+#include <atomic>
+
+class jvalue;
+
+// Cumulative signing counters, always on. Each update is one relaxed atomic add, so they can stay
+// enabled in production and tell a slow sign apart: cache misses, realloc fallbacks or raw hashing.
+class ZMetrics
+{
+public:
+	enum eCounter
+	{
+		E_SHA1_BYTES = 0,
+		E_SHA256_BYTES,
+		E_PAGES_HASHED,
+		E_PAGES_REUSED,
+		E_PAGES_US,
+		E_FILES_HASHED,
+		E_FILES_CACHED,
+		E_FILES_US,
+		E_CMS_SIGNATURES,
+		E_CMS_US,
+		E_REFRESH_FILES,
+		E_REFRESH_BYTES,
+		E_REFRESH_US,
+		E_REALLOC_FILES,
+		E_REALLOC_BYTES,
+		E_REALLOC_US,
+		E_COUNTER_MAX
+	};
+
+public:
+	static void Add(eCounter eName, uint64_t uValue) { s_arrCounters[eName].fetch_add(uValue, memory_order_relaxed); }
+	static uint64_t Get(eCounter eName) { return s_arrCounters[eName].load(memory_order_relaxed); }
+	static bool Get(const char* szName, uint64_t& uValue);
+	static const char* GetName(eCounter eName);
+	static void Reset();
+	static uint64_t Now();
+
+	static void GetJson(jvalue& jvMetrics);
+	static void GetJson(string& strJson);
+	static bool WriteJson(const char* szFile);
+
+private:
+	static atomic<uint64_t> s_arrCounters[E_COUNTER_MAX];
+};
+
+// adds the elapsed microseconds to a *_US counter when it goes out of scope
+class ZMetricsTimer
+{
+public:
+	ZMetricsTimer(ZMetrics::eCounter eName)
+	{
+		m_eName = eName;
+		m_uBegin = ZMetrics::Now();
+	}
+
+	~ZMetricsTimer()
+	{
+		ZMetrics::Add(m_eName, ZMetrics::Now() - m_uBegin);
+	}
+
+private:
+	ZMetricsTimer(const ZMetricsTimer&);
+	ZMetricsTimer& operator=(const ZMetricsTimer&);
+
+private:
+	ZMetrics::eCounter	m_eName;
+	uint64_t			m_uBegin;
+};
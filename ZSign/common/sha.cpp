@@ -2,12 +2,15 @@
 #include "base64.h"
 #include <OpenSSL/sha.h>
 
+static ZBufferPool s_bufferPool(1024 * 1024, 4 * 1024 * 1024); // 1M windows, 4M cap
+
 bool ZSHA::SHA1(uint8_t* data, size_t size, string& strOutput)
 {
 	strOutput.clear();
 	uint8_t hash[20];
 	memset(hash, 0, 20);
 	::SHA1(data, size, hash);
+	ZMetrics::Add(ZMetrics::E_SHA1_BYTES, size);
 	strOutput.append((const char*)hash, 20);
 	return true;
 }
@@ -18,6 +21,7 @@ bool ZSHA::SHA256(uint8_t* data, size_t size, string& strOutput)
 	uint8_t hash[32];
 	memset(hash, 0, 32);
 	::SHA256(data, size, hash);
+	ZMetrics::Add(ZMetrics::E_SHA256_BYTES, size);
 	strOutput.append((const char*)hash, 32);
 	return true;
 }
@@ -55,8 +59,13 @@ bool ZSHA::SHA1Text(const string& strData, string& strOutput)
 
 bool ZSHA::SHAFile(const char* szFile, string& strSHA1, string& strSHA256)
 {
+	ZTraceSpan span("ZSHA::SHAFile");
+	ZMetricsTimer timer(ZMetrics::E_FILES_US);
+	ZMetrics::Add(ZMetrics::E_FILES_HASHED, 1);
 	strSHA1.clear();
 	strSHA256.clear();
+
+#ifdef _WIN32
 	size_t sSize = 0;
 	uint8_t* pBase = (uint8_t*)ZFile::MapFile(szFile, 0, 0, &sSize, true);
 	// pBase may be NULL, but it's ok, because the file may be empty
@@ -65,28 +74,99 @@ bool ZSHA::SHAFile(const char* szFile, string& strSHA1, string& strSHA256)
 	if (NULL != pBase && sSize > 0) {
 		ZFile::UnmapFile(pBase, sSize);
 	}
+#else
+	// read fixed windows into pooled buffers instead of mapping the whole file,
+	// resident memory stays within the pool cap however large the file is
+	SHA_CTX ctx1;
+	SHA256_CTX ctx256;
+	SHA1_Init(&ctx1);
+	SHA256_Init(&ctx256);
+
+	int fd = open(szFile, O_RDONLY);
+	if (fd < 0 && 0 == chmod(szFile, 0755)) { // same permission fix MapFile applies
+		fd = open(szFile, O_RDONLY);
+	}
+	bool bReadFailed = false;
+	if (fd >= 0) { // a file that can't be opened hashes as empty, same as the mapped path did
+		ZFile::AdviseFileSequential(fd);
+
+		size_t sWindow = 0;
+		uint8_t* pBuffer = s_bufferPool.Acquire(sWindow);
+		off_t offset = 0;
+		while (true) {
+			ssize_t nRead = pread(fd, pBuffer, sWindow, offset);
+			if (nRead < 0 && EINTR == errno) {
+				continue;
+			}
+			if (nRead < 0) {
+				ZLog::ErrorV(">>> Read failed while hashing! %s, %s\n", szFile, strerror(errno));
+				bReadFailed = true;
+				break;
+			}
+			if (0 == nRead) {
+				break;
+			}
+			SHA1_Update(&ctx1, pBuffer, nRead);
+			SHA256_Update(&ctx256, pBuffer, nRead);
+			ZFile::AdviseFileDone(fd, offset, nRead);
+			offset += nRead;
+		}
+		s_bufferPool.Release(pBuffer);
+		close(fd);
+		span.SetBytes((uint64_t)offset);
+		ZMetrics::Add(ZMetrics::E_SHA1_BYTES, (uint64_t)offset);
+		ZMetrics::Add(ZMetrics::E_SHA256_BYTES, (uint64_t)offset);
+	}
+	if (bReadFailed) { // the hash of a truncated read must not end up in a signature
+		return false;
+	}
+
+	uint8_t hash1[20];
+	uint8_t hash256[32];
+	SHA1_Final(hash1, &ctx1);
+	SHA256_Final(hash256, &ctx256);
+	strSHA1.append((const char*)hash1, 20);
+	strSHA256.append((const char*)hash256, 32);
+#endif
+
 	return (!strSHA1.empty() && !strSHA256.empty());
 }
 
+void ZSHA::SetStreamMemoryCap(size_t sWindowSize, size_t sMemoryCap)
+{
+	s_bufferPool.Configure(sWindowSize, sMemoryCap);
+}
+
+size_t ZSHA::GetStreamMemoryCap()
+{
+	return s_bufferPool.GetMemoryCap();
+}
+
 bool ZSHA::SHABase64(const string& strData, string& strSHA1Base64, string& strSHA256Base64)
 {
-	jbase64 b64;
 	string strSHA1;
 	string strSHA256;
 	SHA(strData, strSHA1, strSHA256);
-	strSHA1Base64 = b64.encode(strSHA1);
-	strSHA256Base64 = b64.encode(strSHA256);
+	char szSHA1[32]; // 28 chars for a 20 byte digest
+	char szSHA256[48]; // 44 chars for a 32 byte digest
+	strSHA1Base64.assign(szSHA1, jbase64::encode_to(strSHA1.data(), strSHA1.size(), szSHA1));
+	strSHA256Base64.assign(szSHA256, jbase64::encode_to(strSHA256.data(), strSHA256.size(), szSHA256));
 	return (!strSHA1Base64.empty() && !strSHA256Base64.empty());
 }
 
 bool ZSHA::SHABase64File(const char* szFile, string& strSHA1Base64, string& strSHA256Base64)
 {
-	jbase64 b64;
 	string strSHA1;
 	string strSHA256;
-	SHAFile(szFile, strSHA1, strSHA256);
-	strSHA1Base64 = b64.encode(strSHA1);
-	strSHA256Base64 = b64.encode(strSHA256);
+	strSHA1Base64.clear();
+	strSHA256Base64.clear();
+	if (!SHAFile(szFile, strSHA1, strSHA256)) {
+		return false;
+	}
+	char szSHA1[32]; // 28 chars for a 20 byte digest
+	char szSHA256[48]; // 44 chars for a 32 byte digest
+	strSHA1Base64.assign(szSHA1, jbase64::encode_to(strSHA1.data(), strSHA1.size(), szSHA1));
+	strSHA256Base64.assign(szSHA256, jbase64::encode_to(strSHA256.data(), strSHA256.size(), szSHA256));
 	return (!strSHA1Base64.empty() && !strSHA256Base64.empty());
 }
 
@@ -131,3 +211,87 @@ void ZSHA::PrintData256(const char* prefix, uint8_t* data, size_t size, const ch
 	ZSHA::SHA256(data, size, strSHASum);
 	Print(prefix, strSHASum, suffix);
 }
+
+ZSHAContext::ZSHAContext()
+{
+	m_pSHA1Ctx = new SHA_CTX;
+	m_pSHA256Ctx = new SHA256_CTX;
+	SHA1_Init((SHA_CTX*)m_pSHA1Ctx);
+	SHA256_Init((SHA256_CTX*)m_pSHA256Ctx);
+}
+
+ZSHAContext::~ZSHAContext()
+{
+	delete (SHA_CTX*)m_pSHA1Ctx;
+	delete (SHA256_CTX*)m_pSHA256Ctx;
+}
+
+void ZSHAContext::Update(const void* data, size_t size)
+{
+	SHA1_Update((SHA_CTX*)m_pSHA1Ctx, data, size);
+	SHA256_Update((SHA256_CTX*)m_pSHA256Ctx, data, size);
+	ZMetrics::Add(ZMetrics::E_SHA1_BYTES, size);
+	ZMetrics::Add(ZMetrics::E_SHA256_BYTES, size);
+}
+
+void ZSHAContext::Final(string& strSHA1, string& strSHA256)
+{
+	uint8_t hash1[20];
+	uint8_t hash256[32];
+	SHA1_Final(hash1, (SHA_CTX*)m_pSHA1Ctx);
+	SHA256_Final(hash256, (SHA256_CTX*)m_pSHA256Ctx);
+	strSHA1.assign((const char*)hash1, 20);
+	strSHA256.assign((const char*)hash256, 32);
+}
+
+ZSHAFileWriter::ZSHAFileWriter()
+{
+	m_fp = NULL;
+}
+
+ZSHAFileWriter::~ZSHAFileWriter()
+{
+	if (NULL != m_fp) {
+		fclose(m_fp);
+	}
+}
+
+bool ZSHAFileWriter::Open(const char* szFile)
+{
+	_fopen64(m_fp, szFile, "wb");
+	if (NULL == m_fp) {
+		ZLog::ErrorV("ZSHAFileWriter: Failed in fopen! %s, %s\n", szFile, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+bool ZSHAFileWriter::write(const char* data, size_t len)
+{
+	if (NULL == m_fp) {
+		return false;
+	}
+
+	m_ctx.Update(data, len);
+	size_t written = 0;
+	while (written < len) {
+		size_t ret = fwrite(data + written, 1, len - written, m_fp);
+		if (ret <= 0) {
+			return false;
+		}
+		written += ret;
+	}
+	return true;
+}
+
+bool ZSHAFileWriter::Close(string& strSHA1, string& strSHA256)
+{
+	if (NULL == m_fp) {
+		return false;
+	}
+
+	bool bRet = (0 == fclose(m_fp));
+	m_fp = NULL;
+	m_ctx.Final(strSHA1, strSHA256);
+	return bRet;
+}
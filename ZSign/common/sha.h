@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common.h"
+#include "json.h"
 
 class ZSHA
 {
@@ -21,4 +22,42 @@ public:
 	static void PrintData1(const char* prefix, uint8_t* data, size_t size, const char* suffix = "\n");
 	static void PrintData256(const char* prefix, const string& strData, const char* suffix = "\n");
 	static void PrintData256(const char* prefix, uint8_t* data, size_t size, const char* suffix = "\n");
+
+public:
+	static void SetStreamMemoryCap(size_t sWindowSize, size_t sMemoryCap);
+	static size_t GetStreamMemoryCap();
+};
+
+// incremental SHA-1 and SHA-256 over the same byte stream
+class ZSHAContext
+{
+public:
+	ZSHAContext();
+	~ZSHAContext();
+
+public:
+	void Update(const void* data, size_t size);
+	void Final(string& strSHA1, string& strSHA256);
+
+private:
+	void* m_pSHA1Ctx;
+	void* m_pSHA256Ctx;
+};
+
+// plist sink that writes to a file and hashes the bytes on the way out,
+// so the document never has to be held in memory or read back for hashing
+class ZSHAFileWriter : public jpsink
+{
+public:
+	ZSHAFileWriter();
+	~ZSHAFileWriter();
+
+public:
+	bool Open(const char* szFile);
+	bool Close(string& strSHA1, string& strSHA256);
+	virtual bool write(const char* data, size_t len);
+
+private:
+	FILE* m_fp;
+	ZSHAContext m_ctx;
 };
@@ -0,0 +1,131 @@
+#include "trace.h"
+#include "json.h"
+#include <chrono>
+
+atomic<bool> ZTrace::s_bEnabled(false);
+
+struct ZTraceEvent
+{
+	const char*	szName;
+	uint32_t	uTid;
+	uint64_t	uBegin;
+	uint64_t	uEnd;
+	uint64_t	uBytes;
+};
+
+static mutex s_mtxEvents;
+static vector<ZTraceEvent> s_arrEvents;
+static atomic<uint32_t> s_uNextTid(1);
+
+void ZTrace::Enable(bool bEnable)
+{
+	s_bEnabled.store(bEnable, memory_order_relaxed);
+}
+
+void ZTrace::Reset()
+{
+	lock_guard<mutex> lock(s_mtxEvents);
+	s_arrEvents.clear();
+}
+
+uint64_t ZTrace::Now()
+{
+	return (uint64_t)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void ZTrace::AddSpan(const char* szName, uint64_t uBegin, uint64_t uEnd, uint64_t uBytes)
+{
+	// small sequential ids read better in the trace viewer than native thread ids
+	static thread_local uint32_t s_uTid = s_uNextTid.fetch_add(1, memory_order_relaxed);
+
+	ZTraceEvent event;
+	event.szName = szName;
+	event.uTid = s_uTid;
+	event.uBegin = uBegin;
+	event.uEnd = uEnd;
+	event.uBytes = uBytes;
+
+	lock_guard<mutex> lock(s_mtxEvents);
+	s_arrEvents.push_back(event);
+}
+
+bool ZTrace::WriteChromeTrace(const char* szFile)
+{
+	vector<ZTraceEvent> arrEvents;
+	{
+		lock_guard<mutex> lock(s_mtxEvents);
+		arrEvents = s_arrEvents;
+	}
+
+	uint64_t uBase = arrEvents.empty() ? 0 : arrEvents[0].uBegin;
+	for (size_t i = 0; i < arrEvents.size(); i++) {
+		uBase = min(uBase, arrEvents[i].uBegin);
+	}
+
+	// chrome://tracing and Perfetto both read the "X" (complete) event form
+	jvalue jvTrace;
+	jvalue& jvEvents = jvTrace["traceEvents"];
+	jvEvents = jvalue(jvalue::E_ARRAY);
+	for (size_t i = 0; i < arrEvents.size(); i++) {
+		const ZTraceEvent& event = arrEvents[i];
+		jvalue jvEvent;
+		jvEvent["name"] = event.szName;
+		jvEvent["cat"] = "zsign";
+		jvEvent["ph"] = "X";
+		jvEvent["pid"] = 1;
+		jvEvent["tid"] = (int64_t)event.uTid;
+		jvEvent["ts"] = (int64_t)(event.uBegin - uBase);
+		jvEvent["dur"] = (int64_t)(event.uEnd - event.uBegin);
+		if (event.uBytes > 0) {
+			jvEvent["args"]["bytes"] = (int64_t)event.uBytes;
+		}
+		jvEvents.push_back(std::move(jvEvent));
+	}
+	jvTrace["displayTimeUnit"] = "ms";
+	return jvTrace.write_to_file("%s", szFile);
+}
+
+void ZTrace::PrintSummary()
+{
+	struct Phase
+	{
+		uint64_t uCount;
+		uint64_t uTotal;
+		uint64_t uMax;
+		uint64_t uBytes;
+	};
+
+	map<string, Phase> mapPhases;
+	{
+		lock_guard<mutex> lock(s_mtxEvents);
+		for (size_t i = 0; i < s_arrEvents.size(); i++) {
+			const ZTraceEvent& event = s_arrEvents[i];
+			Phase& phase = mapPhases[event.szName];
+			uint64_t uElapse = event.uEnd - event.uBegin;
+			phase.uCount++;
+			phase.uTotal += uElapse;
+			phase.uMax = max(phase.uMax, uElapse);
+			phase.uBytes += event.uBytes;
+		}
+	}
+
+	vector<pair<string, Phase>> arrPhases(mapPhases.begin(), mapPhases.end());
+	sort(arrPhases.begin(), arrPhases.end(), [](const pair<string, Phase>& a, const pair<string, Phase>& b) {
+		return a.second.uTotal > b.second.uTotal;
+	});
+
+	ZLog::PrintV(">>> Trace Summary:\n");
+	ZLog::PrintV("\t%-28s %8s %12s %12s %12s %10s\n", "phase", "count", "total(ms)", "avg(us)", "max(us)", "MB/s");
+	for (size_t i = 0; i < arrPhases.size(); i++) {
+		const Phase& phase = arrPhases[i].second;
+		double dTotalMS = phase.uTotal / 1000.0;
+		double dThroughput = (phase.uBytes > 0 && phase.uTotal > 0) ? (phase.uBytes / (1024.0 * 1024.0)) / (phase.uTotal / 1000000.0) : 0;
+		ZLog::PrintV("\t%-28s %8llu %12.3f %12llu %12llu %10.1f\n",
+						arrPhases[i].first.c_str(),
+						(unsigned long long)phase.uCount,
+						dTotalMS,
+						(unsigned long long)(phase.uTotal / phase.uCount),
+						(unsigned long long)phase.uMax,
+						dThroughput);
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "common.h"
+#include <atomic>
+
+// Span tracing for the signing pipeline. Off by default; when off a span costs one relaxed atomic load,
+// and building with ZSIGN_DISABLE_TRACE compiles every span away.
+class ZTrace
+{
+public:
+#ifdef ZSIGN_DISABLE_TRACE
+	static bool IsEnabled() { return false; }
+#else
+	static bool IsEnabled() { return s_bEnabled.load(memory_order_relaxed); }
+#endif
+	static void Enable(bool bEnable);
+	static void Reset();
+	static uint64_t Now();
+	static void AddSpan(const char* szName, uint64_t uBegin, uint64_t uEnd, uint64_t uBytes);
+
+	static bool WriteChromeTrace(const char* szFile);
+	static void PrintSummary();
+
+private:
+	static atomic<bool> s_bEnabled;
+};
+
+#ifdef ZSIGN_DISABLE_TRACE
+
+// nothing to construct, spans named in code still compile
+class ZTraceSpan
+{
+public:
+	ZTraceSpan(const char* szName, uint64_t uBytes = 0) { (void)szName; (void)uBytes; }
+	void SetBytes(uint64_t uBytes) { (void)uBytes; }
+};
+
+#define ZTRACE_SPAN(name)
+#define ZTRACE_SPAN_BYTES(name, bytes)
+
+#else
+
+class ZTraceSpan
+{
+public:
+	ZTraceSpan(const char* szName, uint64_t uBytes = 0)
+		: m_bActive(ZTrace::IsEnabled()), m_szName(szName), m_uBegin(0), m_uBytes(uBytes)
+	{
+		if (m_bActive) {
+			m_uBegin = ZTrace::Now();
+		}
+	}
+
+	~ZTraceSpan()
+	{
+		if (m_bActive) {
+			ZTrace::AddSpan(m_szName, m_uBegin, ZTrace::Now(), m_uBytes);
+		}
+	}
+
+	void SetBytes(uint64_t uBytes) { m_uBytes = uBytes; }
+
+private:
+	ZTraceSpan(const ZTraceSpan&);
+	ZTraceSpan& operator=(const ZTraceSpan&);
+
+private:
+	bool		m_bActive;
+	const char*	m_szName;
+	uint64_t	m_uBegin;
+	uint64_t	m_uBytes;
+};
+
+#define ZTRACE_CONCAT_(a, b) a##b
+#define ZTRACE_CONCAT(a, b) ZTRACE_CONCAT_(a, b)
+#define ZTRACE_SPAN(name) ZTraceSpan ZTRACE_CONCAT(_ztrace_span_, __LINE__)(name)
+#define ZTRACE_SPAN_BYTES(name, bytes) ZTraceSpan ZTRACE_CONCAT(_ztrace_span_, __LINE__)(name, bytes)
+
+#endif
@@ -36,7 +36,7 @@ bool ZMachO::Free()
 	return CloseFile();
 }
 
-bool ZMachO::NewArchO(uint8_t* pBase, uint32_t uLength)
+bool ZMachO::NewArchO(uint8_t* pBase, uint64_t uLength)
 {
 	ZArchO* archo = new ZArchO();
 	if (archo->Init(pBase, uLength)) {
@@ -60,29 +60,32 @@ void ZMachO::FreeArchOes()
 
 bool ZMachO::OpenFile(const char* szPath)
 {
+	ZTraceSpan span("ZMachO::OpenFile");
 	FreeArchOes();
 
 	m_sSize = 0;
 	m_pBase = (uint8_t*)ZFile::MapFile(szPath, 0, 0, &m_sSize, false);
+	span.SetBytes(m_sSize);
 	if (NULL != m_pBase) {
 		uint32_t magic = *((uint32_t*)m_pBase);
-		if (FAT_CIGAM == magic || FAT_MAGIC == magic) {
-			fat_header* pFatHeader = (fat_header*)m_pBase;
-			int nFatArch = (FAT_MAGIC == magic) ? pFatHeader->nfat_arch : LE(pFatHeader->nfat_arch);
-			for (int i = 0; i < nFatArch; i++) {
-				fat_arch* pFatArch = (fat_arch*)(m_pBase + sizeof(fat_header) + sizeof(fat_arch) * i);
-				uint8_t* pArchBase = m_pBase + ((FAT_MAGIC == magic) ? pFatArch->offset : LE(pFatArch->offset));
-				uint32_t uArchLength = (FAT_MAGIC == magic) ? pFatArch->size : LE(pFatArch->size);
-				if (!NewArchO(pArchBase, uArchLength)) {
+		if (FAT_CIGAM == magic || FAT_MAGIC == magic || FAT_CIGAM_64 == magic || FAT_MAGIC_64 == magic) {
+			vector<fat_arch_64> arrArches;
+			if (!GetFatArches(arrArches)) {
+				ZLog::ErrorV(">>> Invalid fat mach-o file!\n");
+				return false;
+			}
+			for (size_t i = 0; i < arrArches.size(); i++) {
+				if (!NewArchO(m_pBase + arrArches[i].offset, arrArches[i].size)) {
 					ZLog::ErrorV(">>> Invalid arch file in fat mach-o file!\n");
 					return false;
 				}
 			}
 		} else if (MH_MAGIC == magic || MH_CIGAM == magic || MH_MAGIC_64 == magic || MH_CIGAM_64 == magic) {
-			if (!NewArchO(m_pBase, (uint32_t)m_sSize)) {
+			if (!NewArchO(m_pBase, (uint64_t)m_sSize)) {
 				ZLog::ErrorV(">>> Invalid mach-o file!\n");
 				return false;
 			}
+			LoadDirtyRanges();
 		} else {
 			ZLog::ErrorV(">>> Invalid mach-o file (2)!\n");
 			return false;
@@ -92,17 +95,125 @@ bool ZMachO::OpenFile(const char* szPath)
 	return (!m_arrArchOes.empty());
 }
 
+bool ZMachO::GetFatArches(vector<fat_arch_64>& arrArches)
+{
+	arrArches.clear();
+	if (NULL == m_pBase || m_sSize < sizeof(fat_header)) {
+		return false;
+	}
+
+	fat_header* pFatHeader = (fat_header*)m_pBase;
+	bool bNative = (FAT_MAGIC == pFatHeader->magic || FAT_MAGIC_64 == pFatHeader->magic);
+	bool b64 = (FAT_MAGIC_64 == pFatHeader->magic || FAT_CIGAM_64 == pFatHeader->magic);
+	uint32_t nFatArch = bNative ? pFatHeader->nfat_arch : LE(pFatHeader->nfat_arch);
+	size_t sArchSize = b64 ? sizeof(fat_arch_64) : sizeof(fat_arch);
+	if (sizeof(fat_header) + sArchSize * nFatArch > m_sSize) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < nFatArch; i++) {
+		uint8_t* pFatArch = m_pBase + sizeof(fat_header) + sArchSize * i;
+		fat_arch_64 arch;
+		if (b64) {
+			arch = *((fat_arch_64*)pFatArch);
+			if (!bNative) {
+				arch.cputype = (cpu_type_t)LE((uint32_t)arch.cputype);
+				arch.cpusubtype = (cpu_subtype_t)LE((uint32_t)arch.cpusubtype);
+				arch.offset = LE(arch.offset);
+				arch.size = LE(arch.size);
+				arch.align = LE(arch.align);
+			}
+		} else {
+			fat_arch* parch = (fat_arch*)pFatArch;
+			arch.cputype = bNative ? parch->cputype : (cpu_type_t)LE((uint32_t)parch->cputype);
+			arch.cpusubtype = bNative ? parch->cpusubtype : (cpu_subtype_t)LE((uint32_t)parch->cpusubtype);
+			arch.offset = bNative ? parch->offset : LE(parch->offset);
+			arch.size = bNative ? parch->size : LE(parch->size);
+			arch.align = bNative ? parch->align : LE(parch->align);
+		}
+		arch.reserved = 0;
+
+		// the two 64-bit fields could wrap if added
+		if (arch.offset > m_sSize || arch.size > m_sSize - arch.offset) {
+			return false;
+		}
+		arrArches.push_back(arch);
+	}
+	return true;
+}
+
+void ZMachO::BuildFatHeader(vector<fat_arch_64>& arrArches, string& strFatHeader)
+{
+	// lays out the slices (size and align must be set) and writes a big-endian fat header,
+	// switching to fat_arch_64 only when some slice ends past 4GB
+	bool b64 = false;
+	for (int nPass = 0; nPass < 2; nPass++) {
+		uint64_t uOffset = sizeof(fat_header) + arrArches.size() * (b64 ? sizeof(fat_arch_64) : sizeof(fat_arch));
+		bool bOverflow = false;
+		for (size_t i = 0; i < arrArches.size(); i++) {
+			fat_arch_64& arch = arrArches[i];
+			uint64_t uAlign = 1ULL << arch.align;
+			uOffset = (uOffset + uAlign - 1) & ~(uAlign - 1);
+			arch.offset = uOffset;
+			uOffset += arch.size;
+			if (uOffset > UINT32_MAX) {
+				bOverflow = true;
+			}
+		}
+		if (b64 || !bOverflow) {
+			break;
+		}
+		b64 = true;
+	}
+
+	fat_header fath;
+	fath.magic = BE((uint32_t)(b64 ? FAT_MAGIC_64 : FAT_MAGIC));
+	fath.nfat_arch = BE((uint32_t)arrArches.size());
+
+	strFatHeader.clear();
+	strFatHeader.append((const char*)&fath, sizeof(fat_header));
+	for (size_t i = 0; i < arrArches.size(); i++) {
+		fat_arch_64& arch = arrArches[i];
+		if (b64) {
+			fat_arch_64 arch64;
+			arch64.cputype = (cpu_type_t)BE((uint32_t)arch.cputype);
+			arch64.cpusubtype = (cpu_subtype_t)BE((uint32_t)arch.cpusubtype);
+			arch64.offset = BE(arch.offset);
+			arch64.size = BE(arch.size);
+			arch64.align = BE(arch.align);
+			arch64.reserved = 0;
+			strFatHeader.append((const char*)&arch64, sizeof(fat_arch_64));
+		} else {
+			fat_arch arch32;
+			arch32.cputype = (cpu_type_t)BE((uint32_t)arch.cputype);
+			arch32.cpusubtype = (cpu_subtype_t)BE((uint32_t)arch.cpusubtype);
+			arch32.offset = BE((uint32_t)arch.offset);
+			arch32.size = BE((uint32_t)arch.size);
+			arch32.align = BE(arch.align);
+			strFatHeader.append((const char*)&arch32, sizeof(fat_arch));
+		}
+	}
+}
+
 bool ZMachO::CloseFile()
 {
 	if (NULL == m_pBase || m_sSize <= 0) {
 		return false;
 	}
 
+	ZTRACE_SPAN_BYTES("ZMachO::CloseFile", m_sSize);
+
 	if (!ZFile::UnmapFile((void*)m_pBase, m_sSize)) {
 		ZLog::ErrorV(">>> CodeSign write(munmap) failed! Error: %p, %lu, %s\n", m_pBase, m_sSize, strerror(errno));
 		return false;
 	}
-    refreshFile(m_strFile.c_str());
+    {
+        ZTRACE_SPAN("refreshFile");
+        ZMetricsTimer timer(ZMetrics::E_REFRESH_US);
+        ZMetrics::Add(ZMetrics::E_REFRESH_FILES, 1);
+        ZMetrics::Add(ZMetrics::E_REFRESH_BYTES, m_sSize);
+        refreshFile(m_strFile.c_str());
+    }
 	return true;
 }
 
@@ -116,6 +227,21 @@ void ZMachO::PrintInfo()
 
 bool ZMachO::Sign(ZSignAsset* pSignAsset, bool bForce, string strBundleId, string strInfoSHA1, string strInfoSHA256, const string& strCodeResourcesData)
 {
+	string strCodeResourcesSHA1;
+	string strCodeResourcesSHA256;
+	if (strCodeResourcesData.empty()) {
+		strCodeResourcesSHA1.append(20, 0);
+		strCodeResourcesSHA256.append(32, 0);
+	} else {
+		ZSHA::SHA(strCodeResourcesData, strCodeResourcesSHA1, strCodeResourcesSHA256);
+	}
+
+	return Sign(pSignAsset, bForce, strBundleId, strInfoSHA1, strInfoSHA256, strCodeResourcesSHA1, strCodeResourcesSHA256);
+}
+
+bool ZMachO::Sign(ZSignAsset* pSignAsset, bool bForce, string strBundleId, string strInfoSHA1, string strInfoSHA256, const string& strCodeResourcesSHA1, const string& strCodeResourcesSHA256)
+{
+	ZTRACE_SPAN_BYTES("ZMachO::Sign", m_sSize);
 	if (NULL == m_pBase || m_arrArchOes.empty()) {
 		return false;
 	}
@@ -123,9 +249,7 @@ bool ZMachO::Sign(ZSignAsset* pSignAsset, bool bForce, string strBundleId, strin
 	for (size_t i = 0; i < m_arrArchOes.size(); i++) {
 		ZArchO* archo = m_arrArchOes[i];
 		if (strBundleId.empty()) {
-			jvalue jvInfo;
-			jvInfo.read_plist(archo->m_strInfoPlist);
-			strBundleId = jvInfo["CFBundleIdentifier"].as_cstr();
+			strBundleId = jpview(archo->m_strInfoPlist).get_string("CFBundleIdentifier");
 			if (strBundleId.empty()) {
 				strBundleId = ZUtil::GetBaseName(m_strFile.c_str());
 			}
@@ -140,29 +264,83 @@ bool ZMachO::Sign(ZSignAsset* pSignAsset, bool bForce, string strBundleId, strin
 			}
 		}
 
-		if (!archo->Sign(pSignAsset, bForce, strBundleId, strInfoSHA1, strInfoSHA256, strCodeResourcesData)) {
+		if (!archo->Sign(pSignAsset, bForce, strBundleId, strInfoSHA1, strInfoSHA256, strCodeResourcesSHA1, strCodeResourcesSHA256)) {
 			if (!archo->m_bEnoughSpace && !m_bCSRealloced) {
 				m_bCSRealloced = true;
 				if (ReallocCodeSignSpace()) {
-					return Sign(pSignAsset, bForce, strBundleId, strInfoSHA1, strInfoSHA256, strCodeResourcesData);
+					return Sign(pSignAsset, bForce, strBundleId, strInfoSHA1, strInfoSHA256, strCodeResourcesSHA1, strCodeResourcesSHA256);
 				}
 			}
 			return false;
 		}
 	}
 
-	return CloseFile();
+	if (!CloseFile()) {
+		return false;
+	}
+	// every page is covered by the new signature again
+	ZFile::RemoveFileV("%s.zsign_dirty", m_strFile.c_str());
+	return true;
+}
+
+bool ZMachO::LoadDirtyRanges()
+{
+	// "<file>.zsign_dirty" is left by whoever edited an already signed thin binary in place:
+	// a "zsign-dirty 1" line, then one "<offset> <length>" line per edited range.
+	// after a realloc the load commands have moved, so the old page hashes are no use
+	if (m_bCSRealloced || 1 != m_arrArchOes.size()) {
+		return false;
+	}
+
+	string strDirty;
+	if (!ZFile::ReadFileV(strDirty, "%s.zsign_dirty", m_strFile.c_str())) {
+		return false;
+	}
+
+	const char* szLine = strDirty.c_str();
+	if (0 != strncmp(szLine, "zsign-dirty 1\n", 14)) {
+		ZLog::WarnV(">>> Ignoring unknown dirty range file for %s\n", m_strFile.c_str());
+		return false;
+	}
+	szLine += 14;
+
+	vector<pair<uint64_t, uint64_t>> arrRanges;
+	while ('\0' != *szLine) {
+		char* szEnd = NULL;
+		uint64_t uOffset = strtoull(szLine, &szEnd, 10);
+		if (szEnd == szLine || ' ' != *szEnd) {
+			ZLog::WarnV(">>> Invalid dirty range file for %s\n", m_strFile.c_str());
+			return false;
+		}
+		szLine = szEnd + 1;
+		uint64_t uLength = strtoull(szLine, &szEnd, 10);
+		if (szEnd == szLine || '\n' != *szEnd) {
+			ZLog::WarnV(">>> Invalid dirty range file for %s\n", m_strFile.c_str());
+			return false;
+		}
+		szLine = szEnd + 1;
+		if (uLength > 0) {
+			arrRanges.push_back(make_pair(uOffset, uLength));
+		}
+	}
+
+	m_arrArchOes[0]->m_arrDirtyRanges.swap(arrRanges);
+	return true;
 }
 
 bool ZMachO::ReallocCodeSignSpace()
 {
+	ZTRACE_SPAN_BYTES("ZMachO::ReallocCodeSignSpace", m_sSize);
+	ZMetricsTimer timer(ZMetrics::E_REALLOC_US);
+	ZMetrics::Add(ZMetrics::E_REALLOC_FILES, 1);
+	ZMetrics::Add(ZMetrics::E_REALLOC_BYTES, m_sSize);
 	ZLog::Warn(">>> Realloc CodeSignature space... \n");
 
-	vector<uint32_t> arrMachOesSizes;
+	vector<uint64_t> arrMachOesSizes;
 	for (size_t i = 0; i < m_arrArchOes.size(); i++) {
 		string strNewArchOFile;
 		ZUtil::StringFormatV(strNewArchOFile, "%s.archo.%d", m_strFile.c_str(), i);
-		uint32_t uNewLength = m_arrArchOes[i]->ReallocCodeSignSpace(strNewArchOFile);
+		uint64_t uNewLength = m_arrArchOes[i]->ReallocCodeSignSpace(strNewArchOFile);
 		if (uNewLength <= 0) {
 			ZLog::Error(">>> Failed!\n");
 			return false;
@@ -179,50 +357,27 @@ bool ZMachO::ReallocCodeSignSpace()
 			return OpenFile(m_strFile.c_str());
 		}
 	} else { //fat
-		uint32_t uAlign = 16384;
-		vector<fat_arch> arrArches;
-		fat_header fath = *((fat_header*)m_pBase);
-		int nFatArch = (FAT_MAGIC == fath.magic) ? fath.nfat_arch : LE(fath.nfat_arch);
-		for (int i = 0; i < nFatArch; i++) {
-			fat_arch arch = *((fat_arch*)(m_pBase + sizeof(fat_header) + sizeof(fat_arch) * i));
-			arrArches.push_back(arch);
-		}
+		vector<fat_arch_64> arrArches;
+		GetFatArches(arrArches);
 		CloseFile();
 
 		if (arrArches.size() != m_arrArchOes.size()) {
 			return false;
 		}
 
-		uint32_t uFatHeaderSize = sizeof(fat_header) + (uint32_t)arrArches.size() * sizeof(fat_arch);
-		uint32_t uPadding1 = (uAlign - uFatHeaderSize % uAlign);
-		uint32_t uOffset = uFatHeaderSize + uPadding1;
 		for (size_t i = 0; i < arrArches.size(); i++) {
-			fat_arch& arch = arrArches[i];
-			uint32_t& uMachOSize = arrMachOesSizes[i];
-
-			arch.align = (FAT_MAGIC == fath.magic) ? 14 : BE((uint32_t)14);
-			arch.offset = (FAT_MAGIC == fath.magic) ? uOffset : BE(uOffset);
-			arch.size = (FAT_MAGIC == fath.magic) ? uMachOSize : BE(uMachOSize);
-
-			uOffset += uMachOSize;
-			uOffset = uOffset + (uAlign - uOffset % uAlign);
+			arrArches[i].align = 14;
+			arrArches[i].size = arrMachOesSizes[i];
 		}
 
-		string strNewFatMachOFile = m_strFile + ".fato";
-
 		string strFatHeader;
-		strFatHeader.append((const char*)&fath, sizeof(fat_header));
-		for (size_t i = 0; i < arrArches.size(); i++) {
-			fat_arch& arch = arrArches[i];
-			strFatHeader.append((const char*)&arch, sizeof(fat_arch));
-		}
-
-		string strPadding1;
-		strPadding1.append(uPadding1, 0);
+		BuildFatHeader(arrArches, strFatHeader);
 
+		string strNewFatMachOFile = m_strFile + ".fato";
+		ZFile::RemoveFile(strNewFatMachOFile.c_str());
 		ZFile::AppendFile(strNewFatMachOFile.c_str(), strFatHeader);
-		ZFile::AppendFile(strNewFatMachOFile.c_str(), strPadding1);
 
+		uint64_t uWritten = strFatHeader.size();
 		for (size_t i = 0; i < arrArches.size(); i++) {
 			size_t sSize = 0;
 			string strNewArchOFile = m_strFile + ".archo." + jvalue((int)i).as_string();
@@ -232,10 +387,11 @@ bool ZMachO::ReallocCodeSignSpace()
 				return false;
 			}
 			string strPadding;
-			strPadding.append((uAlign - sSize % uAlign), 0);
+			strPadding.append((size_t)(arrArches[i].offset - uWritten), 0);
 
-			ZFile::AppendFile(strNewFatMachOFile.c_str(), (const char*)pData, sSize);
 			ZFile::AppendFile(strNewFatMachOFile.c_str(), strPadding);
+			ZFile::AppendFile(strNewFatMachOFile.c_str(), (const char*)pData, sSize);
+			uWritten = arrArches[i].offset + sSize;
 
 			ZFile::UnmapFile((void*)pData, sSize);
 			ZFile::RemoveFile(strNewArchOFile.c_str());
@@ -250,6 +406,100 @@ bool ZMachO::ReallocCodeSignSpace()
 	return false;
 }
 
+bool ZMachO::Thin(const set<string>& setArches)
+{
+	ZTRACE_SPAN_BYTES("ZMachO::Thin", m_sSize);
+	if (NULL == m_pBase || setArches.empty() || m_arrArchOes.size() <= 1) {
+		return true;
+	}
+
+	vector<size_t> arrKeepIndexes;
+	for (size_t i = 0; i < m_arrArchOes.size(); i++) {
+		if (setArches.count(m_arrArchOes[i]->GetArchName()) > 0) {
+			arrKeepIndexes.push_back(i);
+		}
+	}
+
+	if (arrKeepIndexes.size() == m_arrArchOes.size()) {
+		return true;
+	}
+
+	if (arrKeepIndexes.empty()) { // never drop every slice, sign it as is
+		ZLog::WarnV(">>> Thin: no requested arch found, keep all slices. %s\n", m_strFile.c_str());
+		return true;
+	}
+
+	ZLog::WarnV(">>> Thin: %s (%d -> %d arches)\n", m_strFile.c_str(), (int)m_arrArchOes.size(), (int)arrKeepIndexes.size());
+
+	struct stat st;
+	if (0 != stat(m_strFile.c_str(), &st)) {
+		ZLog::ErrorV(">>> Thin: stat failed! %s, %s\n", m_strFile.c_str(), strerror(errno));
+		return false;
+	}
+
+	string strNewFile = m_strFile + ".thin";
+	ZFile::RemoveFile(strNewFile.c_str());
+
+	if (1 == arrKeepIndexes.size()) {
+		ZArchO* archo = m_arrArchOes[arrKeepIndexes[0]];
+		if (!ZFile::WriteFile(strNewFile.c_str(), (const char*)archo->m_pBase, (size_t)archo->m_uLength)) {
+			ZLog::ErrorV(">>> Thin: write failed! %s\n", strNewFile.c_str());
+			return false;
+		}
+	} else {
+		vector<fat_arch_64> arrAllArches;
+		if (!GetFatArches(arrAllArches) || arrAllArches.size() != m_arrArchOes.size()) {
+			ZLog::ErrorV(">>> Thin: invalid fat header! %s\n", m_strFile.c_str());
+			return false;
+		}
+
+		vector<fat_arch_64> arrArches;
+		for (size_t i = 0; i < arrKeepIndexes.size(); i++) {
+			arrArches.push_back(arrAllArches[arrKeepIndexes[i]]);
+		}
+
+		string strFatHeader;
+		BuildFatHeader(arrArches, strFatHeader);
+		if (!ZFile::WriteFile(strNewFile.c_str(), strFatHeader)) {
+			ZLog::ErrorV(">>> Thin: write failed! %s\n", strNewFile.c_str());
+			return false;
+		}
+
+		uint64_t uWritten = strFatHeader.size();
+		for (size_t i = 0; i < arrArches.size(); i++) {
+			ZArchO* archo = m_arrArchOes[arrKeepIndexes[i]];
+			string strPadding;
+			strPadding.append((size_t)(arrArches[i].offset - uWritten), 0);
+			if (!ZFile::AppendFile(strNewFile.c_str(), strPadding) ||
+				!ZFile::AppendFile(strNewFile.c_str(), (const char*)archo->m_pBase, (size_t)archo->m_uLength)) {
+				ZLog::ErrorV(">>> Thin: write failed! %s\n", strNewFile.c_str());
+				ZFile::RemoveFile(strNewFile.c_str());
+				return false;
+			}
+			uWritten = arrArches[i].offset + archo->m_uLength;
+		}
+	}
+
+	// the new file replaces the old one, so it keeps its mode (+x on executables)
+	if (0 != chmod(strNewFile.c_str(), st.st_mode & 07777)) {
+		ZLog::ErrorV(">>> Thin: chmod failed! %s, %s\n", strNewFile.c_str(), strerror(errno));
+		ZFile::RemoveFile(strNewFile.c_str());
+		return false;
+	}
+
+	// nothing was written through the mapping, so skip the refreshFile() done by CloseFile()
+	ZFile::UnmapFile((void*)m_pBase, m_sSize);
+	FreeArchOes();
+
+	if (0 != rename(strNewFile.c_str(), m_strFile.c_str())) {
+		ZLog::ErrorV(">>> Thin: rename failed! %s, %s\n", m_strFile.c_str(), strerror(errno));
+		ZFile::RemoveFile(strNewFile.c_str());
+		OpenFile(m_strFile.c_str());
+		return false;
+	}
+	return OpenFile(m_strFile.c_str());
+}
+
 bool ZMachO::InjectDylib(bool bWeakInject, const char* szDylibFile)
 {
 	ZLog::WarnV(">>> InjectDylib: %s %s... \n", szDylibFile, bWeakInject ? "(weak)" : "");
@@ -265,6 +515,15 @@ bool ZMachO::InjectDylib(bool bWeakInject, const char* szDylibFile)
 	return true;
 }
 
+void ZMachO::GetCDHashes(vector<string>& arrCDHashes)
+{
+	arrCDHashes.clear();
+	for (size_t i = 0; i < m_arrArchOes.size(); i++) {
+		ZArchO* archo = m_arrArchOes[i];
+		arrCDHashes.insert(arrCDHashes.end(), archo->m_arrCDHashes.begin(), archo->m_arrCDHashes.end());
+	}
+}
+
 bool is_64bit_macho(const char *filepath) {
     FILE *file = fopen(filepath, "rb");
     if (!file) {
@@ -276,5 +535,5 @@ bool is_64bit_macho(const char *filepath) {
     fclose(file);
 
     // check 64-bit Mach-O magic number
-    return magic == MH_MAGIC_64 || magic == FAT_CIGAM;
+    return magic == MH_MAGIC_64 || magic == FAT_CIGAM || magic == FAT_CIGAM_64;
 }
@@ -18,15 +18,27 @@ public:
 				string strInfoSHA1, 
 				string strInfoSHA256, 
 				const string& strCodeResourcesData);
+	bool Sign(ZSignAsset* pSignAsset,
+				bool bForce, 
+				string strBundleId, 
+				string strInfoSHA1, 
+				string strInfoSHA256, 
+				const string& strCodeResourcesSHA1, 
+				const string& strCodeResourcesSHA256);
 	bool InjectDylib(bool bWeakInject, const char* szDylibFile);
+	bool Thin(const set<string>& setArches);
+	void GetCDHashes(vector<string>& arrCDHashes);
 
 private:
 	bool OpenFile(const char* szPath);
 	bool CloseFile();
 
-	bool NewArchO(uint8_t* pBase, uint32_t uLength);
+	bool NewArchO(uint8_t* pBase, uint64_t uLength);
+	bool GetFatArches(vector<fat_arch_64>& arrArches);
+	static void BuildFatHeader(vector<fat_arch_64>& arrArches, string& strFatHeader);
 	void FreeArchOes();
 	bool ReallocCodeSignSpace();
+	bool LoadDirtyRanges();
 
 private:
 	size_t			m_sSize;
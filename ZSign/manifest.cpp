@@ -0,0 +1,198 @@
+#include "manifest.h"
+#include "macho.h"
+
+const char* ZManifest::s_szFileName = "zsign_manifest.json";
+const int ZManifest::s_nVersion = 2;
+
+ZManifest::ZManifest()
+{
+}
+
+void ZManifest::Begin(ZSignAsset* pSignAsset)
+{
+	m_jvManifest.clear();
+	m_jvManifest["version"] = s_nVersion;
+	m_jvManifest["team_id"] = (NULL != pSignAsset) ? pSignAsset->m_strTeamId : "";
+	m_jvManifest["expiration"] = (int64_t)((NULL != pSignAsset) ? pSignAsset->GetExpirationDate() : 0);
+	m_jvManifest["files"] = jvalue(jvalue::E_OBJECT);
+}
+
+static int64_t GetMTime(const struct stat& st)
+{
+#ifdef __APPLE__
+	return (int64_t)st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+	return (int64_t)st.st_mtime * 1000000000LL;
+#else
+	return (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+}
+
+bool ZManifest::GetFileIdentity(const char* szFile, jvalue& jvIdentity)
+{
+	struct stat st;
+	if (0 != stat(szFile, &st) || !S_ISREG(st.st_mode)) {
+		return false;
+	}
+
+	int64_t nMTime = GetMTime(st);
+
+	jvIdentity["dev"] = (int64_t)st.st_dev;
+	jvIdentity["ino"] = (int64_t)st.st_ino;
+	jvIdentity["size"] = (int64_t)st.st_size;
+	jvIdentity["mtime"] = nMTime;
+	return true;
+}
+
+bool ZManifest::GetFolderMTime(const char* szFolder, int64_t& nMTime)
+{
+	struct stat st;
+	if (0 != stat(szFolder, &st) || !S_ISDIR(st.st_mode)) {
+		return false;
+	}
+	nMTime = GetMTime(st);
+	return true;
+}
+
+// the same test GetObjectsToSign uses to pick what gets signed, for files the manifest doesn't know
+bool ZManifest::HasUnsignedMachO(const string& strAppFolder, const string& strFolder, bool bRecursive, const jvalue& jvManifest)
+{
+	bool bFound = false;
+	ZFile::EnumFolder(strFolder.c_str(), bRecursive, NULL, [&](bool bFolder, const string& strPath) {
+		if (bFound) {
+			return true;
+		}
+		string strNode = strPath.substr(strAppFolder.size() + 1);
+		if (bFolder) {
+			// a folder that wasn't there at signing time, nothing in it has been signed
+			if (!bRecursive && !jvManifest["folders"].has(strNode)) {
+				bFound = HasUnsignedMachO(strAppFolder, strPath, true, jvManifest);
+			}
+		} else if (!jvManifest["files"].has(strNode) && (ZFile::IsPathSuffix(strPath, ".dylib") || is_64bit_macho(strPath.c_str()))) {
+			ZLog::DebugV(">>> Manifest missing new file: %s\n", strNode.c_str());
+			bFound = true;
+		}
+		return bFound;
+	});
+	return bFound;
+}
+
+bool ZManifest::AddFile(const string& strAppFolder, const string& strFile, const vector<string>& arrCDHashes)
+{
+	// the identity has to be taken after signing, refreshFile() gives the binary a new inode
+	string strPath = strAppFolder + "/" + strFile;
+	jvalue jvFile;
+	if (!GetFileIdentity(strPath.c_str(), jvFile)) {
+		ZLog::WarnV(">>> Can't stat signed file for manifest! %s\n", strPath.c_str());
+		return false;
+	}
+
+	jvFile["cdhashes"] = jvalue(jvalue::E_ARRAY);
+	for (size_t i = 0; i < arrCDHashes.size(); i++) {
+		jvFile["cdhashes"].push_back(arrCDHashes[i]);
+	}
+	m_jvManifest["files"][strFile] = std::move(jvFile);
+	return true;
+}
+
+bool ZManifest::Save(const string& strAppFolder)
+{
+	if (m_jvManifest.is_null()) {
+		return false;
+	}
+
+	// folder mtimes tell IsSigned where files were added or removed since, so it only looks for
+	// unsigned Mach-Os there. writing the manifest itself touches the root, that one is always looked at
+	jvalue& jvFolders = m_jvManifest["folders"];
+	jvFolders = jvalue(jvalue::E_OBJECT);
+	int64_t nMTime = 0;
+	if (GetFolderMTime(strAppFolder.c_str(), nMTime)) {
+		jvFolders["."] = nMTime;
+	}
+	ZFile::EnumFolder(strAppFolder.c_str(), true, NULL, [&](bool bFolder, const string& strPath) {
+		if (bFolder && GetFolderMTime(strPath.c_str(), nMTime)) {
+			jvFolders[strPath.substr(strAppFolder.size() + 1)] = nMTime;
+		}
+		return false;
+	});
+	return m_jvManifest.style_write_to_file("%s/%s", strAppFolder.c_str(), s_szFileName);
+}
+
+bool ZManifest::Remove(const string& strAppFolder)
+{
+	return ZFile::RemoveFileV("%s/%s", strAppFolder.c_str(), s_szFileName);
+}
+
+bool ZManifest::IsSigned(const string& strAppFolder, const string& strTeamId)
+{
+	jvalue jvManifest;
+	if (!jvManifest.read_from_file("%s/%s", strAppFolder.c_str(), s_szFileName)) {
+		return false;
+	}
+
+	if (s_nVersion != jvManifest["version"].as_int() || !jvManifest["files"].is_object() || !jvManifest["folders"].is_object()) {
+		return false;
+	}
+
+	if (!strTeamId.empty() && strTeamId != jvManifest["team_id"]) {
+		ZLog::DebugV(">>> Manifest team id mismatch: %s != %s\n", jvManifest["team_id"].as_cstr(), strTeamId.c_str());
+		return false;
+	}
+
+	int64_t nExpiration = jvManifest["expiration"].as_int64();
+	if (nExpiration > 0 && nExpiration <= (int64_t)time(NULL)) {
+		ZLog::DebugV(">>> Manifest certificate expired: %lld\n", (long long)nExpiration);
+		return false;
+	}
+
+	vector<string> arrFiles;
+	jvManifest["files"].get_keys(arrFiles);
+	if (arrFiles.empty()) {
+		return false;
+	}
+
+	size_t nVerified = 0;
+	for (size_t i = 0; i < arrFiles.size(); i++) {
+		const string& strFile = arrFiles[i];
+		string strPath = strAppFolder + "/" + strFile;
+
+		jvalue jvIdentity;
+		if (!GetFileIdentity(strPath.c_str(), jvIdentity)) {
+			if (ZFile::IsFileExists(strPath.c_str())) {
+				return false;
+			}
+			continue; // removed after signing (e.g. the temporary Geode.tmp executable), nothing left to verify
+		}
+
+		const jvalue& jvFile = jvManifest["files"][strFile];
+		if (jvIdentity["dev"].as_int64() != jvFile["dev"].as_int64() ||
+			jvIdentity["ino"].as_int64() != jvFile["ino"].as_int64() ||
+			jvIdentity["size"].as_int64() != jvFile["size"].as_int64() ||
+			jvIdentity["mtime"].as_int64() != jvFile["mtime"].as_int64()) {
+			ZLog::DebugV(">>> Manifest file changed: %s\n", strFile.c_str());
+			return false;
+		}
+		nVerified++;
+	}
+
+	// a manifest whose files are all gone vouches for nothing
+	if (0 == nVerified) {
+		return false;
+	}
+
+	// Mach-Os added after signing: only folders whose entries changed since can hold one
+	vector<string> arrFolders;
+	jvManifest["folders"].get_keys(arrFolders);
+	for (size_t i = 0; i < arrFolders.size(); i++) {
+		const string& strFolder = arrFolders[i];
+		string strPath = ("." == strFolder) ? strAppFolder : (strAppFolder + "/" + strFolder);
+		int64_t nMTime = 0;
+		if (!GetFolderMTime(strPath.c_str(), nMTime) || nMTime == jvManifest["folders"][strFolder].as_int64()) {
+			continue; // a removed folder took its files with it, see above
+		}
+		if (HasUnsignedMachO(strAppFolder, strPath, false, jvManifest)) {
+			return false;
+		}
+	}
+	return true;
+}
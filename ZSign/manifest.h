@@ -0,0 +1,34 @@
+#pragma once
+#include "common/common.h"
+#include "common/json.h"
+#include "openssl.h"
+
+// Signed-state manifest written next to zsign_cache.json after a successful sign.
+// Answering "does anything need signing?" only needs one read of it, a stat of each recorded file and folder,
+// and a look for new Mach-Os in the folders whose contents changed since.
+class ZManifest
+{
+public:
+	ZManifest();
+
+public:
+	void Begin(ZSignAsset* pSignAsset);
+	bool AddFile(const string& strAppFolder, const string& strFile, const vector<string>& arrCDHashes);
+	bool Save(const string& strAppFolder);
+
+public:
+	static bool Remove(const string& strAppFolder);
+	static bool IsSigned(const string& strAppFolder, const string& strTeamId);
+
+private:
+	static bool GetFileIdentity(const char* szFile, jvalue& jvIdentity);
+	static bool GetFolderMTime(const char* szFolder, int64_t& nMTime);
+	static bool HasUnsignedMachO(const string& strAppFolder, const string& strFolder, bool bRecursive, const jvalue& jvManifest);
+
+public:
+	static const char* s_szFileName;
+	static const int s_nVersion;
+
+private:
+	jvalue m_jvManifest;
+};
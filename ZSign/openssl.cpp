@@ -371,6 +371,45 @@ string ZSignAsset::ASN1_TIMEtoString(const void* time)
 	return strTime;
 }
 
+time_t ZSignAsset::ASN1_TIMEtoTime(const void* time)
+{
+	if (NULL == time) {
+		return 0;
+	}
+
+#if OPENSSL_VERSION_NUMBER < 0x10101000L
+	int nDays = 0;
+	int nSeconds = 0;
+	if (!ASN1_TIME_diff(&nDays, &nSeconds, NULL, (const ASN1_TIME*)time)) {
+		return 0;
+	}
+	return ::time(NULL) + (time_t)nDays * 86400 + nSeconds;
+#else
+	struct tm tmTime;
+	memset(&tmTime, 0, sizeof(tmTime));
+	if (!ASN1_TIME_to_tm((const ASN1_TIME*)time, &tmTime)) {
+		return 0;
+	}
+	return timegm(&tmTime);
+#endif
+}
+
+time_t ZSignAsset::GetExpirationDate()
+{
+	time_t tExpiration = expirationDate;
+	if (NULL != m_x509Cert) {
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+		time_t tCertExpiration = ASN1_TIMEtoTime(X509_get_notAfter((X509*)m_x509Cert));
+#else
+		time_t tCertExpiration = ASN1_TIMEtoTime(X509_get0_notAfter((X509*)m_x509Cert));
+#endif
+		if (tCertExpiration > 0 && (tExpiration <= 0 || tCertExpiration < tExpiration)) {
+			tExpiration = tCertExpiration;
+		}
+	}
+	return tExpiration;
+}
+
 bool ZSignAsset::GetCertInfo(void* pcert, jvalue & jvCertInfo)
 {
 	if (!pcert) {
@@ -562,6 +601,7 @@ ZSignAsset::ZSignAsset()
 	m_bAdhoc = false;
 	m_bSingleBinary = false;
 	m_bSHA256Only = false;
+	expirationDate = 0;
 }
 
 bool ZSignAsset::Init(
@@ -22,6 +22,7 @@ public:
 						const string& strCodeDirectorySlotSHA1, 
 						const string& strAltnateCodeDirectorySlot256, 
 						string& strCMSOutput);
+	time_t GetExpirationDate();
 
 private:
 	bool GenerateCMS(void* pscert, 
@@ -43,6 +44,7 @@ public:
 	static bool		GetCMSContent(const string& strCMSDataInput, string& strContentOutput);
 	static void		ParseCertSubject(const string& strSubject, jvalue& jvSubject);
 	static string	ASN1_TIMEtoString(const void* time);
+	static time_t	ASN1_TIMEtoTime(const void* time);
 
 public:
 	bool	m_bAdhoc;
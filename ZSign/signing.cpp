@@ -4,82 +4,208 @@
 #include "openssl.h"
 #include "signing.h"
 
-void ZSign::_DERLength(string& strBlob, uint64_t uLength)
+// DER entitlements are encoded in two passes: _DERMeasure walks the tree once and records the
+// content length of every constructed node in pre-order, then _DERWrite fills one preallocated buffer.
+// dictionary members come out of the std::map in byte order of their keys, which is the canonical
+// key order CoreEntitlements expects for its binary search.
+uint32_t ZSign::_DERLengthSize(uint64_t uLength)
 {
 	if (uLength < 128) {
-		strBlob.append(1, (char)uLength);
+		return 1;
+	}
+	return 1 + (64 - ZUtil::builtin_clzll(uLength) + 7) / 8;
+}
+
+uint8_t* ZSign::_DERWriteHeader(uint8_t* pOutput, uint8_t uTag, uint64_t uLength)
+{
+	*pOutput++ = uTag;
+	if (uLength < 128) {
+		*pOutput++ = (uint8_t)uLength;
 	} else {
 		uint32_t sLength = (64 - ZUtil::builtin_clzll(uLength) + 7) / 8;
-		strBlob.append(1, (char)(0x80 | sLength));
+		*pOutput++ = (uint8_t)(0x80 | sLength);
 		sLength *= 8;
 		do {
-			strBlob.append(1, (char)(uLength >> (sLength -= 8)));
+			*pOutput++ = (uint8_t)(uLength >> (sLength -= 8));
 		} while (sLength != 0);
 	}
+	return pOutput;
 }
 
-string ZSign::_DER(const jvalue& data)
+uint32_t ZSign::_DERIntegerSize(int64_t nValue)
 {
-	string strOutput;
+	// minimal two's complement
+	uint32_t sLength = 1;
+	while (sLength < 8) {
+		int64_t nLimit = (int64_t)1 << (sLength * 8 - 1);
+		if (nValue >= -nLimit && nValue < nLimit) {
+			break;
+		}
+		sLength++;
+	}
+	return sLength;
+}
+
+uint32_t ZSign::_DERRealSize(double dValue, uint8_t* pContent)
+{
+	// X.690 8.5, base 2 binary encoding as required by DER
+	if (0 == dValue) {
+		if (signbit(dValue)) {
+			pContent[0] = 0x43; // minus zero
+			return 1;
+		}
+		return 0;
+	} else if (isnan(dValue)) {
+		pContent[0] = 0x42;
+		return 1;
+	} else if (isinf(dValue)) {
+		pContent[0] = (dValue > 0) ? 0x40 : 0x41;
+		return 1;
+	}
+
+	int nExponent = 0;
+	double dMantissa = frexp(fabs(dValue), &nExponent);
+	uint64_t uMantissa = (uint64_t)ldexp(dMantissa, 53);
+	nExponent -= 53;
+	while (0 == (uMantissa & 1)) {
+		uMantissa >>= 1;
+		nExponent++;
+	}
+
+	uint32_t sExponent = _DERIntegerSize(nExponent);
+	uint32_t sMantissa = (64 - ZUtil::builtin_clzll(uMantissa) + 7) / 8;
+	uint32_t uPos = 0;
+	pContent[uPos++] = (uint8_t)(0x80 | ((dValue < 0) ? 0x40 : 0) | (sExponent - 1));
+	for (uint32_t i = sExponent; i > 0; i--) {
+		pContent[uPos++] = (uint8_t)(nExponent >> ((i - 1) * 8));
+	}
+	for (uint32_t i = sMantissa; i > 0; i--) {
+		pContent[uPos++] = (uint8_t)(uMantissa >> ((i - 1) * 8));
+	}
+	return uPos;
+}
+
+uint64_t ZSign::_DERMeasure(const jvalue& data, vector<uint64_t>& arrLengths)
+{
+	uint64_t uContent = 0;
 	if (data.is_bool()) {
-		strOutput.append(1, 0x01);
-		strOutput.append(1, 1);
-		strOutput.append(1, data.as_bool() ? 1 : 0);
+		uContent = 1;
 	} else if (data.is_int()) {
-		uint64_t uVal = data.as_int64();
-		strOutput.append(1, 0x02);
-		_DERLength(strOutput, uVal);
-
-		uint32_t sLength = (64 - ZUtil::builtin_clzll(uVal) + 7) / 8;
-		sLength *= 8;
-		do {
-			strOutput.append(1, (char)(uVal >> (sLength -= 8)));
-		} while (sLength != 0);
+		uContent = _DERIntegerSize(data.as_int64());
 	} else if (data.is_string()) {
-		string strVal = data.as_cstr();
-		strOutput.append(1, 0x0c);
-		_DERLength(strOutput, strVal.size());
-		strOutput += strVal;
+		uContent = strlen(data.as_cstr());
+	} else if (data.is_double()) {
+		uint8_t content[16];
+		uContent = _DERRealSize(data.as_double(), content);
+	} else if (data.is_date()) {
+		uContent = 15; // YYYYMMDDHHMMSSZ
+	} else if (data.is_data()) {
+		uContent = data.as_data().size();
 	} else if (data.is_array()) {
-		string strArray;
-		size_t size = data.size();
-		for (size_t i = 0; i < size; i++) {
-			strArray += _DER(data[i]);
+		size_t uSlot = arrLengths.size();
+		arrLengths.push_back(0);
+		for (size_t i = 0; i < data.size(); i++) {
+			uContent += _DERMeasure(data[i], arrLengths);
 		}
-		strOutput.append(1, 0x30);
-		_DERLength(strOutput, strArray.size());
-		strOutput += strArray;
+		arrLengths[uSlot] = uContent;
 	} else if (data.is_object()) {
-		string strDict;
-		vector<string> arrKeys;
-		data.get_keys(arrKeys);
-		for (size_t i = 0; i < arrKeys.size(); i++) {
-			string& strKey = arrKeys[i];
-			string strVal = _DER(data[strKey]);
-
-			strDict.append(1, 0x30);
-			_DERLength(strDict, (2 + strKey.size() + strVal.size()));
-
-			strDict.append(1, 0x0c);
-			_DERLength(strDict, strKey.size());
-			strDict += strKey;
-
-			strDict += strVal;
+		size_t uSlot = arrLengths.size();
+		arrLengths.push_back(0);
+		const map<string, jvalue>* pMembers = data.get_members();
+		if (NULL != pMembers) {
+			for (auto it = pMembers->begin(); it != pMembers->end(); ++it) {
+				size_t uEntrySlot = arrLengths.size();
+				arrLengths.push_back(0);
+				uint64_t uEntry = 1 + _DERLengthSize(it->first.size()) + it->first.size();
+				uEntry += _DERMeasure(it->second, arrLengths);
+				arrLengths[uEntrySlot] = uEntry;
+				uContent += 1 + _DERLengthSize(uEntry) + uEntry;
+			}
 		}
+		arrLengths[uSlot] = uContent;
+	} else {
+		ZLog::Warn(">>> Unsupported entitlements DER type, encoded as NULL!\n");
+	}
+	return 1 + _DERLengthSize(uContent) + uContent;
+}
 
-		strOutput.append(1, 0x31);
-		_DERLength(strOutput, strDict.size());
-		strOutput += strDict;
+uint8_t* ZSign::_DERWrite(const jvalue& data, const vector<uint64_t>& arrLengths, size_t& uIndex, uint8_t* pOutput)
+{
+	if (data.is_bool()) {
+		pOutput = _DERWriteHeader(pOutput, 0x01, 1);
+		*pOutput++ = data.as_bool() ? 1 : 0;
+	} else if (data.is_int()) {
+		int64_t nVal = data.as_int64();
+		uint32_t sLength = _DERIntegerSize(nVal);
+		pOutput = _DERWriteHeader(pOutput, 0x02, sLength);
+		for (uint32_t i = sLength; i > 0; i--) {
+			*pOutput++ = (uint8_t)(nVal >> ((i - 1) * 8));
+		}
+	} else if (data.is_string()) {
+		const char* szVal = data.as_cstr();
+		size_t sLength = strlen(szVal);
+		pOutput = _DERWriteHeader(pOutput, 0x0c, sLength);
+		memcpy(pOutput, szVal, sLength);
+		pOutput += sLength;
 	} else if (data.is_double()) {
-		assert(false);
+		uint8_t content[16];
+		uint32_t sLength = _DERRealSize(data.as_double(), content);
+		pOutput = _DERWriteHeader(pOutput, 0x09, sLength);
+		memcpy(pOutput, content, sLength);
+		pOutput += sLength;
 	} else if (data.is_date()) {
-		assert(false);
+		time_t tDate = data.as_date();
+		struct tm tmDate;
+#ifdef _WIN32
+		gmtime_s(&tmDate, &tDate);
+#else
+		gmtime_r(&tDate, &tmDate);
+#endif
+		char szDate[32] = { 0 };
+		snprintf(szDate, sizeof(szDate), "%04d%02d%02d%02d%02d%02dZ",
+					tmDate.tm_year + 1900, tmDate.tm_mon + 1, tmDate.tm_mday, tmDate.tm_hour, tmDate.tm_min, tmDate.tm_sec);
+		pOutput = _DERWriteHeader(pOutput, 0x18, 15);
+		memcpy(pOutput, szDate, 15);
+		pOutput += 15;
 	} else if (data.is_data()) {
-		assert(false);
+		string strData = data.as_data();
+		pOutput = _DERWriteHeader(pOutput, 0x04, strData.size());
+		memcpy(pOutput, strData.data(), strData.size());
+		pOutput += strData.size();
+	} else if (data.is_array()) {
+		pOutput = _DERWriteHeader(pOutput, 0x30, arrLengths[uIndex++]);
+		for (size_t i = 0; i < data.size(); i++) {
+			pOutput = _DERWrite(data[i], arrLengths, uIndex, pOutput);
+		}
+	} else if (data.is_object()) {
+		pOutput = _DERWriteHeader(pOutput, 0x31, arrLengths[uIndex++]);
+		const map<string, jvalue>* pMembers = data.get_members();
+		if (NULL != pMembers) {
+			for (auto it = pMembers->begin(); it != pMembers->end(); ++it) {
+				pOutput = _DERWriteHeader(pOutput, 0x30, arrLengths[uIndex++]);
+				pOutput = _DERWriteHeader(pOutput, 0x0c, it->first.size());
+				memcpy(pOutput, it->first.data(), it->first.size());
+				pOutput += it->first.size();
+				pOutput = _DERWrite(it->second, arrLengths, uIndex, pOutput);
+			}
+		}
 	} else {
-		assert(false && "Unsupported Entitlements DER Type");
+		pOutput = _DERWriteHeader(pOutput, 0x05, 0);
 	}
+	return pOutput;
+}
+
+string ZSign::_DER(const jvalue& data)
+{
+	vector<uint64_t> arrLengths;
+	uint64_t uSize = _DERMeasure(data, arrLengths);
 
+	string strOutput;
+	strOutput.resize(uSize);
+	size_t uIndex = 0;
+	uint8_t* pEnd = _DERWrite(data, arrLengths, uIndex, (uint8_t*)&strOutput[0]);
+	assert(pEnd == (uint8_t*)&strOutput[0] + uSize);
+	(void)pEnd;
 	return strOutput;
 }
 
@@ -371,7 +497,7 @@ bool ZSign::SlotParseCodeDirectory(uint8_t* pSlotBase, CS_BlobIndex* pbi)
 
 bool ZSign::SlotBuildCodeDirectory(bool bAlternate,
 	uint8_t* pCodeBase,
-	uint32_t uCodeLength,
+	uint64_t uCodeLength,
 	uint8_t* pCodeSlotsData,
 	uint32_t uCodeSlotsDataLength,
 	uint64_t execSegLimit,
@@ -387,6 +513,7 @@ bool ZSign::SlotBuildCodeDirectory(bool bAlternate,
 	bool isAdhoc,
 	string& strOutput)
 {
+	ZTRACE_SPAN_BYTES("ZSign::SlotBuildCodeDirectory", uCodeLength);
 	strOutput.clear();
 	if (NULL == pCodeBase || uCodeLength <= 0 || strBundleId.empty() || (strTeamId.empty() && !isAdhoc)) {
 		return false;
@@ -404,7 +531,12 @@ bool ZSign::SlotBuildCodeDirectory(bool bAlternate,
 	cdHeader.identOffset = 0;
 	cdHeader.nSpecialSlots = 0;
 	cdHeader.nCodeSlots = 0;
-	cdHeader.codeLimit = BE(uCodeLength);
+	if (uCodeLength > UINT32_MAX) { // codeLimit64 takes over once the code range no longer fits 32 bits
+		cdHeader.codeLimit = BE((uint32_t)UINT32_MAX);
+		cdHeader.codeLimit64 = BE(uCodeLength);
+	} else {
+		cdHeader.codeLimit = BE((uint32_t)uCodeLength);
+	}
 	cdHeader.hashSize = bAlternate ? 32 : 20;
 	cdHeader.hashType = bAlternate ? 2 : 1;
 	cdHeader.spare1 = 0;
@@ -441,8 +573,8 @@ bool ZSign::SlotBuildCodeDirectory(bool bAlternate,
 	}
 
 	uint32_t uPageSize = (uint32_t)pow(2, cdHeader.pageSize);
-	uint32_t uPages = uCodeLength / uPageSize;
-	uint32_t uRemain = uCodeLength % uPageSize;
+	uint32_t uPages = (uint32_t)(uCodeLength / uPageSize);
+	uint32_t uRemain = (uint32_t)(uCodeLength % uPageSize);
 	uint32_t uCodeSlots = uPages + (uRemain > 0 ? 1 : 0);
 
 	uint32_t uHeaderLength = 44;
@@ -507,22 +639,41 @@ bool ZSign::SlotBuildCodeDirectory(bool bAlternate,
 
 	if (NULL != pCodeSlotsData && (uCodeSlotsDataLength == uCodeSlots * cdHeader.hashSize)) { //use exists
 		strOutput.append((const char*)pCodeSlotsData, uCodeSlotsDataLength);
+		ZMetrics::Add(ZMetrics::E_PAGES_REUSED, uCodeSlots);
 	} else {
+		ZMetricsTimer timer(ZMetrics::E_PAGES_US);
+		ZMetrics::Add(ZMetrics::E_PAGES_HASHED, uCodeSlots);
+
+		// large binaries: hash window by window and let the kernel drop what's behind us,
+		// so resident memory stays around the stream cap instead of the whole mapping
+		uint64_t uMemoryCap = ZSHA::GetStreamMemoryCap();
+		bool bBounded = (uMemoryCap > 0 && uCodeLength > uMemoryCap);
+		uint32_t uWindowPages = bBounded ? (uint32_t)max((uint64_t)1, uMemoryCap / 2 / uPageSize) : 0;
+		if (bBounded) {
+			ZFile::AdviseMapSequential(pCodeBase, (size_t)uCodeLength);
+		}
+
+		strOutput.reserve(strOutput.size() + uCodeSlotsLength);
 		for (uint32_t i = 0; i < uPages; i++) {
 			string strSHASum;
 			if (1 == cdHeader.hashType) {
-				ZSHA::SHA1(pCodeBase + uPageSize * i, uPageSize, strSHASum);
+				ZSHA::SHA1(pCodeBase + (uint64_t)uPageSize * i, uPageSize, strSHASum);
 			} else  {
-				ZSHA::SHA256(pCodeBase + uPageSize * i, uPageSize, strSHASum);
+				ZSHA::SHA256(pCodeBase + (uint64_t)uPageSize * i, uPageSize, strSHASum);
 			} 
 			strOutput.append(strSHASum.data(), strSHASum.size());
+
+			if (bBounded && (i + 1) % uWindowPages == 0) {
+				uint64_t uWindowBegin = (uint64_t)(i + 1 - uWindowPages) * uPageSize;
+				ZFile::AdviseMapDone(pCodeBase + uWindowBegin, (size_t)uWindowPages * uPageSize);
+			}
 		}
 		if (uRemain > 0) {
 			string strSHASum;
 			if (1 == cdHeader.hashType) {
-				ZSHA::SHA1(pCodeBase + uPageSize * uPages, uRemain, strSHASum);
+				ZSHA::SHA1(pCodeBase + (uint64_t)uPageSize * uPages, uRemain, strSHASum);
 			} else {
-				ZSHA::SHA256(pCodeBase + uPageSize * uPages, uRemain, strSHASum);
+				ZSHA::SHA256(pCodeBase + (uint64_t)uPageSize * uPages, uRemain, strSHASum);
 			}
 			strOutput.append(strSHASum.data(), strSHASum.size());
 		}
@@ -588,11 +739,59 @@ bool ZSign::SlotParseCMSSignature(uint8_t* pSlotBase, CS_BlobIndex* pbi)
 	return true;
 }
 
+bool ZSign::SlotRehashDirtyPages(bool bAlternate,
+	uint8_t* pCodeBase,
+	uint64_t uCodeLength,
+	const uint8_t* pCodeSlotsData,
+	uint32_t uCodeSlotsDataLength,
+	const vector<pair<uint64_t, uint64_t>>& arrDirtyRanges,
+	string& strOutput)
+{
+	// the existing code slots with only the pages under the dirty ranges hashed again,
+	// fails if the slots weren't made for this code length and page size
+	strOutput.clear();
+	uint32_t uHashSize = bAlternate ? 32 : 20;
+	uint64_t uPageSize = 4096;
+	uint64_t uCodeSlots = (uCodeLength + uPageSize - 1) / uPageSize;
+	if (NULL == pCodeBase || NULL == pCodeSlotsData || uCodeSlotsDataLength != uCodeSlots * uHashSize) {
+		return false;
+	}
+
+	set<uint64_t> setPages;
+	for (size_t i = 0; i < arrDirtyRanges.size(); i++) {
+		uint64_t uBegin = arrDirtyRanges[i].first;
+		if (uBegin >= uCodeLength || 0 == arrDirtyRanges[i].second) {
+			continue;
+		}
+		uint64_t uEnd = uBegin + min(arrDirtyRanges[i].second, uCodeLength - uBegin);
+		for (uint64_t uPage = uBegin / uPageSize; uPage <= (uEnd - 1) / uPageSize; uPage++) {
+			setPages.insert(uPage);
+		}
+	}
+
+	ZMetricsTimer timer(ZMetrics::E_PAGES_US);
+	ZMetrics::Add(ZMetrics::E_PAGES_HASHED, setPages.size());
+	strOutput.assign((const char*)pCodeSlotsData, uCodeSlotsDataLength);
+	for (set<uint64_t>::iterator it = setPages.begin(); it != setPages.end(); it++) {
+		uint64_t uOffset = *it * uPageSize;
+		uint64_t uSize = min(uPageSize, uCodeLength - uOffset);
+		string strSHASum;
+		if (bAlternate) {
+			ZSHA::SHA256(pCodeBase + uOffset, uSize, strSHASum);
+		} else {
+			ZSHA::SHA1(pCodeBase + uOffset, uSize, strSHASum);
+		}
+		strOutput.replace((size_t)(*it * uHashSize), uHashSize, strSHASum);
+	}
+	return true;
+}
+
 bool ZSign::SlotBuildCMSSignature(ZSignAsset* pSignAsset,
 	const string& strCodeDirectorySlot,
 	const string& strAltnateCodeDirectorySlot,
 	string& strOutput)
 {
+	ZTRACE_SPAN("ZSign::SlotBuildCMSSignature");
 	strOutput.clear();
 	if (pSignAsset->m_bAdhoc) { // The empty CSSLOT_SIGNATURESLOT
 		uint8_t ldid[] = { 0xfa, 0xde, 0x0b, 0x01, 0x00, 0x00, 0x00, 0x08 };
@@ -612,6 +811,8 @@ bool ZSign::SlotBuildCMSSignature(ZSignAsset* pSignAsset,
 	jvHashes["cdhashes"][1].assign_data(strAltnateCodeDirectorySlot256.data(), cdHashSize);
 	jvHashes.style_write_plist(strCDHashesPlist);
 
+	ZMetricsTimer timer(ZMetrics::E_CMS_US);
+	ZMetrics::Add(ZMetrics::E_CMS_SIGNATURES, 1);
 	string strCMSData;
 	if (!pSignAsset->GenerateCMS(strCodeDirectorySlot, strCDHashesPlist, strCodeDirectorySlotSHA1, strAltnateCodeDirectorySlot256, strCMSData)) {
 		return false;
@@ -626,6 +827,29 @@ bool ZSign::SlotBuildCMSSignature(ZSignAsset* pSignAsset,
 	return true;
 }
 
+bool ZSign::GetCDHash(const string& strCodeDirectorySlot, bool bSHA256, string& strCDHash)
+{
+	strCDHash.clear();
+	if (strCodeDirectorySlot.empty()) {
+		return false;
+	}
+
+	string strSHASum;
+	if (bSHA256) {
+		ZSHA::SHA256(strCodeDirectorySlot, strSHASum);
+	} else {
+		ZSHA::SHA1(strCodeDirectorySlot, strSHASum);
+	}
+
+	// cdhash is the code directory digest truncated to 20 bytes
+	char buf[16] = { 0 };
+	for (size_t i = 0; i < strSHASum.size() && i < 20; i++) {
+		snprintf(buf, sizeof(buf), "%02x", (uint8_t)strSHASum[i]);
+		strCDHash += buf;
+	}
+	return (!strCDHash.empty());
+}
+
 uint32_t ZSign::GetCodeSignatureLength(uint8_t* pCSBase)
 {
 	CS_SuperBlob* psb = (CS_SuperBlob*)pCSBase;
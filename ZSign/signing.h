@@ -11,7 +11,7 @@ public:
 	static bool SlotBuildRequirements(const string& strBundleID, const string& strSubjectCN, string& strOutput);
 	static bool SlotBuildCodeDirectory(bool bAlternate,
 										uint8_t* pCodeBase,
-										uint32_t uCodeLength,
+										uint64_t uCodeLength,
 										uint8_t* pCodeSlotsData,
 										uint32_t uCodeSlotsDataLength,
 										uint64_t execSegLimit,
@@ -27,6 +27,14 @@ public:
 										bool isAdhoc,
 										string& strOutput);
 	
+	static bool SlotRehashDirtyPages(bool bAlternate,
+										uint8_t* pCodeBase,
+										uint64_t uCodeLength,
+										const uint8_t* pCodeSlotsData,
+										uint32_t uCodeSlotsDataLength,
+										const vector<pair<uint64_t, uint64_t>>& arrDirtyRanges,
+										string& strOutput);
+	
 	static bool SlotBuildCMSSignature(ZSignAsset* pSignAsset,
 										const string& strCodeDirectorySlot,
 										const string& strAltnateCodeDirectorySlot,
@@ -43,9 +51,15 @@ public:
 													uint8_t*& pCodeSlots256Data,
 													uint32_t& uCodeSlots256DataLength);
 	static uint32_t GetCodeSignatureLength(uint8_t* pCSBase);
+	static bool GetCDHash(const string& strCodeDirectorySlot, bool bSHA256, string& strCDHash);
 
 	static string _DER(const jvalue& data);
-	static void _DERLength(string& strBlob, uint64_t uLength);
+	static uint64_t _DERMeasure(const jvalue& data, vector<uint64_t>& arrLengths);
+	static uint8_t* _DERWrite(const jvalue& data, const vector<uint64_t>& arrLengths, size_t& uIndex, uint8_t* pOutput);
+	static uint8_t* _DERWriteHeader(uint8_t* pOutput, uint8_t uTag, uint64_t uLength);
+	static uint32_t _DERLengthSize(uint64_t uLength);
+	static uint32_t _DERIntegerSize(int64_t nValue);
+	static uint32_t _DERRealSize(double dValue, uint8_t* pContent);
 
 	static bool ParseCodeSignature(uint8_t* pCSBase);
 	static bool SlotParseEntitlements(uint8_t* pSlotBase, CS_BlobIndex* pbi);
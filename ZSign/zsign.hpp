@@ -34,6 +34,21 @@ void zsign(NSString *appPath,
           NSProgress* progress,
           void(^completionHandler)(BOOL success, NSError *error)
           );
+// Fast "already signed" query: reads zsign_manifest.json and stats the recorded binaries, no Mach-O parsing.
+// teamId may be nil to skip the team check.
+bool isAppSigned(NSString *appPath,
+                 NSString *teamId);
+
+// Cumulative counters across signs: bytes hashed, pages hashed/reused, files hashed/cached, CMS signatures,
+// refreshFile and realloc copies, with the time spent in each. Returned as a JSON object of name -> number.
+NSString* getSignMetrics(void);
+uint64_t getSignMetric(NSString *name);
+void resetSignMetrics(void);
+
+// Deletes a folder tree with a pool of workers. async renames it aside first and deletes it in the background,
+// so the path is free as soon as this returns.
+bool removeFolder(NSString *folderPath, bool async);
+
 NSString* getTeamId(NSData *prov,
                     NSData *key,
                     NSString *pass);
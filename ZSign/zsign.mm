@@ -4,6 +4,7 @@
 #include "openssl.h"
 #include "macho.h"
 #include "bundle.h"
+#include "manifest.h"
 #include <libgen.h>
 #include <dirent.h>
 #include <getopt.h>
@@ -45,6 +46,12 @@ NSError* makeErrorFromLog(const std::vector<std::string>& vec) {
     return [NSError errorWithDomain:@"Failed to Sign" code:-1 userInfo:userInfo];
 }
 
+NSError* makeErrorFromRecentLog() {
+    vector<string> arrLines;
+    ZLog::GetRecentErrors(arrLines);
+    return makeErrorFromLog(arrLines);
+}
+
 ZSignAsset zSignAsset;
 
 void zsign(NSString *appPath,
@@ -58,6 +65,13 @@ void zsign(NSString *appPath,
     ZTimer gtimer;
     ZTimer timer;
     timer.Reset();
+
+    // ZSIGN_TRACE=<file.json> records spans for this sign and exports them as a Chrome trace
+    const char* szTraceFile = getenv("ZSIGN_TRACE");
+    if (NULL != szTraceFile && 0 != szTraceFile[0]) {
+        ZTrace::Reset();
+        ZTrace::Enable(true);
+    }
     
 	bool bForce = false;
 	bool bWeakInject = false;
@@ -77,13 +91,14 @@ void zsign(NSString *appPath,
 	
 	string strPath = [appPath cStringUsingEncoding:NSUTF8StringEncoding];
     
-    ZLog::logs.clear();
+    ZLog::ClearRecentErrors();
 
 	__block ZSignAsset zSignAsset;
 	
     if (!zSignAsset.InitSimple(strPKeyFileData, (int)[key length], strProvFileData, (int)[prov length], strPassword)) {
-        completionHandler(NO, makeErrorFromLog(ZLog::logs));
-        ZLog::logs.clear();
+        ZLog::Flush();
+        completionHandler(NO, makeErrorFromRecentLog());
+        ZLog::ClearRecentErrors();
 		return;
 	}
     
@@ -94,11 +109,17 @@ void zsign(NSString *appPath,
 	bool success = bundle.ConfigureFolderSign(&zSignAsset, strFolder, "", "", "", strDyLibFile, bForce, bWeakInject, bEnableCache, bDontGenerateEmbeddedMobileProvision);
 
     if(!success) {
-        completionHandler(NO, makeErrorFromLog(ZLog::logs));
-        ZLog::logs.clear();
+        ZLog::Flush();
+        completionHandler(NO, makeErrorFromRecentLog());
+        ZLog::ClearRecentErrors();
         return;
     }
     
+    // only arm64 is ever loaded, don't hash and CMS-sign slices for other arches
+    set<string> setThinArches;
+    setThinArches.insert("arm64");
+    bundle.SetThinArches(setThinArches);
+
     int filesNeedToSign = bundle.GetSignCount();
     [progress setTotalUnitCount:filesNeedToSign];
     bundle.progressHandler = [&progress] {
@@ -112,6 +133,14 @@ void zsign(NSString *appPath,
     bool bRet = bundle.StartSign(bEnableCache);
     timer.PrintResult(bRet, ">>> Signed %s!", bRet ? "OK" : "Failed");
     gtimer.Print(">>> Done.");
+    string strMetrics;
+    ZMetrics::GetJson(strMetrics);
+    ZLog::PrintV(">>> Metrics: \t%s\n", strMetrics.c_str());
+    if (ZTrace::IsEnabled()) {
+        ZTrace::Enable(false);
+        ZTrace::PrintSummary();
+        ZTrace::WriteChromeTrace(szTraceFile);
+    }
     NSError* signError = nil;
     if(!bundle.signFailedFiles.empty()) {
         NSDictionary* userInfo = @{
@@ -120,12 +149,41 @@ void zsign(NSString *appPath,
         signError = [NSError errorWithDomain:@"Failed to Sign" code:-1 userInfo:userInfo];
     }
     
+    ZLog::Flush();
     completionHandler(YES, signError);
-    ZLog::logs.clear();
+    ZLog::ClearRecentErrors();
     
 	return;
 }
 
+bool isAppSigned(NSString *appPath,
+                 NSString *teamId) {
+    string strPath = [appPath cStringUsingEncoding:NSUTF8StringEncoding];
+    string strTeamId = teamId ? [teamId cStringUsingEncoding:NSUTF8StringEncoding] : "";
+    return ZManifest::IsSigned(strPath, strTeamId);
+}
+
+NSString* getSignMetrics(void) {
+    string strMetrics;
+    ZMetrics::GetJson(strMetrics);
+    return [NSString stringWithUTF8String:strMetrics.c_str()];
+}
+
+uint64_t getSignMetric(NSString *name) {
+    uint64_t uValue = 0;
+    ZMetrics::Get([name UTF8String], uValue);
+    return uValue;
+}
+
+void resetSignMetrics(void) {
+    ZMetrics::Reset();
+}
+
+bool removeFolder(NSString *folderPath, bool async) {
+    const char* szFolder = [folderPath fileSystemRepresentation];
+    return async ? ZFile::RemoveFolderAsync(szFolder) : ZFile::RemoveFolder(szFolder);
+}
+
 NSString* getTeamId(NSData *prov,
                     NSData *key,
                     NSString *pass) {
@@ -135,13 +193,13 @@ NSString* getTeamId(NSData *prov,
     const char* strProvFileData = (const char*)[prov bytes];
     strPassword = [pass cStringUsingEncoding:NSUTF8StringEncoding];
 
-    ZLog::logs.clear();
+    ZLog::ClearRecentErrors();
 
 
     __block ZSignAsset zSignAsset;
 
     if (!zSignAsset.InitSimple(strPKeyFileData, (int)[key length], strProvFileData, (int)[prov length], strPassword)) {
-        ZLog::logs.clear();
+        ZLog::ClearRecentErrors();
         return nil;
     }
     NSString* teamId = [NSString stringWithUTF8String:zSignAsset.m_strTeamId.c_str()];
@@ -157,13 +215,13 @@ int checkCert(NSData *prov,
     const char* strProvFileData = (const char*)[prov bytes];
     string strPassword = [pass cStringUsingEncoding:NSUTF8StringEncoding];
     
-    ZLog::logs.clear();
+    ZLog::ClearRecentErrors();
 
 
     __block ZSignAsset zSignAsset;
     
     if (!zSignAsset.InitSimple(strPKeyFileData, (int)[key length], strProvFileData, (int)[prov length], strPassword)) {
-        ZLog::logs.clear();
+        ZLog::ClearRecentErrors();
         completionHandler(2, nil, @"Unable to initialize certificate. Please check your password.");
         return -1;
     }
@@ -11,4 +11,9 @@
 // this method is used to get teamId for ADP/Enterprise certs ,don't use it in normal jitless
 + (NSString*)getTeamIdWithProv:(NSData *)prov key:(NSData *)key pass:(NSString *)pass;
 + (int)checkCertWithProv:(NSData *)prov key:(NSData *)key pass:(NSString *)pass ocsp:(BOOL)ocsp completionHandler:(void(^)(int status, NSDate* expirationDate, NSString *error))completionHandler;
++ (BOOL)isSignedWithAppPath:(NSString *)appPath teamId:(NSString *)teamId;
++ (NSString*)signMetrics;
++ (uint64_t)signMetricWithName:(NSString *)name;
++ (void)resetSignMetrics;
++ (BOOL)removeFolderAtPath:(NSString *)path async:(BOOL)async;
 @end
@@ -27,4 +27,19 @@ NSProgress* currentZSignProgress;
     //return checkCert(prov, key, pass, ocsp, completionHandler);
     return checkCert(prov, key, pass, NO, completionHandler);
 }
++ (BOOL)isSignedWithAppPath:(NSString *)appPath teamId:(NSString *)teamId {
+    return isAppSigned(appPath, teamId);
+}
++ (NSString*)signMetrics {
+    return getSignMetrics();
+}
++ (uint64_t)signMetricWithName:(NSString *)name {
+    return getSignMetric(name);
+}
++ (void)resetSignMetrics {
+    resetSignMetrics();
+}
++ (BOOL)removeFolderAtPath:(NSString *)path async:(BOOL)async {
+    return removeFolder(path, async);
+}
 @end
@@ -203,7 +203,7 @@
 
 	NSString* executablePath = [appPath stringByAppendingPathComponent:infoPlist[@"CFBundleExecutable"]];
 	if (!forceSign) {
-		bool signatureValid = checkCodeSignature(executablePath.UTF8String);
+		bool signatureValid = [LCUtils isAppBundleSigned:appPath] || checkCodeSignature(executablePath.UTF8String);
 		if (signatureValid) {
 			// not expired, don't sign again
 			completetionHandler(YES, nil);
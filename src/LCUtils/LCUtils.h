@@ -29,6 +29,7 @@ void refreshFile(NSString* execPath);
 + (BOOL)launchToGuestApp;
 
 + (NSProgress*)signAppBundleWithZSign:(NSURL*)path completionHandler:(void (^)(BOOL success, NSError* error))completionHandler;
++ (BOOL)isAppBundleSigned:(NSString*)path;
 + (BOOL)isAppGroupAltStoreLike;
 + (NSString*)getCertTeamIdWithKeyData:(NSData*)keyData password:(NSString*)password;
 + (int)validateCertificate:(void (^)(int status, NSDate* expirationDate, NSString* error))completionHandler;
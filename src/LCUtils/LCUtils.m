@@ -169,6 +169,53 @@ Class LCSharedUtilsClass = nil;
 	return ans;
 }
 
++ (BOOL)isAppBundleSigned:(NSString*)path {
+	NSError* error;
+	[self loadStoreFrameworksWithError2:&error];
+	Class signer = NSClassFromString(@"ZSigner");
+	if (error || ![signer respondsToSelector:@selector(isSignedWithAppPath:teamId:)]) {
+		return NO;
+	}
+	// the manifest only vouches for the certificate it was signed with, after a certificate change
+	// it doesn't match and checkCodeSignature gets the final say
+	NSData* certData = [self certificateData];
+	if (!certData) {
+		return NO;
+	}
+	// parsing the PKCS12 costs more than the check itself, so the team ID is kept per certificate
+	static NSMutableDictionary<NSArray*, NSString*>* teamIds;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{ teamIds = [NSMutableDictionary new]; });
+	NSString* password = [self certificatePassword];
+	NSArray* certKey = @[ certData, password ?: @"" ];
+	NSString* teamId;
+	@synchronized(teamIds) {
+		teamId = teamIds[certKey];
+	}
+	if (!teamId) {
+		teamId = [self getCertTeamIdWithKeyData:certData password:password];
+		if (teamId.length == 0) {
+			return NO;
+		}
+		@synchronized(teamIds) {
+			teamIds[certKey] = teamId;
+		}
+	}
+	// answered from zsign_manifest.json: stats the signed binaries and each folder, and only lists
+	// the folders changed since signing to look for Mach-Os added after it
+	return [signer isSignedWithAppPath:path teamId:teamId];
+}
+
+// renames the folder aside and deletes it on ZSign's worker pool, falls back to NSFileManager if ZSign isn't loaded
++ (void)removeFolderInBackground:(NSURL*)url {
+	NSError* error;
+	[self loadStoreFrameworksWithError2:&error];
+	Class signer = NSClassFromString(@"ZSigner");
+	if (error || ![signer respondsToSelector:@selector(removeFolderAtPath:async:)] || ![signer removeFolderAtPath:url.path async:YES]) {
+		[[NSFileManager defaultManager] removeItemAtURL:url error:nil];
+	}
+}
+
 + (NSString*)getCertTeamIdWithKeyData:(NSData*)keyData password:(NSString*)password {
 	NSError* error;
 
@@ -422,7 +469,7 @@ Class LCSharedUtilsClass = nil;
 		return completion(nil);
 	NSURL* tmpDir = [[fm temporaryDirectory] URLByAppendingPathComponent:@"TweakTmp.app"];
 	if ([fm fileExistsAtPath:tmpDir.path]) {
-		[fm removeItemAtURL:tmpDir error:nil];
+		[self removeFolderInBackground:tmpDir];
 	}
 	[fm createDirectoryAtURL:tmpDir withIntermediateDirectories:YES attributes:nil error:nil];
 	NSMutableArray* tmpPaths = [NSMutableArray array];
@@ -448,7 +495,7 @@ Class LCSharedUtilsClass = nil;
 		[fm copyItemAtURL:fileURL toURL:tmpPath error:nil];
 	}
 	if ([tmpPaths count] == 0) {
-		[fm removeItemAtURL:tmpDir error:nil];
+		[self removeFolderInBackground:tmpDir];
 		return completion(nil);
 	}
 	[self signFilesInFolder:tmpDir onProgressCreated:progressHandler completion:^(NSString* error) {
@@ -467,7 +514,7 @@ Class LCSharedUtilsClass = nil;
 			[fileInodes addObject:inodeNumber];
 			[newTweakSignInfo setObject:inodeNumber forKey:tmpFile.lastPathComponent];
 		}
-		[fm removeItemAtURL:tmpDir error:nil];
+		[self removeFolderInBackground:tmpDir];
 		[newTweakSignInfo writeToURL:[tweakFolderUrl URLByAppendingPathComponent:@"TweakInfo.plist"] atomically:YES];
 		completion(nil);
 	}];
@@ -560,7 +607,7 @@ Class LCSharedUtilsClass = nil;
 		return completion(nil);
 	NSURL* tmpDir = [[fm temporaryDirectory] URLByAppendingPathComponent:@"ModTmp.app"];
 	if ([fm fileExistsAtPath:tmpDir.path]) {
-		[fm removeItemAtURL:tmpDir error:nil];
+		[self removeFolderInBackground:tmpDir];
 	}
 	[fm createDirectoryAtURL:tmpDir withIntermediateDirectories:YES attributes:nil error:nil];
 	NSMutableArray<NSURL*>* tmpPaths = [NSMutableArray array];
@@ -588,7 +635,7 @@ Class LCSharedUtilsClass = nil;
 		}
 	}
 	if ([tmpPaths count] == 0) {
-		[fm removeItemAtURL:tmpDir error:nil];
+		[self removeFolderInBackground:tmpDir];
 		return completion(nil);
 	}
 	[self signFilesInFolder:tmpDir onProgressCreated:progressHandler completion:^(NSString* error) {
@@ -613,7 +660,7 @@ Class LCSharedUtilsClass = nil;
 				[newTweakSignInfo setObject:inodeNumber forKey:tmpFile.lastPathComponent];
 			}
 		}
-		[fm removeItemAtURL:tmpDir error:nil];
+		[self removeFolderInBackground:tmpDir];
 		[newTweakSignInfo writeToURL:[tweakFolderUrl URLByAppendingPathComponent:@"ModInfo.plist"] atomically:YES];
 		completion(nil);
 	}];
@@ -24,8 +24,12 @@ static int copy_data(struct archive* ar, struct archive* aw, NSProgress* progres
 			fprintf(stderr, "%s\n", archive_error_string(aw));
 			return (r);
 		}
-		progress.completedUnitCount += size;
-		completedUnitCount += size;
+		// progress follows the compressed bytes consumed, so the archive never has to be read twice
+		la_int64_t consumed = archive_filter_bytes(ar, -1);
+		if (consumed > totalUnitCount)
+			consumed = totalUnitCount;
+		progress.completedUnitCount = consumed;
+		completedUnitCount = consumed;
 	}
 }
 
@@ -58,41 +62,34 @@ int extract(NSString* fileToExtract, NSString* extractionPath, NSProgress* progr
 	flags |= ARCHIVE_EXTRACT_PERM;
 	flags |= ARCHIVE_EXTRACT_ACL;
 	flags |= ARCHIVE_EXTRACT_FFLAGS;
+	// entries land in a staging directory first, ".." must not get them out of it
+	flags |= ARCHIVE_EXTRACT_SECURE_NODOTDOT;
+
+	// Progress is measured against the archive size instead of a separate pass over every header
+	struct stat st;
+	if (stat(fileToExtract.fileSystemRepresentation, &st) == 0) {
+		totalUnitCount = st.st_size;
+		progress.totalUnitCount = st.st_size;
+	}
 
-	// Calculate decompressed size
 	a = archive_read_new();
 	archive_read_support_format_all(a);
 	archive_read_support_filter_all(a);
-	if ((r = archive_read_open_filename(a, fileToExtract.fileSystemRepresentation, 10240))) {
+	if ((r = archive_read_open_filename(a, fileToExtract.fileSystemRepresentation, 1024 * 1024))) {
 		archive_read_free(a);
 		AppLog(@"Failed to open archive: %@", fileToExtract);
 		forceProgress = true;
 		return 1;
 	}
-	while ((r = archive_read_next_header(a, &entry)) != ARCHIVE_EOF) {
-		if (r < ARCHIVE_OK) {
-			fprintf(stderr, "%s\n", archive_error_string(a));
-			AppLog(@"Error reading archive header: %s", archive_error_string(a));
-		}
-		if (r < ARCHIVE_WARN) {
-			archive_read_close(a);
-			archive_read_free(a);
-			AppLog(@"Archive warning: %s", archive_error_string(a));
-			return 1;
-		}
-		totalUnitCount += archive_entry_size(entry);
-		progress.totalUnitCount += archive_entry_size(entry);
-	}
-	archive_read_close(a);
-	archive_read_free(a);
-
-	// Re-open the archive and extract
-	a = archive_read_new();
-	archive_read_support_format_all(a);
-	archive_read_support_filter_all(a);
-	if ((r = archive_read_open_filename(a, fileToExtract.fileSystemRepresentation, 10240))) {
+	// callers often extract straight into the temporary directory, next to whatever an earlier run left there.
+	// everything goes into a fresh directory beside it and only moves into place once the whole archive made it,
+	// so a failed extraction neither leaves a partial tree that looks extracted nor touches what was there before
+	NSFileManager* fm = [NSFileManager defaultManager];
+	NSString* stagingPath = [extractionPath stringByAppendingPathComponent:[NSString stringWithFormat:@".extract-%@", [NSUUID UUID].UUIDString]];
+	if (![fm createDirectoryAtPath:stagingPath withIntermediateDirectories:YES attributes:nil error:nil]) {
+		archive_read_close(a);
 		archive_read_free(a);
-		AppLog(@"Failed to reopen archive for extraction: %@", fileToExtract);
+		AppLog(@"Failed to create staging directory in %@", extractionPath);
 		forceProgress = true;
 		return 1;
 	}
@@ -100,6 +97,7 @@ int extract(NSString* fileToExtract, NSString* extractionPath, NSProgress* progr
 	archive_write_disk_set_options(ext, flags);
 	archive_write_disk_set_standard_lookup(ext);
 
+	BOOL failed = NO;
 	while ((r = archive_read_next_header(a, &entry)) != ARCHIVE_EOF) {
 		if (r == ARCHIVE_EOF)
 			break;
@@ -107,11 +105,15 @@ int extract(NSString* fileToExtract, NSString* extractionPath, NSProgress* progr
 			fprintf(stderr, "%s\n", archive_error_string(a));
 			AppLog(@"Error reading header: %s", archive_error_string(a));
 		}
-		if (r < ARCHIVE_WARN)
+		if (r < ARCHIVE_WARN) {
+			// without a sizing pass headers are only checked as they come
+			AppLog(@"Archive warning: %s", archive_error_string(a));
+			failed = YES;
 			break;
+		}
 
 		NSString* currentFile = [NSString stringWithUTF8String:archive_entry_pathname(entry)];
-		NSString* fullOutputPath = [extractionPath stringByAppendingPathComponent:currentFile];
+		NSString* fullOutputPath = [stagingPath stringByAppendingPathComponent:currentFile];
 		// printf("extracting %@ to %@\n", currentFile, fullOutputPath);
 		archive_entry_set_pathname(entry, fullOutputPath.fileSystemRepresentation);
 
@@ -125,21 +127,52 @@ int extract(NSString* fileToExtract, NSString* extractionPath, NSProgress* progr
 				fprintf(stderr, "%s\n", archive_error_string(ext));
 				AppLog(@"Error copying data: %s", archive_error_string(ext));
 			}
-			if (r < ARCHIVE_WARN)
+			if (r < ARCHIVE_WARN) {
+				failed = YES;
 				break;
+			}
 		}
 		r = archive_write_finish_entry(ext);
 		if (r < ARCHIVE_OK) {
 			fprintf(stderr, "%s\n", archive_error_string(ext));
 			AppLog(@"Error finishing entry: %s", archive_error_string(ext));
 		}
-		if (r < ARCHIVE_WARN)
+		if (r < ARCHIVE_WARN) {
+			failed = YES;
 			break;
+		}
 	}
 	archive_read_close(a);
 	archive_read_free(a);
 	archive_write_close(ext);
 	archive_write_free(ext);
 
+	// each top-level item replaces the one of the same name, a rename since the staging directory is on the same volume
+	if (!failed) {
+		NSError* error = nil;
+		NSArray<NSString*>* items = [fm contentsOfDirectoryAtPath:stagingPath error:&error];
+		if (!items) {
+			AppLog(@"Failed to list extracted files: %@", error);
+			failed = YES;
+		}
+		for (NSString* item in items) {
+			NSString* target = [extractionPath stringByAppendingPathComponent:item];
+			[fm removeItemAtPath:target error:nil];
+			if (![fm moveItemAtPath:[stagingPath stringByAppendingPathComponent:item] toPath:target error:&error]) {
+				AppLog(@"Failed to move %@ into place: %@", item, error);
+				failed = YES;
+				break;
+			}
+		}
+	}
+	[fm removeItemAtPath:stagingPath error:nil];
+	if (failed) {
+		forceProgress = true;
+		return 1;
+	}
+
+	completedUnitCount = totalUnitCount;
+	progress.completedUnitCount = progress.totalUnitCount;
+	forceProgress = true;
 	return 0;
 }
@@ -3,7 +3,6 @@
 
 @interface Patcher : NSObject
 @property(class, nonatomic, strong) NSMutableArray<NSNumber*>* patchedFuncs;
-@property(class, nonatomic, strong) NSMutableDictionary<NSString*, NSData*>* originalBytes;
 
 + (void)startUnzip:(void (^)(NSString* doForce))completionHandler;
 + (void)patchGDBinary:(NSURL*)from
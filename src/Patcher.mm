@@ -5,16 +5,18 @@
 #import "Utils.h"
 #import "components/LogUtils.h"
 #import "src/LCUtils/Shared.h"
+#include "patch/FunctionStarts.hpp"
+#include "patch/HookEngine.hpp"
+#include "patch/MachOEditor.hpp"
+#include "patch/PatchIndex.hpp"
+#include "patch/PatchJournal.hpp"
+#include "patch/PatchPlan.hpp"
+#include "patch/SymbolResolver.hpp"
 #import <mach-o/dyld.h>
 #import <mach-o/loader.h>
 
 
 #include <dlfcn.h>
-// change to 0x1692, and max is 0x7fff
-#define TEXT_OFFSET 0x8050
-// #define TEXT_OFFSET 0x8a8000
-#define TEXT_MAX 0x10000
-// used to be 0x4000
 
 #import <mach-o/dyld.h>
 #import <mach-o/loader.h>
@@ -30,51 +32,35 @@ static uint32_t findImageIndex(const char* dylibName) {
 	return UINT32_MAX;
 }
 
-// sorry but dlsym is NOT working and its giving me a headache, so lets just go through all symbols
-void* findSymbolAddr(const char* targetMangledName) {
+// sorry but dlsym is NOT working and its giving me a headache, so lets read the image ourselves
+// every name is resolved in one go (export trie, then one pass over the symbol table for the rest), cached by the image's uuid
+static bool findSymbolAddrs(std::vector<std::string> const& targetMangledNames, std::vector<void*>& addrs) {
 	uint32_t idx = findImageIndex("libTulipHook.dylib");
 	if (idx == UINT32_MAX) {
 		AppLog(@"Failed to load TulipHook: couldn't find image index");
-		return nullptr;
+		return false;
 	}
 
 	const struct mach_header_64* header = (struct mach_header_64*)_dyld_get_image_header(idx);
 	intptr_t slide = _dyld_get_image_vmaddr_slide(idx);
-
-	struct symtab_command* symtabCmd = nullptr;
-	struct load_command* cmd = (struct load_command*)(header + 1);
-	for (uint32_t i = 0; i < header->ncmds; ++i) {
-		if (cmd->cmd == LC_SYMTAB) {
-			symtabCmd = (struct symtab_command*)cmd;
-			break;
-		}
-		cmd = (struct load_command*)((uint8_t*)cmd + cmd->cmdsize);
-	}
-	if (!symtabCmd) {
-		AppLog(@"Failed to load TulipHook: no symbol table");
-		return nullptr;
-	}
-
-	auto base = (uint8_t*)header;
-	auto symTable = (struct nlist_64*)(base + symtabCmd->symoff);
-	auto strTable = (char*)(base + symtabCmd->stroff);
-
-	for (uint32_t i = 0; i < symtabCmd->nsyms; ++i) {
-		uint32_t strx = symTable[i].n_un.n_strx;
-		if (strx == 0)
-			continue;
-		const char* name = strTable + strx;
-		if ((symTable[i].n_type & N_STAB) == 0 && (symTable[i].n_type & N_TYPE) == N_SECT) {
-			if (strcmp(name, targetMangledName) == 0) {
-				uintptr_t addr = symTable[i].n_value + slide;
-				// AppLog(@"found symbol %s @ %p", name, (void*)addr);
-				AppLog(@"Loaded TulipHook (ID: %lu, func: %p)", (unsigned long)idx, (void*)addr);
-				return (void*)addr;
-			}
+	patch::SymbolResolver resolver;
+	if (!resolver.parseLoaded(header, slide)) {
+		AppLog(@"Failed to load TulipHook: couldn't read image");
+		return false;
+	}
+
+	std::vector<uint64_t> found = resolver.resolveCached(targetMangledNames);
+	addrs.assign(found.size(), nullptr);
+	for (size_t i = 0; i < found.size(); i++) {
+		if (!found[i]) {
+			AppLog(@"Failed to load TulipHook: Symbol %s not found", targetMangledNames[i].c_str());
+			return false;
 		}
+		addrs[i] = (void*)(found[i] + slide);
+		// AppLog(@"found symbol %s @ %p", targetMangledNames[i].c_str(), addrs[i]);
+		AppLog(@"Loaded TulipHook (ID: %lu, func: %p)", (unsigned long)idx, addrs[i]);
 	}
-	AppLog(@"Failed to load TulipHook: Symbol not found");
-	return nullptr;
+	return true;
 }
 
 #include "include/TulipHook.hpp"
@@ -87,164 +73,18 @@ getRelocatedBytesDef getRelocatedBytes;
 getCommonHandlerBytesDef getCommonHandlerBytes;
 getCommonIntervenerBytesDef getCommonIntervenerBytes;
 
-static size_t CAVE_OFFSET = 0x0;
-static size_t codeCaveOffset = 0x0;
-
 // from the article (converted from python to objc)
 static uint64_t align(uint64_t size, uint64_t align) {
 	uint64_t rem = size % align;
 	return rem ? (size + (align - rem)) : size;
 }
 
-// credits:
-// https://lief.re/doc/latest/tutorials/11_macho_modification.html (diagram)
-// https://alexdremov.me/mystery-of-mach-o-object-file-builders/ (for structs)
-// https://alexomara.com/blog/adding-a-segment-to-an-existing-macos-mach-o-binary/ (mainly this, thanks to the python script!)
-// this function creates a new segment and section (rx), and it's main purpose is to allow for an rx area for our code cave, since ios doesnt like us touching the __TEXT seg
-// originally i wanted to extend __text or create a section in __TEXT, but found that headache inducing so i just decided to make a new segment instead, plus its better because i dont have to shift EVERYTHING after that section, load command tables were stupid to handle
-BOOL appendNewSection(NSMutableData* data, uint32_t sect_size) {
-	NSUInteger origSize = data.length;
-	const char* segNameC = "__CUSTOM";
-	const char* sectNameC = "__custom";
-	uint64_t sectSize = TEXT_MAX;
-
-	uint8_t* buf = (uint8_t*)data.mutableBytes;
-	struct mach_header_64* header = (struct mach_header_64*)buf;
-
-	uint8_t* lcPtr = buf + sizeof(*header);
-	uint32_t ncmds = header->ncmds;
-	
-	struct segment_command_64* linkSeg = NULL;
-	uint32_t linkIndex = 0;
-	uint64_t linkFileOff = 0;
-	uint8_t* searchPtr = lcPtr;
-	for (uint32_t i = 0; i < ncmds; i++) {
-		struct load_command* lc = (struct load_command*)searchPtr;
-		if (lc->cmd == LC_SEGMENT_64) {
-			struct segment_command_64* sc = (struct segment_command_64*)searchPtr;
-			if (strncmp(sc->segname, "__LINKEDIT", 16) == 0) {
-				linkSeg = sc;
-				linkIndex = i;
-				linkFileOff = sc->fileoff;
-				break;
-			}
-		}
-		searchPtr += lc->cmdsize;
-	}
-	if (!linkSeg) {
-		AppLog(@"Couldn't find __LINKEDIT segment.");
-		return NO;
-	}
-
-	uint64_t alignedSize = align(MAX(sectSize, 0x4000), 0x1000);
-	struct segment_command_64 newSeg;
-	struct section_64 newSect;
-	memset(&newSeg, 0, sizeof(newSeg));
-	memset(&newSect, 0, sizeof(newSect));
-	newSeg.cmd = LC_SEGMENT_64;
-	newSeg.cmdsize = sizeof(newSeg) + sizeof(newSect);
-	strncpy(newSeg.segname, segNameC, 16);
-	newSeg.vmaddr = linkSeg->vmaddr;
-	newSeg.vmsize = alignedSize;
-	newSeg.fileoff = linkFileOff;
-	newSeg.filesize = alignedSize;
-	newSeg.maxprot = VM_PROT_READ | VM_PROT_EXECUTE;
-	newSeg.initprot = VM_PROT_READ | VM_PROT_EXECUTE;
-	newSeg.nsects = 1;
-
-	strncpy(newSect.sectname, sectNameC, 16);
-	strncpy(newSect.segname, segNameC, 16);
-	newSect.addr = newSeg.vmaddr;
-	newSect.size = sectSize;
-	newSect.offset = newSeg.fileoff;
-	newSect.align = sectSize < 16 ? 0 : 4;
-	newSect.flags = 0x80000400; // S_REGULAR | S_ATTR_PURE_INSTRUCTIONS;
-
-	linkSeg->vmaddr += alignedSize;
-	linkSeg->fileoff += alignedSize;
-
-	// i love mach-o (most of this was assist because this has been giving me a headache) just to shift the linkedit cmds
-	searchPtr = lcPtr;
-	for (uint32_t i = 0; i < ncmds; i++) {
-		struct load_command* lc = (struct load_command*)searchPtr;
-		if (lc->cmd == LC_DYLD_INFO_ONLY || lc->cmd == LC_DYLD_INFO) {
-			struct dyld_info_command* dc = (struct dyld_info_command*)searchPtr;
-			#define SHIFT(field) if (dc->field >= linkFileOff) dc->field += alignedSize
-			SHIFT(rebase_off);
-			SHIFT(bind_off);
-			SHIFT(weak_bind_off);
-			SHIFT(lazy_bind_off);
-			SHIFT(export_off);
-			#undef SHIFT
-		} else if (lc->cmd == LC_SYMTAB) {
-			struct symtab_command* sc = (struct symtab_command*)searchPtr;
-			if (sc->symoff >= linkFileOff)
-				sc->symoff += alignedSize;
-			if (sc->stroff >= linkFileOff)
-				sc->stroff += alignedSize;
-		} else if (lc->cmd == LC_DYSYMTAB) {
-			struct dysymtab_command* dc = (struct dysymtab_command*)searchPtr;
-			#define DS(field) if (dc->field >= linkFileOff) dc->field += alignedSize
-			DS(tocoff);
-			DS(modtaboff);
-			DS(extrefsymoff);
-			DS(indirectsymoff);
-			DS(extreloff);
-			DS(locreloff);
-			#undef DS
-		} else if (lc->cmd == LC_CODE_SIGNATURE || lc->cmd == LC_SEGMENT_SPLIT_INFO || lc->cmd == LC_FUNCTION_STARTS || lc->cmd == LC_DATA_IN_CODE ||
-				   lc->cmd == LC_DYLIB_CODE_SIGN_DRS) {
-			struct linkedit_data_command* ld = (struct linkedit_data_command*)searchPtr;
-			if (ld->dataoff >= linkFileOff)
-				ld->dataoff += alignedSize;
-		}
-		searchPtr += lc->cmdsize;
-	}
-	header->ncmds += 1;
-	header->sizeofcmds += newSeg.cmdsize;
-
-	// rebuilding just in case because binary shifts are wacky
-	NSMutableData* out = [NSMutableData data];
-	[out appendBytes:buf length:sizeof(*header)];
-	lcPtr = buf + sizeof(*header);
-	for (uint32_t i = 0; i < ncmds; i++) {
-		struct load_command* lc = (struct load_command*)lcPtr;
-		if (i == linkIndex) {
-			[out appendBytes:&newSeg length:sizeof(newSeg)];
-			[out appendBytes:&newSect length:sizeof(newSect)];
-		}
-		[out appendBytes:lcPtr length:lc->cmdsize];
-		lcPtr += lc->cmdsize;
-	}
-	NSUInteger headerLen = out.length;
-	if (headerLen < linkFileOff) {
-		NSUInteger copySize = linkFileOff - headerLen;
-		[out appendBytes:buf + headerLen length:copySize];
-	}
-	uint8_t* dead = (uint8_t*)calloc(1, alignedSize);
-	[out appendBytes:dead length:sectSize];
-	if (alignedSize > sectSize) {
-		[out appendBytes:dead + sectSize length:(alignedSize - sectSize)];
-	}
-	free(dead);
-	[out appendBytes:buf + linkFileOff length:origSize - linkFileOff];
-	[data setData:out];
-	return YES;
-}
 // ^^^
 
 @implementation Patcher
 
-static NSMutableDictionary* _originalBytes = nil;
 static NSMutableArray* _patchedFuncs = nil;
 
-+ (NSMutableDictionary<NSString*, NSData*>*)originalBytes {
-	if (!_originalBytes) {
-		_originalBytes = [NSMutableDictionary dictionary];
-	}
-	return _originalBytes;
-}
-
 + (NSMutableArray<NSNumber*>*)patchedFuncs {
 	if (!_patchedFuncs) {
 		_patchedFuncs = [NSMutableArray new];
@@ -255,9 +95,6 @@ static NSMutableArray* _patchedFuncs = nil;
 + (void)setPatchedFuncs:(NSMutableArray<NSNumber*>*)patchedFuncs {
 	_patchedFuncs = patchedFuncs;
 }
-+ (void)setOriginalBytes:(NSMutableDictionary<NSString*, NSData*>*)originalBytes {
-	_originalBytes = originalBytes;
-}
 
 + (BOOL)loadTulipHook {
 	// it definitely makes sense
@@ -273,16 +110,16 @@ static NSMutableArray* _patchedFuncs = nil;
 	}
 	AppLog(@"Loaded TulipHook (Handle: %#llx)", handle);
 
-	auto addr = findSymbolAddr("__ZN5tulip4hook17getRelocatedBytesExxRKNSt3__16vectorIhNS1_9allocatorIhEEEE");
-	if (!addr)
-		return NO;
-	auto addr2 = findSymbolAddr("__ZN5tulip4hook21getCommonHandlerBytesExl");
-	auto addr3 = findSymbolAddr("__ZN5tulip4hook24getCommonIntervenerBytesExxml");
-	if (!addr2 || !addr3)
+	std::vector<void*> addrs;
+	if (!findSymbolAddrs({
+			"__ZN5tulip4hook17getRelocatedBytesExxRKNSt3__16vectorIhNS1_9allocatorIhEEEE",
+			"__ZN5tulip4hook21getCommonHandlerBytesExl",
+			"__ZN5tulip4hook24getCommonIntervenerBytesExxml",
+		}, addrs))
 		return NO;
-	getRelocatedBytes = reinterpret_cast<getRelocatedBytesDef>(addr);
-	getCommonHandlerBytes = reinterpret_cast<getCommonHandlerBytesDef>(addr2);
-	getCommonIntervenerBytes = reinterpret_cast<getCommonIntervenerBytesDef>(addr3);
+	getRelocatedBytes = reinterpret_cast<getRelocatedBytesDef>(addrs[0]);
+	getCommonHandlerBytes = reinterpret_cast<getCommonHandlerBytesDef>(addrs[1]);
+	getCommonIntervenerBytes = reinterpret_cast<getCommonIntervenerBytesDef>(addrs[2]);
 	return YES;
 }
 
@@ -298,99 +135,6 @@ for func in list:
   patch(func.addr, intervenerBytes)
 */
 
-+ (BOOL)patchFunc:(NSMutableData*)data strAddr:(NSString*)strAddr textSect:(struct section_64*)textSect customSect:(struct section_64*)customSect {
-	uint64_t addr = strtoull([strAddr UTF8String], NULL, 0);
-	if (self.originalBytes[strAddr] != nil) {
-		//AppLogDebug(@"Function at %#llx already patched!", addr);
-		AppLog(@"Function at %#llx already patched!", addr);
-		return NO;
-	}
-	// safe guard so we dont override some needed bytes
-	if (codeCaveOffset >= TEXT_MAX) {
-		AppLogWarn(@"Cannot patch more than %#llx! (Current code cave offset: %#llx)", TEXT_MAX, codeCaveOffset);
-		return NO;
-	}
-	int funcIndex = [self.originalBytes count] + 1;
-	NSData* original = [data subdataWithRange:NSMakeRange((NSUInteger)addr, 4 * sizeof(uint32_t))];
-	self.originalBytes[strAddr] = original;
-
-	if (getRelocatedBytes && getCommonIntervenerBytes) {
-		const uint8_t* bytes = static_cast<const uint8_t*>(original.bytes);
-		std::vector<uint8_t> bytesVec = std::vector<uint8_t>(bytes, bytes + original.length);
-		// RelocaledBytesReturn gen = getRelocatedBytes((textSect->addr + addr), (textSect->addr + codeCaveOffset), bytesVec);
-		RelocaledBytesReturn gen = getRelocatedBytes((textSect->addr + addr), (((customSect->addr + codeCaveOffset) + textSect->offset)), bytesVec);
-		if (!gen.error.empty()) {
-			AppLogError(@"[TulipHook] getRelocatedBytes failed: %s", gen.error.c_str());
-			return NO;
-		} else if (gen.bytes.size() == 0) {
-			AppLogError(@"[TulipHook] getRelocatedBytes: Bytes Vector is empty");
-			return NO;
-		}
-		[data replaceBytesInRange:NSMakeRange(customSect->offset + codeCaveOffset, gen.bytes.size()) withBytes:gen.bytes.data()];
-		// std::vector<uint8_t> intervenerBytes = getCommonIntervenerBytes((textSect->addr + addr), (textSect->addr + TEXT_OFFSET), funcIndex, (codeCaveOffset - TEXT_OFFSET));
-		std::vector<uint8_t> intervenerBytes = getCommonIntervenerBytes((textSect->addr + addr), (customSect->addr + textSect->offset), funcIndex, codeCaveOffset);
-		if (intervenerBytes.size() > 0) {
-			[data replaceBytesInRange:NSMakeRange(addr, intervenerBytes.size()) withBytes:intervenerBytes.data()];
-		}
-		codeCaveOffset += gen.bytes.size();
-		return YES;
-	}
-	return NO;
-}
-+ (BOOL)patchWithPatches:(NSMutableData*)data addr:(uint64_t)addr size:(NSUInteger)size patchData:(NSData*)patchData {
-	[data replaceBytesInRange:NSMakeRange(addr, size) withBytes:patchData.bytes];
-	return YES;
-}
-
-+ (NSArray<NSString*>*)getHookOffsetsFromData:(NSString*)data {
-	// \[GEODE_MODIFY_ADDRESS\] base::get\(\) \+ (0x[0-9a-fA-F]+) \[GEODE_MODIFY_END\]
-	NSMutableArray<NSString*>* offsets = [NSMutableArray array];
-	NSError* error;
-	NSRegularExpression* regex = [NSRegularExpression regularExpressionWithPattern:@"\\[GEODE_MODIFY_ADDRESS\\]\\s*base::get\\(\\) \\+ (0x[0-9a-fA-F]+) \\[GEODE_MODIFY_END\\]"
-																		   options:0
-																			 error:&error];
-	if (regex && !error) {
-		NSArray<NSTextCheckingResult*>* matches = [regex matchesInString:data options:0 range:NSMakeRange(0, data.length)];
-		for (NSTextCheckingResult* match in matches) {
-			NSRange range = [match rangeAtIndex:1];
-			NSString* string = [data substringWithRange:range];
-			[offsets addObject:string];
-		}
-	}
-	return [offsets copy];
-}
-
-+ (NSArray<NSString*>*)getStaticHookOffsetsFromData:(NSString*)data {
-	// \[GEODE_MODIFY_NAME\](.+?)\[GEODE_MODIFY_OFFSET\]([0-9a-fA-F]+)\[GEODE_MODIFY_END\]
-	NSMutableArray<NSString*>* offsets = [NSMutableArray array];
-	NSError* error;
-	NSRegularExpression* regex = [NSRegularExpression regularExpressionWithPattern:@"\\[GEODE_MODIFY_NAME\\](.+?)\\[GEODE_MODIFY_OFFSET\\]([0-9a-fA-F]+)\\[GEODE_MODIFY_END\\]"
-																		   options:0
-																			 error:&error];
-	if (regex && !error) {
-		NSArray<NSTextCheckingResult*>* matches = [regex matchesInString:data options:0 range:NSMakeRange(0, data.length)];
-		for (NSTextCheckingResult* match in matches) {
-			NSRange range = [match rangeAtIndex:1];
-			NSString* string = [data substringWithRange:range];
-			[offsets addObject:string];
-		}
-	}
-	return [offsets copy];
-}
-
-+ (NSArray<NSTextCheckingResult*>*)getStaticPatchesOffsetsFromData:(NSString*)data {
-	// \[GEODE_PATCH_SIZE\]([0-9]+)\[GEODE_PATCH_BYTES\](.+?)\[GEODE_PATCH_OFFSET\]([0-9a-fA-F]+)\[GEODE_PATCH_END\]
-	NSError* error;
-	NSRegularExpression* regex = [NSRegularExpression regularExpressionWithPattern:@"\\[GEODE_PATCH_SIZE\\]([0-9]+)\\[GEODE_PATCH_BYTES\\](.+?)\\[GEODE_PATCH_OFFSET\\]([0-9a-fA-F]+)\\[GEODE_PATCH_END\\]"
-																		   options:0
-																			 error:&error];
-	if (regex && !error) {
-		NSArray<NSTextCheckingResult*>* matches = [regex matchesInString:data options:0 range:NSMakeRange(0, data.length)];
-		return matches;
-	}
-	return nil;
-}
-
 // ai because im too lazy to do this
 + (NSString *)hexStringWithSpaces:(NSData*)data includeSpaces:(BOOL)includeSpaces {
 	const unsigned char *dataBuffer = (const unsigned char *)[data bytes];
@@ -467,7 +211,6 @@ for func in list:
 + (void)patchGDBinary:(NSURL*)from to:(NSURL*)to withHandlerAddress:(uint64_t)handlerAddress force:(BOOL)force completionHandler:(void (^)(BOOL success, NSString* error))completionHandler {
 	NSFileManager* fm = [NSFileManager defaultManager];
 	NSError* error;
-	self.originalBytes = [NSMutableDictionary dictionary];
 	if (![fm fileExistsAtPath:from.path]) {
 		[fm copyItemAtURL:to toURL:from error:&error];
 		if (error) {
@@ -479,100 +222,8 @@ for func in list:
 	}
 	NSString *forceSign = nil;
 
-	AppLog(@"Patching Binary...");
-	if (![Patcher loadTulipHook])
-		return completionHandler(NO, @"Couldn't load TulipHook");
-	NSMutableData* data = [NSMutableData dataWithContentsOfURL:from options:0 error:&error];
-	if (!data || error) {
-		AppLog(@"Couldn't read binary: %@", error);
-		return completionHandler(NO, @"Couldn't read binary");
-	}
-	uint8_t* base = (uint8_t*)data.mutableBytes;
-	struct mach_header_64* header = (struct mach_header_64*)base;
-	uint8_t* imageHeaderPtr = (uint8_t*)header + sizeof(struct mach_header_64);
-	if (data.length < sizeof(struct mach_header_64) || (header->magic != MH_MAGIC && header->magic != MH_MAGIC_64)) {
-		AppLog(@"Couldn't patch! Binary is not 64-bit Mach-O.");
-		return completionHandler(NO, @"Binary is not 64-bit Mach-O.");
-	}
-
-	AppLog(@"Writing new executable region...");
-	if (!appendNewSection(data, 0x4000)) {
-		AppLog(@"Something went wrong when writing a new executable region.");
-		return completionHandler(NO, @"Couldn't write new RX region.");
-	}
-
-	// === PATCH STEP 1 ====
-	struct segment_command_64* textSeg = NULL;
-	struct section_64* textSect = NULL;
-	struct section_64* customSect = NULL;
-	struct linkedit_data_command const* func_start = NULL; // is this necessary
-	struct load_command* command = (struct load_command*)imageHeaderPtr;
-	for (int i = 0; i < header->ncmds; i++) {
-		if (command->cmd == LC_SEGMENT_64) {
-			struct segment_command_64* seg = (struct segment_command_64*)command;
-			if (strcmp(seg->segname, "__TEXT") == 0) {
-				textSeg = seg;
-				struct section_64* sect = (struct section_64*)(seg + 1);
-				for (int x = 0; x < seg->nsects; x++) {
-					if (strcmp(sect[x].sectname, "__text") == 0) {
-						textSect = &sect[x];
-						// break;
-					} else if (strcmp(sect[x].sectname, "__mysect") == 0) {
-						customSect = &sect[x];
-					}
-				}
-			} else if (strcmp(seg->segname, "__CUSTOM") == 0) {
-				struct section_64* sect = (struct section_64*)(seg + 1);
-				for (int x = 0; x < seg->nsects; x++) {
-					if (strcmp(sect[x].sectname, "__custom") == 0) {
-						customSect = &sect[x];
-						CAVE_OFFSET = customSect->addr;
-						codeCaveOffset = CAVE_OFFSET;
-						break;
-					}
-				}
-			}
-		} else if (command->cmd == LC_FUNCTION_STARTS) {
-			func_start = (struct linkedit_data_command const*)command; // load command of function start
-		}
-		// void* -> char*
-		command = (struct load_command*)((char*)command + command->cmdsize);
-	}
-	if (!textSeg) {
-		AppLog(@"Couldn't find __TEXT segment.");
-		return completionHandler(NO, @"Couldn't find __TEXT segment (Binary corrupted?)");
-	}
-	if (!textSect) {
-		AppLog(@"Couldn't find __text section.");
-		return completionHandler(NO, @"Couldn't find __text segment (Binary corrupted?)");
-	}
-	if (!customSect) {
-		AppLog(@"Couldn't find __custom section.");
-		return completionHandler(NO, @"Couldn't find __custom segment (Creating RX region failed?)");
-	}
-	if (func_start == NULL || func_start->datasize == 0) {
-		AppLog(@"Couldn't find LC_FUNCTION_STARTS cmd.");
-		return completionHandler(NO, @"Couldn't find LC_FUNCTION_STARTS segment (Binary corrupted?)");
-	}
-
-	AppLog(@"Patching handler at %#llx...", CAVE_OFFSET);
-	if (getCommonHandlerBytes) {
-		// textSect->addr + TEXT_OFFSET, handlerAddress - TEXT_OFFSET
-		std::vector<uint8_t> bytes = getCommonHandlerBytes(customSect->addr, (handlerAddress - (customSect->addr - textSeg->vmaddr)));
-		if (bytes.size() == 0) {
-			AppLog(@"Handler generation from TulipHook failed. (Empty bytes)");
-			return completionHandler(NO, @"TulipHook failed to generate handler bytes (Empty bytes)");
-		}
-		//[data replaceBytesInRange:NSMakeRange(codeCaveOffset, bytes.size()) withBytes:bytes.data()];
-		[data replaceBytesInRange:NSMakeRange(customSect->offset, bytes.size()) withBytes:bytes.data()];
-		// codeCaveOffset += bytes.size();
-		codeCaveOffset = bytes.size();
-	} else {
-		AppLog(@"Couldn't patch! getCommonHandlerBytes function is null!");
-		return completionHandler(NO, @"TulipHook failed find getCommonHandlerBytes");
-	}
-
-	// === PATCH STEP 2 ====
+	// === PLAN ===
+	// everything that decides the output is hashed first, so an unchanged setup returns before TulipHook or the binary are touched
 	NSString* unzipModsPath = [[LCPath dataPath] URLByAppendingPathComponent:@"GeometryDash/Documents/game/geode/unzipped"].path;
 	NSURL* savedJSONURL = [[LCPath dataPath] URLByAppendingPathComponent:@"GeometryDash/Documents/save/geode/mods/geode.loader/saved.json"];
 	NSData* savedJSONData = [NSData dataWithContentsOfURL:savedJSONURL options:0 error:&error];
@@ -594,16 +245,14 @@ for func in list:
 		}
 	}
 
-	NSArray* modsDir = [fm contentsOfDirectoryAtPath:unzipModsPath error:&error];
+	// sorted so the plan hash doesn't depend on directory order
+	NSArray* modsDir = [[fm contentsOfDirectoryAtPath:unzipModsPath error:&error] sortedArrayUsingSelector:@selector(compare:)];
 	if (error) {
 		AppLog(@"Couldn't read unzipped directory: %@", error);
 		error = nil;
 	}
 	NSMutableArray<NSString*>* modDict = [NSMutableArray new];
 	NSString* geodePath = [Utils getTweakDir];
-	if (geodePath) {
-		[modDict addObject:geodePath];
-	}
 	if (canParseJSON) {
 		AppLog(@"saved.json parsed!");
 		for (NSString* modId in modsDir) {
@@ -621,67 +270,266 @@ for func in list:
 			}
 		}
 	}
-	for (int i = 0; i < modDict.count; i++) {
-		AppLog(@"Patching functions... (%i/%i)", (i + 1), modDict.count);
-		NSData* mdata = [NSData dataWithContentsOfFile:[modDict objectAtIndex:i] options:0 error:nil];
-		if (mdata == nil) continue;
-		NSString* dataString = [[NSString alloc] initWithData:mdata encoding:NSASCIIStringEncoding];
-		for (NSString* offset in [Patcher getHookOffsetsFromData:dataString]) {
-			if (![offset hasPrefix:@"0x"])
-				continue;
-			if ([Patcher patchFunc:data strAddr:offset textSect:textSect customSect:customSect]) {
-				AppLogDebug(@"Patched Function %@", offset);
-			};
-		}
-		for (NSString* offset in [Patcher getStaticHookOffsetsFromData:dataString]) {
-			if ([Patcher patchFunc:data strAddr:offset textSect:textSect customSect:customSect]) {
-				AppLogDebug(@"Patched Function %@", offset);
-			};
-		}
-		NSArray<NSTextCheckingResult*>* staticMatches = [Patcher getStaticPatchesOffsetsFromData:dataString];
-		for (NSTextCheckingResult* match in staticMatches) {
-			NSString *sizeString = [dataString substringWithRange:[match rangeAtIndex:1]];
-			NSUInteger patchSize = [sizeString integerValue];
-			NSData *patchData = [[dataString substringWithRange:[match rangeAtIndex:2]] dataUsingEncoding:NSISOLatin1StringEncoding];
-			
-			NSString *strAddr = [NSString stringWithFormat:@"0x%@", [dataString substringWithRange:[match rangeAtIndex:3]]];
-			NSUInteger addr = strtoull([strAddr UTF8String], NULL, 0);
-
-			[data replaceBytesInRange:NSMakeRange(addr, patchSize) withBytes:patchData.bytes];
-			AppLogDebug(@"Patched Offset %#llx with %i bytes (%@)", addr, patchSize, [Patcher hexStringWithSpaces:patchData includeSpaces:YES]);
+	error = nil;
+	patch::PatchPlan plan;
+	std::string planError;
+	if (!plan.setBinary(from.path.fileSystemRepresentation, &planError)) {
+		AppLog(@"Couldn't hash binary: %s", planError.c_str());
+		return completionHandler(NO, @"Couldn't read binary");
+	}
+	plan.setHandlerAddress(handlerAddress);
+	if (geodePath && !plan.addLoader(geodePath.fileSystemRepresentation, &planError)) {
+		AppLog(@"Couldn't scan Geode: %s", planError.c_str());
+	}
+	for (NSString* modPath in modDict) {
+		// read from the mod's .hookindex sidecar, the dylib is only scanned when it changed
+		if (!plan.addMod(modPath.fileSystemRepresentation, &planError)) {
+			AppLog(@"Couldn't scan mod: %s", planError.c_str());
 		}
 	}
+	NSString* hash = [NSString stringWithUTF8String:plan.hash().c_str()];
 	NSString* patchChecksum = [[Utils getPrefs] stringForKey:@"PATCH_CHECKSUM"];
-	NSArray* keys = [self.originalBytes allKeys];
-	NSString* hash = [Utils sha256sumWithString:[keys componentsJoinedByString:@","]];
 	if (patchChecksum != nil) {
 		if (![patchChecksum isEqualToString:hash]) {
 			AppLog(@"Hash mismatch (%@ vs %@), now writing to binary...", patchChecksum, hash)
-			[[Utils getPrefs] setObject:hash forKey:@"PATCH_CHECKSUM"];
-		} else {
-			//AppLog(@"Binary already patched, skipping...");
-			if (!force) {
-				AppLog(@"Binary already patched, skipping...");
-				return completionHandler(YES, nil);
-			}
+		} else if (!patch::PatchPlan::isPatchedBinary(to.path.fileSystemRepresentation)) {
+			AppLog(@"Hash matches but the patched binary is missing or damaged, now writing to binary...");
+		} else if (!force) {
+			AppLog(@"Binary already patched, skipping...");
+			return completionHandler(YES, nil);
 		}
 	} else {
 		AppLog(@"Got hash %@, now writing to binary...", hash)
-		[[Utils getPrefs] setObject:hash forKey:@"PATCH_CHECKSUM"];
 	}
 
-	struct mach_header_64* headerNew = (struct mach_header_64*)(uint8_t*)data.mutableBytes;
-	if (data.length < sizeof(struct mach_header_64) || (headerNew->magic != MH_MAGIC && headerNew->magic != MH_MAGIC_64)) {
-		// okay how would this realistically happen
-		AppLog(@"Couldn't patch! Binary wasn't properly patched as a 64-bit Mach-O.");
-		return completionHandler(NO, @"Patched binary wasn't properly patched as a proper Mach-O binary");
+	AppLog(@"Patching Binary...");
+	if (![Patcher loadTulipHook])
+		return completionHandler(NO, @"Couldn't load TulipHook");
+	// the output is laid out and filled straight from the original file, patches then go into its mapping
+	patch::MachOEditor editor;
+	std::string editError;
+	if (!editor.open(from.path.fileSystemRepresentation, &editError)) {
+		AppLog(@"Couldn't patch! %s", editError.c_str());
+		return completionHandler(NO, @"Binary is not 64-bit Mach-O.");
 	}
+	patch::MachOImage const& source = editor.source();
 
-	[data writeToURL:to options:NSDataWritingAtomic error:&error];
-	if (error) {
-		AppLog(@"Couldn't patch binary: %@", error);
-		return completionHandler(NO, [NSString stringWithFormat:@"Patch failed: %@", error.localizedDescription]);
+	// === PATCH STEP 1 ====
+	struct segment_command_64 const* textSeg = source.findSegment("__TEXT");
+	struct section_64 const* textSect = source.findSection("__TEXT", "__text");
+	struct segment_command_64 const* linkSeg = source.findSegment("__LINKEDIT");
+	if (!textSeg) {
+		AppLog(@"Couldn't find __TEXT segment.");
+		return completionHandler(NO, @"Couldn't find __TEXT segment (Binary corrupted?)");
+	}
+	if (!textSect) {
+		AppLog(@"Couldn't find __text section.");
+		return completionHandler(NO, @"Couldn't find __text segment (Binary corrupted?)");
+	}
+	if (!linkSeg) {
+		AppLog(@"Couldn't find __LINKEDIT segment.");
+		return completionHandler(NO, @"Couldn't find __LINKEDIT segment (Binary corrupted?)");
+	}
+	// every hook target is checked against it, so a bad offset can't land in the middle of a function
+	patch::FunctionStarts functionStarts;
+	if (!functionStarts.parse(source) || functionStarts.empty()) {
+		AppLog(@"Couldn't find LC_FUNCTION_STARTS cmd.");
+		return completionHandler(NO, @"Couldn't find LC_FUNCTION_STARTS segment (Binary corrupted?)");
+	}
+
+	// the cave segment takes __LINKEDIT's place, so its address is known before it exists
+	// everything is generated into memory first and the segment is sized to what came out
+	uint64_t caveAddr = linkSeg->vmaddr;
+	uint64_t caveFileOff = linkSeg->fileoff;
+	std::vector<uint8_t> cave;
+	patch::PatchIndex patches;
+
+	// === JOURNAL ===
+	// a binary patched before from the same original keeps its cave, then only what changed since is written, in place
+	std::string journalPath = patch::patchJournalPath(to.path.fileSystemRepresentation);
+	patch::PatchJournal journal;
+	patch::WritableFile output;
+	uint64_t outputSize = 0;
+	int64_t outputMtime = 0;
+	BOOL incremental = NO;
+	if (!force && journal.load(journalPath) && journal.binarySha256 == plan.binarySha256() && journal.handlerAddress == handlerAddress &&
+		journal.caveAddr == caveAddr && journal.caveFileOff == caveFileOff && patch::statFile(to.path.fileSystemRepresentation, outputSize, outputMtime)) {
+		std::string journalError;
+		if (output.open(to.path.fileSystemRepresentation, &journalError) && journal.matchesOutput(output.data(), output.size(), &journalError)) {
+			incremental = YES;
+		} else {
+			AppLog(@"Patch journal doesn't match the patched binary (%s), patching from the original...", journalError.c_str());
+			output.close();
+		}
+	}
+
+	// === PATCH STEP 2 ====
+	std::vector<patch::ModPlan> const& mods = plan.mods();
+	patch::HookEngine hooks;
+	hooks.setFunctionStarts(&functionStarts);
+	for (size_t i = 0; i < mods.size(); i++) {
+		AppLog(@"Collecting patches... (%i/%i)", (int)(i + 1), (int)mods.size());
+		for (patch::HookRecord const& hook : mods[i].records.hooks) {
+			hooks.add(hook.offset, mods[i].name);
+		}
+		for (patch::PatchRecord const& staticPatch : mods[i].records.patches) {
+			NSUInteger addr = (NSUInteger)staticPatch.offset;
+			NSUInteger patchSize = staticPatch.bytes.size();
+			if (addr > source.size() || patchSize > source.size() - addr) {
+				AppLogWarn(@"Skipping patch at %#llx (%i bytes), it's outside the binary", addr, patchSize);
+				continue;
+			}
+			patches.addPatch(staticPatch.offset, staticPatch.bytes, mods[i].name);
+			NSData* patchData = [NSData dataWithBytesNoCopy:(void*)staticPatch.bytes.data() length:patchSize freeWhenDone:NO];
+			AppLogDebug(@"Patched Offset %#llx with %i bytes (%@)", addr, patchSize, [Patcher hexStringWithSpaces:patchData includeSpaces:YES]);
+		}
+	}
+
+	// every hook of every mod at once: one trampoline per address, generated in address order
+	if (!getRelocatedBytes || !getCommonIntervenerBytes) {
+		AppLog(@"Couldn't patch! TulipHook functions are null!");
+		return completionHandler(NO, @"TulipHook failed find getRelocatedBytes");
+	}
+	patch::HookGenerator generator;
+	generator.trampoline = [&](uint64_t addr, uint64_t caveOffset, std::vector<uint8_t> const& original, std::vector<uint8_t>& out, std::string& genError) {
+		RelocaledBytesReturn gen = getRelocatedBytes((textSect->addr + addr), (((caveAddr + caveOffset) + textSect->offset)), original);
+		genError = gen.error;
+		out = std::move(gen.bytes);
+		return gen.error.empty();
+	};
+	generator.intervener = [&](uint64_t addr, size_t funcIndex, uint64_t caveOffset) {
+		return getCommonIntervenerBytes((textSect->addr + addr), (caveAddr + textSect->offset), funcIndex, caveOffset);
+	};
+	uint64_t handlerSize = 0;
+	// an in-place patch whose new trampolines overflow the cave goes round once more, as a full rewrite of the original
+	for (;;) {
+		if (incremental) {
+			// the handler and the trampolines of hooks that stay are already in the file, new ones go after them
+			AppLog(@"Patching in place, %i hooks already in the code cave...", (int)journal.hooks.size());
+			cave.resize(journal.caveUsed);
+		} else if (getCommonHandlerBytes) {
+			AppLog(@"Patching handler at %#llx...", caveAddr);
+			std::vector<uint8_t> bytes = getCommonHandlerBytes(caveAddr, (handlerAddress - (caveAddr - textSeg->vmaddr)));
+			if (bytes.size() == 0) {
+				AppLog(@"Handler generation from TulipHook failed. (Empty bytes)");
+				return completionHandler(NO, @"TulipHook failed to generate handler bytes (Empty bytes)");
+			}
+			cave = std::move(bytes);
+		} else {
+			AppLog(@"Couldn't patch! getCommonHandlerBytes function is null!");
+			return completionHandler(NO, @"TulipHook failed find getCommonHandlerBytes");
+		}
+		handlerSize = cave.size();
+		std::vector<patch::HookSite> previous;
+		if (incremental) previous = journal.sites();
+		hooks.build(source.base(), source.size(), cave, generator, incremental ? &previous : nullptr);
+		if (!incremental || cave.size() <= journal.caveCapacity) break;
+		AppLog(@"New trampolines don't fit in the code cave (%#llx of %#llx bytes), patching from the original...", (uint64_t)cave.size(), journal.caveCapacity);
+		output.close();
+		incremental = NO;
+	}
+	for (patch::HookConflict const& conflict : hooks.conflicts()) {
+		NSMutableArray<NSString*>* modList = [NSMutableArray new];
+		for (std::string const& mod : conflict.mods) {
+			[modList addObject:[NSString stringWithUTF8String:mod.c_str()]];
+		}
+		NSString* modNames = [modList componentsJoinedByString:@", "];
+		switch (conflict.kind) {
+			case patch::HookConflictKind::Collision:
+				AppLogDebug(@"Function at %#llx is hooked by several mods, sharing one trampoline (%@)", conflict.offset, modNames);
+				break;
+			case patch::HookConflictKind::Overlap:
+				AppLogWarn(@"Skipping hook at %#llx, it overlaps the hook at %#llx (%@)", conflict.offset, conflict.other, modNames);
+				break;
+			case patch::HookConflictKind::OutOfRange:
+				AppLogWarn(@"Skipping hook at %#llx, it's outside the binary (%@)", conflict.offset, modNames);
+				break;
+			case patch::HookConflictKind::NotFunctionStart:
+				AppLogWarn(@"Skipping hook at %#llx, it isn't the start of a function (the closest one is at %#llx) (%@)", conflict.offset, conflict.other, modNames);
+				break;
+			case patch::HookConflictKind::GenerationFailed:
+				AppLogError(@"[TulipHook] Couldn't hook %#llx: %s (%@)", conflict.offset, conflict.error.c_str(), modNames);
+				break;
+		}
+	}
+	AppLog(@"Hooked %i functions (%#llx bytes of trampolines)", (int)hooks.sites().size(), (uint64_t)(cave.size() - handlerSize));
+
+	// static patches are checked against each other and against the interveners, then merged into as few writes as possible
+	for (patch::HookSite const& site : hooks.sites()) {
+		patches.addHook(site.offset, site.intervener.size(), site.mods);
+	}
+	patches.build();
+	for (patch::PatchConflict const& conflict : patches.conflicts()) {
+		NSMutableArray<NSString*>* modList = [NSMutableArray new];
+		for (std::string const& mod : conflict.mods) {
+			[modList addObject:[NSString stringWithUTF8String:mod.c_str()]];
+		}
+		NSString* modNames = [modList componentsJoinedByString:@", "];
+		if (conflict.sameBytes) {
+			AppLogDebug(@"Patches at %#llx-%#llx are identical (%@)", conflict.begin, conflict.end, modNames);
+		} else if (conflict.withHook) {
+			AppLogWarn(@"Patch at %#llx-%#llx overwrites a hook, the hook won't work (%@)", conflict.begin, conflict.end, modNames);
+		} else {
+			AppLogWarn(@"Patches at %#llx-%#llx overlap, the last one wins (%@)", conflict.begin, conflict.end, modNames);
+		}
+	}
+	AppLog(@"Merged %i patches into %i writes", (int)patches.patchCount(), (int)patches.writes().size());
+
+	patch::PatchJournal next;
+	next.binarySha256 = plan.binarySha256();
+	next.handlerAddress = handlerAddress;
+	next.caveAddr = caveAddr;
+	next.caveFileOff = caveFileOff;
+	next.caveUsed = cave.size();
+	next.record(source.base(), source.size(), hooks.sites(), patches.writes());
+
+	if (incremental) {
+		next.caveCapacity = journal.caveCapacity;
+		// a crash halfway through must not leave a journal that describes neither state
+		unlink(journalPath.c_str());
+		std::vector<patch::DirtyRange> dirty = journal.applyDelta(next, cave, output.data(), output.size());
+		next.recordCave(output.data(), output.size());
+		output.close();
+		uint64_t dirtyBytes = 0;
+		for (patch::DirtyRange const& range : dirty) {
+			dirtyBytes += range.length;
+		}
+		AppLog(@"Patched in place (%i ranges, %llu bytes changed)", (int)dirty.size(), dirtyBytes);
+		// a size or mtime other than the journal's means the binary has been signed since, the signer then only rehashes these pages
+		if (!patch::addDirtyRanges(to.path.fileSystemRepresentation, dirty, outputSize != journal.outputSize || outputMtime != journal.outputMtime)) {
+			AppLogWarn(@"Couldn't record the changed ranges, the next signature hashes every page");
+		}
+	} else {
+		// 16 KiB pages on arm64, the segment has to cover whole ones
+		uint64_t caveSize = align(MAX(cave.size(), (size_t)1), 0x4000);
+		AppLog(@"Writing new executable region (%#llx bytes of code, %#llx mapped)...", (uint64_t)cave.size(), caveSize);
+		if (!editor.insertSegment("__CUSTOM", "__custom", cave.size(), caveSize, VM_PROT_READ | VM_PROT_EXECUTE, 0x80000400, &editError) ||
+			!editor.write(to.path.fileSystemRepresentation, &editError)) {
+			AppLog(@"Something went wrong when writing a new executable region: %s", editError.c_str());
+			return completionHandler(NO, @"Couldn't write new RX region.");
+		}
+		uint8_t* data = editor.data();
+		memcpy(data + caveFileOff, cave.data(), cave.size());
+		// everything before __LINKEDIT keeps its file offset, so planned offsets still line up
+		hooks.apply(data, editor.size());
+		patches.apply(data, editor.size());
+		next.caveCapacity = caveSize;
+		next.recordCave(data, editor.size());
+
+		if (!editor.commit(&editError)) {
+			AppLog(@"Couldn't patch binary: %s", editError.c_str());
+			return completionHandler(NO, [NSString stringWithFormat:@"Patch failed: %s", editError.c_str()]);
+		}
+		// every page is new, a leftover list of changed ranges would have the signer keep stale hashes
+		unlink(patch::dirtyRangesPath(to.path.fileSystemRepresentation).c_str());
+	}
+	// the journal describes the file as it is now, the next signature changes its size or mtime
+	if (!patch::statFile(to.path.fileSystemRepresentation, next.outputSize, next.outputMtime) || !next.save(journalPath)) {
+		AppLogWarn(@"Couldn't save the patch journal, the next patch starts from the original binary");
+		unlink(journalPath.c_str());
 	}
+	// only remember the plan once its output is on disk
+	[[Utils getPrefs] setObject:hash forKey:@"PATCH_CHECKSUM"];
 	AppLog(@"Binary has been patched!");
 	return completionHandler(YES, forceSign);
 }
@@ -0,0 +1,44 @@
+#include "ByteIO.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+namespace patch {
+	bool readWholeFile(std::string const& path, std::string& data) {
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		data.clear();
+		char buffer[16 * 1024];
+		while (true) {
+			ssize_t n = read(fd, buffer, sizeof(buffer));
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) {
+				close(fd);
+				return n == 0;
+			}
+			data.append(buffer, (size_t)n);
+		}
+	}
+
+	bool writeWholeFile(std::string const& path, std::string const& data) {
+		// write then rename, a crash never leaves a torn sidecar behind
+		std::string tmpPath = path + ".tmp";
+		int fd = open(tmpPath.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+		if (fd < 0) return false;
+		size_t written = 0;
+		while (written < data.size()) {
+			ssize_t n = write(fd, data.data() + written, data.size() - written);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) break;
+			written += (size_t)n;
+		}
+		close(fd);
+		if (written != data.size() || rename(tmpPath.c_str(), path.c_str()) != 0) {
+			unlink(tmpPath.c_str());
+			return false;
+		}
+		return true;
+	}
+}
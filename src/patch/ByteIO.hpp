@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+// little-endian records for the sidecar files next to mods and binaries
+namespace patch {
+	class ByteWriter {
+	public:
+		template <typename T>
+		void put(T value) {
+			m_data.append(reinterpret_cast<char const*>(&value), sizeof(value));
+		}
+		void put(void const* data, size_t size) {
+			m_data.append(static_cast<char const*>(data), size);
+		}
+		std::string const& data() const { return m_data; }
+
+	private:
+		std::string m_data;
+	};
+
+	class ByteReader {
+	public:
+		ByteReader(uint8_t const* data, size_t size) : m_p(data), m_end(data + size) {}
+
+		template <typename T>
+		bool get(T& value) {
+			if ((size_t)(m_end - m_p) < sizeof(value)) return false;
+			memcpy(&value, m_p, sizeof(value));
+			m_p += sizeof(value);
+			return true;
+		}
+		bool get(void* data, size_t size) {
+			if ((size_t)(m_end - m_p) < size) return false;
+			memcpy(data, m_p, size);
+			m_p += size;
+			return true;
+		}
+		uint8_t const* take(size_t size) {
+			if ((size_t)(m_end - m_p) < size) return nullptr;
+			uint8_t const* p = m_p;
+			m_p += size;
+			return p;
+		}
+		bool atEnd() const { return m_p == m_end; }
+
+	private:
+		uint8_t const* m_p;
+		uint8_t const* m_end;
+	};
+
+	bool readWholeFile(std::string const& path, std::string& data);
+	bool writeWholeFile(std::string const& path, std::string const& data);
+}
@@ -0,0 +1,42 @@
+#include "FunctionStarts.hpp"
+
+#include <algorithm>
+
+namespace patch {
+	bool FunctionStarts::parse(MachOImage const& image) {
+		m_starts.clear();
+		auto cmd = reinterpret_cast<linkedit_data_command const*>(image.findCommand(LC_FUNCTION_STARTS));
+		if (!cmd || cmd->dataoff > image.size() || cmd->datasize > image.size() - cmd->dataoff) return false;
+
+		// a ULEB128 delta per function, each at least one byte, so datasize bounds the count
+		uint8_t const* p = image.base() + cmd->dataoff;
+		uint8_t const* end = p + cmd->datasize;
+		m_starts.reserve(cmd->datasize);
+		uint64_t offset = 0;
+		while (p < end) {
+			uint64_t delta;
+			if (*p < 0x80) {
+				delta = *p++;
+			} else if (!readUleb128(p, end, delta)) {
+				return false;
+			}
+			// the stream is padded with zeros
+			if (delta == 0) break;
+			offset += delta;
+			m_starts.push_back(offset);
+		}
+		m_starts.shrink_to_fit();
+		return true;
+	}
+
+	bool FunctionStarts::contains(uint64_t offset) const {
+		return std::binary_search(m_starts.begin(), m_starts.end(), offset);
+	}
+
+	bool FunctionStarts::functionAt(uint64_t offset, uint64_t& start) const {
+		auto it = std::upper_bound(m_starts.begin(), m_starts.end(), offset);
+		if (it == m_starts.begin()) return false;
+		start = *(it - 1);
+		return true;
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "MachOFile.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace patch {
+	// LC_FUNCTION_STARTS decoded into a sorted array, offsets are relative to the start of __TEXT
+	// (which is also the file offset, __TEXT starts the file)
+	class FunctionStarts {
+	public:
+		bool parse(MachOImage const& image);
+
+		bool empty() const { return m_starts.empty(); }
+		size_t size() const { return m_starts.size(); }
+		std::vector<uint64_t> const& starts() const { return m_starts; }
+
+		// true if a function starts exactly at offset
+		bool contains(uint64_t offset) const;
+		// start of the function offset falls into, false if it's before the first one
+		bool functionAt(uint64_t offset, uint64_t& start) const;
+
+	private:
+		std::vector<uint64_t> m_starts;
+	};
+}
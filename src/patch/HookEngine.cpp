@@ -0,0 +1,114 @@
+#include "HookEngine.hpp"
+
+#include <algorithm>
+#include <string.h>
+
+namespace patch {
+	void HookEngine::add(uint64_t offset, std::string const& mod) {
+		// mods are added one after another, so only the last name has to be checked
+		if (m_mods.empty() || m_mods.back() != mod) {
+			m_mods.push_back(mod);
+		}
+		m_pending.push_back({offset, (uint32_t)(m_mods.size() - 1)});
+	}
+
+	void HookEngine::build(uint8_t const* binary, size_t size, std::vector<uint8_t>& cave, HookGenerator const& generator,
+						   std::vector<HookSite> const* previous) {
+		m_sites.clear();
+		m_conflicts.clear();
+
+		std::sort(m_pending.begin(), m_pending.end(), [](Pending const& a, Pending const& b) {
+			return a.offset != b.offset ? a.offset < b.offset : a.mod < b.mod;
+		});
+
+		// group by address, one site per address, every mod that asked for it kept for reporting
+		std::vector<HookSite> sites;
+		for (size_t i = 0; i < m_pending.size();) {
+			HookSite site {m_pending[i].offset, {}, 0, 0, {}};
+			size_t j = i;
+			for (; j < m_pending.size() && m_pending[j].offset == site.offset; j++) {
+				std::string const& mod = m_mods[m_pending[j].mod];
+				if (site.mods.empty() || site.mods.back() != mod) site.mods.push_back(mod);
+			}
+			if (site.mods.size() > 1) {
+				m_conflicts.push_back({HookConflictKind::Collision, site.offset, site.offset, site.mods, {}});
+			}
+			uint64_t function = 0;
+			if (site.offset > size || kHookOriginalSize > size - site.offset) {
+				m_conflicts.push_back({HookConflictKind::OutOfRange, site.offset, site.offset, site.mods, {}});
+			} else if (m_functionStarts && !m_functionStarts->contains(site.offset)) {
+				m_functionStarts->functionAt(site.offset, function);
+				m_conflicts.push_back({HookConflictKind::NotFunctionStart, site.offset, function, site.mods, {}});
+			} else if (!sites.empty() && site.offset < sites.back().offset + kHookOriginalSize) {
+				// the earlier hook's relocated bytes already cover this address
+				std::vector<std::string> mods = sites.back().mods;
+				mods.insert(mods.end(), site.mods.begin(), site.mods.end());
+				m_conflicts.push_back({HookConflictKind::Overlap, site.offset, sites.back().offset, std::move(mods), {}});
+			} else {
+				sites.push_back(std::move(site));
+			}
+			i = j;
+		}
+
+		// sites that are already in the cave, both lists are sorted so one merge pass finds them
+		std::vector<HookSite const*> kept(sites.size(), nullptr);
+		std::vector<uint32_t> usedIndices;
+		if (previous) {
+			size_t p = 0;
+			for (size_t i = 0; i < sites.size(); i++) {
+				while (p < previous->size() && (*previous)[p].offset < sites[i].offset) p++;
+				if (p < previous->size() && (*previous)[p].offset == sites[i].offset) {
+					kept[i] = &(*previous)[p];
+					usedIndices.push_back(kept[i]->index);
+				}
+			}
+			std::sort(usedIndices.begin(), usedIndices.end());
+		}
+
+		// trampolines go into the cave in address order, the interveners are generated right after
+		std::vector<uint8_t> original(kHookOriginalSize);
+		std::vector<uint8_t> trampoline;
+		m_sites.reserve(sites.size());
+		uint32_t nextIndex = 1;
+		size_t used = 0;
+		for (size_t i = 0; i < sites.size(); i++) {
+			HookSite& site = sites[i];
+			if (kept[i]) {
+				site.caveOffset = kept[i]->caveOffset;
+				site.index = kept[i]->index;
+				site.intervener = kept[i]->intervener;
+				m_sites.push_back(std::move(site));
+				continue;
+			}
+			while (used < usedIndices.size() && usedIndices[used] <= nextIndex) {
+				if (usedIndices[used] == nextIndex) nextIndex++;
+				used++;
+			}
+			memcpy(original.data(), binary + site.offset, kHookOriginalSize);
+			site.caveOffset = cave.size();
+			trampoline.clear();
+			std::string error;
+			if (!generator.trampoline(site.offset, site.caveOffset, original, trampoline, error) || trampoline.empty()) {
+				m_conflicts.push_back({HookConflictKind::GenerationFailed, site.offset, site.offset, site.mods, error.empty() ? "empty trampoline" : error});
+				continue;
+			}
+			site.index = nextIndex;
+			site.intervener = generator.intervener(site.offset, site.index, site.caveOffset);
+			if (site.intervener.size() > kHookOriginalSize) {
+				m_conflicts.push_back({HookConflictKind::GenerationFailed, site.offset, site.offset, site.mods, "intervener is larger than the relocated bytes"});
+				continue;
+			}
+			nextIndex++;
+			cave.insert(cave.end(), trampoline.begin(), trampoline.end());
+			m_sites.push_back(std::move(site));
+		}
+		m_pending.clear();
+	}
+
+	void HookEngine::apply(uint8_t* out, size_t size) const {
+		for (HookSite const& site : m_sites) {
+			if (site.offset > size || site.intervener.size() > size - site.offset) continue;
+			memcpy(out + site.offset, site.intervener.data(), site.intervener.size());
+		}
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "FunctionStarts.hpp"
+
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace patch {
+	// bytes relocated into each trampoline (four arm64 instructions), also how far an intervener may reach
+	constexpr size_t kHookOriginalSize = 16;
+
+	enum class HookConflictKind : uint8_t {
+		// several mods hook the same address, they share one trampoline
+		Collision,
+		// a hook starts inside the bytes another hook's intervener replaces, the later one is dropped
+		Overlap,
+		// the hook's bytes aren't inside the binary
+		OutOfRange,
+		// the hook isn't at a function entry, other is the start of the function it falls into (0 if none)
+		NotFunctionStart,
+		// trampoline or intervener generation failed
+		GenerationFailed,
+	};
+
+	struct HookConflict {
+		HookConflictKind kind;
+		uint64_t offset;
+		// the hook it clashed with (Overlap) or the enclosing function (NotFunctionStart), otherwise the same as offset
+		uint64_t other;
+		std::vector<std::string> mods;
+		std::string error;
+	};
+
+	struct HookSite {
+		uint64_t offset;
+		std::vector<std::string> mods;
+		// where the trampoline starts, relative to the start of the cave
+		uint64_t caveOffset;
+		// 1-based number the intervener hands to the handler, unique among the sites of a build
+		uint32_t index;
+		std::vector<uint8_t> intervener;
+	};
+
+	// TulipHook glue, the engine itself doesn't know how the code is generated
+	struct HookGenerator {
+		// trampoline for the original bytes at offset, placed caveOffset bytes into the cave
+		std::function<bool(uint64_t offset, uint64_t caveOffset, std::vector<uint8_t> const& original, std::vector<uint8_t>& out, std::string& error)> trampoline;
+		// jump that replaces the original bytes, index is the site's 1-based number
+		std::function<std::vector<uint8_t>(uint64_t offset, size_t index, uint64_t caveOffset)> intervener;
+	};
+
+	// Collects the hooks of every mod and lays them out in one go:
+	// deduped by address, sorted, trampolines appended to the cave in address order, interveners written in one sweep.
+	class HookEngine {
+	public:
+		void add(uint64_t offset, std::string const& mod);
+		size_t pending() const { return m_pending.size(); }
+		// hooks that don't land on a function entry are dropped, a wrong offset would corrupt the middle of a function
+		void setFunctionStarts(FunctionStarts const* starts) { m_functionStarts = starts; }
+
+		// reads the original bytes from binary and appends every trampoline to cave.
+		// sites found in previous (sorted by address, from an earlier build into the same cave) keep their trampoline,
+		// intervener and index, so only hooks that are new get generated; new sites take the lowest free indices
+		void build(uint8_t const* binary, size_t size, std::vector<uint8_t>& cave, HookGenerator const& generator,
+				   std::vector<HookSite> const* previous = nullptr);
+		// writes the interveners, out has the same layout as the binary passed to build()
+		void apply(uint8_t* out, size_t size) const;
+
+		// sorted by address
+		std::vector<HookSite> const& sites() const { return m_sites; }
+		std::vector<HookConflict> const& conflicts() const { return m_conflicts; }
+
+	private:
+		struct Pending {
+			uint64_t offset;
+			uint32_t mod;
+		};
+
+		FunctionStarts const* m_functionStarts = nullptr;
+		std::vector<std::string> m_mods;
+		std::vector<Pending> m_pending;
+		std::vector<HookSite> m_sites;
+		std::vector<HookConflict> m_conflicts;
+	};
+}
@@ -0,0 +1,165 @@
+#include "ByteIO.hpp"
+#include "HookIndex.hpp"
+#include "MachOFile.hpp"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// sidecar layout, little-endian:
+//   u32 magic, u32 version, u64 size, i64 mtime, u8[32] sha256, u32 hook count, u32 patch count
+//   hooks:   u64 offset, u8 kind, u16 name length, name
+//   patches: u64 offset, u32 length, bytes
+namespace patch {
+	static constexpr uint32_t kHookIndexMagic = 0x49484447; // "GDHI"
+	static constexpr uint32_t kHookIndexVersion = 1;
+	static constexpr size_t kHookIndexMtimeOffset = 4 + 4 + 8;
+
+	bool statFile(char const* path, uint64_t& size, int64_t& mtime) {
+		struct stat st;
+		if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) return false;
+		size = (uint64_t)st.st_size;
+#ifdef __APPLE__
+		mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+		mtime = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+		return true;
+	}
+
+	std::string hookIndexPath(char const* dylibPath) {
+		return std::string(dylibPath) + ".hookindex";
+	}
+
+	static std::string serialize(FileIdentity const& identity, ModScanResult const& result) {
+		ByteWriter writer;
+		writer.put(kHookIndexMagic);
+		writer.put(kHookIndexVersion);
+		writer.put(identity.size);
+		writer.put(identity.mtime);
+		writer.put(identity.sha256.data(), identity.sha256.size());
+		writer.put((uint32_t)result.hooks.size());
+		writer.put((uint32_t)result.patches.size());
+		for (HookRecord const& hook : result.hooks) {
+			uint16_t nameLen = (uint16_t)(hook.name.size() > 0xffff ? 0xffff : hook.name.size());
+			writer.put(hook.offset);
+			writer.put((uint8_t)hook.kind);
+			writer.put(nameLen);
+			writer.put(hook.name.data(), nameLen);
+		}
+		for (PatchRecord const& patch : result.patches) {
+			writer.put(patch.offset);
+			writer.put((uint32_t)patch.bytes.size());
+			writer.put(patch.bytes.data(), patch.bytes.size());
+		}
+		return writer.data();
+	}
+
+	static bool parseHeader(ByteReader& reader, FileIdentity& identity, uint32_t& hookCount, uint32_t& patchCount) {
+		uint32_t magic, version;
+		return reader.get(magic) && magic == kHookIndexMagic && reader.get(version) && version == kHookIndexVersion && reader.get(identity.size) &&
+			   reader.get(identity.mtime) && reader.get(identity.sha256.data(), identity.sha256.size()) && reader.get(hookCount) && reader.get(patchCount);
+	}
+
+	static bool parseRecords(ByteReader& reader, uint32_t hookCount, uint32_t patchCount, ModScanResult& result) {
+		for (uint32_t i = 0; i < hookCount; i++) {
+			HookRecord hook;
+			uint8_t kind;
+			uint16_t nameLen;
+			if (!reader.get(hook.offset) || !reader.get(kind) || kind > (uint8_t)HookKind::Static || !reader.get(nameLen)) return false;
+			uint8_t const* name = reader.take(nameLen);
+			if (!name) return false;
+			hook.kind = (HookKind)kind;
+			hook.name.assign(reinterpret_cast<char const*>(name), nameLen);
+			result.hooks.push_back(std::move(hook));
+		}
+		for (uint32_t i = 0; i < patchCount; i++) {
+			PatchRecord patch;
+			uint32_t length;
+			if (!reader.get(patch.offset) || !reader.get(length)) return false;
+			uint8_t const* bytes = reader.take(length);
+			if (!bytes) return false;
+			patch.bytes.assign(bytes, bytes + length);
+			result.patches.push_back(std::move(patch));
+		}
+		return reader.atEnd();
+	}
+
+	ModScanResult buildHookIndex(char const* dylibPath, FileIdentity* identityOut) {
+		ModScanResult result;
+		FileIdentity identity;
+		if (!statFile(dylibPath, identity.size, identity.mtime)) {
+			result.error = std::string("couldn't stat ") + dylibPath + ": " + strerror(errno);
+			return result;
+		}
+
+		// one mapping serves both the hash and the scan
+		MappedFile file;
+		if (!file.open(dylibPath, &result.error)) return result;
+		identity.sha256 = Sha256::ofData(file.data(), file.size());
+		result = scanModData(file.data(), file.size());
+
+		// a sidecar that can't be written only costs a rescan next time
+		writeWholeFile(hookIndexPath(dylibPath), serialize(identity, result));
+		if (identityOut) *identityOut = identity;
+		return result;
+	}
+
+	ModScanResult loadHookIndex(char const* dylibPath, bool* fromSidecar, FileIdentity* identity) {
+		if (fromSidecar) *fromSidecar = false;
+
+		FileIdentity current;
+		std::string sidecar;
+		if (statFile(dylibPath, current.size, current.mtime) && readWholeFile(hookIndexPath(dylibPath), sidecar)) {
+			ByteReader reader(reinterpret_cast<uint8_t const*>(sidecar.data()), sidecar.size());
+			FileIdentity stored;
+			uint32_t hookCount, patchCount;
+			if (parseHeader(reader, stored, hookCount, patchCount) && stored.size == current.size) {
+				bool valid = stored.mtime == current.mtime;
+				if (!valid && Sha256::ofFile(dylibPath, current.sha256) && current.sha256 == stored.sha256) {
+					// same bytes under a new mtime (re-extracted), keep the records and remember the new mtime
+					valid = true;
+					memcpy(&sidecar[kHookIndexMtimeOffset], &current.mtime, sizeof(current.mtime));
+					writeWholeFile(hookIndexPath(dylibPath), sidecar);
+				}
+
+				ModScanResult result;
+				if (valid && parseRecords(reader, hookCount, patchCount, result)) {
+					if (fromSidecar) *fromSidecar = true;
+					if (identity) {
+						*identity = stored;
+						identity->mtime = current.mtime;
+					}
+					return result;
+				}
+			}
+		}
+		return buildHookIndex(dylibPath, identity);
+	}
+
+	bool cachedFileSha256(char const* path, Sha256Digest& digest) {
+		FileIdentity current;
+		if (!statFile(path, current.size, current.mtime)) return false;
+
+		std::string cachePath = std::string(path) + ".sha256";
+		std::string cache;
+		if (readWholeFile(cachePath, cache)) {
+			ByteReader reader(reinterpret_cast<uint8_t const*>(cache.data()), cache.size());
+			FileIdentity stored;
+			if (reader.get(stored.size) && reader.get(stored.mtime) && reader.get(stored.sha256.data(), stored.sha256.size()) && reader.atEnd() &&
+				stored.size == current.size && stored.mtime == current.mtime) {
+				digest = stored.sha256;
+				return true;
+			}
+		}
+
+		if (!Sha256::ofFile(path, current.sha256)) return false;
+		ByteWriter writer;
+		writer.put(current.size);
+		writer.put(current.mtime);
+		writer.put(current.sha256.data(), current.sha256.size());
+		writeWholeFile(cachePath, writer.data());
+		digest = current.sha256;
+		return true;
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "ModScanner.hpp"
+#include "Sha256.hpp"
+
+#include <string>
+
+namespace patch {
+	// what a sidecar was built from; size + mtime are checked first, the hash only when the mtime moved
+	struct FileIdentity {
+		uint64_t size = 0;
+		int64_t mtime = 0;
+		Sha256Digest sha256 {};
+	};
+
+	bool statFile(char const* path, uint64_t& size, int64_t& mtime);
+
+	// "<dylib>.hookindex", next to the mod's dylib
+	std::string hookIndexPath(char const* dylibPath);
+
+	// scans the dylib and (re)writes its sidecar
+	ModScanResult buildHookIndex(char const* dylibPath, FileIdentity* identity = nullptr);
+
+	// the sidecar's records if it still describes the dylib, otherwise rebuilds it;
+	// fromSidecar tells which of the two happened, identity is what the records belong to
+	ModScanResult loadHookIndex(char const* dylibPath, bool* fromSidecar = nullptr, FileIdentity* identity = nullptr);
+
+	// SHA-256 of a large file, remembered in "<path>.sha256" until its size or mtime changes
+	bool cachedFileSha256(char const* path, Sha256Digest& digest);
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+// the Mach-O definitions the patch code uses; the SDK headers on Apple, a minimal copy elsewhere
+// so the scanner and resolver can also be built and run against fixtures on Linux
+#if __has_include(<mach-o/loader.h>)
+#include <mach-o/fat.h>
+#include <mach-o/loader.h>
+#include <mach-o/nlist.h>
+#else
+#include <stdint.h>
+
+#define MH_MAGIC_64 0xfeedfacf
+#define MH_CIGAM_64 0xcffaedfe
+#define FAT_MAGIC 0xcafebabe
+#define FAT_CIGAM 0xbebafeca
+#define FAT_MAGIC_64 0xcafebabf
+#define FAT_CIGAM_64 0xbfbafeca
+
+#define CPU_ARCH_ABI64 0x01000000
+#define CPU_TYPE_ARM 12
+#define CPU_TYPE_ARM64 (CPU_TYPE_ARM | CPU_ARCH_ABI64)
+
+#define LC_REQ_DYLD 0x80000000
+#define LC_SYMTAB 0x2
+#define LC_DYSYMTAB 0xb
+#define LC_SEGMENT_64 0x19
+#define LC_UUID 0x1b
+#define LC_CODE_SIGNATURE 0x1d
+#define LC_SEGMENT_SPLIT_INFO 0x1e
+#define LC_DYLD_INFO 0x22
+#define LC_DYLD_INFO_ONLY (0x22 | LC_REQ_DYLD)
+#define LC_FUNCTION_STARTS 0x26
+#define LC_DATA_IN_CODE 0x29
+#define LC_DYLIB_CODE_SIGN_DRS 0x2B
+#define LC_DYLD_EXPORTS_TRIE (0x33 | LC_REQ_DYLD)
+#define LC_DYLD_CHAINED_FIXUPS (0x34 | LC_REQ_DYLD)
+
+#define VM_PROT_READ 0x01
+#define VM_PROT_WRITE 0x02
+#define VM_PROT_EXECUTE 0x04
+
+#define SECTION_TYPE 0x000000ff
+#define S_REGULAR 0x0
+#define S_ZEROFILL 0x1
+#define S_GB_ZEROFILL 0xc
+#define S_THREAD_LOCAL_ZEROFILL 0x12
+#define S_ATTR_PURE_INSTRUCTIONS 0x80000000
+#define S_ATTR_SOME_INSTRUCTIONS 0x00000400
+
+#define N_STAB 0xe0
+#define N_TYPE 0x0e
+#define N_SECT 0xe
+
+#define EXPORT_SYMBOL_FLAGS_KIND_MASK 0x03
+#define EXPORT_SYMBOL_FLAGS_KIND_ABSOLUTE 0x02
+#define EXPORT_SYMBOL_FLAGS_REEXPORT 0x08
+#define EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER 0x10
+
+struct fat_header {
+	uint32_t magic;
+	uint32_t nfat_arch;
+};
+
+struct fat_arch {
+	int32_t cputype;
+	int32_t cpusubtype;
+	uint32_t offset;
+	uint32_t size;
+	uint32_t align;
+};
+
+struct fat_arch_64 {
+	int32_t cputype;
+	int32_t cpusubtype;
+	uint64_t offset;
+	uint64_t size;
+	uint32_t align;
+	uint32_t reserved;
+};
+
+struct mach_header_64 {
+	uint32_t magic;
+	int32_t cputype;
+	int32_t cpusubtype;
+	uint32_t filetype;
+	uint32_t ncmds;
+	uint32_t sizeofcmds;
+	uint32_t flags;
+	uint32_t reserved;
+};
+
+struct load_command {
+	uint32_t cmd;
+	uint32_t cmdsize;
+};
+
+struct segment_command_64 {
+	uint32_t cmd;
+	uint32_t cmdsize;
+	char segname[16];
+	uint64_t vmaddr;
+	uint64_t vmsize;
+	uint64_t fileoff;
+	uint64_t filesize;
+	int32_t maxprot;
+	int32_t initprot;
+	uint32_t nsects;
+	uint32_t flags;
+};
+
+struct section_64 {
+	char sectname[16];
+	char segname[16];
+	uint64_t addr;
+	uint64_t size;
+	uint32_t offset;
+	uint32_t align;
+	uint32_t reloff;
+	uint32_t nreloc;
+	uint32_t flags;
+	uint32_t reserved1;
+	uint32_t reserved2;
+	uint32_t reserved3;
+};
+
+struct symtab_command {
+	uint32_t cmd;
+	uint32_t cmdsize;
+	uint32_t symoff;
+	uint32_t nsyms;
+	uint32_t stroff;
+	uint32_t strsize;
+};
+
+struct dysymtab_command {
+	uint32_t cmd;
+	uint32_t cmdsize;
+	uint32_t ilocalsym;
+	uint32_t nlocalsym;
+	uint32_t iextdefsym;
+	uint32_t nextdefsym;
+	uint32_t iundefsym;
+	uint32_t nundefsym;
+	uint32_t tocoff;
+	uint32_t ntoc;
+	uint32_t modtaboff;
+	uint32_t nmodtab;
+	uint32_t extrefsymoff;
+	uint32_t nextrefsyms;
+	uint32_t indirectsymoff;
+	uint32_t nindirectsyms;
+	uint32_t extreloff;
+	uint32_t nextrel;
+	uint32_t locreloff;
+	uint32_t nlocrel;
+};
+
+struct dyld_info_command {
+	uint32_t cmd;
+	uint32_t cmdsize;
+	uint32_t rebase_off;
+	uint32_t rebase_size;
+	uint32_t bind_off;
+	uint32_t bind_size;
+	uint32_t weak_bind_off;
+	uint32_t weak_bind_size;
+	uint32_t lazy_bind_off;
+	uint32_t lazy_bind_size;
+	uint32_t export_off;
+	uint32_t export_size;
+};
+
+struct linkedit_data_command {
+	uint32_t cmd;
+	uint32_t cmdsize;
+	uint32_t dataoff;
+	uint32_t datasize;
+};
+
+struct uuid_command {
+	uint32_t cmd;
+	uint32_t cmdsize;
+	uint8_t uuid[16];
+};
+
+struct nlist_64 {
+	union {
+		uint32_t n_strx;
+	} n_un;
+	uint8_t n_type;
+	uint8_t n_sect;
+	uint16_t n_desc;
+	uint64_t n_value;
+};
+#endif
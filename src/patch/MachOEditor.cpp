@@ -0,0 +1,299 @@
+#include "MachOEditor.hpp"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// credits:
+// https://lief.re/doc/latest/tutorials/11_macho_modification.html (diagram)
+// https://alexomara.com/blog/adding-a-segment-to-an-existing-macos-mach-o-binary/ (the layout this follows)
+namespace patch {
+	static bool fail(std::string* error, std::string const& message) {
+		if (error) *error = message;
+		return false;
+	}
+
+	// segname/sectname aren't nul-terminated when the name takes all 16 bytes
+	static void setName(char (&field)[16], char const* name) {
+		memset(field, 0, sizeof(field));
+		memcpy(field, name, std::min(strlen(name), sizeof(field)));
+	}
+
+	static void shift(uint32_t& field, uint64_t linkFileOff, uint64_t segSize) {
+		if (field >= linkFileOff) field += (uint32_t)segSize;
+	}
+
+	// moves every file offset that points into __LINKEDIT, cmd is a copy in the new header
+	static void shiftLinkedit(load_command* lc, uint64_t linkFileOff, uint64_t segSize) {
+		switch (lc->cmd) {
+			case LC_DYLD_INFO:
+			case LC_DYLD_INFO_ONLY: {
+				auto dc = reinterpret_cast<dyld_info_command*>(lc);
+				shift(dc->rebase_off, linkFileOff, segSize);
+				shift(dc->bind_off, linkFileOff, segSize);
+				shift(dc->weak_bind_off, linkFileOff, segSize);
+				shift(dc->lazy_bind_off, linkFileOff, segSize);
+				shift(dc->export_off, linkFileOff, segSize);
+				break;
+			}
+			case LC_SYMTAB: {
+				auto sc = reinterpret_cast<symtab_command*>(lc);
+				shift(sc->symoff, linkFileOff, segSize);
+				shift(sc->stroff, linkFileOff, segSize);
+				break;
+			}
+			case LC_DYSYMTAB: {
+				auto dc = reinterpret_cast<dysymtab_command*>(lc);
+				shift(dc->tocoff, linkFileOff, segSize);
+				shift(dc->modtaboff, linkFileOff, segSize);
+				shift(dc->extrefsymoff, linkFileOff, segSize);
+				shift(dc->indirectsymoff, linkFileOff, segSize);
+				shift(dc->extreloff, linkFileOff, segSize);
+				shift(dc->locreloff, linkFileOff, segSize);
+				break;
+			}
+			case LC_CODE_SIGNATURE:
+			case LC_SEGMENT_SPLIT_INFO:
+			case LC_FUNCTION_STARTS:
+			case LC_DATA_IN_CODE:
+			case LC_DYLIB_CODE_SIGN_DRS:
+			case LC_DYLD_EXPORTS_TRIE:
+			case LC_DYLD_CHAINED_FIXUPS: {
+				auto ld = reinterpret_cast<linkedit_data_command*>(lc);
+				shift(ld->dataoff, linkFileOff, segSize);
+				break;
+			}
+			default:
+				break;
+		}
+	}
+
+	MachOEditor::~MachOEditor() {
+		discard();
+		if (m_inFd >= 0) ::close(m_inFd);
+	}
+
+	bool MachOEditor::open(char const* path, std::string* error) {
+		discard();
+		if (m_inFd >= 0) ::close(m_inFd);
+		m_header.clear();
+		m_inPath = path;
+		if (!m_in.open(path, error)) return false;
+		m_inFd = ::open(path, O_RDONLY);
+		if (m_inFd < 0) return fail(error, std::string("couldn't open ") + path + ": " + strerror(errno));
+
+		// the editor works on the file layout directly, so fat binaries are out
+		if (m_in.size() < sizeof(mach_header_64) || reinterpret_cast<mach_header_64 const*>(m_in.data())->magic != MH_MAGIC_64) {
+			return fail(error, std::string(path) + " is not a thin 64-bit Mach-O");
+		}
+		if (!m_image.parse(m_in.data(), m_in.size())) return fail(error, std::string("couldn't parse ") + path);
+		return true;
+	}
+
+	bool MachOEditor::insertSegment(char const* segName, char const* sectName, uint64_t sectSize, uint64_t segSize, uint32_t prot, uint32_t sectFlags, std::string* error) {
+		uint8_t const* base = m_in.data();
+		if (!base) return fail(error, "no binary opened");
+		auto header = reinterpret_cast<mach_header_64 const*>(base);
+		uint64_t cmdsEnd = sizeof(mach_header_64) + (uint64_t)header->sizeofcmds;
+		if (cmdsEnd > m_in.size()) return fail(error, "load commands run past the end of the binary");
+
+		// first pass: find __LINKEDIT and the first byte of segment data, the new command has to fit in front of it
+		segment_command_64 const* linkSeg = nullptr;
+		uint64_t firstData = m_in.size();
+		uint8_t const* ptr = base + sizeof(mach_header_64);
+		for (uint32_t i = 0; i < header->ncmds; i++) {
+			auto lc = reinterpret_cast<load_command const*>(ptr);
+			if (ptr + sizeof(load_command) > base + cmdsEnd || lc->cmdsize < sizeof(load_command) || ptr + lc->cmdsize > base + cmdsEnd) {
+				return fail(error, "malformed load command");
+			}
+			if (lc->cmd == LC_SEGMENT_64 && lc->cmdsize >= sizeof(segment_command_64)) {
+				auto seg = reinterpret_cast<segment_command_64 const*>(lc);
+				if (strncmp(seg->segname, "__LINKEDIT", 16) == 0) {
+					linkSeg = seg;
+				}
+				auto sect = reinterpret_cast<section_64 const*>(seg + 1);
+				for (uint32_t x = 0; x < seg->nsects && sizeof(segment_command_64) + (x + 1) * sizeof(section_64) <= lc->cmdsize; x++) {
+					uint32_t type = sect[x].flags & SECTION_TYPE;
+					if (sect[x].offset != 0 && type != S_ZEROFILL && type != S_GB_ZEROFILL && type != S_THREAD_LOCAL_ZEROFILL && sect[x].offset < firstData) {
+						firstData = sect[x].offset;
+					}
+				}
+			}
+			ptr += lc->cmdsize;
+		}
+		if (!linkSeg) return fail(error, "couldn't find __LINKEDIT segment");
+		m_linkFileOff = linkSeg->fileoff;
+		m_segSize = segSize;
+		if (m_linkFileOff > m_in.size()) return fail(error, "__LINKEDIT starts past the end of the binary");
+
+		uint32_t newCmdSize = sizeof(segment_command_64) + sizeof(section_64);
+		if (cmdsEnd + newCmdSize > firstData) return fail(error, "no room left for another load command");
+
+		segment_command_64 newSeg;
+		section_64 newSect;
+		memset(&newSeg, 0, sizeof(newSeg));
+		memset(&newSect, 0, sizeof(newSect));
+		newSeg.cmd = LC_SEGMENT_64;
+		newSeg.cmdsize = newCmdSize;
+		setName(newSeg.segname, segName);
+		newSeg.vmaddr = linkSeg->vmaddr;
+		newSeg.vmsize = segSize;
+		newSeg.fileoff = m_linkFileOff;
+		newSeg.filesize = segSize;
+		newSeg.maxprot = (int32_t)prot;
+		newSeg.initprot = (int32_t)prot;
+		newSeg.nsects = 1;
+
+		setName(newSect.sectname, sectName);
+		setName(newSect.segname, segName);
+		newSect.addr = newSeg.vmaddr;
+		newSect.size = sectSize;
+		newSect.offset = (uint32_t)newSeg.fileoff;
+		newSect.align = sectSize < 16 ? 0 : 4;
+		newSect.flags = sectFlags;
+
+		// second pass: copy the commands into the new header, the segment goes right before __LINKEDIT
+		m_header.clear();
+		m_header.reserve(cmdsEnd + newCmdSize);
+		m_header.insert(m_header.end(), base, base + sizeof(mach_header_64));
+		ptr = base + sizeof(mach_header_64);
+		for (uint32_t i = 0; i < header->ncmds; i++) {
+			auto lc = reinterpret_cast<load_command const*>(ptr);
+			bool isLinkedit = ptr == reinterpret_cast<uint8_t const*>(linkSeg);
+			if (isLinkedit) {
+				auto seg = reinterpret_cast<uint8_t const*>(&newSeg);
+				auto sect = reinterpret_cast<uint8_t const*>(&newSect);
+				m_header.insert(m_header.end(), seg, seg + sizeof(newSeg));
+				m_header.insert(m_header.end(), sect, sect + sizeof(newSect));
+			}
+			size_t at = m_header.size();
+			m_header.insert(m_header.end(), ptr, ptr + lc->cmdsize);
+			auto copy = reinterpret_cast<load_command*>(m_header.data() + at);
+			if (isLinkedit) {
+				auto seg = reinterpret_cast<segment_command_64*>(copy);
+				seg->vmaddr += segSize;
+				seg->fileoff += segSize;
+			} else {
+				shiftLinkedit(copy, m_linkFileOff, segSize);
+			}
+			ptr += lc->cmdsize;
+		}
+		auto newHeader = reinterpret_cast<mach_header_64*>(m_header.data());
+		newHeader->ncmds += 1;
+		newHeader->sizeofcmds += newCmdSize;
+		return true;
+	}
+
+	bool MachOEditor::copyRange(int outFd, uint64_t from, uint64_t to, uint64_t length, std::string* error) {
+#ifdef __linux__
+		// in-kernel copy first, the bytes never come up to user space
+		loff_t inOff = (loff_t)from;
+		loff_t outOff = (loff_t)to;
+		while (length > 0) {
+			ssize_t copied = copy_file_range(m_inFd, &inOff, outFd, &outOff, (size_t)length, 0);
+			if (copied < 0 && errno == EINTR) continue;
+			if (copied <= 0) break;
+			length -= (uint64_t)copied;
+		}
+		from = (uint64_t)inOff;
+		to = (uint64_t)outOff;
+#endif
+		// straight out of the read-only mapping, no intermediate buffer
+		uint8_t const* src = m_in.data() + from;
+		while (length > 0) {
+			ssize_t written = pwrite(outFd, src, (size_t)length, (off_t)to);
+			if (written < 0 && errno == EINTR) continue;
+			if (written <= 0) return fail(error, std::string("couldn't write ") + m_tmpPath + ": " + strerror(errno));
+			src += written;
+			to += (uint64_t)written;
+			length -= (uint64_t)written;
+		}
+		return true;
+	}
+
+	bool MachOEditor::write(char const* path, std::string* error) {
+		if (m_header.empty()) return fail(error, "no segment inserted");
+		discard();
+		m_outPath = path;
+		m_tmpPath = m_outPath + ".tmp";
+
+		struct stat st;
+		mode_t mode = fstat(m_inFd, &st) == 0 ? (st.st_mode & 07777) : 0755;
+		int fd = ::open(m_tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, mode);
+		if (fd < 0) return fail(error, std::string("couldn't create ") + m_tmpPath + ": " + strerror(errno));
+
+		// final size up front, the new segment stays a hole until something is patched into it
+		uint64_t headerLen = m_header.size();
+		uint64_t outSize = m_in.size() + m_segSize;
+		bool ok = true;
+		if (ftruncate(fd, (off_t)outSize) != 0) {
+			ok = fail(error, std::string("couldn't size ") + m_tmpPath + ": " + strerror(errno));
+		}
+		if (ok && pwrite(fd, m_header.data(), headerLen, 0) != (ssize_t)headerLen) {
+			ok = fail(error, std::string("couldn't write header to ") + m_tmpPath + ": " + strerror(errno));
+		}
+		// the old padding after the load commands is what the new command took over
+		if (ok && m_linkFileOff > headerLen) {
+			ok = copyRange(fd, headerLen, headerLen, m_linkFileOff - headerLen, error);
+		}
+		if (ok && m_in.size() > m_linkFileOff) {
+			ok = copyRange(fd, m_linkFileOff, m_linkFileOff + m_segSize, m_in.size() - m_linkFileOff, error);
+		}
+		if (ok) {
+			void* addr = mmap(nullptr, (size_t)outSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (addr == MAP_FAILED) {
+				ok = fail(error, std::string("couldn't map ") + m_tmpPath + ": " + strerror(errno));
+			} else {
+				m_out = static_cast<uint8_t*>(addr);
+				m_outSize = (size_t)outSize;
+			}
+		}
+		::close(fd);
+		if (!ok) unlink(m_tmpPath.c_str());
+		return ok;
+	}
+
+	bool MachOEditor::commit(std::string* error) {
+		if (!m_out) return fail(error, "nothing to commit");
+		// the data has to be on disk before the rename makes it the binary, or a crash can leave a renamed file full of holes
+		bool ok = msync(m_out, m_outSize, MS_SYNC) == 0;
+		munmap(m_out, m_outSize);
+		m_out = nullptr;
+		m_outSize = 0;
+		if (!ok) {
+			fail(error, std::string("couldn't flush ") + m_tmpPath + ": " + strerror(errno));
+			unlink(m_tmpPath.c_str());
+			return false;
+		}
+
+		int fd = ::open(m_tmpPath.c_str(), O_RDONLY);
+		ok = fd >= 0 && fsync(fd) == 0;
+		int syncErrno = errno;
+		if (fd >= 0) ::close(fd);
+		if (!ok) {
+			fail(error, std::string("couldn't sync ") + m_tmpPath + ": " + strerror(syncErrno));
+			unlink(m_tmpPath.c_str());
+			return false;
+		}
+
+		ok = rename(m_tmpPath.c_str(), m_outPath.c_str()) == 0;
+		if (!ok) {
+			fail(error, std::string("couldn't write ") + m_outPath + ": " + strerror(errno));
+			unlink(m_tmpPath.c_str());
+		}
+		return ok;
+	}
+
+	void MachOEditor::discard() {
+		if (!m_out) return;
+		munmap(m_out, m_outSize);
+		m_out = nullptr;
+		m_outSize = 0;
+		unlink(m_tmpPath.c_str());
+	}
+}
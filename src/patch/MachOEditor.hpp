@@ -0,0 +1,54 @@
+#pragma once
+
+#include "MachOFile.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace patch {
+	// Inserts one segment (with a single section) right before __LINKEDIT of a thin 64-bit binary.
+	// The output is created at its final size and every byte of it is written once: the new header in one pwrite,
+	// everything else copied file to file, and the new segment left as a hole that reads back as zeros.
+	class MachOEditor {
+	public:
+		MachOEditor() = default;
+		~MachOEditor();
+		MachOEditor(MachOEditor const&) = delete;
+		MachOEditor& operator=(MachOEditor const&) = delete;
+
+		bool open(char const* path, std::string* error = nullptr);
+		// the original binary, for planning anything that has to be known before the layout is fixed
+		MachOImage const& source() const { return m_image; }
+
+		// lays out the new header: the segment takes __LINKEDIT's place and __LINKEDIT moves up by segSize
+		bool insertSegment(char const* segName, char const* sectName, uint64_t sectSize, uint64_t segSize, uint32_t prot, uint32_t sectFlags, std::string* error = nullptr);
+
+		// creates `path` and maps it writable, patches go straight into data() until commit()
+		bool write(char const* path, std::string* error = nullptr);
+		uint8_t* data() const { return m_out; }
+		size_t size() const { return m_outSize; }
+		// flushes the mapping and moves the output over `path`
+		bool commit(std::string* error = nullptr);
+		// drops an uncommitted output
+		void discard();
+
+	private:
+		bool copyRange(int outFd, uint64_t from, uint64_t to, uint64_t length, std::string* error);
+
+		std::string m_inPath;
+		MappedFile m_in;
+		MachOImage m_image;
+		int m_inFd = -1;
+
+		std::vector<uint8_t> m_header;
+		uint64_t m_linkFileOff = 0;
+		uint64_t m_segSize = 0;
+
+		std::string m_outPath;
+		std::string m_tmpPath;
+		uint8_t* m_out = nullptr;
+		size_t m_outSize = 0;
+	};
+}
@@ -0,0 +1,174 @@
+#include "MachOFile.hpp"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace patch {
+	MappedFile::~MappedFile() {
+		close();
+	}
+
+	bool MappedFile::open(char const* path, std::string* error) {
+		close();
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0) {
+			if (error) *error = std::string("couldn't open ") + path + ": " + strerror(errno);
+			return false;
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			if (error) *error = std::string("couldn't stat ") + path + ": " + strerror(errno);
+			::close(fd);
+			return false;
+		}
+		if (st.st_size > 0) {
+			void* addr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (addr == MAP_FAILED) {
+				if (error) *error = std::string("couldn't map ") + path + ": " + strerror(errno);
+				::close(fd);
+				return false;
+			}
+			m_data = static_cast<uint8_t const*>(addr);
+			m_size = (size_t)st.st_size;
+		}
+		::close(fd);
+		return true;
+	}
+
+	void MappedFile::close() {
+		if (m_data) {
+			munmap(const_cast<uint8_t*>(m_data), m_size);
+		}
+		m_data = nullptr;
+		m_size = 0;
+	}
+
+	bool readUleb128(uint8_t const*& p, uint8_t const* end, uint64_t& value) {
+		value = 0;
+		for (unsigned shift = 0; p < end; shift += 7) {
+			uint8_t byte = *p++;
+			if (shift >= 64 || (shift == 63 && (byte & 0x7e))) return false;
+			value |= (uint64_t)(byte & 0x7f) << shift;
+			if (!(byte & 0x80)) return true;
+		}
+		return false;
+	}
+
+	static bool sliceOfFat(uint8_t const* data, size_t size, uint8_t const*& slice, size_t& sliceSize) {
+		if (size < sizeof(fat_header)) return false;
+		auto fat = reinterpret_cast<fat_header const*>(data);
+		uint32_t magic = fat->magic;
+		bool is64 = magic == FAT_CIGAM_64;
+		if (magic != FAT_CIGAM && !is64) return false;
+
+		// fat headers are big-endian
+		uint32_t count = __builtin_bswap32(fat->nfat_arch);
+		size_t archSize = is64 ? sizeof(fat_arch_64) : sizeof(fat_arch);
+		if (count > (size - sizeof(fat_header)) / archSize) return false;
+		for (uint32_t i = 0; i < count; i++) {
+			uint8_t const* entry = data + sizeof(fat_header) + i * archSize;
+			int32_t cputype;
+			uint64_t offset, length;
+			if (is64) {
+				auto arch = reinterpret_cast<fat_arch_64 const*>(entry);
+				cputype = (int32_t)__builtin_bswap32((uint32_t)arch->cputype);
+				offset = __builtin_bswap64(arch->offset);
+				length = __builtin_bswap64(arch->size);
+			} else {
+				auto arch = reinterpret_cast<fat_arch const*>(entry);
+				cputype = (int32_t)__builtin_bswap32((uint32_t)arch->cputype);
+				offset = __builtin_bswap32(arch->offset);
+				length = __builtin_bswap32(arch->size);
+			}
+			if (cputype == CPU_TYPE_ARM64 && offset <= size && length <= size - offset) {
+				slice = data + offset;
+				sliceSize = (size_t)length;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool MachOImage::parse(uint8_t const* data, size_t size) {
+		m_base = nullptr;
+		m_size = 0;
+		m_commands.clear();
+
+		uint8_t const* slice = data;
+		size_t sliceSize = size;
+		sliceOfFat(data, size, slice, sliceSize);
+		if (!slice || sliceSize < sizeof(mach_header_64)) return false;
+
+		auto header = reinterpret_cast<mach_header_64 const*>(slice);
+		if (header->magic != MH_MAGIC_64) return false;
+		if (header->sizeofcmds > sliceSize - sizeof(mach_header_64)) return false;
+
+		uint8_t const* cmdPtr = slice + sizeof(mach_header_64);
+		uint8_t const* cmdEnd = cmdPtr + header->sizeofcmds;
+		std::vector<load_command const*> commands;
+		commands.reserve(header->ncmds);
+		for (uint32_t i = 0; i < header->ncmds; i++) {
+			if ((size_t)(cmdEnd - cmdPtr) < sizeof(load_command)) return false;
+			auto lc = reinterpret_cast<load_command const*>(cmdPtr);
+			if (lc->cmdsize < sizeof(load_command) || lc->cmdsize > (size_t)(cmdEnd - cmdPtr)) return false;
+			if (lc->cmd == LC_SEGMENT_64) {
+				auto seg = reinterpret_cast<segment_command_64 const*>(lc);
+				if (lc->cmdsize < sizeof(segment_command_64) || seg->nsects > (lc->cmdsize - sizeof(segment_command_64)) / sizeof(section_64)) return false;
+			}
+			commands.push_back(lc);
+			cmdPtr += lc->cmdsize;
+		}
+
+		m_base = slice;
+		m_size = sliceSize;
+		m_commands = std::move(commands);
+		return true;
+	}
+
+	load_command const* MachOImage::findCommand(uint32_t cmd) const {
+		for (auto lc : m_commands) {
+			if (lc->cmd == cmd) return lc;
+		}
+		return nullptr;
+	}
+
+	std::vector<section_64 const*> MachOImage::sections() const {
+		std::vector<section_64 const*> result;
+		for (auto lc : m_commands) {
+			if (lc->cmd != LC_SEGMENT_64) continue;
+			auto seg = reinterpret_cast<segment_command_64 const*>(lc);
+			auto sect = reinterpret_cast<section_64 const*>(seg + 1);
+			for (uint32_t i = 0; i < seg->nsects; i++) {
+				result.push_back(&sect[i]);
+			}
+		}
+		return result;
+	}
+
+	section_64 const* MachOImage::findSection(char const* segname, char const* sectname) const {
+		for (auto sect : sections()) {
+			if (strncmp(sect->segname, segname, 16) == 0 && strncmp(sect->sectname, sectname, 16) == 0) return sect;
+		}
+		return nullptr;
+	}
+
+	segment_command_64 const* MachOImage::findSegment(char const* segname) const {
+		for (auto lc : m_commands) {
+			if (lc->cmd != LC_SEGMENT_64) continue;
+			auto seg = reinterpret_cast<segment_command_64 const*>(lc);
+			if (strncmp(seg->segname, segname, 16) == 0) return seg;
+		}
+		return nullptr;
+	}
+
+	uint8_t const* MachOImage::sectionData(section_64 const* sect) const {
+		if (!sect || sect->offset == 0) return nullptr;
+		uint32_t type = sect->flags & SECTION_TYPE;
+		if (type == S_ZEROFILL || type == S_GB_ZEROFILL || type == S_THREAD_LOCAL_ZEROFILL) return nullptr;
+		if (sect->offset > m_size || sect->size > m_size - sect->offset) return nullptr;
+		return m_base + sect->offset;
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "MachOCompat.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace patch {
+	// read-only mapping of a whole file
+	class MappedFile {
+	public:
+		MappedFile() = default;
+		~MappedFile();
+		MappedFile(MappedFile const&) = delete;
+		MappedFile& operator=(MappedFile const&) = delete;
+
+		bool open(char const* path, std::string* error = nullptr);
+		void close();
+
+		uint8_t const* data() const { return m_data; }
+		size_t size() const { return m_size; }
+
+	private:
+		uint8_t const* m_data = nullptr;
+		size_t m_size = 0;
+	};
+
+	// advances p past one ULEB128 value, false if it runs into end or doesn't fit in 64 bits
+	bool readUleb128(uint8_t const*& p, uint8_t const* end, uint64_t& value);
+
+	// a thin 64-bit little-endian image, the arm64 slice when the file is fat
+	class MachOImage {
+	public:
+		bool parse(uint8_t const* data, size_t size);
+
+		uint8_t const* base() const { return m_base; }
+		size_t size() const { return m_size; }
+		mach_header_64 const* header() const { return reinterpret_cast<mach_header_64 const*>(m_base); }
+
+		// load commands that passed the bounds check in parse()
+		std::vector<load_command const*> const& commands() const { return m_commands; }
+		load_command const* findCommand(uint32_t cmd) const;
+
+		std::vector<section_64 const*> sections() const;
+		section_64 const* findSection(char const* segname, char const* sectname) const;
+		segment_command_64 const* findSegment(char const* segname) const;
+
+		// file data of a section, or null when it has no bytes in the file
+		uint8_t const* sectionData(section_64 const* sect) const;
+
+	private:
+		uint8_t const* m_base = nullptr;
+		size_t m_size = 0;
+		std::vector<load_command const*> m_commands;
+	};
+}
@@ -0,0 +1,212 @@
+#include "ModScanner.hpp"
+#include "MachOFile.hpp"
+
+#include <algorithm>
+#include <string.h>
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PATCH_SCAN_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PATCH_SCAN_SSE2 1
+#endif
+
+namespace patch {
+	static constexpr char kMarkerPrefix[] = "[GEODE_";
+	static constexpr size_t kMarkerPrefixLen = sizeof(kMarkerPrefix) - 1;
+
+	uint8_t const* findMarker(uint8_t const* begin, uint8_t const* end) {
+		if (end - begin < (ptrdiff_t)kMarkerPrefixLen) return end;
+		uint8_t const* p = begin;
+
+		// compare the first and last prefix bytes 16 positions at a time, only candidates get a memcmp
+#if defined(PATCH_SCAN_NEON) || defined(PATCH_SCAN_SSE2)
+		// the second load reads 16 bytes at p + 6
+		uint8_t const* last = (end - p >= (ptrdiff_t)(kMarkerPrefixLen + 16)) ? end - kMarkerPrefixLen - 16 + 1 : p;
+#if defined(PATCH_SCAN_NEON)
+		uint8x16_t first = vdupq_n_u8('[');
+		uint8x16_t tail = vdupq_n_u8('_');
+		for (; p < last; p += 16) {
+			uint8x16_t eq = vandq_u8(vceqq_u8(vld1q_u8(p), first), vceqq_u8(vld1q_u8(p + kMarkerPrefixLen - 1), tail));
+			// narrow to 4 bits per byte, neon has no movemask
+			uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+			while (mask) {
+				int bit = __builtin_ctzll(mask) >> 2;
+				if (memcmp(p + bit + 1, kMarkerPrefix + 1, kMarkerPrefixLen - 2) == 0) return p + bit;
+				mask &= ~(0xfull << (bit * 4));
+			}
+		}
+#else
+		__m128i first = _mm_set1_epi8('[');
+		__m128i tail = _mm_set1_epi8('_');
+		for (; p < last; p += 16) {
+			__m128i a = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + kMarkerPrefixLen - 1));
+			uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, tail)));
+			while (mask) {
+				int bit = __builtin_ctz(mask);
+				if (memcmp(p + bit + 1, kMarkerPrefix + 1, kMarkerPrefixLen - 2) == 0) return p + bit;
+				mask &= mask - 1;
+			}
+		}
+#endif
+#endif
+		auto found = static_cast<uint8_t const*>(memmem(p, (size_t)(end - p), kMarkerPrefix, kMarkerPrefixLen));
+		return found ? found : end;
+	}
+
+	// cursor over one section, every expect/read advances only on success
+	class MarkerReader {
+	public:
+		MarkerReader(uint8_t const* p, uint8_t const* end) : m_p(p), m_end(end) {}
+
+		uint8_t const* pos() const { return m_p; }
+
+		bool expect(char const* text) {
+			size_t len = strlen(text);
+			if ((size_t)(m_end - m_p) < len || memcmp(m_p, text, len) != 0) return false;
+			m_p += len;
+			return true;
+		}
+
+		void skipSpaces() {
+			while (m_p < m_end && (*m_p == ' ' || (*m_p >= '\t' && *m_p <= '\r'))) m_p++;
+		}
+
+		bool readHex(uint64_t& value) {
+			value = 0;
+			uint8_t const* start = m_p;
+			while (m_p < m_end && m_p - start < 16) {
+				int digit = hexDigit(*m_p);
+				if (digit < 0) break;
+				value = (value << 4) | (uint64_t)digit;
+				m_p++;
+			}
+			return m_p != start && (m_p == m_end || hexDigit(*m_p) < 0);
+		}
+
+		bool readDecimal(uint64_t& value) {
+			value = 0;
+			uint8_t const* start = m_p;
+			while (m_p < m_end && *m_p >= '0' && *m_p <= '9' && m_p - start < 19) {
+				value = value * 10 + (uint64_t)(*m_p - '0');
+				m_p++;
+			}
+			return m_p != start && (m_p == m_end || *m_p < '0' || *m_p > '9');
+		}
+
+		// text up to the next occurrence of marker, at least one byte and no line breaks (what `.+?` matched)
+		bool readUntil(char const* marker, uint8_t const*& text, size_t& textLen) {
+			size_t len = strlen(marker);
+			auto found = static_cast<uint8_t const*>(memmem(m_p, (size_t)(m_end - m_p), marker, len));
+			if (!found || found == m_p) return false;
+			for (uint8_t const* q = m_p; q < found; q++) {
+				if (*q == '\n' || *q == '\r') return false;
+			}
+			text = m_p;
+			textLen = (size_t)(found - m_p);
+			m_p = found + len;
+			return true;
+		}
+
+		bool skip(size_t len) {
+			if ((size_t)(m_end - m_p) < len) return false;
+			m_p += len;
+			return true;
+		}
+
+	private:
+		static int hexDigit(uint8_t c) {
+			if (c >= '0' && c <= '9') return c - '0';
+			if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+			if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+			return -1;
+		}
+
+		uint8_t const* m_p;
+		uint8_t const* m_end;
+	};
+
+	static bool parseAddressHook(MarkerReader& reader, ModScanResult& result) {
+		uint64_t offset;
+		reader.skipSpaces();
+		if (!reader.expect("base::get() + 0x") || !reader.readHex(offset) || !reader.expect(" [GEODE_MODIFY_END]")) return false;
+		result.hooks.push_back({ offset, HookKind::Address, std::string() });
+		return true;
+	}
+
+	static bool parseStaticHook(MarkerReader& reader, ModScanResult& result) {
+		uint8_t const* name;
+		size_t nameLen;
+		uint64_t offset;
+		if (!reader.readUntil("[GEODE_MODIFY_OFFSET]", name, nameLen) || !reader.readHex(offset) || !reader.expect("[GEODE_MODIFY_END]")) return false;
+		result.hooks.push_back({ offset, HookKind::Static, std::string(reinterpret_cast<char const*>(name), nameLen) });
+		return true;
+	}
+
+	static bool parsePatch(MarkerReader& reader, ModScanResult& result) {
+		uint64_t size;
+		if (!reader.readDecimal(size) || size == 0 || !reader.expect("[GEODE_PATCH_BYTES]")) return false;
+
+		// the declared size is authoritative, so patch bytes may contain anything, including '[' or newlines;
+		// only fall back to searching for the next offset marker when the bytes aren't exactly that long
+		uint8_t const* bytes = reader.pos();
+		MarkerReader exact = reader;
+		if (!(exact.skip((size_t)size) && exact.expect("[GEODE_PATCH_OFFSET]"))) {
+			size_t bytesLen;
+			if (!reader.readUntil("[GEODE_PATCH_OFFSET]", bytes, bytesLen) || bytesLen < size) return false;
+			exact = reader;
+		}
+		reader = exact;
+
+		uint64_t offset;
+		if (!reader.readHex(offset) || !reader.expect("[GEODE_PATCH_END]")) return false;
+		result.patches.push_back({ offset, std::vector<uint8_t>(bytes, bytes + size) });
+		return true;
+	}
+
+	static void scanRange(uint8_t const* p, uint8_t const* end, ModScanResult& result) {
+		while ((p = findMarker(p, end)) != end) {
+			MarkerReader reader(p + kMarkerPrefixLen, end);
+			bool parsed = false;
+			if (reader.expect("MODIFY_ADDRESS]")) {
+				parsed = parseAddressHook(reader, result);
+			} else if (reader.expect("MODIFY_NAME]")) {
+				parsed = parseStaticHook(reader, result);
+			} else if (reader.expect("PATCH_SIZE]")) {
+				parsed = parsePatch(reader, result);
+			}
+			p = parsed ? reader.pos() : p + 1;
+		}
+	}
+
+	ModScanResult scanModData(uint8_t const* data, size_t size) {
+		ModScanResult result;
+		MachOImage image;
+		if (image.parse(data, size)) {
+			// the markers are string literals, they can only end up in cstring or const data
+			for (auto sect : image.sections()) {
+				if (strncmp(sect->sectname, "__cstring", 16) != 0 && strncmp(sect->sectname, "__const", 16) != 0) continue;
+				uint8_t const* sectData = image.sectionData(sect);
+				if (sectData) {
+					scanRange(sectData, sectData + sect->size, result);
+				}
+			}
+		} else {
+			scanRange(data, data + size, result);
+		}
+
+		std::stable_partition(result.hooks.begin(), result.hooks.end(), [](HookRecord const& hook) {
+			return hook.kind == HookKind::Address;
+		});
+		return result;
+	}
+
+	ModScanResult scanModFile(char const* path) {
+		MappedFile file;
+		ModScanResult result;
+		if (!file.open(path, &result.error)) return result;
+		return scanModData(file.data(), file.size());
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace patch {
+	enum class HookKind : uint8_t {
+		// [GEODE_MODIFY_ADDRESS] base::get() + 0x... [GEODE_MODIFY_END]
+		Address = 0,
+		// [GEODE_MODIFY_NAME]name[GEODE_MODIFY_OFFSET]hex[GEODE_MODIFY_END]
+		Static = 1,
+	};
+
+	struct HookRecord {
+		uint64_t offset;
+		HookKind kind;
+		// function name of a static hook, empty for address hooks
+		std::string name;
+	};
+
+	// [GEODE_PATCH_SIZE]dec[GEODE_PATCH_BYTES]bytes[GEODE_PATCH_OFFSET]hex[GEODE_PATCH_END]
+	struct PatchRecord {
+		uint64_t offset;
+		std::vector<uint8_t> bytes;
+	};
+
+	struct ModScanResult {
+		// address hooks first, then static hooks, each in file order (the order the regexes used to return them)
+		std::vector<HookRecord> hooks;
+		std::vector<PatchRecord> patches;
+		std::string error;
+	};
+
+	// finds the next "[GEODE_" marker in [begin, end), end if there is none
+	uint8_t const* findMarker(uint8_t const* begin, uint8_t const* end);
+
+	// scans the __cstring/__const sections of a mod dylib (the whole buffer if it isn't a Mach-O)
+	ModScanResult scanModData(uint8_t const* data, size_t size);
+	ModScanResult scanModFile(char const* path);
+}
@@ -0,0 +1,112 @@
+#include "PatchIndex.hpp"
+
+#include <algorithm>
+#include <string.h>
+
+namespace patch {
+	uint32_t PatchIndex::modIndex(std::string const& mod) {
+		// mods are added one after another, so only the last name has to be checked
+		if (m_mods.empty() || m_mods.back() != mod) {
+			m_mods.push_back(mod);
+		}
+		return (uint32_t)(m_mods.size() - 1);
+	}
+
+	void PatchIndex::addPatch(uint64_t offset, std::vector<uint8_t> const& bytes, std::string const& mod) {
+		if (bytes.empty()) return;
+		m_ranges.push_back({offset, offset + bytes.size(), (uint32_t)m_patches.size(), false});
+		m_patches.push_back({offset, bytes, modIndex(mod)});
+	}
+
+	void PatchIndex::addHook(uint64_t offset, size_t size, std::vector<std::string> const& mods) {
+		if (size == 0) return;
+		Hook hook;
+		for (std::string const& mod : mods) hook.mods.push_back(modIndex(mod));
+		m_ranges.push_back({offset, offset + size, (uint32_t)m_hooks.size(), true});
+		m_hooks.push_back(std::move(hook));
+	}
+
+	void PatchIndex::build() {
+		m_conflicts.clear();
+		m_writes.clear();
+
+		// ties broken by kind and insertion order so reports come out the same every time
+		std::sort(m_ranges.begin(), m_ranges.end(), [](Range const& a, Range const& b) {
+			if (a.begin != b.begin) return a.begin < b.begin;
+			if (a.hook != b.hook) return a.hook;
+			return a.index < b.index;
+		});
+
+		// overlaps: one pass over the sorted ranges, a cluster lasts while the next range starts before its end
+		for (size_t i = 0; i < m_ranges.size();) {
+			uint64_t end = m_ranges[i].end;
+			size_t j = i + 1;
+			for (; j < m_ranges.size() && m_ranges[j].begin < end; j++) {
+				end = std::max(end, m_ranges[j].end);
+			}
+			if (j - i > 1) {
+				PatchConflict conflict {m_ranges[i].begin, end, {}, false, true};
+				std::vector<uint32_t> mods;
+				Patch const* first = nullptr;
+				for (size_t k = i; k < j; k++) {
+					Range const& range = m_ranges[k];
+					if (range.hook) {
+						conflict.withHook = true;
+						conflict.sameBytes = false;
+						mods.insert(mods.end(), m_hooks[range.index].mods.begin(), m_hooks[range.index].mods.end());
+						continue;
+					}
+					Patch const& patch = m_patches[range.index];
+					mods.push_back(patch.mod);
+					if (!first) {
+						first = &patch;
+					} else if (patch.offset != first->offset || patch.bytes != first->bytes) {
+						conflict.sameBytes = false;
+					}
+				}
+				std::sort(mods.begin(), mods.end());
+				mods.erase(std::unique(mods.begin(), mods.end()), mods.end());
+				for (uint32_t mod : mods) conflict.mods.push_back(m_mods[mod]);
+				m_conflicts.push_back(std::move(conflict));
+			}
+			i = j;
+		}
+
+		// coalescing: runs of patches that overlap or touch become one buffer, filled in the order they were added
+		std::vector<uint32_t> run;
+		auto flush = [&](uint64_t begin, uint64_t end) {
+			if (run.empty()) return;
+			std::sort(run.begin(), run.end());
+			PatchWrite write {begin, std::vector<uint8_t>(end - begin)};
+			for (uint32_t index : run) {
+				Patch const& patch = m_patches[index];
+				memcpy(write.bytes.data() + (patch.offset - begin), patch.bytes.data(), patch.bytes.size());
+			}
+			m_writes.push_back(std::move(write));
+			run.clear();
+		};
+		uint64_t runBegin = 0;
+		uint64_t runEnd = 0;
+		for (Range const& range : m_ranges) {
+			if (range.hook) continue;
+			if (!run.empty() && range.begin > runEnd) {
+				flush(runBegin, runEnd);
+			}
+			if (run.empty()) {
+				runBegin = range.begin;
+				runEnd = range.end;
+			} else {
+				runEnd = std::max(runEnd, range.end);
+			}
+			run.push_back(range.index);
+		}
+		flush(runBegin, runEnd);
+	}
+
+	void PatchIndex::apply(uint8_t* out, size_t size) const {
+		for (PatchWrite const& write : m_writes) {
+			if (write.offset > size || write.bytes.size() > size - write.offset) continue;
+			memcpy(out + write.offset, write.bytes.data(), write.bytes.size());
+		}
+	}
+}
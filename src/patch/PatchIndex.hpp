@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace patch {
+	struct PatchConflict {
+		// union of the overlapping ranges, [begin, end)
+		uint64_t begin;
+		uint64_t end;
+		std::vector<std::string> mods;
+		// one of the ranges is a hook's intervener, the patch breaks that hook
+		bool withHook;
+		// only patches, all writing the same bytes to the same range
+		bool sameBytes;
+	};
+
+	struct PatchWrite {
+		uint64_t offset;
+		std::vector<uint8_t> bytes;
+	};
+
+	// Interval index over every byte range static patches and hook interveners touch.
+	// build() sorts once: overlapping ranges are reported per cluster, and adjacent or overlapping patches
+	// are merged into one write, later patches winning where they overlap (the order they used to be applied in).
+	class PatchIndex {
+	public:
+		void addPatch(uint64_t offset, std::vector<uint8_t> const& bytes, std::string const& mod);
+		void addHook(uint64_t offset, size_t size, std::vector<std::string> const& mods);
+
+		void build();
+		// sorted by address
+		std::vector<PatchConflict> const& conflicts() const { return m_conflicts; }
+		std::vector<PatchWrite> const& writes() const { return m_writes; }
+		size_t patchCount() const { return m_patches.size(); }
+
+		void apply(uint8_t* out, size_t size) const;
+
+	private:
+		struct Range {
+			uint64_t begin;
+			uint64_t end;
+			// index into m_patches, or into m_hooks when hook is set
+			uint32_t index;
+			bool hook;
+		};
+		struct Patch {
+			uint64_t offset;
+			std::vector<uint8_t> bytes;
+			uint32_t mod;
+		};
+		struct Hook {
+			std::vector<uint32_t> mods;
+		};
+
+		uint32_t modIndex(std::string const& mod);
+
+		std::vector<std::string> m_mods;
+		std::vector<Patch> m_patches;
+		std::vector<Hook> m_hooks;
+		std::vector<Range> m_ranges;
+		std::vector<PatchConflict> m_conflicts;
+		std::vector<PatchWrite> m_writes;
+	};
+}
@@ -0,0 +1,300 @@
+#include "PatchJournal.hpp"
+#include "ByteIO.hpp"
+#include "MachOFile.hpp"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// journal layout, little-endian:
+//   u32 magic, u32 version, u8[32] binary sha256, u64 handler address,
+//   u64 cave address, u64 cave file offset, u64 cave capacity, u64 cave used, u8[32] cave sha256,
+//   u64 output size, i64 output mtime, u32 hook count, u32 patch count
+//   hooks:   u64 offset, u64 cave offset, u32 index, u8 original length, original, u8 intervener length, intervener
+//   patches: u64 offset, u32 length, original, bytes
+namespace patch {
+	static constexpr uint32_t kJournalMagic = 0x4a504447; // "GDPJ"
+	static constexpr uint32_t kJournalVersion = 1;
+	static constexpr char kDirtyRangesHeader[] = "zsign-dirty 1\n";
+
+	std::string patchJournalPath(char const* binaryPath) {
+		return std::string(binaryPath) + ".patchjournal";
+	}
+
+	std::string dirtyRangesPath(char const* binaryPath) {
+		return std::string(binaryPath) + ".zsign_dirty";
+	}
+
+	bool PatchJournal::save(std::string const& path) const {
+		ByteWriter writer;
+		writer.put(kJournalMagic);
+		writer.put(kJournalVersion);
+		writer.put(binarySha256.data(), binarySha256.size());
+		writer.put(handlerAddress);
+		writer.put(caveAddr);
+		writer.put(caveFileOff);
+		writer.put(caveCapacity);
+		writer.put(caveUsed);
+		writer.put(caveSha256.data(), caveSha256.size());
+		writer.put(outputSize);
+		writer.put(outputMtime);
+		writer.put((uint32_t)hooks.size());
+		writer.put((uint32_t)patches.size());
+		for (JournalHook const& hook : hooks) {
+			writer.put(hook.offset);
+			writer.put(hook.caveOffset);
+			writer.put(hook.index);
+			writer.put((uint8_t)hook.original.size());
+			writer.put(hook.original.data(), hook.original.size());
+			writer.put((uint8_t)hook.intervener.size());
+			writer.put(hook.intervener.data(), hook.intervener.size());
+		}
+		for (JournalPatch const& patch : patches) {
+			writer.put(patch.offset);
+			writer.put((uint32_t)patch.bytes.size());
+			writer.put(patch.original.data(), patch.original.size());
+			writer.put(patch.bytes.data(), patch.bytes.size());
+		}
+		return writeWholeFile(path, writer.data());
+	}
+
+	bool PatchJournal::load(std::string const& path) {
+		std::string data;
+		if (!readWholeFile(path, data)) return false;
+		ByteReader reader(reinterpret_cast<uint8_t const*>(data.data()), data.size());
+
+		PatchJournal journal;
+		uint32_t magic, version, hookCount, patchCount;
+		if (!reader.get(magic) || magic != kJournalMagic || !reader.get(version) || version != kJournalVersion ||
+			!reader.get(journal.binarySha256.data(), journal.binarySha256.size()) || !reader.get(journal.handlerAddress) ||
+			!reader.get(journal.caveAddr) || !reader.get(journal.caveFileOff) || !reader.get(journal.caveCapacity) || !reader.get(journal.caveUsed) ||
+			!reader.get(journal.caveSha256.data(), journal.caveSha256.size()) || !reader.get(journal.outputSize) || !reader.get(journal.outputMtime) ||
+			!reader.get(hookCount) || !reader.get(patchCount)) {
+			return false;
+		}
+		for (uint32_t i = 0; i < hookCount; i++) {
+			JournalHook hook;
+			uint8_t originalLen, intervenerLen;
+			if (!reader.get(hook.offset) || !reader.get(hook.caveOffset) || !reader.get(hook.index) || !reader.get(originalLen)) return false;
+			uint8_t const* original = reader.take(originalLen);
+			if (!original || !reader.get(intervenerLen)) return false;
+			uint8_t const* intervener = reader.take(intervenerLen);
+			if (!intervener) return false;
+			hook.original.assign(original, original + originalLen);
+			hook.intervener.assign(intervener, intervener + intervenerLen);
+			journal.hooks.push_back(std::move(hook));
+		}
+		for (uint32_t i = 0; i < patchCount; i++) {
+			JournalPatch patch;
+			uint32_t length;
+			if (!reader.get(patch.offset) || !reader.get(length)) return false;
+			uint8_t const* original = reader.take(length);
+			uint8_t const* bytes = reader.take(length);
+			if (!original || !bytes) return false;
+			patch.original.assign(original, original + length);
+			patch.bytes.assign(bytes, bytes + length);
+			journal.patches.push_back(std::move(patch));
+		}
+		if (!reader.atEnd()) return false;
+		*this = std::move(journal);
+		return true;
+	}
+
+	void PatchJournal::record(uint8_t const* pristine, size_t size, std::vector<HookSite> const& sites, std::vector<PatchWrite> const& writes) {
+		hooks.clear();
+		patches.clear();
+		hooks.reserve(sites.size());
+		for (HookSite const& site : sites) {
+			if (site.offset > size || kHookOriginalSize > size - site.offset) continue;
+			uint8_t const* original = pristine + site.offset;
+			hooks.push_back({site.offset, site.caveOffset, site.index, std::vector<uint8_t>(original, original + kHookOriginalSize), site.intervener});
+		}
+		patches.reserve(writes.size());
+		for (PatchWrite const& write : writes) {
+			if (write.offset > size || write.bytes.size() > size - write.offset) continue;
+			uint8_t const* original = pristine + write.offset;
+			patches.push_back({write.offset, std::vector<uint8_t>(original, original + write.bytes.size()), write.bytes});
+		}
+	}
+
+	void PatchJournal::recordCave(uint8_t const* out, size_t size) {
+		if (caveFileOff > size || caveUsed > size - caveFileOff) return;
+		caveSha256 = Sha256::ofData(out + caveFileOff, caveUsed);
+	}
+
+	std::vector<HookSite> PatchJournal::sites() const {
+		std::vector<HookSite> sites;
+		sites.reserve(hooks.size());
+		for (JournalHook const& hook : hooks) {
+			sites.push_back({hook.offset, {}, hook.caveOffset, hook.index, hook.intervener});
+		}
+		return sites;
+	}
+
+	bool PatchJournal::matchesOutput(uint8_t const* out, size_t size, std::string* error) const {
+		MachOImage image;
+		if (!image.parse(out, size) || image.base() != out) {
+			if (error) *error = "not a thin 64-bit Mach-O";
+			return false;
+		}
+		segment_command_64 const* caveSeg = image.findSegment("__CUSTOM");
+		if (!caveSeg || caveSeg->vmaddr != caveAddr || caveSeg->fileoff != caveFileOff || caveSeg->vmsize != caveCapacity ||
+			caveSeg->filesize < caveUsed || caveFileOff > size || caveUsed > size - caveFileOff) {
+			if (error) *error = "the code cave segment isn't where the journal put it";
+			return false;
+		}
+		if (Sha256::ofData(out + caveFileOff, caveUsed) != caveSha256) {
+			if (error) *error = "the code cave has changed";
+			return false;
+		}
+
+		for (JournalPatch const& patch : patches) {
+			if (patch.offset > size || patch.bytes.size() > size - patch.offset || memcmp(out + patch.offset, patch.bytes.data(), patch.bytes.size()) != 0) {
+				if (error) *error = "a patch has been overwritten";
+				return false;
+			}
+		}
+		// patches are written after the interveners, a hook under one isn't expected to be intact
+		size_t p = 0;
+		for (JournalHook const& hook : hooks) {
+			while (p < patches.size() && patches[p].offset + patches[p].bytes.size() <= hook.offset) p++;
+			if (p < patches.size() && patches[p].offset < hook.offset + hook.intervener.size()) continue;
+			if (hook.offset > size || hook.intervener.size() > size - hook.offset || memcmp(out + hook.offset, hook.intervener.data(), hook.intervener.size()) != 0) {
+				if (error) *error = "a hook has been overwritten";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	std::vector<DirtyRange> PatchJournal::applyDelta(PatchJournal const& next, std::vector<uint8_t> const& cave, uint8_t* out, size_t size) const {
+		// everything either side writes, merged into disjoint spans and kept as it is now to find what really changed
+		std::vector<DirtyRange> spans;
+		auto touch = [&](uint64_t offset, size_t length) {
+			if (length == 0 || offset > size || length > size - offset) return;
+			spans.push_back({offset, length});
+		};
+		for (PatchJournal const* journal : {this, &next}) {
+			for (JournalHook const& hook : journal->hooks) touch(hook.offset, hook.original.size());
+			for (JournalPatch const& patch : journal->patches) touch(patch.offset, patch.bytes.size());
+		}
+		std::sort(spans.begin(), spans.end(), [](DirtyRange const& a, DirtyRange const& b) { return a.offset < b.offset; });
+		std::vector<DirtyRange> merged;
+		for (DirtyRange const& span : spans) {
+			if (!merged.empty() && span.offset <= merged.back().offset + merged.back().length) {
+				merged.back().length = std::max(merged.back().length, span.offset + span.length - merged.back().offset);
+			} else {
+				merged.push_back(span);
+			}
+		}
+		std::vector<uint8_t> before;
+		for (DirtyRange const& span : merged) {
+			before.insert(before.end(), out + span.offset, out + span.offset + span.length);
+		}
+
+		// back to the pristine bytes, then the same order a full patch writes in
+		auto write = [&](uint64_t offset, std::vector<uint8_t> const& bytes) {
+			if (offset > size || bytes.size() > size - offset) return;
+			memcpy(out + offset, bytes.data(), bytes.size());
+		};
+		for (JournalHook const& hook : hooks) write(hook.offset, hook.original);
+		for (JournalPatch const& patch : patches) write(patch.offset, patch.original);
+		for (JournalHook const& hook : next.hooks) write(hook.offset, hook.intervener);
+		for (JournalPatch const& patch : next.patches) write(patch.offset, patch.bytes);
+
+		std::vector<DirtyRange> dirty;
+		size_t at = 0;
+		for (DirtyRange const& span : merged) {
+			uint8_t const* now = out + span.offset;
+			uint8_t const* was = before.data() + at;
+			for (uint64_t i = 0; i < span.length;) {
+				if (now[i] == was[i]) {
+					i++;
+					continue;
+				}
+				uint64_t begin = i;
+				while (i < span.length && now[i] != was[i]) i++;
+				dirty.push_back({span.offset + begin, i - begin});
+			}
+			at += span.length;
+		}
+
+		// new trampolines go after the old ones, the section is grown to cover them
+		if (next.caveUsed > caveUsed && cave.size() >= next.caveUsed && caveFileOff <= size && next.caveUsed <= size - caveFileOff) {
+			memcpy(out + caveFileOff + caveUsed, cave.data() + caveUsed, next.caveUsed - caveUsed);
+			dirty.push_back({caveFileOff + caveUsed, next.caveUsed - caveUsed});
+
+			MachOImage image;
+			section_64 const* caveSect = image.parse(out, size) ? image.findSection("__CUSTOM", "__custom") : nullptr;
+			if (caveSect && caveSect->size != next.caveUsed) {
+				section_64* sect = const_cast<section_64*>(caveSect);
+				sect->size = next.caveUsed;
+				dirty.push_back({(uint64_t)(reinterpret_cast<uint8_t const*>(&sect->size) - out), sizeof(sect->size)});
+			}
+		}
+		return dirty;
+	}
+
+	bool addDirtyRanges(char const* binaryPath, std::vector<DirtyRange> const& ranges, bool signedSince) {
+		std::string path = dirtyRangesPath(binaryPath);
+		std::string list;
+		if (!signedSince) {
+			if (!readWholeFile(path, list)) return true;
+			if (list.compare(0, sizeof(kDirtyRangesHeader) - 1, kDirtyRangesHeader) != 0) {
+				// a list that can't be extended is worse than none, without one every page is hashed
+				unlink(path.c_str());
+				return false;
+			}
+		} else {
+			list = kDirtyRangesHeader;
+		}
+		for (DirtyRange const& range : ranges) {
+			list += std::to_string(range.offset) + " " + std::to_string(range.length) + "\n";
+		}
+		if (!writeWholeFile(path, list)) {
+			unlink(path.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	WritableFile::~WritableFile() {
+		close();
+	}
+
+	bool WritableFile::open(char const* path, std::string* error) {
+		close();
+		int fd = ::open(path, O_RDWR);
+		if (fd < 0) {
+			if (error) *error = std::string("couldn't open ") + path + ": " + strerror(errno);
+			return false;
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+			if (error) *error = std::string("couldn't stat ") + path + ": " + strerror(errno);
+			::close(fd);
+			return false;
+		}
+		void* addr = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (addr == MAP_FAILED) {
+			if (error) *error = std::string("couldn't map ") + path + ": " + strerror(errno);
+			return false;
+		}
+		m_data = static_cast<uint8_t*>(addr);
+		m_size = (size_t)st.st_size;
+		return true;
+	}
+
+	void WritableFile::close() {
+		if (m_data) {
+			munmap(m_data, m_size);
+		}
+		m_data = nullptr;
+		m_size = 0;
+	}
+}
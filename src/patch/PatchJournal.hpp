@@ -0,0 +1,100 @@
+#pragma once
+
+#include "HookEngine.hpp"
+#include "PatchIndex.hpp"
+#include "Sha256.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace patch {
+	struct JournalHook {
+		uint64_t offset;
+		uint64_t caveOffset;
+		uint32_t index;
+		// the pristine bytes the trampoline relocated (kHookOriginalSize), written back when the hook goes away
+		std::vector<uint8_t> original;
+		std::vector<uint8_t> intervener;
+	};
+
+	struct JournalPatch {
+		uint64_t offset;
+		// pristine bytes under the write
+		std::vector<uint8_t> original;
+		std::vector<uint8_t> bytes;
+	};
+
+	// bytes [offset, offset + length) of a file that changed
+	struct DirtyRange {
+		uint64_t offset;
+		uint64_t length;
+	};
+
+	// What a patched binary carries on top of the pristine one, kept in "<binary>.patchjournal".
+	// With it a different set of hooks and patches is applied in place: removed ones get their original bytes back,
+	// new trampolines go after the ones already in the cave, and only bytes that end up different are written.
+	struct PatchJournal {
+		Sha256Digest binarySha256 {};
+		uint64_t handlerAddress = 0;
+		// where the cave segment is and how much of it is used, capacity is the segment's size
+		uint64_t caveAddr = 0;
+		uint64_t caveFileOff = 0;
+		uint64_t caveCapacity = 0;
+		uint64_t caveUsed = 0;
+		Sha256Digest caveSha256 {};
+		// the patched file as it was left, anything else means it has been signed (or replaced) since
+		uint64_t outputSize = 0;
+		int64_t outputMtime = 0;
+		// sorted by address
+		std::vector<JournalHook> hooks;
+		std::vector<JournalPatch> patches;
+
+		bool load(std::string const& path);
+		bool save(std::string const& path) const;
+
+		// hooks and coalesced patches as built, originals read from the pristine binary
+		void record(uint8_t const* pristine, size_t size, std::vector<HookSite> const& sites, std::vector<PatchWrite> const& writes);
+		// the cave's hash as it is in out, after it has been written
+		void recordCave(uint8_t const* out, size_t size);
+
+		// the hooks as HookEngine::build() takes them back
+		std::vector<HookSite> sites() const;
+
+		// true if out still has the cave segment, cave contents, interveners and patches this journal describes
+		bool matchesOutput(uint8_t const* out, size_t size, std::string* error = nullptr) const;
+
+		// turns out from what this journal describes into what next describes: originals first, then next's interveners,
+		// patches and the part of cave past caveUsed (plus the section size that covers it). returns what actually changed
+		std::vector<DirtyRange> applyDelta(PatchJournal const& next, std::vector<uint8_t> const& cave, uint8_t* out, size_t size) const;
+	};
+
+	// "<binary>.patchjournal", next to the patched binary
+	std::string patchJournalPath(char const* binaryPath);
+
+	// "<binary>.zsign_dirty", tells ZSign which ranges to hash again instead of every page
+	std::string dirtyRangesPath(char const* binaryPath);
+	// signedSince: the binary got a signature after the last patch, so the ranges start a new list.
+	// otherwise they join the list still waiting for the signer, and if there is none no page hash is valid yet and nothing is written
+	bool addDirtyRanges(char const* binaryPath, std::vector<DirtyRange> const& ranges, bool signedSince);
+
+	// a whole file mapped shared and writable, changes land in the file itself
+	class WritableFile {
+	public:
+		WritableFile() = default;
+		~WritableFile();
+		WritableFile(WritableFile const&) = delete;
+		WritableFile& operator=(WritableFile const&) = delete;
+
+		bool open(char const* path, std::string* error = nullptr);
+		void close();
+
+		uint8_t* data() const { return m_data; }
+		size_t size() const { return m_size; }
+
+	private:
+		uint8_t* m_data = nullptr;
+		size_t m_size = 0;
+	};
+}
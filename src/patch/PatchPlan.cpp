@@ -0,0 +1,97 @@
+#include "PatchPlan.hpp"
+#include "MachOFile.hpp"
+
+#include <algorithm>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace patch {
+	static constexpr int kManifestVersion = 2;
+
+	bool PatchPlan::setBinary(char const* path, std::string* error) {
+		if (!cachedFileSha256(path, m_binarySha256)) {
+			if (error) *error = std::string("couldn't hash ") + path + ": " + strerror(errno);
+			return false;
+		}
+		return true;
+	}
+
+	bool PatchPlan::addMod(char const* dylibPath, std::string* error) {
+		return add(dylibPath, false, error);
+	}
+
+	bool PatchPlan::addLoader(char const* dylibPath, std::string* error) {
+		return add(dylibPath, true, error);
+	}
+
+	bool PatchPlan::add(char const* dylibPath, bool loader, std::string* error) {
+		ModPlan mod;
+		char const* slash = strrchr(dylibPath, '/');
+		mod.name = slash ? slash + 1 : dylibPath;
+		mod.loader = loader;
+
+		FileIdentity identity;
+		mod.records = loadHookIndex(dylibPath, nullptr, &identity);
+		if (!mod.records.error.empty()) {
+			if (error) *error = mod.records.error;
+			return false;
+		}
+		mod.sha256 = identity.sha256;
+		m_mods.push_back(std::move(mod));
+		return true;
+	}
+
+	std::string PatchPlan::manifest() const {
+		char line[128];
+		std::string text;
+		snprintf(line, sizeof(line), "geode-patch-plan %d\n", kManifestVersion);
+		text += line;
+		text += "binary " + Sha256::toHex(m_binarySha256) + "\n";
+		snprintf(line, sizeof(line), "handler 0x%" PRIx64 "\n", m_handlerAddress);
+		text += line;
+
+		for (ModPlan const& mod : m_mods) {
+			// what a mod does to the binary is all in its records below, only the loader's version matters beyond them
+			if (mod.loader) {
+				text += "loader " + mod.name + " " + Sha256::toHex(mod.sha256) + "\n";
+			} else {
+				text += "mod " + mod.name + "\n";
+			}
+
+			std::vector<HookRecord const*> hooks;
+			for (HookRecord const& hook : mod.records.hooks) hooks.push_back(&hook);
+			std::sort(hooks.begin(), hooks.end(), [](HookRecord const* a, HookRecord const* b) {
+				return a->offset != b->offset ? a->offset < b->offset : a->kind < b->kind;
+			});
+			for (HookRecord const* hook : hooks) {
+				snprintf(line, sizeof(line), "hook %d 0x%" PRIx64 "\n", (int)hook->kind, hook->offset);
+				text += line;
+			}
+
+			std::vector<PatchRecord const*> patches;
+			for (PatchRecord const& patch : mod.records.patches) patches.push_back(&patch);
+			std::sort(patches.begin(), patches.end(), [](PatchRecord const* a, PatchRecord const* b) {
+				return a->offset != b->offset ? a->offset < b->offset : a->bytes < b->bytes;
+			});
+			for (PatchRecord const* patch : patches) {
+				snprintf(line, sizeof(line), "patch 0x%" PRIx64 " %zu ", patch->offset, patch->bytes.size());
+				text += line;
+				text += Sha256::toHex(Sha256::ofData(patch->bytes.data(), patch->bytes.size()));
+				text += "\n";
+			}
+		}
+		return text;
+	}
+
+	std::string PatchPlan::hash() const {
+		std::string text = manifest();
+		return Sha256::toHex(Sha256::ofData(text.data(), text.size()));
+	}
+
+	bool PatchPlan::isPatchedBinary(char const* path) {
+		MappedFile file;
+		MachOImage image;
+		return file.open(path) && image.parse(file.data(), file.size()) && image.findSegment("__CUSTOM") != nullptr;
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "HookIndex.hpp"
+
+#include <string>
+#include <vector>
+
+namespace patch {
+	struct ModPlan {
+		std::string name;
+		// Geode's own dylib, the only one whose bytes go into the plan
+		bool loader = false;
+		Sha256Digest sha256;
+		ModScanResult records;
+	};
+
+	// Everything that decides what the patched binary looks like, gathered before any patching work.
+	// If its hash matches the last successful patch and the output is still a patched binary, nothing has to be redone.
+	class PatchPlan {
+	public:
+		// the pristine binary everything is patched from (hash cached next to it)
+		bool setBinary(char const* path, std::string* error = nullptr);
+		void setHandlerAddress(uint64_t address) { m_handlerAddress = address; }
+		// records come from the mod's hook index sidecar. a mod counts by its records alone,
+		// its dylib gets re-signed after every patch and would never hash the same twice
+		bool addMod(char const* dylibPath, std::string* error = nullptr);
+		// same, but the dylib's hash is kept as the loader's version
+		bool addLoader(char const* dylibPath, std::string* error = nullptr);
+
+		Sha256Digest const& binarySha256() const { return m_binarySha256; }
+		std::vector<ModPlan> const& mods() const { return m_mods; }
+
+		// canonical text form: fixed field order, hooks and patches sorted within each mod
+		std::string manifest() const;
+		std::string hash() const;
+
+		// true if the file is a 64-bit Mach-O that already carries the code cave segment
+		static bool isPatchedBinary(char const* path);
+
+	private:
+		bool add(char const* dylibPath, bool loader, std::string* error);
+
+		Sha256Digest m_binarySha256 {};
+		uint64_t m_handlerAddress = 0;
+		std::vector<ModPlan> m_mods;
+	};
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#if __has_include(<CommonCrypto/CommonDigest.h>)
+#include <CommonCrypto/CommonDigest.h>
+#define PATCH_SHA256_COMMONCRYPTO 1
+#endif
+
+namespace patch {
+	using Sha256Digest = std::array<uint8_t, 32>;
+
+	// CommonCrypto on Apple (uses the SHA instructions), a plain implementation elsewhere
+	class Sha256 {
+	public:
+		Sha256();
+
+		void update(void const* data, size_t size);
+		Sha256Digest finish();
+
+		static Sha256Digest ofData(void const* data, size_t size);
+		static bool ofFile(char const* path, Sha256Digest& digest);
+		static std::string toHex(Sha256Digest const& digest);
+
+	private:
+#ifdef PATCH_SHA256_COMMONCRYPTO
+		CC_SHA256_CTX m_ctx;
+#else
+		void compress(uint8_t const* block);
+
+		uint32_t m_state[8];
+		uint8_t m_buffer[64];
+		size_t m_bufferLen;
+		uint64_t m_totalLen;
+#endif
+	};
+}
@@ -0,0 +1,163 @@
+#include "SymbolResolver.hpp"
+
+#include <map>
+#include <mutex>
+#include <string.h>
+#include <string_view>
+#include <unordered_map>
+
+namespace patch {
+	bool SymbolResolver::parseFile(uint8_t const* data, size_t size) {
+		if (!m_image.parse(data, size)) return false;
+		m_linkeditBase = m_image.base();
+		if (!parse()) return false;
+		// the segment can claim more than the file has
+		if (m_linkeditEnd > m_image.size()) m_linkeditEnd = m_image.size();
+		return true;
+	}
+
+	bool SymbolResolver::parseLoaded(mach_header_64 const* header, intptr_t slide) {
+		if (!header || header->magic != MH_MAGIC_64) return false;
+		if (!m_image.parse(reinterpret_cast<uint8_t const*>(header), sizeof(mach_header_64) + header->sizeofcmds)) return false;
+		segment_command_64 const* linkSeg = m_image.findSegment("__LINKEDIT");
+		if (!linkSeg) return false;
+		m_linkeditBase = reinterpret_cast<uint8_t const*>(linkSeg->vmaddr + slide - linkSeg->fileoff);
+		return parse();
+	}
+
+	bool SymbolResolver::parse() {
+		segment_command_64 const* linkSeg = m_image.findSegment("__LINKEDIT");
+		segment_command_64 const* textSeg = m_image.findSegment("__TEXT");
+		if (!linkSeg || !textSeg) return false;
+		m_linkeditBegin = linkSeg->fileoff;
+		m_linkeditEnd = linkSeg->fileoff + linkSeg->filesize;
+		m_textVmaddr = textSeg->vmaddr;
+
+		auto uuid = reinterpret_cast<uuid_command const*>(m_image.findCommand(LC_UUID));
+		m_hasUuid = uuid && uuid->cmdsize >= sizeof(uuid_command);
+		if (m_hasUuid) memcpy(m_uuid.data(), uuid->uuid, m_uuid.size());
+		return true;
+	}
+
+	uint8_t const* SymbolResolver::linkedit(uint64_t offset, uint64_t size) const {
+		if (offset < m_linkeditBegin || offset > m_linkeditEnd || size > m_linkeditEnd - offset) return nullptr;
+		return m_linkeditBase + offset;
+	}
+
+	bool SymbolResolver::lookupTrie(uint8_t const* trie, uint8_t const* end, std::string const& name, uint64_t& address) const {
+		uint8_t const* node = trie;
+		size_t matched = 0;
+		// every edge eats at least one character, so a well-formed trie can't take more steps than that
+		for (size_t depth = 0; depth <= name.size(); depth++) {
+			uint8_t const* p = node;
+			uint64_t terminalSize;
+			if (!readUleb128(p, end, terminalSize) || terminalSize > (uint64_t)(end - p)) return false;
+
+			if (matched == name.size()) {
+				if (terminalSize == 0) return false;
+				uint64_t flags, value;
+				if (!readUleb128(p, end, flags)) return false;
+				// re-exports live in another image
+				if (flags & EXPORT_SYMBOL_FLAGS_REEXPORT) return false;
+				// for stub-and-resolver exports the first value is the stub, which is what callers jump to
+				if (!readUleb128(p, end, value)) return false;
+				address = (flags & EXPORT_SYMBOL_FLAGS_KIND_MASK) == EXPORT_SYMBOL_FLAGS_KIND_ABSOLUTE ? value : m_textVmaddr + value;
+				return true;
+			}
+
+			p += terminalSize;
+			if (p >= end) return false;
+			uint8_t childCount = *p++;
+			uint8_t const* next = nullptr;
+			for (uint8_t i = 0; i < childCount && !next; i++) {
+				size_t edgeLength = strnlen(reinterpret_cast<char const*>(p), (size_t)(end - p));
+				if (edgeLength == 0 || edgeLength == (size_t)(end - p)) return false;
+				bool match = name.compare(matched, edgeLength, reinterpret_cast<char const*>(p), edgeLength) == 0;
+				p += edgeLength + 1;
+				uint64_t childOffset;
+				if (!readUleb128(p, end, childOffset) || childOffset >= (uint64_t)(end - trie)) return false;
+				if (match) {
+					matched += edgeLength;
+					next = trie + childOffset;
+				}
+			}
+			if (!next) return false;
+			node = next;
+		}
+		return false;
+	}
+
+	std::vector<uint64_t> SymbolResolver::resolve(std::vector<std::string> const& names) const {
+		std::vector<uint64_t> addresses(names.size(), 0);
+		if (!m_linkeditBase) return addresses;
+
+		// the export trie answers each name in a walk the length of the name
+		uint8_t const* trie = nullptr;
+		uint64_t trieSize = 0;
+		if (auto info = reinterpret_cast<dyld_info_command const*>(m_image.findCommand(LC_DYLD_INFO_ONLY))) {
+			trie = linkedit(info->export_off, info->export_size);
+			trieSize = info->export_size;
+		} else if (auto info = reinterpret_cast<dyld_info_command const*>(m_image.findCommand(LC_DYLD_INFO))) {
+			trie = linkedit(info->export_off, info->export_size);
+			trieSize = info->export_size;
+		}
+		if (auto exports = reinterpret_cast<linkedit_data_command const*>(m_image.findCommand(LC_DYLD_EXPORTS_TRIE))) {
+			trie = linkedit(exports->dataoff, exports->datasize);
+			trieSize = exports->datasize;
+		}
+
+		std::unordered_map<std::string_view, uint64_t> missing;
+		for (size_t i = 0; i < names.size(); i++) {
+			if (trie && trieSize > 0 && lookupTrie(trie, trie + trieSize, names[i], addresses[i])) continue;
+			missing.emplace(names[i], 0);
+		}
+		if (missing.empty()) return addresses;
+
+		// whatever isn't exported: one pass over the symbol table, each name checked against a hash set
+		auto symtab = reinterpret_cast<symtab_command const*>(m_image.findCommand(LC_SYMTAB));
+		if (!symtab) return addresses;
+		auto symbols = reinterpret_cast<nlist_64 const*>(linkedit(symtab->symoff, (uint64_t)symtab->nsyms * sizeof(nlist_64)));
+		auto strings = reinterpret_cast<char const*>(linkedit(symtab->stroff, symtab->strsize));
+		if (!symbols || !strings) return addresses;
+		size_t left = missing.size();
+		for (uint32_t i = 0; i < symtab->nsyms && left > 0; i++) {
+			nlist_64 const& symbol = symbols[i];
+			uint32_t strx = symbol.n_un.n_strx;
+			if (strx == 0 || strx >= symtab->strsize) continue;
+			if ((symbol.n_type & N_STAB) != 0 || (symbol.n_type & N_TYPE) != N_SECT) continue;
+			std::string_view name(strings + strx, strnlen(strings + strx, symtab->strsize - strx));
+			auto found = missing.find(name);
+			if (found == missing.end() || found->second != 0) continue;
+			found->second = symbol.n_value;
+			left--;
+		}
+		for (size_t i = 0; i < names.size(); i++) {
+			auto found = missing.find(names[i]);
+			if (found != missing.end()) addresses[i] = found->second;
+		}
+		return addresses;
+	}
+
+	std::vector<uint64_t> SymbolResolver::resolveCached(std::vector<std::string> const& names) const {
+		if (!m_hasUuid) return resolve(names);
+
+		static std::mutex s_mutex;
+		static std::map<ImageUuid, std::unordered_map<std::string, uint64_t>> s_cache;
+		std::lock_guard<std::mutex> lock(s_mutex);
+		auto& cached = s_cache[m_uuid];
+
+		std::vector<std::string> missing;
+		for (std::string const& name : names) {
+			if (cached.find(name) == cached.end()) missing.push_back(name);
+		}
+		if (!missing.empty()) {
+			std::vector<uint64_t> found = resolve(missing);
+			for (size_t i = 0; i < missing.size(); i++) cached[missing[i]] = found[i];
+		}
+
+		std::vector<uint64_t> addresses;
+		addresses.reserve(names.size());
+		for (std::string const& name : names) addresses.push_back(cached[name]);
+		return addresses;
+	}
+}
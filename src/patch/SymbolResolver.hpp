@@ -0,0 +1,46 @@
+#pragma once
+
+#include "MachOFile.hpp"
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace patch {
+	using ImageUuid = std::array<uint8_t, 16>;
+
+	// Looks names up in an image's export trie and falls back to a single pass over the symbol table for
+	// whatever the trie doesn't export. Works on files and on images dyld has loaded, __LINKEDIT is found through its segment.
+	class SymbolResolver {
+	public:
+		// image as laid out on disk (the arm64 slice of a fat file)
+		bool parseFile(uint8_t const* data, size_t size);
+		// image as mapped by dyld, __LINKEDIT sits at its vmaddr plus the slide
+		bool parseLoaded(mach_header_64 const* header, intptr_t slide);
+
+		// unslid addresses in the order of names, 0 for names the image doesn't define
+		std::vector<uint64_t> resolve(std::vector<std::string> const& names) const;
+		// resolve() with the results kept per image UUID, so the same library is never searched twice for a name
+		std::vector<uint64_t> resolveCached(std::vector<std::string> const& names) const;
+
+		bool hasUuid() const { return m_hasUuid; }
+		ImageUuid const& uuid() const { return m_uuid; }
+
+	private:
+		bool parse();
+		// pointer to [offset, offset + size) of the file, only inside __LINKEDIT
+		uint8_t const* linkedit(uint64_t offset, uint64_t size) const;
+		bool lookupTrie(uint8_t const* trie, uint8_t const* end, std::string const& name, uint64_t& address) const;
+
+		MachOImage m_image;
+		// where file offset 0 would be if all of the image were laid out like __LINKEDIT
+		uint8_t const* m_linkeditBase = nullptr;
+		uint64_t m_linkeditBegin = 0;
+		uint64_t m_linkeditEnd = 0;
+		uint64_t m_textVmaddr = 0;
+		bool m_hasUuid = false;
+		ImageUuid m_uuid {};
+	};
+}
@@ -0,0 +1,170 @@
+// FunctionStarts against hand-built LC_FUNCTION_STARTS streams: one, two and many-byte deltas, the zero
+// padding at the end, damaged streams, and contains/functionAt around every start. Then a stream the
+// size of a big game binary's, timing the decode and the lookups HookEngine does per hook.
+//   FunctionStartsTest [functions, default 100000]
+#include "MachOFixture.hpp"
+#include "check.hpp"
+#include "patch/FunctionStarts.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stddef.h>
+#include <stdio.h>
+
+using Clock = std::chrono::steady_clock;
+
+static double millisecondsSince(Clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static std::vector<uint8_t> encode(std::vector<uint64_t> const& starts, size_t padding) {
+	std::vector<uint8_t> out;
+	uint64_t previous = 0;
+	for (uint64_t start : starts) {
+		fixture::appendUleb128(out, start - previous);
+		previous = start;
+	}
+	out.resize(out.size() + padding, 0);
+	return out;
+}
+
+static std::vector<uint8_t> makeImage(std::vector<uint8_t> const& stream) {
+	fixture::MachOBuilder builder;
+	builder.sections.push_back({ "__text", std::vector<uint8_t>(0x40, 0xcc) });
+	builder.functionStarts = stream;
+	return builder.build();
+}
+
+static bool parseStream(std::vector<uint8_t> const& stream, patch::FunctionStarts& starts) {
+	std::vector<uint8_t> bytes = makeImage(stream);
+	patch::MachOImage image;
+	CHECK(image.parse(bytes.data(), bytes.size()));
+	return starts.parse(image);
+}
+
+static void testDecode() {
+	// deltas of one, two, three and five bytes, and one that needs all 64 bits' worth
+	std::vector<uint64_t> expected = { 0x4000, 0x4004, 0x407c, 0x4080, 0x4100, 0x8100, 0x20008100, 0x820008100, 0x820008104 };
+	for (size_t padding : { 0, 1, 7 }) {
+		patch::FunctionStarts starts;
+		CHECK(parseStream(encode(expected, padding), starts));
+		CHECK(starts.starts() == expected);
+	}
+
+	// bytes after the zero that ends the stream aren't starts
+	std::vector<uint8_t> stream = encode(expected, 1);
+	stream.push_back(0x10);
+	stream.push_back(0x10);
+	patch::FunctionStarts starts;
+	CHECK(parseStream(stream, starts));
+	CHECK(starts.starts() == expected);
+
+	// a stream that is only padding, e.g. an image without functions
+	CHECK(parseStream(std::vector<uint8_t>(8, 0), starts));
+	CHECK(starts.empty());
+
+	// the last uleb keeps going past the end of the data
+	stream = encode(expected, 0);
+	stream.push_back(0x80);
+	stream.push_back(0x80);
+	CHECK(!parseStream(stream, starts));
+
+	// a uleb too long for 64 bits
+	stream = encode({ 0x4000 }, 0);
+	stream.insert(stream.end(), 10, 0xff);
+	stream.push_back(0x01);
+	CHECK(!parseStream(stream, starts));
+
+	// no command at all
+	std::vector<uint8_t> bytes = makeImage({});
+	patch::MachOImage image;
+	CHECK(image.parse(bytes.data(), bytes.size()));
+	CHECK(!starts.parse(image));
+	CHECK(starts.empty());
+
+	// datasize running past the end of the file
+	bytes = makeImage(encode(expected, 0));
+	CHECK(image.parse(bytes.data(), bytes.size()));
+	auto command = image.findCommand(LC_FUNCTION_STARTS);
+	CHECK(command);
+	size_t commandOffset = reinterpret_cast<uint8_t const*>(command) - bytes.data();
+	uint32_t datasize = (uint32_t)bytes.size();
+	memcpy(bytes.data() + commandOffset + offsetof(linkedit_data_command, datasize), &datasize, sizeof(datasize));
+	CHECK(image.parse(bytes.data(), bytes.size()));
+	CHECK(!starts.parse(image));
+}
+
+static void testLookup() {
+	std::vector<uint64_t> expected = { 0x4000, 0x4010, 0x4400, 0x10000 };
+	patch::FunctionStarts starts;
+	CHECK(parseStream(encode(expected, 3), starts));
+
+	uint64_t start = 0;
+	CHECK(!starts.contains(0));
+	CHECK(!starts.functionAt(0, start));
+	CHECK(!starts.functionAt(0x3fff, start));
+	for (size_t i = 0; i < expected.size(); i++) {
+		CHECK(starts.contains(expected[i]));
+		CHECK(!starts.contains(expected[i] + 4));
+		CHECK(starts.functionAt(expected[i], start) && start == expected[i]);
+		CHECK(starts.functionAt(expected[i] + 4, start) && start == expected[i]);
+		if (i + 1 < expected.size()) {
+			CHECK(starts.functionAt(expected[i + 1] - 1, start) && start == expected[i]);
+		}
+	}
+	// past the last start still belongs to the last function
+	CHECK(starts.functionAt(UINT64_MAX, start) && start == 0x10000);
+}
+
+int main(int argc, char** argv) {
+	testDecode();
+	testLookup();
+
+	size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+	if (count == 0) count = 1;
+
+	// instruction-aligned functions of a few bytes to a few pages, mostly small like a real binary's
+	std::mt19937_64 rng(49);
+	std::vector<uint64_t> expected;
+	uint64_t offset = 0x4000;
+	for (size_t i = 0; i < count; i++) {
+		expected.push_back(offset);
+		offset += (rng() % 8 == 0) ? 4 * (1 + rng() % 4096) : 4 * (1 + rng() % 64);
+	}
+	std::vector<uint8_t> stream = encode(expected, 4);
+	std::vector<uint8_t> bytes = makeImage(stream);
+	patch::MachOImage image;
+	CHECK(image.parse(bytes.data(), bytes.size()));
+
+	patch::FunctionStarts starts;
+	Clock::time_point begin = Clock::now();
+	CHECK(starts.parse(image));
+	double decodeMs = millisecondsSince(begin);
+	CHECK(starts.starts() == expected);
+
+	// a lookup in the middle of every function, in no particular order
+	std::vector<std::pair<uint64_t, uint64_t>> probes;
+	for (size_t i = 0; i < count; i++) {
+		uint64_t end = i + 1 < count ? expected[i + 1] : expected[i] + 4;
+		probes.emplace_back(expected[i] + (end - expected[i]) / 2, expected[i]);
+	}
+	std::shuffle(probes.begin(), probes.end(), rng);
+	size_t found = 0;
+	begin = Clock::now();
+	for (auto const& probe : probes) {
+		uint64_t start = 0;
+		if (starts.functionAt(probe.first, start) && start == probe.second && (probe.first == start || !starts.contains(probe.first))) found++;
+	}
+	double lookupMs = millisecondsSince(begin);
+	CHECK(found == count);
+	for (size_t i = 0; i < count; i += 97) {
+		uint64_t start = 0;
+		CHECK(starts.contains(expected[i]) && starts.functionAt(expected[i], start) && start == expected[i]);
+	}
+
+	printf("FunctionStartsTest: %zu functions, %zu bytes of ulebs\n", count, stream.size());
+	printf("  decode                   %8.3f ms\n", decodeMs);
+	printf("  functionAt + contains    %8.3f ms  (%.1f ns per lookup)\n", lookupMs, lookupMs * 1e6 / count);
+	return 0;
+}
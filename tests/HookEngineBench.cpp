@@ -0,0 +1,146 @@
+// HookEngine with 10k hooks from 20 mods over a 64 MiB binary, collisions, overlaps and out-of-range
+// hooks included. The sites are checked against a plain set-based reference, then the same hooks plus a few
+// new ones are built again on top of the first cave, which is the incremental path Patcher takes.
+//   HookEngineBench [hooks, default 10000]
+#include "check.hpp"
+#include "patch/HookEngine.hpp"
+
+#include <chrono>
+#include <map>
+#include <random>
+#include <set>
+#include <stdio.h>
+#include <string.h>
+
+using Clock = std::chrono::steady_clock;
+
+static double millisecondsSince(Clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static constexpr size_t kBinarySize = 64 << 20;
+static constexpr size_t kTrampolineSize = 28;
+static constexpr size_t kIntervenerSize = 12;
+
+static patch::HookGenerator makeGenerator() {
+	patch::HookGenerator generator;
+	// a fake trampoline: the relocated bytes padded out, like TulipHook's relocation plus the jump back
+	generator.trampoline = [](uint64_t, uint64_t, std::vector<uint8_t> const& original, std::vector<uint8_t>& out, std::string&) {
+		out = original;
+		out.resize(kTrampolineSize, 0xd5);
+		return true;
+	};
+	// the index in the first bytes, so the sweep can be checked site by site
+	generator.intervener = [](uint64_t, size_t index, uint64_t) {
+		std::vector<uint8_t> bytes(kIntervenerSize, 0xaa);
+		memcpy(bytes.data(), &index, sizeof(uint32_t));
+		return bytes;
+	};
+	return generator;
+}
+
+// what build() has to come up with: unique in-range addresses, each dropped if the last kept one still covers it
+static std::vector<uint64_t> expectedSites(std::vector<uint64_t> offsets) {
+	std::set<uint64_t> unique(offsets.begin(), offsets.end());
+	std::vector<uint64_t> sites;
+	for (uint64_t offset : unique) {
+		if (offset > kBinarySize || patch::kHookOriginalSize > kBinarySize - offset) continue;
+		if (!sites.empty() && offset < sites.back() + patch::kHookOriginalSize) continue;
+		sites.push_back(offset);
+	}
+	return sites;
+}
+
+static void checkSites(patch::HookEngine const& engine, std::vector<uint64_t> const& expected, std::vector<uint8_t> const& out) {
+	std::vector<patch::HookSite> const& sites = engine.sites();
+	CHECK(sites.size() == expected.size());
+	std::set<uint32_t> indices;
+	for (size_t i = 0; i < sites.size(); i++) {
+		CHECK(sites[i].offset == expected[i]);
+		CHECK(indices.insert(sites[i].index).second);
+		uint32_t written;
+		memcpy(&written, out.data() + sites[i].offset, sizeof(written));
+		CHECK(written == sites[i].index);
+	}
+}
+
+int main(int argc, char** argv) {
+	size_t hookCount = argc > 1 ? (size_t)strtoul(argv[1], nullptr, 10) : 10000;
+	std::mt19937_64 rng(46);
+
+	std::vector<uint8_t> binary(kBinarySize);
+	for (size_t i = 0; i < binary.size(); i += 8) {
+		uint64_t v = rng();
+		memcpy(&binary[i], &v, 8);
+	}
+
+	// 20 mods; some hooks land on the same function as another mod's, some right behind one, a few past the end
+	std::vector<std::pair<uint64_t, std::string>> hooks;
+	for (size_t i = 0; i < hookCount; i++) {
+		uint64_t offset;
+		switch (rng() % 20) {
+			case 0: offset = hooks.empty() ? 0x1000 : hooks[rng() % hooks.size()].first; break;
+			case 1: offset = hooks.empty() ? 0x1000 : hooks[rng() % hooks.size()].first + 4 * (1 + rng() % 3); break;
+			case 2: offset = kBinarySize - 4 * (rng() % 8); break;
+			default: offset = (rng() % (kBinarySize / 4)) * 4; break;
+		}
+		hooks.push_back({ offset, "mod" + std::to_string(i * 20 / std::max<size_t>(hookCount, 1)) });
+	}
+	std::vector<uint64_t> offsets;
+	for (auto const& hook : hooks) offsets.push_back(hook.first);
+
+	patch::HookGenerator generator = makeGenerator();
+	patch::HookEngine engine;
+	std::vector<uint8_t> cave;
+	std::vector<uint8_t> out = binary;
+	Clock::time_point start = Clock::now();
+	for (auto const& hook : hooks) engine.add(hook.first, hook.second);
+	engine.build(binary.data(), binary.size(), cave, generator);
+	engine.apply(out.data(), out.size());
+	double fullMs = millisecondsSince(start);
+
+	std::vector<uint64_t> expected = expectedSites(offsets);
+	checkSites(engine, expected, out);
+	CHECK(cave.size() == expected.size() * kTrampolineSize);
+	std::map<patch::HookConflictKind, size_t> kinds;
+	for (patch::HookConflict const& conflict : engine.conflicts()) kinds[conflict.kind]++;
+	CHECK(kinds[patch::HookConflictKind::GenerationFailed] == 0);
+	CHECK(kinds[patch::HookConflictKind::OutOfRange] > 0 && kinds[patch::HookConflictKind::Overlap] > 0);
+
+	// again with 1% more hooks on top of the first build: only the new ones get trampolines
+	std::vector<patch::HookSite> previous = engine.sites();
+	size_t firstCave = cave.size();
+	std::vector<uint64_t> moreOffsets = offsets;
+	for (size_t i = 0; i < hookCount / 100 + 1; i++) {
+		uint64_t offset = (rng() % (kBinarySize / 4)) * 4;
+		hooks.push_back({ offset, "late" });
+		moreOffsets.push_back(offset);
+	}
+	patch::HookEngine incremental;
+	start = Clock::now();
+	for (auto const& hook : hooks) incremental.add(hook.first, hook.second);
+	incremental.build(binary.data(), binary.size(), cave, generator, &previous);
+	incremental.apply(out.data(), out.size());
+	double incrementalMs = millisecondsSince(start);
+
+	std::vector<uint64_t> moreExpected = expectedSites(moreOffsets);
+	checkSites(incremental, moreExpected, out);
+	size_t added = 0;
+	size_t p = 0;
+	for (patch::HookSite const& site : incremental.sites()) {
+		while (p < previous.size() && previous[p].offset < site.offset) p++;
+		if (p < previous.size() && previous[p].offset == site.offset) {
+			CHECK(site.caveOffset == previous[p].caveOffset && site.index == previous[p].index);
+		} else {
+			CHECK(site.caveOffset >= firstCave);
+			added++;
+		}
+	}
+	CHECK(cave.size() == firstCave + added * kTrampolineSize);
+
+	printf("HookEngineBench: %zu hooks -> %zu sites (%zu collisions, %zu overlaps, %zu out of range)\n", hookCount, expected.size(),
+		   kinds[patch::HookConflictKind::Collision], kinds[patch::HookConflictKind::Overlap], kinds[patch::HookConflictKind::OutOfRange]);
+	printf("  full build + apply         %8.2f ms  (%zu bytes of trampolines)\n", fullMs, firstCave);
+	printf("  incremental, %4zu new      %8.2f ms\n", added, incrementalMs);
+	return 0;
+}
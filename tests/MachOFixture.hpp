@@ -0,0 +1,283 @@
+#pragma once
+
+#include "patch/MachOCompat.hpp"
+
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Builds small arm64 images by hand for the src/patch tests: __TEXT with the given sections,
+// then __LINKEDIT holding an export trie, function starts and a symbol table. Only what the parsers read is filled in.
+namespace fixture {
+	constexpr uint64_t kTextVmaddr = 0x100000000;
+	constexpr uint64_t kPageSize = 0x4000;
+
+	inline void setName(char (&field)[16], std::string const& name) {
+		memset(field, 0, sizeof(field));
+		memcpy(field, name.data(), std::min(name.size(), sizeof(field)));
+	}
+
+	inline void appendUleb128(std::vector<uint8_t>& out, uint64_t value) {
+		do {
+			uint8_t byte = value & 0x7f;
+			value >>= 7;
+			out.push_back(value ? (byte | 0x80) : byte);
+		} while (value);
+	}
+
+	struct Export {
+		std::string name;
+		uint64_t flags;
+		// offset from __TEXT's vmaddr, or the address itself for absolute exports
+		uint64_t value;
+		// stub-and-resolver exports carry the resolver after the stub
+		uint64_t resolver = 0;
+	};
+
+	// a proper compressed trie: a node's edges never share a first character, so lookups have to walk prefixes
+	class TrieBuilder {
+	public:
+		static std::vector<uint8_t> build(std::vector<Export> exports) {
+			std::sort(exports.begin(), exports.end(), [](Export const& a, Export const& b) { return a.name < b.name; });
+			TrieBuilder builder;
+			builder.addNode(exports, 0, exports.size(), 0);
+			// child offsets are ulebs, their sizes move the nodes after them, so lay out until nothing moves
+			std::vector<uint8_t> out;
+			for (int pass = 0; pass < 8; pass++) {
+				out.clear();
+				bool moved = false;
+				for (Node& node : builder.m_nodes) {
+					if (node.offset != out.size()) moved = true;
+					node.offset = out.size();
+					builder.writeNode(node, out);
+				}
+				if (!moved) break;
+			}
+			return out;
+		}
+
+	private:
+		struct Node {
+			Export const* terminal = nullptr;
+			std::vector<std::pair<std::string, size_t>> edges;
+			uint64_t offset = 0;
+		};
+
+		size_t addNode(std::vector<Export> const& exports, size_t begin, size_t end, size_t depth) {
+			size_t index = m_nodes.size();
+			m_nodes.emplace_back();
+			if (begin < end && exports[begin].name.size() == depth) {
+				m_nodes[index].terminal = &exports[begin];
+				begin++;
+			}
+			while (begin < end) {
+				size_t group = begin + 1;
+				while (group < end && exports[group].name[depth] == exports[begin].name[depth]) group++;
+				// longest prefix the group shares past depth
+				size_t length = exports[begin].name.size() - depth;
+				for (size_t i = begin + 1; i < group; i++) {
+					size_t same = 0;
+					while (same < length && exports[i].name[depth + same] == exports[begin].name[depth + same]) same++;
+					length = same;
+				}
+				size_t child = addNode(exports, begin, group, depth + length);
+				m_nodes[index].edges.emplace_back(exports[begin].name.substr(depth, length), child);
+				begin = group;
+			}
+			return index;
+		}
+
+		void writeNode(Node const& node, std::vector<uint8_t>& out) const {
+			std::vector<uint8_t> terminal;
+			if (node.terminal) {
+				appendUleb128(terminal, node.terminal->flags);
+				appendUleb128(terminal, node.terminal->value);
+				if (node.terminal->flags & EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER) appendUleb128(terminal, node.terminal->resolver);
+			}
+			appendUleb128(out, terminal.size());
+			out.insert(out.end(), terminal.begin(), terminal.end());
+			out.push_back((uint8_t)node.edges.size());
+			for (auto const& edge : node.edges) {
+				out.insert(out.end(), edge.first.begin(), edge.first.end());
+				out.push_back(0);
+				appendUleb128(out, m_nodes[edge.second].offset);
+			}
+		}
+
+		std::vector<Node> m_nodes;
+	};
+
+	struct Symbol {
+		std::string name;
+		uint8_t type;
+		uint64_t value;
+	};
+
+	struct Section {
+		std::string name;
+		std::vector<uint8_t> bytes;
+	};
+
+	enum class TrieCommand {
+		None,
+		DyldInfoOnly,
+		ExportsTrie,
+	};
+
+	struct MachOBuilder {
+		std::vector<Section> sections;
+		std::vector<Export> exports;
+		std::vector<Symbol> symbols;
+		// LC_FUNCTION_STARTS payload as is, so tests can hand in damaged streams. no command when empty
+		std::vector<uint8_t> functionStarts;
+		TrieCommand trieCommand = TrieCommand::ExportsTrie;
+		// free space after the load commands, like the linker's -headerpad, for tests that add a command
+		uint64_t headerPad = 0;
+		bool uuid = true;
+		uint8_t uuidSeed = 0;
+
+		std::vector<uint8_t> build() const {
+			std::vector<uint8_t> trie = exports.empty() ? std::vector<uint8_t>() : TrieBuilder::build(exports);
+
+			std::string strings(1, '\0');
+			std::vector<nlist_64> nlists;
+			for (Symbol const& symbol : symbols) {
+				nlist_64 entry {};
+				entry.n_un.n_strx = (uint32_t)strings.size();
+				entry.n_type = symbol.type;
+				entry.n_sect = 1;
+				entry.n_value = symbol.value;
+				nlists.push_back(entry);
+				strings += symbol.name;
+				strings += '\0';
+			}
+
+			uint32_t ncmds = 2 + (trieCommand != TrieCommand::None) + !functionStarts.empty() + !symbols.empty() + uuid;
+			uint32_t sizeofcmds = (uint32_t)(2 * sizeof(segment_command_64) + sections.size() * sizeof(section_64));
+			if (trieCommand == TrieCommand::DyldInfoOnly) sizeofcmds += sizeof(dyld_info_command);
+			if (trieCommand == TrieCommand::ExportsTrie) sizeofcmds += sizeof(linkedit_data_command);
+			if (!functionStarts.empty()) sizeofcmds += sizeof(linkedit_data_command);
+			if (!symbols.empty()) sizeofcmds += sizeof(symtab_command);
+			if (uuid) sizeofcmds += sizeof(uuid_command);
+
+			// __TEXT: header, commands, then each section 16-byte aligned
+			uint64_t cursor = align(sizeof(mach_header_64) + sizeofcmds + headerPad, 16);
+			std::vector<uint64_t> sectionOffsets;
+			for (Section const& section : sections) {
+				sectionOffsets.push_back(cursor);
+				cursor = align(cursor + section.bytes.size(), 16);
+			}
+			uint64_t textSize = align(std::max<uint64_t>(cursor, 1), kPageSize);
+
+			// __LINKEDIT: trie, function starts, nlists, strings
+			uint64_t trieOff = textSize;
+			uint64_t startsOff = align(trieOff + trie.size(), 8);
+			uint64_t symOff = align(startsOff + functionStarts.size(), 8);
+			uint64_t strOff = symOff + nlists.size() * sizeof(nlist_64);
+			uint64_t linkSize = strOff + strings.size() - textSize;
+
+			std::vector<uint8_t> out(textSize + linkSize, 0);
+			uint8_t* p = out.data();
+
+			mach_header_64 header {};
+			header.magic = MH_MAGIC_64;
+			header.cputype = CPU_TYPE_ARM64;
+			header.filetype = 6; // MH_DYLIB
+			header.ncmds = ncmds;
+			header.sizeofcmds = sizeofcmds;
+			p = put(p, header);
+
+			segment_command_64 text {};
+			text.cmd = LC_SEGMENT_64;
+			text.cmdsize = (uint32_t)(sizeof(segment_command_64) + sections.size() * sizeof(section_64));
+			setName(text.segname, "__TEXT");
+			text.vmaddr = kTextVmaddr;
+			text.vmsize = textSize;
+			text.fileoff = 0;
+			text.filesize = textSize;
+			text.maxprot = text.initprot = VM_PROT_READ | VM_PROT_EXECUTE;
+			text.nsects = (uint32_t)sections.size();
+			p = put(p, text);
+			for (size_t i = 0; i < sections.size(); i++) {
+				section_64 sect {};
+				setName(sect.sectname, sections[i].name);
+				setName(sect.segname, "__TEXT");
+				sect.addr = kTextVmaddr + sectionOffsets[i];
+				sect.size = sections[i].bytes.size();
+				sect.offset = (uint32_t)sectionOffsets[i];
+				sect.align = 4;
+				p = put(p, sect);
+				memcpy(out.data() + sectionOffsets[i], sections[i].bytes.data(), sections[i].bytes.size());
+			}
+
+			segment_command_64 link {};
+			link.cmd = LC_SEGMENT_64;
+			link.cmdsize = sizeof(segment_command_64);
+			setName(link.segname, "__LINKEDIT");
+			link.vmaddr = kTextVmaddr + textSize;
+			link.vmsize = align(linkSize, kPageSize);
+			link.fileoff = textSize;
+			link.filesize = linkSize;
+			link.maxprot = link.initprot = VM_PROT_READ;
+			p = put(p, link);
+
+			if (trieCommand == TrieCommand::DyldInfoOnly) {
+				dyld_info_command info {};
+				info.cmd = LC_DYLD_INFO_ONLY;
+				info.cmdsize = sizeof(dyld_info_command);
+				info.export_off = (uint32_t)trieOff;
+				info.export_size = (uint32_t)trie.size();
+				p = put(p, info);
+			} else if (trieCommand == TrieCommand::ExportsTrie) {
+				linkedit_data_command info {};
+				info.cmd = LC_DYLD_EXPORTS_TRIE;
+				info.cmdsize = sizeof(linkedit_data_command);
+				info.dataoff = (uint32_t)trieOff;
+				info.datasize = (uint32_t)trie.size();
+				p = put(p, info);
+			}
+			if (!functionStarts.empty()) {
+				linkedit_data_command starts {};
+				starts.cmd = LC_FUNCTION_STARTS;
+				starts.cmdsize = sizeof(linkedit_data_command);
+				starts.dataoff = (uint32_t)startsOff;
+				starts.datasize = (uint32_t)functionStarts.size();
+				p = put(p, starts);
+			}
+			if (!symbols.empty()) {
+				symtab_command symtab {};
+				symtab.cmd = LC_SYMTAB;
+				symtab.cmdsize = sizeof(symtab_command);
+				symtab.symoff = (uint32_t)symOff;
+				symtab.nsyms = (uint32_t)nlists.size();
+				symtab.stroff = (uint32_t)strOff;
+				symtab.strsize = (uint32_t)strings.size();
+				p = put(p, symtab);
+			}
+			if (uuid) {
+				uuid_command command {};
+				command.cmd = LC_UUID;
+				command.cmdsize = sizeof(uuid_command);
+				for (size_t i = 0; i < sizeof(command.uuid); i++) command.uuid[i] = (uint8_t)(uuidSeed + i);
+				p = put(p, command);
+			}
+
+			memcpy(out.data() + trieOff, trie.data(), trie.size());
+			if (!functionStarts.empty()) memcpy(out.data() + startsOff, functionStarts.data(), functionStarts.size());
+			if (!nlists.empty()) memcpy(out.data() + symOff, nlists.data(), nlists.size() * sizeof(nlist_64));
+			memcpy(out.data() + strOff, strings.data(), strings.size());
+			return out;
+		}
+
+	private:
+		static uint64_t align(uint64_t value, uint64_t to) { return (value + to - 1) / to * to; }
+
+		template <typename T>
+		static uint8_t* put(uint8_t* p, T const& value) {
+			memcpy(p, &value, sizeof(T));
+			return p + sizeof(T);
+		}
+	};
+}
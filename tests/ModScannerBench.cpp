@@ -0,0 +1,164 @@
+// ModScanner on a large synthetic mod dylib: __text full of noise (and fake markers that must be skipped),
+// __cstring with the planted hook and patch markers among filler strings, a small __const.
+// checks the records against what was planted, then reports throughput next to a plain memmem scan.
+//   ModScannerBench [MiB of __cstring, default 256]
+#include "MachOFixture.hpp"
+#include "check.hpp"
+#include "patch/MachOFile.hpp"
+#include "patch/ModScanner.hpp"
+
+#include <chrono>
+#include <inttypes.h>
+#include <random>
+#include <stdio.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start) {
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct Planted {
+	std::vector<uint64_t> addressHooks;
+	std::vector<uint64_t> staticHooks;
+	std::vector<uint64_t> patches;
+};
+
+static void appendString(std::vector<uint8_t>& out, std::string const& text) {
+	out.insert(out.end(), text.begin(), text.end());
+	out.push_back(0);
+}
+
+static std::vector<uint8_t> makeCstrings(size_t size, std::mt19937_64& rng, Planted& planted) {
+	static char const kFiller[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 _:[]<>()";
+	std::vector<uint8_t> out;
+	out.reserve(size + 256);
+	char line[160];
+	while (out.size() < size) {
+		switch (rng() % 64) {
+			case 0: {
+				uint64_t offset = 0x1000 + (rng() % 0x4000000) * 4;
+				snprintf(line, sizeof(line), "[GEODE_MODIFY_ADDRESS] base::get() + 0x%" PRIx64 " [GEODE_MODIFY_END]", offset);
+				planted.addressHooks.push_back(offset);
+				appendString(out, line);
+				break;
+			}
+			case 1: {
+				uint64_t offset = 0x1000 + (rng() % 0x4000000) * 4;
+				snprintf(line, sizeof(line), "[GEODE_MODIFY_NAME]cocos2d::CCNode::update%u[GEODE_MODIFY_OFFSET]%" PRIx64 "[GEODE_MODIFY_END]",
+						 (unsigned)(rng() % 1000), offset);
+				planted.staticHooks.push_back(offset);
+				appendString(out, line);
+				break;
+			}
+			case 2: {
+				uint64_t offset = 0x1000 + (rng() % 0x4000000) * 4;
+				std::string text = "[GEODE_PATCH_SIZE]4[GEODE_PATCH_BYTES]";
+				for (int i = 0; i < 4; i++) text += (char)(1 + rng() % 255);
+				snprintf(line, sizeof(line), "[GEODE_PATCH_OFFSET]%" PRIx64 "[GEODE_PATCH_END]", offset);
+				text += line;
+				planted.patches.push_back(offset);
+				appendString(out, text);
+				break;
+			}
+			case 3:
+				// looks like a marker but isn't one, the scanner has to move past it
+				appendString(out, "[GEODE_MODIFY_ADDRESS] not an address [GEODE_MODIFY_END] [GEODE_");
+				break;
+			default: {
+				std::string text(8 + rng() % 120, ' ');
+				for (char& c : text) c = kFiller[rng() % (sizeof(kFiller) - 1)];
+				appendString(out, text);
+				break;
+			}
+		}
+	}
+	return out;
+}
+
+static std::vector<uint8_t> makeNoise(size_t size, std::mt19937_64& rng) {
+	std::vector<uint8_t> out(size);
+	for (size_t i = 0; i + 8 <= size; i += 8) {
+		uint64_t v = rng();
+		memcpy(&out[i], &v, 8);
+	}
+	// markers outside __cstring/__const are never string literals
+	static char const kFake[] = "[GEODE_MODIFY_ADDRESS] base::get() + 0x1234 [GEODE_MODIFY_END]";
+	for (size_t i = 0; i + sizeof(kFake) < size; i += 1 << 20) memcpy(&out[i], kFake, sizeof(kFake));
+	return out;
+}
+
+int main(int argc, char** argv) {
+	size_t mib = argc > 1 ? (size_t)strtoul(argv[1], nullptr, 10) : 256;
+	if (mib == 0) mib = 1;
+
+	std::mt19937_64 rng(41);
+	Planted planted;
+	fixture::MachOBuilder builder;
+	builder.trieCommand = fixture::TrieCommand::None;
+	builder.sections.push_back({ "__text", makeNoise(mib << 19, rng) });
+	builder.sections.push_back({ "__cstring", makeCstrings(mib << 20, rng, planted) });
+	Planted planted2;
+	builder.sections.push_back({ "__const", makeCstrings(64 << 10, rng, planted2) });
+	std::vector<uint8_t> image = builder.build();
+	planted.addressHooks.insert(planted.addressHooks.end(), planted2.addressHooks.begin(), planted2.addressHooks.end());
+	planted.staticHooks.insert(planted.staticHooks.end(), planted2.staticHooks.begin(), planted2.staticHooks.end());
+	planted.patches.insert(planted.patches.end(), planted2.patches.begin(), planted2.patches.end());
+
+	char path[] = "/tmp/ModScannerBench.XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd >= 0);
+	CHECK(write(fd, image.data(), image.size()) == (ssize_t)image.size());
+	close(fd);
+	std::vector<uint8_t>().swap(image);
+
+	Clock::time_point start = Clock::now();
+	patch::ModScanResult result = patch::scanModFile(path);
+	double scanSeconds = secondsSince(start);
+	CHECK(result.error.empty());
+
+	// address hooks first, then static hooks, each in file order
+	size_t addressCount = planted.addressHooks.size();
+	CHECK(result.hooks.size() == addressCount + planted.staticHooks.size());
+	for (size_t i = 0; i < result.hooks.size(); i++) {
+		patch::HookRecord const& hook = result.hooks[i];
+		if (i < addressCount) {
+			CHECK(hook.kind == patch::HookKind::Address && hook.offset == planted.addressHooks[i]);
+		} else {
+			CHECK(hook.kind == patch::HookKind::Static && hook.offset == planted.staticHooks[i - addressCount]);
+		}
+	}
+	CHECK(result.patches.size() == planted.patches.size());
+	for (size_t i = 0; i < result.patches.size(); i++) {
+		CHECK(result.patches[i].offset == planted.patches[i] && result.patches[i].bytes.size() == 4);
+	}
+
+	// the marker search alone, against libc's memmem over the same bytes
+	patch::MappedFile file;
+	CHECK(file.open(path));
+	uint8_t const* begin = file.data();
+	uint8_t const* end = begin + file.size();
+	size_t found = 0;
+	start = Clock::now();
+	for (uint8_t const* p = begin; (p = patch::findMarker(p, end)) != end; p++) found++;
+	double findSeconds = secondsSince(start);
+	size_t foundMemmem = 0;
+	start = Clock::now();
+	for (uint8_t const* p = begin; p < end; p++) {
+		p = static_cast<uint8_t const*>(memmem(p, (size_t)(end - p), "[GEODE_", 7));
+		if (!p) break;
+		foundMemmem++;
+	}
+	double memmemSeconds = secondsSince(start);
+	CHECK(found == foundMemmem);
+	file.close();
+	unlink(path);
+
+	double mb = (double)(mib << 20) / 1e6;
+	printf("ModScannerBench: %zu MiB __cstring, %zu hooks, %zu patches\n", mib, result.hooks.size(), result.patches.size());
+	printf("  scanModFile     %8.1f ms  %8.1f MB/s of string data\n", scanSeconds * 1e3, mb / scanSeconds);
+	printf("  findMarker      %8.1f ms  (whole file, %zu markers)\n", findSeconds * 1e3, found);
+	printf("  memmem          %8.1f ms\n", memmemSeconds * 1e3);
+	return 0;
+}
@@ -0,0 +1,272 @@
+// PatchJournal through the same steps Patcher takes: a full patch of a hand-built image through MachOEditor, then
+// in-place re-patches that add and remove hooks and patches. Each result has to equal the pristine text with the
+// new plan applied, the returned dirty ranges have to cover every byte that changed (and in the text, nothing that
+// didn't), and the list addDirtyRanges leaves for the signer has to cover everything changed since the signature.
+#include "MachOFixture.hpp"
+#include "check.hpp"
+#include "patch/ByteIO.hpp"
+#include "patch/HookEngine.hpp"
+#include "patch/MachOEditor.hpp"
+#include "patch/PatchIndex.hpp"
+#include "patch/PatchJournal.hpp"
+
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static constexpr size_t kTextSize = 0x8000;
+static constexpr size_t kHandlerSize = 64;
+static constexpr size_t kTrampolineSize = 28;
+static constexpr size_t kIntervenerSize = 12;
+
+// stands in for TulipHook: the trampoline carries its cave offset, the intervener its index and where it jumps
+static patch::HookGenerator makeGenerator() {
+	patch::HookGenerator generator;
+	generator.trampoline = [](uint64_t, uint64_t caveOffset, std::vector<uint8_t> const& original, std::vector<uint8_t>& out, std::string&) {
+		out = original;
+		out.resize(kTrampolineSize, 0xd5);
+		memcpy(out.data() + original.size(), &caveOffset, sizeof(uint32_t));
+		return true;
+	};
+	generator.intervener = [](uint64_t, size_t index, uint64_t caveOffset) {
+		std::vector<uint8_t> bytes(kIntervenerSize, 0xaa);
+		memcpy(bytes.data(), &index, sizeof(uint32_t));
+		memcpy(bytes.data() + 4, &caveOffset, sizeof(uint32_t));
+		return bytes;
+	};
+	return generator;
+}
+
+struct Plan {
+	std::vector<uint64_t> hooks;
+	std::vector<std::pair<uint64_t, std::vector<uint8_t>>> patches;
+};
+
+struct Built {
+	patch::HookEngine hooks;
+	patch::PatchIndex patches;
+};
+
+static void buildPlan(Plan const& plan, patch::MachOImage const& source, std::vector<uint8_t>& cave, std::vector<patch::HookSite> const* previous, Built& built) {
+	patch::HookGenerator generator = makeGenerator();
+	for (uint64_t offset : plan.hooks) built.hooks.add(offset, "mod");
+	built.hooks.build(source.base(), source.size(), cave, generator, previous);
+	CHECK(built.hooks.conflicts().empty());
+	for (auto const& staticPatch : plan.patches) built.patches.addPatch(staticPatch.first, staticPatch.second, "mod");
+	for (patch::HookSite const& site : built.hooks.sites()) built.patches.addHook(site.offset, site.intervener.size(), site.mods);
+	built.patches.build();
+}
+
+// the full path of Patcher: handler, trampolines, new segment before __LINKEDIT, interveners, patches
+static patch::PatchJournal fullPatch(std::string const& pristine, std::string const& output, Plan const& plan) {
+	patch::MachOEditor editor;
+	std::string error;
+	CHECK(editor.open(pristine.c_str(), &error));
+	patch::MachOImage const& source = editor.source();
+	segment_command_64 const* linkSeg = source.findSegment("__LINKEDIT");
+	CHECK(linkSeg);
+
+	std::vector<uint8_t> cave(kHandlerSize, 0xee);
+	Built built;
+	buildPlan(plan, source, cave, nullptr, built);
+
+	patch::PatchJournal journal;
+	journal.handlerAddress = 0x1234;
+	journal.caveAddr = linkSeg->vmaddr;
+	journal.caveFileOff = linkSeg->fileoff;
+	journal.caveUsed = cave.size();
+	journal.record(source.base(), source.size(), built.hooks.sites(), built.patches.writes());
+
+	uint64_t caveSize = (std::max<size_t>(cave.size(), 1) + 0x3fff) & ~(uint64_t)0x3fff;
+	CHECK(editor.insertSegment("__CUSTOM", "__custom", cave.size(), caveSize, VM_PROT_READ | VM_PROT_EXECUTE, 0x80000400, &error));
+	CHECK(editor.write(output.c_str(), &error));
+	uint8_t* data = editor.data();
+	memcpy(data + journal.caveFileOff, cave.data(), cave.size());
+	built.hooks.apply(data, editor.size());
+	built.patches.apply(data, editor.size());
+	journal.caveCapacity = caveSize;
+	journal.recordCave(data, editor.size());
+	CHECK(editor.commit(&error));
+	return journal;
+}
+
+static bool covered(std::vector<patch::DirtyRange> const& ranges, uint64_t offset) {
+	for (patch::DirtyRange const& range : ranges) {
+		if (offset >= range.offset && offset - range.offset < range.length) return true;
+	}
+	return false;
+}
+
+// the in-place path: checks the journal against the output, builds on top of its cave and applies the delta
+static patch::PatchJournal patchInPlace(std::string const& pristine, std::string const& output, patch::PatchJournal const& journal, Plan const& plan,
+										std::vector<patch::DirtyRange>& dirty) {
+	std::string data;
+	CHECK(patch::readWholeFile(pristine, data));
+	patch::MachOImage source;
+	CHECK(source.parse(reinterpret_cast<uint8_t const*>(data.data()), data.size()));
+	section_64 const* text = source.findSection("__TEXT", "__text");
+	CHECK(text);
+
+	patch::WritableFile out;
+	std::string error;
+	CHECK(out.open(output.c_str(), &error));
+	CHECK(journal.matchesOutput(out.data(), out.size(), &error));
+
+	std::vector<uint8_t> cave(journal.caveUsed);
+	std::vector<patch::HookSite> previous = journal.sites();
+	Built built;
+	buildPlan(plan, source, cave, &previous, built);
+	CHECK(cave.size() <= journal.caveCapacity);
+
+	patch::PatchJournal next = journal;
+	next.caveUsed = cave.size();
+	next.record(source.base(), source.size(), built.hooks.sites(), built.patches.writes());
+
+	std::vector<uint8_t> before(out.data(), out.data() + out.size());
+	dirty = journal.applyDelta(next, cave, out.data(), out.size());
+	next.recordCave(out.data(), out.size());
+	CHECK(next.matchesOutput(out.data(), out.size(), &error));
+
+	// every changed byte is in a range, and in the text a range only holds changed bytes
+	for (size_t i = 0; i < before.size(); i++) {
+		if (before[i] != out.data()[i]) CHECK(covered(dirty, i));
+	}
+	for (patch::DirtyRange const& range : dirty) {
+		CHECK(range.length > 0 && range.offset + range.length <= out.size());
+		if (range.offset >= journal.caveFileOff || range.offset < text->offset) continue;
+		for (uint64_t i = range.offset; i < range.offset + range.length; i++) CHECK(before[i] != out.data()[i]);
+	}
+
+	// the text is the pristine one with exactly this plan on it, the cave kept what it had and got the new trampolines
+	std::vector<uint8_t> expected(source.base(), source.base() + source.size());
+	built.hooks.apply(expected.data(), expected.size());
+	built.patches.apply(expected.data(), expected.size());
+	CHECK(memcmp(out.data() + text->offset, expected.data() + text->offset, text->size) == 0);
+	CHECK(memcmp(out.data() + journal.caveFileOff, before.data() + journal.caveFileOff, journal.caveUsed) == 0);
+	CHECK(memcmp(out.data() + journal.caveFileOff + journal.caveUsed, cave.data() + journal.caveUsed, cave.size() - journal.caveUsed) == 0);
+	patch::MachOImage patched;
+	CHECK(patched.parse(out.data(), out.size()));
+	section_64 const* caveSect = patched.findSection("__CUSTOM", "__custom");
+	CHECK(caveSect && caveSect->size == cave.size());
+	return next;
+}
+
+static void checkMismatch(std::string const& output, patch::PatchJournal const& journal, uint64_t offset) {
+	patch::WritableFile out;
+	CHECK(out.open(output.c_str()));
+	out.data()[offset] ^= 0xff;
+	std::string error;
+	CHECK(!journal.matchesOutput(out.data(), out.size(), &error) && !error.empty());
+	out.data()[offset] ^= 0xff;
+	CHECK(journal.matchesOutput(out.data(), out.size()));
+}
+
+static std::vector<patch::DirtyRange> readDirtyRanges(std::string const& output) {
+	std::string list;
+	CHECK(patch::readWholeFile(patch::dirtyRangesPath(output.c_str()), list));
+	CHECK(list.compare(0, 14, "zsign-dirty 1\n") == 0);
+	std::vector<patch::DirtyRange> ranges;
+	char const* line = list.c_str() + 14;
+	while (*line) {
+		char* end = nullptr;
+		patch::DirtyRange range;
+		range.offset = strtoull(line, &end, 10);
+		CHECK(*end == ' ');
+		range.length = strtoull(end + 1, &end, 10);
+		CHECK(*end == '\n');
+		ranges.push_back(range);
+		line = end + 1;
+	}
+	return ranges;
+}
+
+int main() {
+	char folder[] = "/tmp/PatchJournalTest.XXXXXX";
+	CHECK(mkdtemp(folder));
+	std::string pristine = std::string(folder) + "/pristine";
+	std::string output = std::string(folder) + "/output";
+
+	std::mt19937_64 rng(50);
+	fixture::MachOBuilder builder;
+	std::vector<uint8_t> code(kTextSize);
+	for (uint8_t& byte : code) byte = (uint8_t)rng();
+	builder.sections.push_back({ "__text", code });
+	builder.headerPad = 0x200;
+	builder.symbols.push_back({ "_main", 0x0f, fixture::kTextVmaddr });
+	std::vector<uint8_t> image = builder.build();
+	CHECK(patch::writeWholeFile(pristine, std::string(image.begin(), image.end())));
+	patch::MachOImage pristineImage;
+	CHECK(pristineImage.parse(image.data(), image.size()));
+	uint64_t text = pristineImage.findSection("__TEXT", "__text")->offset;
+
+	Plan first;
+	first.hooks = { text + 0x100, text + 0x2000, text + 0x4ff0, text + 0x6000 };
+	first.patches = { { text + 0x300, { 1, 2, 3, 4, 5, 6, 7, 8 } }, { text + 0x3ffc, { 9, 9, 9, 9, 9, 9, 9, 9 } } };
+	patch::PatchJournal journal = fullPatch(pristine, output, first);
+
+	std::string saved = output + ".journal";
+	CHECK(journal.save(saved));
+	patch::PatchJournal loaded;
+	CHECK(loaded.load(saved));
+	CHECK(loaded.hooks.size() == 4 && loaded.patches.size() == 2 && loaded.caveUsed == journal.caveUsed && loaded.caveSha256 == journal.caveSha256);
+
+	// the cave, an intervener and a patch all count as the output having changed
+	checkMismatch(output, journal, journal.caveFileOff + 5);
+	checkMismatch(output, journal, text + 0x2000 + 2);
+	checkMismatch(output, journal, text + 0x3ffc + 1);
+
+	std::string signedOutput;
+	CHECK(patch::readWholeFile(output, signedOutput));
+	CHECK(patch::addDirtyRanges(output.c_str(), {}, true));
+
+	// a hook added, one removed, a patch changed and moved, one dropped and a new one where a hook used to be
+	Plan second;
+	second.hooks = { text + 0x100, text + 0x4ff0, text + 0x6000, text + 0x7000, text + 0x10 };
+	second.patches = { { text + 0x300, { 1, 2, 0x33, 4, 5, 6, 7, 8, 0x99 } }, { text + 0x2004, { 0xff, 0xff } } };
+	std::vector<patch::DirtyRange> dirty;
+	journal = patchInPlace(pristine, output, journal, second, dirty);
+	CHECK(journal.hooks.size() == 5);
+	CHECK(patch::addDirtyRanges(output.c_str(), dirty, false));
+
+	// hooks only removed: no new trampolines, the cave and the section size stay as they are
+	Plan third = second;
+	third.hooks = { text + 0x4ff0 };
+	uint64_t caveUsed = journal.caveUsed;
+	journal = patchInPlace(pristine, output, journal, third, dirty);
+	CHECK(journal.caveUsed == caveUsed);
+	for (patch::DirtyRange const& range : dirty) CHECK(range.offset < text + kTextSize);
+	CHECK(patch::addDirtyRanges(output.c_str(), dirty, false));
+
+	// and back to the first plan, the hooks dropped since get new trampolines after the old ones
+	journal = patchInPlace(pristine, output, journal, first, dirty);
+	CHECK(patch::addDirtyRanges(output.c_str(), dirty, false));
+
+	// the list the signer gets covers everything since the signature
+	std::string patched;
+	CHECK(patch::readWholeFile(output, patched));
+	CHECK(patched.size() == signedOutput.size());
+	std::vector<patch::DirtyRange> listed = readDirtyRanges(output);
+	for (size_t i = 0; i < patched.size(); i++) {
+		if (patched[i] != signedOutput[i]) CHECK(covered(listed, i));
+	}
+
+	// with no list waiting nothing is written, a signature after the patch starts a new one, a broken one is removed
+	std::string listPath = patch::dirtyRangesPath(output.c_str());
+	unlink(listPath.c_str());
+	CHECK(patch::addDirtyRanges(output.c_str(), dirty, false));
+	CHECK(access(listPath.c_str(), F_OK) != 0);
+	CHECK(patch::addDirtyRanges(output.c_str(), { { 5, 7 } }, true));
+	CHECK(readDirtyRanges(output).size() == 1);
+	CHECK(patch::writeWholeFile(listPath, "something else\n"));
+	CHECK(!patch::addDirtyRanges(output.c_str(), dirty, false));
+	CHECK(access(listPath.c_str(), F_OK) != 0);
+
+	unlink(listPath.c_str());
+	unlink(saved.c_str());
+	unlink(output.c_str());
+	unlink(pristine.c_str());
+	rmdir(folder);
+	printf("PatchJournalTest: ok\n");
+	return 0;
+}
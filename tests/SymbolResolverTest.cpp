@@ -0,0 +1,151 @@
+// SymbolResolver against hand-built images: prefix walks through the export trie, the kinds of export,
+// the symbol table fallback for what isn't exported, and damaged linkedit data
+#include "MachOFixture.hpp"
+#include "check.hpp"
+#include "patch/SymbolResolver.hpp"
+
+using fixture::kTextVmaddr;
+
+static fixture::MachOBuilder makeImage(fixture::TrieCommand trieCommand) {
+	fixture::MachOBuilder builder;
+	builder.trieCommand = trieCommand;
+	builder.sections.push_back({ "__text", std::vector<uint8_t>(0x40, 0xcc) });
+	builder.exports = {
+		{ "_foo", 0, 0x100 },
+		{ "_foobar", 0, 0x200 },
+		{ "_fob", 0, 0x300 },
+		{ "__ZN5tulip4hook17getRelocatedBytesE", EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER, 0x400, 0x999 },
+		{ "_absolute", EXPORT_SYMBOL_FLAGS_KIND_ABSOLUTE, 0x1234 },
+		{ "_reexported", EXPORT_SYMBOL_FLAGS_REEXPORT, 0 },
+	};
+	builder.symbols = {
+		{ "_debug_note", 0x24, 0x100000010 },	// N_FUN stab, never a definition
+		{ "_undefined", 0x01, 0 },				// N_UNDF | N_EXT
+		{ "_hidden", 0x0e, 0x100000020 },		// local N_SECT
+		{ "_foo", 0x0f, 0x1000000f0 },			// exported too, the trie wins
+		{ "_hidden", 0x0e, 0x100000030 },		// a later duplicate doesn't replace the first
+		{ "_debug_note", 0x0e, 0x100000018 },
+	};
+	return builder;
+}
+
+static void checkResolved(std::vector<uint8_t> const& image, bool hasTrie) {
+	patch::SymbolResolver resolver;
+	CHECK(resolver.parseFile(image.data(), image.size()));
+	std::vector<uint64_t> found = resolver.resolve({
+		"_foo",
+		"_foobar",
+		"_fob",
+		"_fo",
+		"_foob",
+		"_foobarx",
+		"__ZN5tulip4hook17getRelocatedBytesE",
+		"_absolute",
+		"_reexported",
+		"_hidden",
+		"_undefined",
+		"_debug_note",
+		"",
+	});
+	CHECK(found.size() == 13);
+	CHECK(found[0] == (hasTrie ? kTextVmaddr + 0x100 : 0x1000000f0));
+	CHECK(found[1] == (hasTrie ? kTextVmaddr + 0x200 : 0));
+	CHECK(found[2] == (hasTrie ? kTextVmaddr + 0x300 : 0));
+	// prefixes of exported names and names past them end on nodes without a terminal or edge
+	CHECK(found[3] == 0);
+	CHECK(found[4] == 0);
+	CHECK(found[5] == 0);
+	// the stub, not the resolver
+	CHECK(found[6] == (hasTrie ? kTextVmaddr + 0x400 : 0));
+	CHECK(found[7] == (hasTrie ? 0x1234 : 0));
+	CHECK(found[8] == 0);
+	CHECK(found[9] == 0x100000020);
+	CHECK(found[10] == 0);
+	CHECK(found[11] == 0x100000018);
+	CHECK(found[12] == 0);
+}
+
+static void testTrieAndSymtab() {
+	checkResolved(makeImage(fixture::TrieCommand::ExportsTrie).build(), true);
+	checkResolved(makeImage(fixture::TrieCommand::DyldInfoOnly).build(), true);
+	checkResolved(makeImage(fixture::TrieCommand::None).build(), false);
+}
+
+static void testFatFile() {
+	std::vector<uint8_t> thin = makeImage(fixture::TrieCommand::ExportsTrie).build();
+	// big-endian fat header with the arm64 slice at 0x4000
+	std::vector<uint8_t> fat(0x4000, 0);
+	auto be32 = [&](size_t at, uint32_t v) {
+		fat[at] = v >> 24;
+		fat[at + 1] = v >> 16;
+		fat[at + 2] = v >> 8;
+		fat[at + 3] = v;
+	};
+	be32(0, FAT_MAGIC);
+	be32(4, 1);
+	be32(8, CPU_TYPE_ARM64);
+	be32(12, 0);
+	be32(16, 0x4000);
+	be32(20, (uint32_t)thin.size());
+	be32(24, 14);
+	fat.insert(fat.end(), thin.begin(), thin.end());
+	checkResolved(fat, true);
+}
+
+static void testDamaged() {
+	std::vector<uint8_t> image = makeImage(fixture::TrieCommand::ExportsTrie).build();
+	patch::SymbolResolver resolver;
+	CHECK(!resolver.parseFile(image.data(), sizeof(mach_header_64) - 1));
+
+	// a child offset past the end of the trie stops the walk, the symbol table still answers
+	std::vector<uint8_t> broken = image;
+	patch::MachOImage parsed;
+	CHECK(parsed.parse(broken.data(), broken.size()));
+	auto trie = const_cast<linkedit_data_command*>(reinterpret_cast<linkedit_data_command const*>(parsed.findCommand(LC_DYLD_EXPORTS_TRIE)));
+	CHECK(trie);
+	uint8_t const* root = broken.data() + trie->dataoff;
+	// root: terminal size 0, one edge "_" (every export starts with it) and its child offset, then the rest is cut off
+	CHECK(root[0] == 0 && root[1] == 1 && root[2] == '_' && root[3] == 0 && root[4] >= 5);
+	trie->datasize = 5;
+	CHECK(resolver.parseFile(broken.data(), broken.size()));
+	std::vector<uint64_t> found = resolver.resolve({ "_foobar", "_hidden", "_foo" });
+	CHECK(found[0] == 0);
+	CHECK(found[1] == 0x100000020);
+	CHECK(found[2] == 0x1000000f0);
+
+	// linkedit data that claims to run past the file is ignored instead of read
+	std::vector<uint8_t> truncated(image.begin(), image.end() - 4);
+	CHECK(resolver.parseFile(truncated.data(), truncated.size()));
+	found = resolver.resolve({ "_hidden", "_foo" });
+	CHECK(found[0] == 0);
+	CHECK(found[1] == kTextVmaddr + 0x100);
+}
+
+static void testCache() {
+	fixture::MachOBuilder first = makeImage(fixture::TrieCommand::ExportsTrie);
+	first.uuidSeed = 0x10;
+	fixture::MachOBuilder second = makeImage(fixture::TrieCommand::ExportsTrie);
+	second.uuidSeed = 0x20;
+	second.exports[0].value = 0x500;
+	std::vector<uint8_t> firstImage = first.build();
+	std::vector<uint8_t> secondImage = second.build();
+
+	patch::SymbolResolver a, b;
+	CHECK(a.parseFile(firstImage.data(), firstImage.size()) && a.hasUuid());
+	CHECK(b.parseFile(secondImage.data(), secondImage.size()) && b.hasUuid());
+	CHECK(a.uuid() != b.uuid());
+	// partly cached, partly new, in the caller's order
+	CHECK(a.resolveCached({ "_foo" })[0] == kTextVmaddr + 0x100);
+	std::vector<uint64_t> found = a.resolveCached({ "_hidden", "_foo", "_missing" });
+	CHECK(found[0] == 0x100000020 && found[1] == kTextVmaddr + 0x100 && found[2] == 0);
+	CHECK(b.resolveCached({ "_foo" })[0] == kTextVmaddr + 0x500);
+}
+
+int main() {
+	testTrieAndSymtab();
+	testFatFile();
+	testDamaged();
+	testCache();
+	printf("SymbolResolverTest: ok\n");
+	return 0;
+}
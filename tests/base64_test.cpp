@@ -0,0 +1,125 @@
+// jbase64 against a plain byte-at-a-time reference, so the vector loops (ssse3, or neon with
+// JBASE64_ENABLE_NEON on arm64) have to agree with it on every length, alignment and bad input
+#include "check.hpp"
+#include "common/base64.h"
+
+#include <random>
+#include <string.h>
+#include <string>
+
+static const char kChars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static std::string refEncode(std::string const& in)
+{
+	std::string out;
+	size_t i = 0;
+	for (; i + 3 <= in.size(); i += 3) {
+		uint32_t v = (uint8_t)in[i] << 16 | (uint8_t)in[i + 1] << 8 | (uint8_t)in[i + 2];
+		out += kChars[v >> 18 & 63];
+		out += kChars[v >> 12 & 63];
+		out += kChars[v >> 6 & 63];
+		out += kChars[v & 63];
+	}
+	if (i < in.size()) {
+		uint32_t v = (uint8_t)in[i] << 16 | (i + 1 < in.size() ? (uint8_t)in[i + 1] << 8 : 0);
+		out += kChars[v >> 18 & 63];
+		out += kChars[v >> 12 & 63];
+		out += (i + 1 < in.size()) ? kChars[v >> 6 & 63] : '=';
+		out += '=';
+	}
+	return out;
+}
+
+static bool refDecode(std::string const& in, std::string& out)
+{
+	out.clear();
+	uint32_t v = 0;
+	int count = 0;
+	for (char c : in) {
+		char const* p = (c != '\0') ? strchr(kChars, c) : nullptr;
+		if (p) {
+			v = v << 6 | (uint32_t)(p - kChars);
+			if (++count == 4) {
+				out += (char)(v >> 16);
+				out += (char)(v >> 8);
+				out += (char)v;
+				v = 0;
+				count = 0;
+			}
+		} else if (c == '=') {
+			break;
+		} else if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+			return false;
+		}
+	}
+	if (count >= 2) {
+		v <<= (4 - count) * 6;
+		out += (char)(v >> 16);
+		if (count >= 3) {
+			out += (char)(v >> 8);
+		}
+	}
+	return count != 1;
+}
+
+int main()
+{
+	std::mt19937 rng(1234);
+	for (size_t len = 0; len < 1200; len++) {
+		std::string data(len, '\0');
+		for (auto& c : data) {
+			c = (char)rng();
+		}
+
+		std::string enc;
+		jbase64::encode_append(data.data(), data.size(), enc);
+		CHECK(enc == refEncode(data));
+		CHECK(enc.size() == jbase64::encoded_size(len));
+
+		// unaligned source for the loads
+		std::string shifted = "x" + data;
+		std::string encShifted;
+		jbase64::encode_append(shifted.data() + 1, len, encShifted);
+		CHECK(encShifted == enc);
+
+		std::string dec;
+		CHECK(jbase64::decode_to(enc.data(), enc.size(), dec));
+		CHECK(dec == data);
+
+		// whitespace inside a block pushes the vector loop back to the scalar one mid-stream
+		std::string wrapped;
+		for (size_t i = 0; i < enc.size(); i++) {
+			wrapped += enc[i];
+			if (rng() % 37 == 0) {
+				wrapped += (rng() & 1) ? '\n' : ' ';
+			}
+		}
+		std::string ref;
+		CHECK(refDecode(wrapped, ref) == jbase64::decode_to(wrapped.data(), wrapped.size(), dec));
+		CHECK(dec == ref && dec == data);
+
+		// one bad character anywhere, including high bytes that miss the lookup tables
+		if (!enc.empty()) {
+			std::string bad = enc;
+			size_t at = rng() % bad.size();
+			static char const kBad[] = { '!', '-', '_', '\x80', '\xff', '\0', '.' };
+			bad[at] = kBad[rng() % sizeof(kBad)];
+			bool refOk = refDecode(bad, ref);
+			bool ok = jbase64::decode_to(bad.data(), bad.size(), dec);
+			CHECK(ok == refOk);
+			if (ok) {
+				CHECK(dec == ref);
+			}
+		}
+	}
+
+	// the legacy api goes through the same code
+	jbase64 b64;
+	CHECK(std::string(b64.encode("hello world")) == "aGVsbG8gd29ybGQ=");
+	int decLen = 0;
+	CHECK(std::string(b64.decode("aGVsbG8gd29ybGQ=", 0, &decLen)) == "hello world");
+	CHECK(decLen == 11);
+
+	printf("base64_test: ok\n");
+	return 0;
+}
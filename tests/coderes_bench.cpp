@@ -0,0 +1,204 @@
+// the jvalue work behind a bundle's CodeResources, for a bundle of N files: building the dictionary the way
+// ZBundle::GenerateCodeResources does, writing it out, reading it back the way SignNode does for an already
+// signed bundle, rehashing a few changed files into it, and copying versus moving the tree. reports time and
+// heap allocations for each step, and checks the round trip gives the same bytes.
+//   coderes_bench [files, default 10000]
+#include "check.hpp"
+#include "common/common.h"
+#include "common/base64.h"
+#include "common/json.h"
+
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <random>
+#include <set>
+#include <string>
+
+using Clock = std::chrono::steady_clock;
+
+static std::atomic<size_t> s_uAllocs(0);
+static std::atomic<size_t> s_uAllocBytes(0);
+
+void* operator new(size_t uSize)
+{
+	s_uAllocs++;
+	s_uAllocBytes += uSize;
+	void* p = malloc(uSize ? uSize : 1);
+	if (NULL == p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+struct Step
+{
+	const char* szName;
+	double seconds;
+	size_t uAllocs;
+	size_t uAllocBytes;
+};
+
+template <typename Fn>
+static Step measure(const char* szName, Fn fn)
+{
+	size_t uAllocs = s_uAllocs;
+	size_t uAllocBytes = s_uAllocBytes;
+	Clock::time_point start = Clock::now();
+	fn();
+	Step step;
+	step.szName = szName;
+	step.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	step.uAllocs = s_uAllocs - uAllocs;
+	step.uAllocBytes = s_uAllocBytes - uAllocBytes;
+	return step;
+}
+
+static string randomBase64(mt19937_64& rng, size_t uBytes)
+{
+	string strRaw(uBytes, '\0');
+	for (char& c : strRaw) {
+		c = (char)rng();
+	}
+	string strBase64;
+	jbase64::encode_append(strRaw.data(), strRaw.size(), strBase64);
+	return strBase64;
+}
+
+// the same shape and key handling as GenerateCodeResources, with the hashes made up instead of read from disk
+static void buildCodeResources(const set<string>& setFiles, const vector<pair<string, string>>& arrHashes, jvalue& jvCodeRes)
+{
+	jvCodeRes.clear();
+	jvalue& jvFiles = jvCodeRes["files"];
+	jvalue& jvFiles2 = jvCodeRes["files2"];
+	jvFiles = jvalue(jvalue::E_OBJECT);
+	jvFiles2 = jvalue(jvalue::E_OBJECT);
+
+	size_t i = 0;
+	for (const string& strKey : setFiles) {
+		const string& strSHA1Base64 = arrHashes[i].first;
+		const string& strSHA256Base64 = arrHashes[i].second;
+		i++;
+
+		bool bomit1 = ZFile::IsPathSuffix(strKey, ".lproj/locversion.plist");
+		bool bomit2 = bomit1 || ZFile::IsPathSuffix(strKey, ".DS_Store") || "Info.plist" == strKey || "PkgInfo" == strKey;
+		if (!bomit1) {
+			jvalue& jvFile = jvFiles[strKey];
+			if (string::npos != strKey.rfind(".lproj/")) {
+				jvFile["hash"] = "data:" + strSHA1Base64;
+				jvFile["optional"] = true;
+			} else {
+				jvFile = "data:" + strSHA1Base64;
+			}
+		}
+		if (!bomit2) {
+			jvalue& jvFile2 = jvFiles2[strKey];
+			jvFile2["hash"] = "data:" + strSHA1Base64;
+			jvFile2["hash2"] = "data:" + strSHA256Base64;
+			if (string::npos != strKey.rfind(".lproj/")) {
+				jvFile2["optional"] = true;
+			}
+		}
+	}
+
+	jvalue& jvRules = jvCodeRes["rules"];
+	jvRules["^.*"] = true;
+	jvRules["^.*\\.lproj/"]["optional"] = true;
+	jvRules["^.*\\.lproj/"]["weight"] = 1000.0;
+	jvRules["^.*\\.lproj/locversion.plist$"]["omit"] = true;
+	jvRules["^.*\\.lproj/locversion.plist$"]["weight"] = 1100.0;
+	jvRules["^Base\\.lproj/"]["weight"] = 1010.0;
+	jvRules["^version.plist$"] = true;
+	jvalue& jvRules2 = jvCodeRes["rules2"];
+	jvRules2["^.*"] = true;
+	jvRules2[".*\\.dSYM($|/)"]["weight"] = 11.0;
+	jvRules2["^(.*/)?\\.DS_Store$"]["omit"] = true;
+	jvRules2["^(.*/)?\\.DS_Store$"]["weight"] = 2000.0;
+	jvRules2["^Info\\.plist$"]["omit"] = true;
+	jvRules2["^Info\\.plist$"]["weight"] = 20.0;
+	jvRules2["^embedded\\.provisionprofile$"]["weight"] = 20.0;
+}
+
+int main(int argc, char** argv)
+{
+	size_t uFiles = argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : 10000;
+
+	// paths like a game bundle's resources: a few folders deep, some localized
+	mt19937_64 rng(31);
+	set<string> setFiles;
+	setFiles.insert("Info.plist");
+	setFiles.insert("PkgInfo");
+	while (setFiles.size() < uFiles + 2) {
+		size_t i = setFiles.size();
+		string strKey;
+		if (0 == i % 17) {
+			strKey = "lang" + to_string(i % 29) + ".lproj/Localizable-" + to_string(i) + ".strings";
+		} else {
+			strKey = "Resources/pack" + to_string(i % 41) + "/sheet" + to_string(i % 7) + "/sprite-" + to_string(i) + "-uhd.png";
+		}
+		setFiles.insert(strKey);
+	}
+	vector<pair<string, string>> arrHashes;
+	for (size_t i = 0; i < setFiles.size(); i++) {
+		arrHashes.push_back(make_pair(randomBase64(rng, 20), randomBase64(rng, 32)));
+	}
+	vector<string> arrChanged;
+	for (const string& strKey : setFiles) {
+		if (0 == rng() % 100) {
+			arrChanged.push_back(strKey);
+		}
+	}
+
+	vector<Step> arrSteps;
+	jvalue jvCodeRes;
+	arrSteps.push_back(measure("build", [&] { buildCodeResources(setFiles, arrHashes, jvCodeRes); }));
+
+	string strPlist;
+	arrSteps.push_back(measure("style_write_plist", [&] { jvCodeRes.style_write_plist(strPlist); }));
+
+	jvalue jvRead;
+	arrSteps.push_back(measure("read_plist", [&] { CHECK(jvRead.read_plist(strPlist)); }));
+
+	arrSteps.push_back(measure("rehash 1% changed", [&] {
+		jvalue& jvFiles = jvRead["files"];
+		jvalue& jvFiles2 = jvRead["files2"];
+		for (const string& strKey : arrChanged) {
+			jvFiles[strKey] = "data:" + arrHashes[0].first;
+			jvalue& jvFile2 = jvFiles2[strKey];
+			jvFile2["hash"] = "data:" + arrHashes[0].first;
+			jvFile2["hash2"] = "data:" + arrHashes[0].second;
+		}
+	}));
+
+	jvalue jvCopy;
+	arrSteps.push_back(measure("copy", [&] { jvCopy = jvCodeRes; }));
+	jvalue jvMoved;
+	arrSteps.push_back(measure("move", [&] { jvMoved = std::move(jvCopy); }));
+
+	// what came back out has to be what went in, and the rehash only touched the changed keys
+	string strRoundTrip;
+	jvMoved.style_write_plist(strRoundTrip);
+	CHECK(strRoundTrip == strPlist);
+	CHECK(jvRead["files2"].size() == jvCodeRes["files2"].size());
+	for (const string& strKey : arrChanged) {
+		if (jvCodeRes["files2"].has(strKey)) {
+			CHECK(jvRead["files2"][strKey]["hash2"].as_data() == jvalue("data:" + arrHashes[0].second).as_data());
+		}
+	}
+
+	printf("coderes_bench: %zu files, CodeResources %zu KB, %zu changed\n", uFiles, strPlist.size() >> 10, arrChanged.size());
+	for (const Step& step : arrSteps) {
+		printf("  %-18s  %8.2f ms  %8zu allocations  %8zu KB\n", step.szName, step.seconds * 1e3, step.uAllocs, step.uAllocBytes >> 10);
+	}
+	return 0;
+}
@@ -0,0 +1,113 @@
+// ZFile::CopyFile on a large file, to a new destination and over an existing one, next to a plain 64KB
+// read/write loop. checks the copies byte for byte, and that a copy that fails leaves the old destination
+// alone with no temporary file next to it.
+//   copy_bench [MiB, default 100]
+#include "check.hpp"
+#include "common/common.h"
+
+#include <chrono>
+#include <dirent.h>
+#include <random>
+#include <string>
+
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static bool plainCopy(const char* szSrc, const char* szDest)
+{
+	FILE* in = fopen(szSrc, "rb");
+	FILE* out = fopen(szDest, "wb");
+	bool bOk = (NULL != in && NULL != out);
+	static char buffer[64 << 10];
+	while (bOk) {
+		size_t n = fread(buffer, 1, sizeof(buffer), in);
+		if (0 == n) {
+			break;
+		}
+		bOk = (fwrite(buffer, 1, n, out) == n);
+	}
+	if (in) {
+		fclose(in);
+	}
+	if (out) {
+		fclose(out);
+	}
+	return bOk;
+}
+
+static size_t countEntries(const string& strFolder)
+{
+	size_t uCount = 0;
+	DIR* dir = opendir(strFolder.c_str());
+	CHECK(NULL != dir);
+	while (dirent* ent = readdir(dir)) {
+		if (0 != strcmp(ent->d_name, ".") && 0 != strcmp(ent->d_name, "..")) {
+			uCount++;
+		}
+	}
+	closedir(dir);
+	return uCount;
+}
+
+int main(int argc, char** argv)
+{
+	size_t mib = argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : 100;
+	if (0 == mib) {
+		mib = 1;
+	}
+
+	char folder[] = "/tmp/copy_bench.XXXXXX";
+	CHECK(NULL != mkdtemp(folder));
+	string strFolder = folder;
+	string strSrc = strFolder + "/src.bin";
+	string strNew = strFolder + "/new.bin";
+	string strOver = strFolder + "/over.bin";
+	string strPlain = strFolder + "/plain.bin";
+
+	string strData(mib << 20, '\0');
+	mt19937_64 rng(39);
+	for (size_t i = 0; i + 8 <= strData.size(); i += 8) {
+		uint64_t v = rng();
+		memcpy(&strData[i], &v, 8);
+	}
+	CHECK(ZFile::WriteFile(strSrc.c_str(), strData.data(), strData.size()));
+	CHECK(ZFile::WriteFile(strOver.c_str(), "old contents", 12));
+	chmod(strSrc.c_str(), 0751);
+
+	Clock::time_point start = Clock::now();
+	CHECK(ZFile::CopyFile(strSrc.c_str(), strNew.c_str()));
+	double newSeconds = secondsSince(start);
+	start = Clock::now();
+	CHECK(ZFile::CopyFile(strSrc.c_str(), strOver.c_str()));
+	double overSeconds = secondsSince(start);
+	start = Clock::now();
+	CHECK(plainCopy(strSrc.c_str(), strPlain.c_str()));
+	double plainSeconds = secondsSince(start);
+
+	string strCopy;
+	CHECK(ZFile::ReadFile(strNew.c_str(), strCopy) && strCopy == strData);
+	CHECK(ZFile::ReadFile(strOver.c_str(), strCopy) && strCopy == strData);
+	struct stat st;
+	CHECK(0 == stat(strOver.c_str(), &st) && 0751 == (st.st_mode & 07777));
+
+	// a directory opens fine but can't be read, so the copy fails after the destination side is set up
+	CHECK(!ZFile::CopyFile(strFolder.c_str(), strOver.c_str()));
+	CHECK(ZFile::ReadFile(strOver.c_str(), strCopy) && strCopy == strData);
+	// copying a file onto itself is refused instead of truncating it
+	CHECK(!ZFile::CopyFile(strOver.c_str(), strOver.c_str()));
+	CHECK(ZFile::ReadFile(strOver.c_str(), strCopy) && strCopy == strData);
+	CHECK(4 == countEntries(strFolder));
+
+	double mb = (double)strData.size() / 1e6;
+	printf("copy_bench: %zu MiB\n", mib);
+	printf("  CopyFile, new destination     %8.1f ms  %8.1f MB/s\n", newSeconds * 1e3, mb / newSeconds);
+	printf("  CopyFile, over existing file  %8.1f ms  %8.1f MB/s\n", overSeconds * 1e3, mb / overSeconds);
+	printf("  64KB read/write loop          %8.1f ms  %8.1f MB/s\n", plainSeconds * 1e3, mb / plainSeconds);
+
+	ZFile::RemoveFolder(strFolder.c_str());
+	return 0;
+}
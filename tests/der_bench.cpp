@@ -0,0 +1,92 @@
+// ZSign::_DER next to the encoder it replaced, on a typical app's entitlements and on a large tree of
+// nested dicts and string arrays. both only get types the old encoder handled, and must agree byte for byte.
+//   der_bench [iterations of the entitlements, default 200000]
+#include "check.hpp"
+#include "common/common.h"
+#include "common/mach-o.h"
+#include "der_legacy.hpp"
+#include "signing.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string>
+
+using Clock = std::chrono::steady_clock;
+
+static jvalue makeEntitlements()
+{
+	jvalue ent(jvalue::E_OBJECT);
+	ent["application-identifier"] = "ABCDE12345.com.robtop.geometryjump";
+	ent["com.apple.developer.team-identifier"] = "ABCDE12345";
+	ent["get-task-allow"] = true;
+	ent["aps-environment"] = "production";
+	ent["com.apple.developer.game-center"] = true;
+	ent["com.apple.developer.ubiquity-kvstore-identifier"] = "ABCDE12345.com.robtop.geometryjump";
+	ent["com.apple.developer.icloud-container-environment"] = "Production";
+	jvalue& groups = ent["keychain-access-groups"];
+	groups.push_back("ABCDE12345.com.robtop.geometryjump");
+	groups.push_back("ABCDE12345.com.robtop.shared");
+	jvalue& appGroups = ent["com.apple.security.application-groups"];
+	appGroups.push_back("group.com.robtop.geometryjump");
+	appGroups.push_back("group.com.robtop.launcher");
+	jvalue& containers = ent["com.apple.developer.icloud-container-identifiers"];
+	containers.push_back("iCloud.com.robtop.geometryjump");
+	jvalue& services = ent["com.apple.developer.icloud-services"];
+	services.push_back("CloudDocuments");
+	services.push_back("CloudKit");
+	jvalue& domains = ent["com.apple.developer.associated-domains"];
+	for (int i = 0; i < 8; i++) {
+		domains.push_back("applinks:link" + std::to_string(i) + ".robtop.example.com");
+	}
+	return ent;
+}
+
+static jvalue makeLargeTree()
+{
+	jvalue tree(jvalue::E_OBJECT);
+	for (int i = 0; i < 2000; i++) {
+		jvalue& entry = tree["com.example.entitlement." + std::to_string(i)];
+		entry["enabled"] = (i % 3) != 0;
+		jvalue& values = entry["values"];
+		for (int j = 0; j < 16; j++) {
+			values.push_back("value-" + std::to_string(i) + "-" + std::to_string(j) + "-padding-to-a-realistic-length");
+		}
+	}
+	return tree;
+}
+
+template <typename Encode>
+static double run(const jvalue& value, int iterations, size_t& uBytes, Encode encode)
+{
+	uBytes = 0;
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < iterations; i++) {
+		uBytes += encode(value).size();
+	}
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void compare(const char* szName, const jvalue& value, int iterations)
+{
+	std::string der = ZSign::_DER(value);
+	CHECK(der == LegacyDER(value));
+
+	size_t uBytes = 0;
+	double newSeconds = run(value, iterations, uBytes, [](const jvalue& v) { return ZSign::_DER(v); });
+	double legacySeconds = run(value, iterations, uBytes, [](const jvalue& v) { return LegacyDER(v); });
+	double mb = (double)uBytes / 1e6;
+	printf("  %-14s %8zu bytes x %-7d  new %8.2f us %8.1f MB/s   old %8.2f us %8.1f MB/s   %.2fx\n", szName, der.size(), iterations,
+		   newSeconds * 1e6 / iterations, mb / newSeconds, legacySeconds * 1e6 / iterations, mb / legacySeconds, legacySeconds / newSeconds);
+}
+
+int main(int argc, char** argv)
+{
+	int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+	if (iterations < 1) {
+		iterations = 1;
+	}
+	printf("der_bench:\n");
+	compare("entitlements", makeEntitlements(), iterations);
+	compare("large tree", makeLargeTree(), iterations / 1000 + 1);
+	return 0;
+}
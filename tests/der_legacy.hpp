@@ -0,0 +1,71 @@
+#pragma once
+
+// ZSign::_DER as it was before the two-pass encoder, kept as the reference for der_test and der_bench.
+// only bool, string, array and dict were right: ints were written with their value as the length,
+// the other types asserted, and a dict entry's length assumed a key shorter than 128 bytes.
+#include "common/common.h"
+#include "common/json.h"
+#include "common/util.h"
+
+static void LegacyDERLength(string& strBlob, uint64_t uLength)
+{
+	if (uLength < 128) {
+		strBlob.append(1, (char)uLength);
+	} else {
+		uint32_t sLength = (64 - ZUtil::builtin_clzll(uLength) + 7) / 8;
+		strBlob.append(1, (char)(0x80 | sLength));
+		sLength *= 8;
+		do {
+			strBlob.append(1, (char)(uLength >> (sLength -= 8)));
+		} while (sLength != 0);
+	}
+}
+
+static string LegacyDER(const jvalue& data)
+{
+	string strOutput;
+	if (data.is_bool()) {
+		strOutput.append(1, 0x01);
+		strOutput.append(1, 1);
+		strOutput.append(1, data.as_bool() ? 1 : 0);
+	} else if (data.is_string()) {
+		string strVal = data.as_cstr();
+		strOutput.append(1, 0x0c);
+		LegacyDERLength(strOutput, strVal.size());
+		strOutput += strVal;
+	} else if (data.is_array()) {
+		string strArray;
+		size_t size = data.size();
+		for (size_t i = 0; i < size; i++) {
+			strArray += LegacyDER(data[i]);
+		}
+		strOutput.append(1, 0x30);
+		LegacyDERLength(strOutput, strArray.size());
+		strOutput += strArray;
+	} else if (data.is_object()) {
+		string strDict;
+		vector<string> arrKeys;
+		data.get_keys(arrKeys);
+		for (size_t i = 0; i < arrKeys.size(); i++) {
+			string& strKey = arrKeys[i];
+			string strVal = LegacyDER(data[strKey]);
+
+			strDict.append(1, 0x30);
+			LegacyDERLength(strDict, (2 + strKey.size() + strVal.size()));
+
+			strDict.append(1, 0x0c);
+			LegacyDERLength(strDict, strKey.size());
+			strDict += strKey;
+
+			strDict += strVal;
+		}
+
+		strOutput.append(1, 0x31);
+		LegacyDERLength(strOutput, strDict.size());
+		strOutput += strDict;
+	} else {
+		assert(false && "Unsupported Entitlements DER Type");
+	}
+
+	return strOutput;
+}
@@ -0,0 +1,414 @@
+// ZSign::_DER against the encoder it replaced and against a strict decoder. On the types the old encoder got
+// right (bool, string, array, dict with short keys) the bytes have to be identical; every type round trips
+// through the decoder, which rejects non-minimal lengths and integers, non-canonical reals and unsorted keys.
+#include "check.hpp"
+#include "common/common.h"
+#include "common/mach-o.h"
+#include "der_legacy.hpp"
+#include "signing.h"
+
+#include <random>
+#include <string.h>
+#include <string>
+#include <time.h>
+
+class DERReader
+{
+public:
+	DERReader(const std::string& der) : m_p((const uint8_t*)der.data()), m_end(m_p + der.size()) {}
+
+	bool done() const { return m_p == m_end; }
+
+	jvalue read()
+	{
+		CHECK(m_end - m_p >= 2);
+		uint8_t tag = *m_p++;
+		uint64_t length = readLength();
+		CHECK(length <= (uint64_t)(m_end - m_p));
+		const uint8_t* content = m_p;
+		m_p += length;
+
+		switch (tag) {
+			case 0x01:
+				CHECK(length == 1 && (content[0] == 0 || content[0] == 1));
+				return jvalue(content[0] == 1);
+			case 0x02:
+				return jvalue(readInteger(content, length));
+			case 0x0c:
+				return jvalue(std::string((const char*)content, length));
+			case 0x09:
+				return jvalue(readReal(content, length));
+			case 0x18: {
+				CHECK(length == 15 && content[14] == 'Z');
+				struct tm tmDate = {};
+				std::string text((const char*)content, 14);
+				CHECK(text.find_first_not_of("0123456789") == std::string::npos);
+				tmDate.tm_year = atoi(text.substr(0, 4).c_str()) - 1900;
+				tmDate.tm_mon = atoi(text.substr(4, 2).c_str()) - 1;
+				tmDate.tm_mday = atoi(text.substr(6, 2).c_str());
+				tmDate.tm_hour = atoi(text.substr(8, 2).c_str());
+				tmDate.tm_min = atoi(text.substr(10, 2).c_str());
+				tmDate.tm_sec = atoi(text.substr(12, 2).c_str());
+				jvalue date;
+				date.assign_date(timegm(&tmDate));
+				return date;
+			}
+			case 0x04: {
+				jvalue data;
+				data.assign_data(content, (size_t)length);
+				return data;
+			}
+			case 0x05:
+				CHECK(length == 0);
+				return jvalue();
+			case 0x30: {
+				DERReader inner(content, length);
+				jvalue array(jvalue::E_ARRAY);
+				while (!inner.done()) {
+					array.push_back(inner.read());
+				}
+				return array;
+			}
+			case 0x31: {
+				DERReader inner(content, length);
+				jvalue dict(jvalue::E_OBJECT);
+				std::string previous;
+				bool first = true;
+				while (!inner.done()) {
+					// SEQUENCE { UTF8String key, value }
+					CHECK(*inner.m_p++ == 0x30);
+					uint64_t entry = inner.readLength();
+					CHECK(entry <= (uint64_t)(inner.m_end - inner.m_p));
+					DERReader pair(inner.m_p, entry);
+					inner.m_p += entry;
+					jvalue key = pair.read();
+					CHECK(key.is_string());
+					std::string strKey = key.as_cstr();
+					// strictly increasing byte order, so no duplicates either
+					CHECK(first || previous < strKey);
+					dict[strKey] = pair.read();
+					CHECK(pair.done());
+					previous = strKey;
+					first = false;
+				}
+				return dict;
+			}
+		}
+		CHECK(false && "unknown tag");
+		return jvalue();
+	}
+
+private:
+	DERReader(const uint8_t* p, uint64_t length) : m_p(p), m_end(p + length) {}
+
+	uint64_t readLength()
+	{
+		CHECK(m_p < m_end);
+		uint8_t first = *m_p++;
+		if (first < 0x80) {
+			return first;
+		}
+		uint32_t count = first & 0x7f;
+		CHECK(count >= 1 && count <= 8 && count <= (uint64_t)(m_end - m_p));
+		// no leading zero byte and no long form for what fits the short one
+		CHECK(m_p[0] != 0);
+		uint64_t length = 0;
+		for (uint32_t i = 0; i < count; i++) {
+			length = length << 8 | *m_p++;
+		}
+		CHECK(length >= 0x80);
+		return length;
+	}
+
+	static int64_t readInteger(const uint8_t* content, uint64_t length)
+	{
+		CHECK(length >= 1 && length <= 8);
+		// the first nine bits can't all be the same
+		if (length > 1) {
+			CHECK(!(content[0] == 0x00 && !(content[1] & 0x80)));
+			CHECK(!(content[0] == 0xff && (content[1] & 0x80)));
+		}
+		uint64_t value = (content[0] & 0x80) ? ~(uint64_t)0 : 0;
+		for (uint64_t i = 0; i < length; i++) {
+			value = value << 8 | content[i];
+		}
+		return (int64_t)value;
+	}
+
+	static double readReal(const uint8_t* content, uint64_t length)
+	{
+		if (length == 0) {
+			return 0.0;
+		}
+		uint8_t first = content[0];
+		if (length == 1 && (first & 0xc0) == 0x40) {
+			CHECK(first <= 0x43);
+			switch (first) {
+				case 0x40: return HUGE_VAL;
+				case 0x41: return -HUGE_VAL;
+				case 0x42: return NAN;
+				default: return -0.0;
+			}
+		}
+		// binary, base 2, no scaling factor, one to three exponent bytes
+		CHECK((first & 0x80) && (first & 0x3c) == 0 && (first & 0x03) != 0x03);
+		uint64_t exponentSize = (first & 0x03) + 1;
+		CHECK(length > 1 + exponentSize);
+		int64_t exponent = readInteger(content + 1, exponentSize);
+		uint64_t mantissa = 0;
+		CHECK(length - 1 - exponentSize <= 7);
+		for (uint64_t i = 1 + exponentSize; i < length; i++) {
+			mantissa = mantissa << 8 | content[i];
+		}
+		// DER wants the mantissa odd and without leading zero bytes
+		CHECK((mantissa & 1) && content[1 + exponentSize] != 0);
+		double value = ldexp((double)mantissa, (int)exponent);
+		return (first & 0x40) ? -value : value;
+	}
+
+	const uint8_t* m_p;
+	const uint8_t* m_end;
+};
+
+static bool sameValue(const jvalue& a, const jvalue& b)
+{
+	if (a.type() != b.type()) {
+		return false;
+	}
+	switch (a.type()) {
+		case jvalue::E_NULL:
+			return true;
+		case jvalue::E_BOOL:
+			return a.as_bool() == b.as_bool();
+		case jvalue::E_INT:
+			return a.as_int64() == b.as_int64();
+		case jvalue::E_FLOAT: {
+			double x = a.as_double();
+			double y = b.as_double();
+			if (isnan(x) || isnan(y)) {
+				return isnan(x) && isnan(y);
+			}
+			return x == y && signbit(x) == signbit(y);
+		}
+		case jvalue::E_STRING:
+			return strcmp(a.as_cstr(), b.as_cstr()) == 0;
+		case jvalue::E_DATE:
+			return a.as_date() == b.as_date();
+		case jvalue::E_DATA:
+			return a.as_data() == b.as_data();
+		case jvalue::E_ARRAY:
+			if (a.size() != b.size()) {
+				return false;
+			}
+			for (size_t i = 0; i < a.size(); i++) {
+				if (!sameValue(a[i], b[i])) {
+					return false;
+				}
+			}
+			return true;
+		case jvalue::E_OBJECT: {
+			const map<string, jvalue>* pa = a.get_members();
+			const map<string, jvalue>* pb = b.get_members();
+			size_t na = pa ? pa->size() : 0;
+			size_t nb = pb ? pb->size() : 0;
+			if (na != nb) {
+				return false;
+			}
+			if (na == 0) {
+				return true;
+			}
+			for (auto ia = pa->begin(), ib = pb->begin(); ia != pa->end(); ++ia, ++ib) {
+				if (ia->first != ib->first || !sameValue(ia->second, ib->second)) {
+					return false;
+				}
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+static std::string randomText(std::mt19937_64& rng, size_t maxLength)
+{
+	// any byte but NUL, jvalue strings are C strings
+	size_t length = rng() % (maxLength + 1);
+	if (rng() % 16 == 0) {
+		length += 100 + rng() % 400;
+	}
+	std::string text(length, ' ');
+	for (char& c : text) {
+		c = (char)(1 + rng() % 255);
+	}
+	return text;
+}
+
+static int64_t randomInteger(std::mt19937_64& rng)
+{
+	static const int64_t kEdges[] = { 0, 1, -1, 127, 128, -128, -129, 255, 256, 32767, 32768, -32768, -32769,
+									  INT64_MAX, INT64_MIN, INT64_MAX - 1, INT64_MIN + 1, (int64_t)1 << 55, -((int64_t)1 << 55) };
+	if (rng() % 4 == 0) {
+		return kEdges[rng() % (sizeof(kEdges) / sizeof(kEdges[0]))];
+	}
+	// every byte count
+	return (int64_t)rng() >> (rng() % 64);
+}
+
+static double randomReal(std::mt19937_64& rng)
+{
+	static const double kEdges[] = { 0.0, -0.0, 1.0, -1.0, 0.5, 3.0, 0.1, -1e300, 1e-300, 5e-324, -5e-324, 2.2250738585072014e-308,
+									 1.7976931348623157e308, HUGE_VAL, -HUGE_VAL, NAN };
+	if (rng() % 4 == 0) {
+		return kEdges[rng() % (sizeof(kEdges) / sizeof(kEdges[0]))];
+	}
+	// any bit pattern: normals, subnormals, infinities and NaNs
+	uint64_t bits = rng();
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+// the types the old encoder handled, keys short enough for its dict entry length
+static jvalue randomLegacyTree(std::mt19937_64& rng, int depth)
+{
+	switch (rng() % (depth > 0 ? 4 : 2)) {
+		case 0:
+			return jvalue(rng() % 2 == 0);
+		case 1:
+			return jvalue(randomText(rng, 40));
+		case 2: {
+			jvalue array(jvalue::E_ARRAY);
+			size_t count = rng() % 12;
+			for (size_t i = 0; i < count; i++) {
+				array.push_back(randomLegacyTree(rng, depth - 1));
+			}
+			return array;
+		}
+		default: {
+			jvalue dict(jvalue::E_OBJECT);
+			size_t count = rng() % 12;
+			for (size_t i = 0; i < count; i++) {
+				std::string key = randomText(rng, 40).substr(0, 100);
+				dict[key] = randomLegacyTree(rng, depth - 1);
+			}
+			return dict;
+		}
+	}
+}
+
+static jvalue randomTree(std::mt19937_64& rng, int depth)
+{
+	// no nulls, the fallback warns on each one and testKnownEncodings covers it
+	switch (rng() % (depth > 0 ? 9 : 7)) {
+		case 0:
+			return jvalue(rng() % 2 == 0);
+		case 1:
+			return jvalue(randomInteger(rng));
+		case 2:
+			return jvalue(randomReal(rng));
+		case 3:
+			return jvalue(randomText(rng, 40));
+		case 4: {
+			jvalue date;
+			// 1970 through 2099, four digit years
+			date.assign_date((time_t)(rng() % 4102444800ULL));
+			return date;
+		}
+		case 5: {
+			jvalue data;
+			std::string bytes = randomText(rng, 64);
+			for (char& c : bytes) {
+				c = (char)rng();
+			}
+			data.assign_data((const uint8_t*)bytes.data(), bytes.size());
+			return data;
+		}
+		case 6:
+			return jvalue(rng() % 2 == 0 ? jvalue::E_ARRAY : jvalue::E_OBJECT);
+		case 7: {
+			jvalue array(jvalue::E_ARRAY);
+			size_t count = rng() % 10;
+			for (size_t i = 0; i < count; i++) {
+				array.push_back(randomTree(rng, depth - 1));
+			}
+			return array;
+		}
+		default: {
+			// any key length, long form entry and key lengths included
+			jvalue dict(jvalue::E_OBJECT);
+			size_t count = rng() % 10;
+			for (size_t i = 0; i < count; i++) {
+				dict[randomText(rng, 200)] = randomTree(rng, depth - 1);
+			}
+			return dict;
+		}
+	}
+}
+
+static void checkRoundTrip(const jvalue& value)
+{
+	std::string der = ZSign::_DER(value);
+	DERReader reader(der);
+	jvalue decoded = reader.read();
+	CHECK(reader.done());
+	CHECK(sameValue(value, decoded));
+}
+
+static void testAgainstLegacy()
+{
+	std::mt19937_64 rng(34);
+	for (int i = 0; i < 3000; i++) {
+		jvalue value = randomLegacyTree(rng, 4);
+		CHECK(ZSign::_DER(value) == LegacyDER(value));
+		checkRoundTrip(value);
+	}
+}
+
+static void testRoundTrip()
+{
+	std::mt19937_64 rng(340);
+	for (int i = 0; i < 3000; i++) {
+		checkRoundTrip(randomTree(rng, 4));
+	}
+	for (int i = 0; i < 20000; i++) {
+		checkRoundTrip(jvalue(randomInteger(rng)));
+		checkRoundTrip(jvalue(randomReal(rng)));
+	}
+}
+
+static void testKnownEncodings()
+{
+	CHECK(ZSign::_DER(jvalue((int64_t)0)) == std::string("\x02\x01\x00", 3));
+	CHECK(ZSign::_DER(jvalue((int64_t)128)) == std::string("\x02\x02\x00\x80", 4));
+	CHECK(ZSign::_DER(jvalue((int64_t)-129)) == std::string("\x02\x02\xff\x7f", 4));
+	CHECK(ZSign::_DER(jvalue(0.0)) == std::string("\x09\x00", 2));
+	CHECK(ZSign::_DER(jvalue(-0.0)) == std::string("\x09\x01\x43", 3));
+	CHECK(ZSign::_DER(jvalue(1.0)) == std::string("\x09\x03\x80\x00\x01", 5));
+	CHECK(ZSign::_DER(jvalue(HUGE_VAL)) == std::string("\x09\x01\x40", 3));
+	CHECK(ZSign::_DER(jvalue()) == std::string("\x05\x00", 2));
+	jvalue date;
+	date.assign_date((time_t)1700000000);
+	CHECK(ZSign::_DER(date) == std::string("\x18\x0f" "20231114221320Z", 17));
+
+	// keys in byte order, not insertion order, and a 200 byte key gets long form lengths
+	jvalue dict(jvalue::E_OBJECT);
+	dict["b"] = jvalue(true);
+	dict["B"] = jvalue(true);
+	dict["\xc3\xa9"] = jvalue(true);
+	dict["a"] = jvalue(true);
+	dict[std::string(200, 'k')] = jvalue(false);
+	std::string der = ZSign::_DER(dict);
+	DERReader reader(der);
+	jvalue decoded = reader.read();
+	CHECK(reader.done() && sameValue(dict, decoded));
+	CHECK(der.find("B") < der.find("a") && der.find("a") < der.find("b") && der.find("b") < der.find("kkkk"));
+	CHECK(der.find("kkkk") < der.find("\xc3\xa9"));
+}
+
+int main()
+{
+	testKnownEncodings();
+	testAgainstLegacy();
+	testRoundTrip();
+	printf("der_test: ok\n");
+	return 0;
+}
@@ -0,0 +1,141 @@
+// re-signing a binary that was edited in place after it was signed, with "<binary>.zsign_dirty" listing the edits
+// (what Patcher leaves after an in-place patch): only the pages under the ranges are hashed again and the rest of
+// the page hashes come from the old signature, forced or not. the result has to be the same file, code directory
+// included, as hashing every page, and a list that misses an edit has to show up as a different signature.
+#include "check.hpp"
+#include "common/common.h"
+#include "common/mach-o.h"
+#include "macho.h"
+#include "openssl.h"
+
+#include <random>
+#include <string>
+#include <unistd.h>
+
+static const uint64_t kTextSize = 0x10000;
+static const uint64_t kLinkeditSize = 0x100;
+
+// __TEXT with a __text of random code after the load commands, then a small __LINKEDIT, and no signature yet
+static std::string makeBinary()
+{
+	mach_header_64 header = {};
+	header.magic = MH_MAGIC_64;
+	header.cputype = CPU_TYPE_ARM64;
+	header.filetype = MH_EXECUTE;
+	header.ncmds = 2;
+	header.sizeofcmds = 2 * sizeof(segment_command_64) + sizeof(section_64);
+
+	segment_command_64 text = {};
+	text.cmd = LC_SEGMENT_64;
+	text.cmdsize = sizeof(segment_command_64) + sizeof(section_64);
+	memcpy(text.segname, "__TEXT", 6);
+	text.vmaddr = 0x100000000ULL;
+	text.vmsize = kTextSize;
+	text.filesize = kTextSize;
+	text.maxprot = text.initprot = 5;
+	text.nsects = 1;
+
+	// the gap before __text is where the signature's load command goes
+	section_64 code = {};
+	memcpy(code.sectname, "__text", 6);
+	memcpy(code.segname, "__TEXT", 6);
+	code.addr = text.vmaddr + 0x1000;
+	code.size = kTextSize - 0x1000;
+	code.offset = 0x1000;
+
+	segment_command_64 linkedit = {};
+	linkedit.cmd = LC_SEGMENT_64;
+	linkedit.cmdsize = sizeof(segment_command_64);
+	memcpy(linkedit.segname, "__LINKEDIT", 10);
+	linkedit.vmaddr = text.vmaddr + kTextSize;
+	linkedit.vmsize = 0x4000;
+	linkedit.fileoff = kTextSize;
+	linkedit.filesize = kLinkeditSize;
+	linkedit.maxprot = linkedit.initprot = 1;
+
+	std::string binary(kTextSize + kLinkeditSize, '\0');
+	mt19937_64 rng(50);
+	for (size_t i = 0x1000; i < kTextSize; i++) {
+		binary[i] = (char)rng();
+	}
+	memcpy(&binary[0], &header, sizeof(header));
+	memcpy(&binary[sizeof(header)], &text, sizeof(text));
+	memcpy(&binary[sizeof(header) + sizeof(text)], &code, sizeof(code));
+	memcpy(&binary[sizeof(header) + sizeof(text) + sizeof(code)], &linkedit, sizeof(linkedit));
+	return binary;
+}
+
+static std::string sign(const std::string& strFile, bool bForce)
+{
+	ZSignAsset asset;
+	CHECK(asset.Init("", "", "", "", "", true, false, false));
+	ZMachO macho;
+	CHECK(macho.Init(strFile.c_str()));
+	CHECK(macho.Sign(&asset, bForce, "com.example.dirty", "", "", ""));
+	macho.Free();
+	std::string strSigned;
+	CHECK(ZFile::ReadFile(strFile.c_str(), strSigned));
+	return strSigned;
+}
+
+static void writeDirty(const std::string& strFile, const vector<pair<uint64_t, uint64_t>>& arrRanges)
+{
+	std::string strList = "zsign-dirty 1\n";
+	for (size_t i = 0; i < arrRanges.size(); i++) {
+		strList += to_string(arrRanges[i].first) + " " + to_string(arrRanges[i].second) + "\n";
+	}
+	CHECK(ZFile::WriteFile((strFile + ".zsign_dirty").c_str(), strList.data(), strList.size()));
+}
+
+int main()
+{
+	char folder[] = "/tmp/dirty_resign_test.XXXXXX";
+	CHECK(NULL != mkdtemp(folder));
+	std::string strFolder = folder;
+	std::string strFile = strFolder + "/binary";
+
+	std::string strBinary = makeBinary();
+	CHECK(ZFile::WriteFile(strFile.c_str(), strBinary.data(), strBinary.size()));
+	std::string strSigned = sign(strFile, true);
+
+	// an intervener in one page, a patch across a page boundary, a single byte, and one range past the code
+	vector<pair<uint64_t, uint64_t>> arrRanges;
+	arrRanges.push_back(make_pair(0x2010, 12));
+	arrRanges.push_back(make_pair(0x5ffe, 4));
+	arrRanges.push_back(make_pair(0xc000, 1));
+	arrRanges.push_back(make_pair(strSigned.size() + 0x1000, 16));
+	std::string strEdited = strSigned;
+	for (size_t i = 0; i + 1 < arrRanges.size(); i++) {
+		for (uint64_t j = 0; j < arrRanges[i].second; j++) {
+			strEdited[arrRanges[i].first + j] ^= 0x5a;
+		}
+	}
+
+	// every page hashed again, which needs bForce: unforced it would keep the stale hashes
+	CHECK(ZFile::WriteFile(strFile.c_str(), strEdited.data(), strEdited.size()));
+	std::string strFull = sign(strFile, true);
+	CHECK(strFull != strSigned);
+
+	for (int nForce = 0; nForce < 2; nForce++) {
+		CHECK(ZFile::WriteFile(strFile.c_str(), strEdited.data(), strEdited.size()));
+		writeDirty(strFile, arrRanges);
+		CHECK(sign(strFile, 1 == nForce) == strFull);
+		CHECK(!ZFile::IsFileExists((strFile + ".zsign_dirty").c_str()));
+
+		// leaving out the range across the page boundary keeps one stale hash
+		vector<pair<uint64_t, uint64_t>> arrMissing = arrRanges;
+		arrMissing.erase(arrMissing.begin() + 1);
+		CHECK(ZFile::WriteFile(strFile.c_str(), strEdited.data(), strEdited.size()));
+		writeDirty(strFile, arrMissing);
+		CHECK(sign(strFile, 1 == nForce) != strFull);
+	}
+
+	// a list that doesn't parse is ignored, forced that hashes every page
+	CHECK(ZFile::WriteFile(strFile.c_str(), strEdited.data(), strEdited.size()));
+	CHECK(ZFile::WriteFile((strFile + ".zsign_dirty").c_str(), "zsign-dirty 1\n8208 x\n", 21));
+	CHECK(sign(strFile, true) == strFull);
+
+	ZFile::RemoveFolder(strFolder.c_str());
+	printf("dirty_resign_test: ok\n");
+	return 0;
+}
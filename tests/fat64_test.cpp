@@ -0,0 +1,184 @@
+// ZMachO and ZArchO on files past 4GB: a FAT_MAGIC_64 header with a slice that starts above 4GB, a slice that is
+// itself bigger than 4GB, and the CodeDirectory's codeLimit64 for such a slice. the big files are sparse, when the
+// filesystem can't make them the sparse part is skipped. a 32-bit offset or size anywhere on the way would read the
+// zeroes of the hole instead of the slice, or let a slice that runs past the end of the file through.
+#include "check.hpp"
+#include "common/common.h"
+#include "common/mach-o.h"
+#include "macho.h"
+#include "signing.h"
+
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint64_t k4GB = 0x100000000ULL;
+
+// the smallest thing ZArchO::Init takes: a header and an empty __TEXT
+static std::string makeThin()
+{
+	mach_header_64 header = {};
+	header.magic = MH_MAGIC_64;
+	header.cputype = CPU_TYPE_ARM64;
+	header.filetype = 6; // MH_DYLIB
+	header.ncmds = 1;
+	header.sizeofcmds = sizeof(segment_command_64);
+
+	segment_command_64 text = {};
+	text.cmd = LC_SEGMENT_64;
+	text.cmdsize = sizeof(segment_command_64);
+	strncpy(text.segname, "__TEXT", sizeof(text.segname));
+	text.vmsize = 0x4000;
+
+	std::string thin((const char*)&header, sizeof(header));
+	thin.append((const char*)&text, sizeof(text));
+	return thin;
+}
+
+// one fat_arch_64, big-endian like on disk or in host order
+static std::string makeFat64(uint64_t uOffset, uint64_t uSize, bool bBigEndian)
+{
+	fat_header fath;
+	fat_arch_64 arch = {};
+	if (bBigEndian) {
+		fath.magic = BE((uint32_t)FAT_MAGIC_64);
+		fath.nfat_arch = BE((uint32_t)1);
+		arch.cputype = (cpu_type_t)BE((uint32_t)CPU_TYPE_ARM64);
+		arch.offset = BE(uOffset);
+		arch.size = BE(uSize);
+		arch.align = BE((uint32_t)14);
+	} else {
+		fath.magic = FAT_MAGIC_64;
+		fath.nfat_arch = 1;
+		arch.cputype = CPU_TYPE_ARM64;
+		arch.offset = uOffset;
+		arch.size = uSize;
+		arch.align = 14;
+	}
+	std::string fat((const char*)&fath, sizeof(fath));
+	fat.append((const char*)&arch, sizeof(arch));
+	return fat;
+}
+
+static bool writeAt(int fd, uint64_t uOffset, const std::string& strData)
+{
+	return pwrite(fd, strData.data(), strData.size(), (off_t)uOffset) == (ssize_t)strData.size();
+}
+
+// a file of uSize bytes holding the given pieces, sparse everywhere else. empty if the filesystem can't do it
+static std::string makeFile(uint64_t uSize, const std::vector<std::pair<uint64_t, std::string>>& arrPieces)
+{
+	char path[] = "/tmp/fat64_test.XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd >= 0);
+	bool bOk = (0 == ftruncate(fd, (off_t)uSize));
+	for (size_t i = 0; bOk && i < arrPieces.size(); i++) {
+		bOk = writeAt(fd, arrPieces[i].first, arrPieces[i].second);
+	}
+	struct stat st;
+	bOk = bOk && (0 == fstat(fd, &st)) && (uint64_t)st.st_size == uSize && (uint64_t)st.st_blocks * 512 < (64 << 20);
+	close(fd);
+	if (!bOk) {
+		unlink(path);
+		return "";
+	}
+	return path;
+}
+
+static void testSliceBounds()
+{
+	// a slice 4GB + 4KB long in a 32KB file: truncated to 32 bits its size would be 4KB and fit
+	std::string strThin = makeThin();
+	std::string strFile = makeFile(0x8000, { { 0, makeFat64(0x4000, k4GB + 0x1000, true) }, { 0x4000, strThin } });
+	CHECK(!strFile.empty());
+	ZMachO macho;
+	CHECK(!macho.Init(strFile.c_str()));
+	unlink(strFile.c_str());
+
+	// offset + size wrapping around to something small
+	strFile = makeFile(0x8000, { { 0, makeFat64(0x4000, UINT64_MAX - 0x1000, true) }, { 0x4000, strThin } });
+	CHECK(!macho.Init(strFile.c_str()));
+	unlink(strFile.c_str());
+
+	// the same with the real size is fine
+	strFile = makeFile(0x8000, { { 0, makeFat64(0x4000, 0x4000, true) }, { 0x4000, strThin } });
+	CHECK(macho.Init(strFile.c_str()));
+	macho.Free();
+	unlink(strFile.c_str());
+}
+
+static bool testSliceAbove4GB()
+{
+	// the slice at 4GB + 16KB, truncated it would be the hole at 16KB
+	std::string strThin = makeThin();
+	for (int nOrder = 0; nOrder < 2; nOrder++) {
+		std::string strFile = makeFile(k4GB + 0x8000, { { 0, makeFat64(k4GB + 0x4000, 0x4000, 0 == nOrder) }, { k4GB + 0x4000, strThin } });
+		if (strFile.empty()) {
+			return false;
+		}
+		ZMachO macho;
+		CHECK(macho.Init(strFile.c_str()));
+		macho.Free();
+		unlink(strFile.c_str());
+	}
+	return true;
+}
+
+static bool testSliceOver4GB()
+{
+	// a slice of 4GB + 4KB at 16KB, then the same bytes through ZArchO and into a CodeDirectory
+	uint64_t uSliceSize = k4GB + 0x1000;
+	std::string strFile = makeFile(0x4000 + uSliceSize, { { 0, makeFat64(0x4000, uSliceSize, true) }, { 0x4000, makeThin() } });
+	if (strFile.empty()) {
+		return false;
+	}
+	ZMachO macho;
+	CHECK(macho.Init(strFile.c_str()));
+	macho.Free();
+
+	size_t sSize = 0;
+	uint8_t* pBase = (uint8_t*)ZFile::MapFile(strFile.c_str(), 0, 0, &sSize, true);
+	CHECK(NULL != pBase && sSize == 0x4000 + uSliceSize);
+	ZArchO archo;
+	CHECK(archo.Init(pBase + 0x4000, uSliceSize));
+	CHECK(archo.m_uLength == uSliceSize && archo.m_uCodeLength == uSliceSize);
+
+	// the code slots are handed in, so nothing hashes 4GB of zeroes
+	uint32_t uCodeSlots = (uint32_t)((uSliceSize + 4095) / 4096);
+	std::string strSlots(uCodeSlots * 20, '\0');
+	std::string strCodeDirectory;
+	CHECK(ZSign::SlotBuildCodeDirectory(false, pBase + 0x4000, archo.m_uCodeLength, (uint8_t*)&strSlots[0], (uint32_t)strSlots.size(), 0x4000, 0,
+										"com.example.fat64", "", "", "", "", "", "", false, true, strCodeDirectory));
+	const CS_CodeDirectory* pcd = (const CS_CodeDirectory*)strCodeDirectory.data();
+	CHECK(strCodeDirectory.size() >= sizeof(CS_CodeDirectory));
+	CHECK(BE(pcd->version) >= (uint32_t)CS_SUPPORTSCODELIMIT64);
+	CHECK(BE(pcd->codeLimit) == UINT32_MAX);
+	CHECK(BE(pcd->codeLimit64) == uSliceSize);
+	CHECK(BE(pcd->nCodeSlots) == uCodeSlots);
+
+	// below 4GB codeLimit64 stays zero
+	CHECK(ZSign::SlotBuildCodeDirectory(false, pBase + 0x4000, 0x4000, (uint8_t*)&strSlots[0], 4 * 20, 0x4000, 0,
+										"com.example.fat64", "", "", "", "", "", "", false, true, strCodeDirectory));
+	pcd = (const CS_CodeDirectory*)strCodeDirectory.data();
+	CHECK(BE(pcd->codeLimit) == 0x4000 && 0 == pcd->codeLimit64);
+
+	ZFile::UnmapFile(pBase, sSize);
+	unlink(strFile.c_str());
+	return true;
+}
+
+int main()
+{
+	if (sizeof(size_t) < 8) {
+		printf("fat64_test: skipped, 32-bit host\n");
+		return 0;
+	}
+	testSliceBounds();
+	if (!testSliceAbove4GB() || !testSliceOver4GB()) {
+		printf("fat64_test: sparse files not supported here, only the bounds were checked\n");
+		return 0;
+	}
+	printf("fat64_test: ok\n");
+	return 0;
+}
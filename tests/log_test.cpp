@@ -0,0 +1,71 @@
+// ZLog from many threads at once, with stdout sent to a file: every line has to come out exactly once and each
+// thread's lines in the order it wrote them, including the long ones that skip the ring and the Flush() calls
+// racing the background flusher.
+#include "check.hpp"
+#include "common/common.h"
+
+#include <fcntl.h>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static const int kThreads = 8;
+static const int kLines = 20000;
+
+int main()
+{
+	char path[] = "/tmp/log_test.XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd >= 0);
+	int nStdout = dup(STDOUT_FILENO);
+	CHECK(dup2(fd, STDOUT_FILENO) >= 0);
+
+	vector<thread> arrThreads;
+	for (int t = 0; t < kThreads; t++) {
+		arrThreads.emplace_back([t] {
+			for (int i = 0; i < kLines; i++) {
+				if (i % 997 == 0) {
+					// longer than a ring slot
+					string strLong = "T" + to_string(t) + " " + to_string(i) + " " + string(1500, 'x') + "\n";
+					ZLog::Print(strLong.c_str());
+				} else {
+					ZLog::PrintV("T%d %d\n", t, i);
+				}
+				if (i % 1500 == 0) {
+					ZLog::Flush();
+				}
+			}
+		});
+	}
+	for (size_t i = 0; i < arrThreads.size(); i++) {
+		arrThreads[i].join();
+	}
+	ZLog::Flush();
+
+	CHECK(dup2(nStdout, STDOUT_FILENO) >= 0);
+	close(nStdout);
+	close(fd);
+
+	string strOutput;
+	CHECK(ZFile::ReadFile(path, strOutput));
+	unlink(path);
+
+	vector<int> arrNext(kThreads, 0);
+	istringstream stream(strOutput);
+	string strLine;
+	size_t uLines = 0;
+	while (getline(stream, strLine)) {
+		int t = -1;
+		int i = -1;
+		CHECK(2 == sscanf(strLine.c_str(), "T%d %d", &t, &i));
+		CHECK(t >= 0 && t < kThreads);
+		CHECK(i == arrNext[t]);
+		arrNext[t]++;
+		uLines++;
+	}
+	CHECK(uLines == (size_t)kThreads * kLines);
+	printf("log_test: ok, %zu lines\n", uLines);
+	return 0;
+}
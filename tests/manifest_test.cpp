@@ -0,0 +1,98 @@
+// ZManifest::IsSigned on a bundle changed after signing: a signed binary rewritten, a new resource, a new Mach-O
+// next to the signed ones or in a new folder, signed binaries removed, and a manifest from before folders were
+// recorded. anything that would need the bundle signed again has to answer no.
+#include "check.hpp"
+#include "common/common.h"
+#include "manifest.h"
+
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char s_szMachO[] = "\xcf\xfa\xed\xfe"; // MH_MAGIC_64, all is_64bit_macho reads
+
+static void writeFile(const std::string& strFile, const char* szData)
+{
+	CHECK(ZFile::WriteFile(strFile.c_str(), szData, strlen(szData)));
+}
+
+// folder mtimes come from the kernel's coarse clock, changes right after Save might not move them
+static void waitForClock()
+{
+	usleep(20000);
+}
+
+int main()
+{
+	char folder[] = "/tmp/manifest_test.XXXXXX";
+	CHECK(NULL != mkdtemp(folder));
+	std::string strApp = folder;
+	CHECK(0 == mkdir((strApp + "/Frameworks").c_str(), 0755));
+	CHECK(0 == mkdir((strApp + "/Resources").c_str(), 0755));
+	CHECK(0 == mkdir((strApp + "/Resources/sheets").c_str(), 0755));
+	writeFile(strApp + "/GeometryJump", s_szMachO);
+	writeFile(strApp + "/Frameworks/libfmod.dylib", s_szMachO);
+	writeFile(strApp + "/Resources/sheets/GJ_GameSheet.png", "png");
+
+	ZManifest manifest;
+	manifest.Begin(NULL);
+	CHECK(manifest.AddFile(strApp, "GeometryJump", vector<string>()));
+	CHECK(manifest.AddFile(strApp, "Frameworks/libfmod.dylib", vector<string>()));
+	CHECK(manifest.Save(strApp));
+	waitForClock();
+	CHECK(ZManifest::IsSigned(strApp, ""));
+	CHECK(!ZManifest::IsSigned(strApp, "TEAMID1234"));
+
+	// resources don't need a signature of their own
+	writeFile(strApp + "/Resources/sheets/GJ_GameSheet-uhd.png", "png");
+	writeFile(strApp + "/Info.plist", "plist");
+	CHECK(ZManifest::IsSigned(strApp, ""));
+
+	// a new Mach-O next to signed files, by magic or by name
+	writeFile(strApp + "/Resources/sheets/payload", s_szMachO);
+	CHECK(!ZManifest::IsSigned(strApp, ""));
+	CHECK(ZFile::RemoveFile((strApp + "/Resources/sheets/payload").c_str()));
+	CHECK(ZManifest::IsSigned(strApp, ""));
+	writeFile(strApp + "/Frameworks/Geode.ios.dylib", "not a header yet");
+	CHECK(!ZManifest::IsSigned(strApp, ""));
+	CHECK(ZFile::RemoveFile((strApp + "/Frameworks/Geode.ios.dylib").c_str()));
+	CHECK(ZManifest::IsSigned(strApp, ""));
+
+	// a new folder a few levels deep, only its parent's mtime moved
+	CHECK(ZFile::CreateFolder((strApp + "/PlugIns/Mod.framework/Modules").c_str()));
+	writeFile(strApp + "/PlugIns/Mod.framework/Modules/Mod", s_szMachO);
+	CHECK(!ZManifest::IsSigned(strApp, ""));
+	CHECK(ZFile::RemoveFolder((strApp + "/PlugIns").c_str()));
+	CHECK(ZManifest::IsSigned(strApp, ""));
+
+	// a signed binary rewritten
+	writeFile(strApp + "/Frameworks/libfmod.dylib", "\xcf\xfa\xed\xfe" "patched");
+	CHECK(!ZManifest::IsSigned(strApp, ""));
+	CHECK(manifest.AddFile(strApp, "Frameworks/libfmod.dylib", vector<string>()));
+	CHECK(manifest.Save(strApp));
+	waitForClock();
+	CHECK(ZManifest::IsSigned(strApp, ""));
+
+	// removed signed files are skipped, but not all of them
+	CHECK(ZFile::RemoveFile((strApp + "/Frameworks/libfmod.dylib").c_str()));
+	CHECK(ZManifest::IsSigned(strApp, ""));
+	CHECK(ZFile::RemoveFile((strApp + "/GeometryJump").c_str()));
+	CHECK(!ZManifest::IsSigned(strApp, ""));
+	writeFile(strApp + "/GeometryJump", s_szMachO);
+	CHECK(manifest.AddFile(strApp, "GeometryJump", vector<string>()));
+	CHECK(manifest.Save(strApp));
+	waitForClock();
+	CHECK(ZManifest::IsSigned(strApp, ""));
+
+	// a manifest without folders can't tell whether anything was added
+	jvalue jvOld;
+	CHECK(jvOld.read_from_file("%s/%s", strApp.c_str(), ZManifest::s_szFileName));
+	jvOld["version"] = 1;
+	jvOld.erase("folders");
+	CHECK(jvOld.style_write_to_file("%s/%s", strApp.c_str(), ZManifest::s_szFileName));
+	CHECK(!ZManifest::IsSigned(strApp, ""));
+
+	ZFile::RemoveFolder(strApp.c_str());
+	printf("manifest_test: ok\n");
+	return 0;
+}
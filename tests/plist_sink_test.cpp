@@ -0,0 +1,132 @@
+// jvalue::style_write_plist(jpsink&) against style_write_plist(string&), the serializer CodeResources was written
+// with before it was streamed: same bytes through a sink that keeps every chunk and through ZSHAFileWriter, and
+// the writer's SHA-1/SHA-256 equal to hashing the whole document. documents big enough for many 64K flushes.
+#include "check.hpp"
+#include "common/common.h"
+#include "common/json.h"
+
+#include <random>
+#include <string>
+
+class ChunkSink : public jpsink
+{
+public:
+	ChunkSink(size_t uFailAfter = SIZE_MAX) : m_uChunks(0), m_uFailAfter(uFailAfter) {}
+
+	virtual bool write(const char* data, size_t len)
+	{
+		CHECK(len > 0);
+		m_uChunks++;
+		if (m_strData.size() + len > m_uFailAfter) {
+			return false;
+		}
+		m_strData.append(data, len);
+		return true;
+	}
+
+	string m_strData;
+	size_t m_uChunks;
+
+private:
+	size_t m_uFailAfter;
+};
+
+// what SignNode builds: files with a SHA-1, files2 with both hashes, plus rules with nested dicts and odd values
+static jvalue makeCodeResources(size_t uFiles, mt19937_64& rng)
+{
+	jvalue jvCodeRes;
+	jvalue& jvFiles = jvCodeRes["files"];
+	jvalue& jvFiles2 = jvCodeRes["files2"];
+	for (size_t i = 0; i < uFiles; i++) {
+		string strKey = "Assets/folder" + to_string(i % 37) + "/file-" + to_string(i) + ((i % 5) ? ".png" : ".plist");
+		if (0 == i % 101) {
+			strKey += " & <escaped> \"name\" \xc3\xa9\xe2\x82\xac";
+		}
+		string strSHA1(20, '\0');
+		string strSHA256(32, '\0');
+		for (char& c : strSHA1) {
+			c = (char)rng();
+		}
+		for (char& c : strSHA256) {
+			c = (char)rng();
+		}
+		jvFiles[strKey].assign_data((const uint8_t*)strSHA1.data(), strSHA1.size());
+		jvalue& jvFile2 = jvFiles2[strKey];
+		jvFile2["hash"].assign_data((const uint8_t*)strSHA1.data(), strSHA1.size());
+		jvFile2["hash2"].assign_data((const uint8_t*)strSHA256.data(), strSHA256.size());
+		if (0 == i % 13) {
+			jvFile2["optional"] = true;
+		}
+	}
+
+	jvalue& jvRules = jvCodeRes["rules"];
+	jvRules["^.*"] = true;
+	jvRules["^.*\\.lproj/"]["optional"] = true;
+	jvRules["^.*\\.lproj/"]["weight"] = 1000.0;
+	jvRules["^.*\\.lproj/locversion.plist$"]["omit"] = true;
+	jvRules["^.*\\.lproj/locversion.plist$"]["weight"] = 1100.0;
+	jvRules["^Base\\.lproj/"]["weight"] = 1010.0;
+	jvRules["^version.plist$"] = true;
+
+	jvalue& jvMisc = jvCodeRes["misc"];
+	jvMisc["int"] = (int64_t)-1234567890123LL;
+	jvMisc["real"] = 3.25;
+	jvMisc["empty array"] = jvalue(jvalue::E_ARRAY);
+	jvMisc["empty dict"] = jvalue(jvalue::E_OBJECT);
+	jvMisc["empty string"] = "";
+	jvMisc["date"].assign_date((time_t)1700000000);
+	jvMisc["long string"] = string(200000, 'z'); // bigger than one flush on its own
+	jvalue& jvNested = jvMisc["nested"];
+	jvalue* pLevel = &jvNested;
+	for (int i = 0; i < 40; i++) {
+		(*pLevel)["name"] = "level " + to_string(i);
+		(*pLevel)["list"].push_back(i);
+		pLevel = &(*pLevel)["child"];
+	}
+	return jvCodeRes;
+}
+
+static void checkDocument(const jvalue& jvDoc)
+{
+	string strExpected;
+	jvDoc.style_write_plist(strExpected);
+	CHECK(!strExpected.empty());
+
+	ChunkSink sink;
+	CHECK(jvDoc.style_write_plist(sink));
+	CHECK(sink.m_strData == strExpected);
+	CHECK(strExpected.size() < (64 << 10) || sink.m_uChunks > 1);
+
+	char path[] = "/tmp/plist_sink_test.XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd >= 0);
+	close(fd);
+	ZSHAFileWriter writer;
+	string strSHA1;
+	string strSHA256;
+	CHECK(writer.Open(path) && jvDoc.style_write_plist(writer) && writer.Close(strSHA1, strSHA256));
+	string strFile;
+	CHECK(ZFile::ReadFile(path, strFile) && strFile == strExpected);
+	unlink(path);
+
+	string strExpectedSHA1;
+	string strExpectedSHA256;
+	CHECK(ZSHA::SHA(strExpected, strExpectedSHA1, strExpectedSHA256));
+	CHECK(strSHA1 == strExpectedSHA1 && strSHA256 == strExpectedSHA256);
+}
+
+int main()
+{
+	mt19937_64 rng(32);
+	checkDocument(makeCodeResources(0, rng));
+	checkDocument(makeCodeResources(3, rng));
+	checkDocument(makeCodeResources(10000, rng));
+
+	// a sink that stops taking bytes fails the write
+	jvalue jvDoc = makeCodeResources(2000, rng);
+	ChunkSink failing(100 << 10);
+	CHECK(!jvDoc.style_write_plist(failing));
+
+	printf("plist_sink_test: ok\n");
+	return 0;
+}
@@ -0,0 +1,130 @@
+// ZSHA::SHAFile, which reads fixed windows into pooled buffers, next to hashing a whole-file mapping the way it
+// used to. both start from a cold page cache; reports throughput and how much the peak RSS grew for each, and
+// checks the hashes agree and that the streamed path stays within the pool's cap.
+//   sha_bench [MiB, default 512]
+#include "check.hpp"
+#include "common/common.h"
+
+#include <OpenSSL/sha.h>
+#include <chrono>
+#include <fcntl.h>
+#include <random>
+#include <string>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static size_t readStatusKB(const char* szKey)
+{
+	FILE* fp = fopen("/proc/self/status", "r");
+	if (NULL == fp) {
+		return 0;
+	}
+	char line[256];
+	size_t uValue = 0;
+	size_t uKeyLen = strlen(szKey);
+	while (fgets(line, sizeof(line), fp)) {
+		if (0 == strncmp(line, szKey, uKeyLen) && ':' == line[uKeyLen]) {
+			uValue = strtoul(line + uKeyLen + 1, NULL, 10);
+			break;
+		}
+	}
+	fclose(fp);
+	return uValue;
+}
+
+// resets VmHWM to the current RSS, false where the kernel doesn't support it
+static bool resetPeakRss()
+{
+	FILE* fp = fopen("/proc/self/clear_refs", "w");
+	if (NULL == fp) {
+		return false;
+	}
+	bool bOk = (fputs("5", fp) >= 0);
+	bOk = (0 == fclose(fp)) && bOk;
+	return bOk;
+}
+
+static void dropCache(const char* szFile)
+{
+	int fd = open(szFile, O_RDONLY);
+	CHECK(fd >= 0);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+static void hashMapped(const char* szFile, string& strSHA1, string& strSHA256)
+{
+	size_t sSize = 0;
+	uint8_t* pBase = (uint8_t*)ZFile::MapFile(szFile, 0, 0, &sSize, true);
+	CHECK(NULL != pBase);
+	ZSHA::SHA1(pBase, sSize, strSHA1);
+	ZSHA::SHA256(pBase, sSize, strSHA256);
+	ZFile::UnmapFile(pBase, sSize);
+}
+
+int main(int argc, char** argv)
+{
+	size_t mib = argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : 512;
+	if (0 == mib) {
+		mib = 1;
+	}
+
+	// written a MiB at a time, so making the file doesn't raise the peak itself
+	char path[] = "/tmp/sha_bench.XXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd >= 0);
+	mt19937_64 rng(29);
+	vector<uint64_t> arrChunk((1 << 20) / 8);
+	for (size_t i = 0; i < mib; i++) {
+		for (uint64_t& v : arrChunk) {
+			v = rng();
+		}
+		CHECK(write(fd, arrChunk.data(), 1 << 20) == (1 << 20));
+	}
+	CHECK(0 == fsync(fd));
+	close(fd);
+	vector<uint64_t>().swap(arrChunk);
+
+	string strSHA1;
+	string strSHA256;
+	SHA256(NULL, 0, NULL); // load everything the first hash would, outside the measurement
+	dropCache(path);
+	bool bPeak = resetPeakRss();
+	size_t uBefore = readStatusKB("VmHWM");
+	Clock::time_point start = Clock::now();
+	CHECK(ZSHA::SHAFile(path, strSHA1, strSHA256));
+	double streamSeconds = secondsSince(start);
+	size_t uStreamPeak = readStatusKB("VmHWM") - uBefore;
+
+	string strMappedSHA1;
+	string strMappedSHA256;
+	dropCache(path);
+	bPeak = resetPeakRss() && bPeak;
+	uBefore = readStatusKB("VmHWM");
+	start = Clock::now();
+	hashMapped(path, strMappedSHA1, strMappedSHA256);
+	double mappedSeconds = secondsSince(start);
+	size_t uMappedPeak = readStatusKB("VmHWM") - uBefore;
+	unlink(path);
+
+	CHECK(strSHA1 == strMappedSHA1 && strSHA256 == strMappedSHA256);
+	if (bPeak) {
+		// the pool's cap plus some slack for the allocator
+		CHECK(uStreamPeak * 1024 <= ZSHA::GetStreamMemoryCap() + (8 << 20));
+	}
+
+	double mb = (double)(mib << 20) / 1e6;
+	printf("sha_bench: %zu MiB, SHA-1 + SHA-256, cold cache\n", mib);
+	printf("  SHAFile, pooled windows  %8.1f ms  %8.1f MB/s  peak RSS +%zu KB\n", streamSeconds * 1e3, mb / streamSeconds, uStreamPeak);
+	printf("  whole-file mapping       %8.1f ms  %8.1f MB/s  peak RSS +%zu KB\n", mappedSeconds * 1e3, mb / mappedSeconds, uMappedPeak);
+	if (!bPeak) {
+		printf("  (peak RSS can't be reset here, the numbers include earlier peaks)\n");
+	}
+	return 0;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+// the cpu types ZSign's mach-o.h takes from <mach/machine.h>, which only the Apple SDKs have
+#define CPU_ARCH_ABI64 0x01000000
+#define CPU_ARCH_ABI64_32 0x02000000
+#define CPU_TYPE_X86 7
+#define CPU_TYPE_X86_64 (CPU_TYPE_X86|CPU_ARCH_ABI64)
+#define CPU_TYPE_ARM 12
+#define CPU_TYPE_ARM64 (CPU_TYPE_ARM|CPU_ARCH_ABI64)
+#define CPU_TYPE_ARM64_32 (CPU_TYPE_ARM|CPU_ARCH_ABI64_32)
+#define CPU_SUBTYPE_ARM_V6 6
+#define CPU_SUBTYPE_ARM_V7 9
+#define CPU_SUBTYPE_ARM_V7S 11
+#define CPU_SUBTYPE_ARM_V7K 12
+#define CPU_SUBTYPE_ARM_V8 13
+#define CPU_SUBTYPE_ARM64_ALL 0
+#define CPU_SUBTYPE_ARM64_V8 1
+#define CPU_SUBTYPE_ARM64_32_V8 1
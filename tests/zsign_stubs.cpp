@@ -0,0 +1,7 @@
+// the iOS side of ZSign/Utils.hpp that the ZSign sources call, nothing to refresh on the host
+#include "Utils.hpp"
+
+void refreshFile(const char* path)
+{
+	(void)path;
+}